@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "compiler/compiler.h"
+#include "vm/vm.h"
+#include "interpreter/interpreter.h"
+#include <string>
+
+using namespace claw;
+
+// Arg(0) runs the portable switch loop, Arg(1) the computed-goto loop.
+// Without CLAW_THREADED_DISPATCH both arguments measure the switch loop.
+static void runDispatch(benchmark::State& state, const std::string& source) {
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    auto statements = parser.parseProgram();
+
+    Compiler compiler;
+    auto chunk = compiler.compile(statements);
+
+    bool previous = gRuntimeFlags.forceSwitchDispatch;
+    gRuntimeFlags.forceSwitchDispatch = state.range(0) == 0;
+    state.SetLabel(state.range(0) == 0 ? "switch" : "threaded");
+    for (auto _ : state) {
+        Interpreter interpreter;
+        VM vm(interpreter);
+        vm.interpret(*chunk);
+    }
+    gRuntimeFlags.forceSwitchDispatch = previous;
+}
+
+static void BM_VM_Dispatch_Loop(benchmark::State& state) {
+    runDispatch(state,
+        "let sum = 0;"
+        "for (let i = 0; i < 100000; i = i + 1) {"
+        "  sum = sum + i;"
+        "}");
+}
+BENCHMARK(BM_VM_Dispatch_Loop)->Arg(0)->Arg(1);
+
+static void BM_VM_Dispatch_Fibonacci(benchmark::State& state) {
+    runDispatch(state,
+        "fn fib(n) {"
+        "  if (n < 2) return n;"
+        "  return fib(n-1) + fib(n-2);"
+        "}"
+        "fib(20);");
+}
+BENCHMARK(BM_VM_Dispatch_Fibonacci)->Arg(0)->Arg(1);
+
+static void BM_VM_Dispatch_Bitwise(benchmark::State& state) {
+    runDispatch(state,
+        "let h = 0;"
+        "for (let i = 0; i < 100000; i = i + 1) {"
+        "  h = ((h << 5) ^ i) & 65535;"
+        "}");
+}
+BENCHMARK(BM_VM_Dispatch_Bitwise)->Arg(0)->Arg(1);
@@ -0,0 +1,52 @@
+#include <benchmark/benchmark.h>
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "compiler/compiler.h"
+#include "vm/vm.h"
+#include "interpreter/interpreter.h"
+#include <string>
+
+using namespace claw;
+
+// Arg(0) compiles without the peephole pass, Arg(1) with superinstructions.
+static void runFused(benchmark::State& state, const std::string& source) {
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    auto statements = parser.parseProgram();
+
+    Compiler compiler;
+    compiler.setPeepholeEnabled(state.range(0) != 0);
+    auto chunk = compiler.compile(statements);
+
+    state.SetLabel(state.range(0) == 0 ? "plain" : "fused");
+    state.counters["fusions"] = compiler.peepholeStats().total();
+    for (auto _ : state) {
+        Interpreter interpreter;
+        VM vm(interpreter);
+        vm.interpret(*chunk);
+    }
+}
+
+static void BM_VM_Superinstructions_ForLoop(benchmark::State& state) {
+    runFused(state,
+        "fn sumTo() {"
+        "  let sum = 0;"
+        "  for (let i = 0; i < 100000; i = i + 1) {"
+        "    sum = sum + i;"
+        "  }"
+        "  return sum;"
+        "}"
+        "sumTo();");
+}
+BENCHMARK(BM_VM_Superinstructions_ForLoop)->Arg(0)->Arg(1);
+
+static void BM_VM_Superinstructions_Fibonacci(benchmark::State& state) {
+    runFused(state,
+        "fn fib(n) {"
+        "  if (n < 2) return n;"
+        "  return fib(n-1) + fib(n-2);"
+        "}"
+        "fib(20);");
+}
+BENCHMARK(BM_VM_Superinstructions_Fibonacci)->Arg(0)->Arg(1);
@@ -148,3 +148,28 @@ static void BM_JSONAlloc1M(benchmark::State& state) {
     gcSetBenchmarkMode(false);
 }
 BENCHMARK(BM_JSONAlloc1M)->Unit(benchmark::kMillisecond)->MinTime(10.0);
+
+// Arg(0) grows a string with `s = s + piece`, Arg(1) with a StringBuilder;
+// both read the result once at the end
+static void BM_VM_StringConcat(benchmark::State& state) {
+    std::string source = state.range(0) == 0
+        ? "let s = \"\";"
+          "for (let i = 0; i < 100000; i = i + 1) { s = s + \"line \" + i + \"\\n\"; }"
+          "let n = len(s);"
+        : "let sb = StringBuilder();"
+          "for (let i = 0; i < 100000; i = i + 1) { sb.append(\"line \").append(i).append(\"\\n\"); }"
+          "let n = len(sb.toString());";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    auto statements = parser.parseProgram();
+    Compiler compiler;
+    auto chunk = compiler.compile(statements);
+    state.SetLabel(state.range(0) == 0 ? "concat" : "builder");
+    for (auto _ : state) {
+        Interpreter interpreter;
+        VM vm(interpreter);
+        vm.interpret(*chunk);
+    }
+}
+BENCHMARK(BM_VM_StringConcat)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
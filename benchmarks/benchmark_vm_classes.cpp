@@ -0,0 +1,55 @@
+#include <benchmark/benchmark.h>
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "compiler/compiler.h"
+#include "vm/vm.h"
+#include "interpreter/interpreter.h"
+#include <string>
+
+using namespace claw;
+
+// Method-heavy code: every iteration makes three Invoke calls, one of them
+// through super. Arg(0) runs the tree-walker, Arg(1) the VM.
+static const char* kMethodSource =
+    "class Counter {"
+    "  fn init() { this.n = 0; }"
+    "  fn add(k) { this.n = this.n + k; return this; }"
+    "  fn get() { return this.n; }"
+    "}"
+    "class Stepper < Counter {"
+    "  fn add(k) { return super.add(k + 1); }"
+    "}"
+    "fn drive() {"
+    "  let c = Stepper();"
+    "  for (let i = 0; i < 20000; i = i + 1) {"
+    "    c.add(i);"
+    "    c.get();"
+    "  }"
+    "  return c.get();"
+    "}"
+    "drive();";
+
+static void BM_Classes_MethodCalls(benchmark::State& state) {
+    Lexer lexer(kMethodSource);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    auto statements = parser.parseProgram();
+
+    if (state.range(0) == 0) {
+        state.SetLabel("interpreter");
+        for (auto _ : state) {
+            Interpreter interpreter;
+            interpreter.execute(statements);
+        }
+        return;
+    }
+    Compiler compiler;
+    auto chunk = compiler.compile(statements);
+    state.SetLabel("vm");
+    for (auto _ : state) {
+        Interpreter interpreter;
+        VM vm(interpreter);
+        vm.interpret(*chunk);
+    }
+}
+BENCHMARK(BM_Classes_MethodCalls)->Arg(0)->Arg(1);
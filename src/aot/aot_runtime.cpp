@@ -1,9 +1,174 @@
 #include "llvm_aot.h"
 #include "vm/vm.h"
+#include "vm/global_table.h"
+#include "compiler/stack_depth.h"
 #include "features/string_pool.h"
+#include <algorithm>
 #include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
 
-extern "C" int claw_aot_run(const uint8_t* code, uint64_t codeSize, const claw::AotConstant* consts, uint64_t constCount) {
+namespace claw {
+
+namespace {
+
+void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void putString(std::vector<uint8_t>& out, std::string_view text) {
+    putU32(out, static_cast<uint32_t>(text.size()));
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+// Reads back what putU32 and putString wrote. A read past the end clears ok
+// and returns zeros, so the caller checks once at the end.
+struct TableReader {
+    const uint8_t* data;
+    uint64_t size;
+    uint64_t pos = 0;
+    bool ok = true;
+
+    uint32_t u32() {
+        if (size - pos < 4) {
+            ok = false;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(data[pos + i]) << (8 * i);
+        pos += 4;
+        return value;
+    }
+
+    std::string_view string() {
+        uint32_t length = u32();
+        if (!ok || size - pos < length) {
+            ok = false;
+            return {};
+        }
+        std::string_view text(reinterpret_cast<const char*>(data + pos), length);
+        pos += length;
+        return text;
+    }
+};
+
+bool isGlobalOp(uint8_t op) {
+    return op == static_cast<uint8_t>(OpCode::GetGlobal) || op == static_cast<uint8_t>(OpCode::DefineGlobal) ||
+           op == static_cast<uint8_t>(OpCode::SetGlobal);
+}
+
+uint16_t globalSlotAt(const Chunk& chunk, size_t offset) {
+    return static_cast<uint16_t>((chunk.code()[offset + 1] << 8) | chunk.code()[offset + 2]);
+}
+
+} // namespace
+
+std::vector<uint8_t> serializeAotTables(const Chunk& chunk) {
+    std::vector<uint8_t> out;
+    for (size_t kind = 0; kind < static_cast<size_t>(CacheKind::Count); kind++) {
+        putU32(out, static_cast<uint32_t>(chunk.cacheSlotCount(static_cast<CacheKind>(kind))));
+    }
+    putU32(out, static_cast<uint32_t>(chunk.loopCount()));
+
+    // Names of the global slots the code uses, each once
+    std::vector<uint16_t> slots;
+    for (size_t offset = 0; offset < chunk.size(); offset += chunk.instructionLength(offset)) {
+        if (!isGlobalOp(chunk.code()[offset])) continue;
+        uint16_t slot = globalSlotAt(chunk, offset);
+        if (std::find(slots.begin(), slots.end(), slot) == slots.end()) slots.push_back(slot);
+    }
+    putU32(out, static_cast<uint32_t>(slots.size()));
+    for (uint16_t slot : slots) {
+        const char* name = GlobalTable::getInstance().name(slot);
+        if (!name) throw std::runtime_error("Unknown global slot " + std::to_string(slot) + " in AOT chunk");
+        putU32(out, slot);
+        putString(out, name);
+    }
+
+    putU32(out, static_cast<uint32_t>(chunk.exceptionHandlers().size()));
+    for (const auto& handler : chunk.exceptionHandlers()) {
+        putU32(out, handler.start);
+        putU32(out, handler.end);
+        putU32(out, handler.handler);
+        putU32(out, handler.stackDepth);
+    }
+
+    putU32(out, static_cast<uint32_t>(chunk.switchTableCount()));
+    for (size_t i = 0; i < chunk.switchTableCount(); i++) {
+        const SwitchTable& table = chunk.switchTable(i);
+        putU32(out, static_cast<uint32_t>(table.low));
+        putU32(out, static_cast<uint32_t>(table.ints.size()));
+        for (uint32_t target : table.ints) putU32(out, target);
+        putU32(out, static_cast<uint32_t>(table.strings.size()));
+        for (const auto& [label, target] : table.strings) {
+            putString(out, label);
+            putU32(out, target);
+        }
+        putU32(out, table.fallback);
+    }
+    return out;
+}
+
+bool restoreAotTables(Chunk& chunk, const uint8_t* data, uint64_t size) {
+    TableReader in{data, size};
+    for (size_t kind = 0; kind < static_cast<size_t>(CacheKind::Count); kind++) {
+        chunk.setCacheSlotCount(static_cast<CacheKind>(kind), static_cast<int>(in.u32()));
+    }
+    chunk.setLoopCount(static_cast<int>(in.u32()));
+
+    // Slots are numbered by this process's table, so each name is resolved
+    // again and the operands are rewritten to match
+    std::unordered_map<uint16_t, uint16_t> slots;
+    uint32_t globalCount = in.u32();
+    for (uint32_t i = 0; i < globalCount && in.ok; i++) {
+        uint32_t slot = in.u32();
+        std::string_view name = in.string();
+        if (!in.ok || slot > UINT16_MAX) return false;
+        int resolved = GlobalTable::getInstance().resolve(name);
+        if (resolved > UINT16_MAX) return false;
+        slots[static_cast<uint16_t>(slot)] = static_cast<uint16_t>(resolved);
+    }
+    if (!in.ok) return false;
+    for (size_t offset = 0; offset < chunk.size(); offset += chunk.instructionLength(offset)) {
+        if (!isGlobalOp(chunk.code()[offset])) continue;
+        if (offset + 2 >= chunk.size()) return false;
+        auto it = slots.find(globalSlotAt(chunk, offset));
+        if (it == slots.end()) return false;
+        chunk.patchShort(offset + 1, it->second);
+    }
+
+    uint32_t handlerCount = in.u32();
+    for (uint32_t i = 0; i < handlerCount && in.ok; i++) {
+        ExceptionHandler handler;
+        handler.start = in.u32();
+        handler.end = in.u32();
+        handler.handler = in.u32();
+        handler.stackDepth = in.u32();
+        chunk.addExceptionHandler(handler);
+    }
+
+    uint32_t switchCount = in.u32();
+    for (uint32_t i = 0; i < switchCount && in.ok; i++) {
+        SwitchTable table;
+        table.low = static_cast<int32_t>(in.u32());
+        uint32_t intCount = in.u32();
+        for (uint32_t j = 0; j < intCount && in.ok; j++) table.ints.push_back(in.u32());
+        uint32_t stringCount = in.u32();
+        for (uint32_t j = 0; j < stringCount && in.ok; j++) {
+            const char* label = StringPool::intern(in.string()).data();
+            table.strings[label] = in.u32();
+        }
+        table.fallback = in.u32();
+        chunk.addSwitchTable(std::move(table));
+    }
+    return in.ok && in.pos == size;
+}
+
+} // namespace claw
+
+extern "C" int claw_aot_run(const uint8_t* code, uint64_t codeSize, const claw::AotConstant* consts, uint64_t constCount,
+                            const uint8_t* tables, uint64_t tablesSize) {
     using namespace claw;
 
     Chunk chunk;
@@ -24,17 +189,23 @@ extern "C" int claw_aot_run(const uint8_t* code, uint64_t codeSize, const claw::
             chunk.addConstant(numberToValue(num));
         } else if (entry.tag == static_cast<uint8_t>(AotConstTag::String)) {
             const char* text = reinterpret_cast<const char*>(entry.payload);
-            auto sv = StringPool::intern(text ? text : "");
-            chunk.addConstant(stringValue(sv.data()));
+            chunk.addConstant(internedStringValue(text ? text : ""));
         } else {
             chunk.addConstant(nilValue());
         }
     }
 
+    if (!restoreAotTables(chunk, tables, tablesSize)) {
+        std::cerr << "Corrupt AOT side tables." << std::endl;
+        return 1;
+    }
+    chunk.setMaxStackDepth(computeMaxStackDepth(chunk, 0));
+
     VM vm;
     auto result = vm.interpret(chunk);
     return result == InterpretResult::Ok ? 0 : 1;
 }
-extern "C" int volt_aot_run(const uint8_t* code, uint64_t codeSize, const claw::AotConstant* consts, uint64_t constCount) {
-    return claw_aot_run(code, codeSize, consts, constCount);
+extern "C" int volt_aot_run(const uint8_t* code, uint64_t codeSize, const claw::AotConstant* consts, uint64_t constCount,
+                            const uint8_t* tables, uint64_t tablesSize) {
+    return claw_aot_run(code, codeSize, consts, constCount, tables, tablesSize);
 }
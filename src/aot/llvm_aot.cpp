@@ -32,58 +32,17 @@ static uint64_t toBits(double value) {
     return bits;
 }
 
-static double fromBits(uint64_t bits) {
-    double value;
-    std::memcpy(&value, &bits, sizeof(double));
-    return value;
-}
-
-extern "C" int claw_aot_run(const uint8_t* code,
-                            uint64_t code_size,
-                            const AotConstant* constants,
-                            uint64_t constant_count) {
-    Chunk chunk;
-    for (uint64_t i = 0; i < code_size; i++) {
-        chunk.write(code[i], 0);
-    }
-
-    for (uint64_t i = 0; i < constant_count; i++) {
-        const auto& constant = constants[i];
-        Value value = nilValue();
-        switch (static_cast<AotConstTag>(constant.tag)) {
-            case AotConstTag::Nil:
-                value = nilValue();
-                break;
-            case AotConstTag::Bool:
-                value = boolValue(constant.payload != 0);
-                break;
-            case AotConstTag::Number:
-                value = numberToValue(fromBits(constant.payload));
-                break;
-            case AotConstTag::String: {
-                const char* text = reinterpret_cast<const char*>(constant.payload);
-                auto sv = StringPool::intern(text ? text : "");
-                value = stringValue(sv.data());
-                break;
-            }
-            default:
-                value = nilValue();
-                break;
-        }
-        chunk.addConstant(value);
-    }
-
-    Interpreter interpreter;
-    VM vm(interpreter);
-    auto result = vm.interpret(chunk);
-    return result == InterpretResult::Ok ? 0 : 1;
-}
-
 AotModule AotCompiler::compile(const std::string& name, const Chunk& chunk) {
     llvm::InitializeNativeTarget();
     llvm::InitializeNativeTargetAsmPrinter();
     llvm::InitializeNativeTargetAsmParser();
 
+    // The loader has no interpreter and no way to rebuild nested functions
+    if (chunk.interpretedStmtCount() > 0) {
+        throw std::runtime_error("Statements left to the interpreter cannot be compiled ahead of time");
+    }
+    std::vector<uint8_t> tables = serializeAotTables(chunk);
+
     llvm::LLVMContext context;
     auto module = std::make_unique<llvm::Module>(name, context);
     std::string triple = llvm::sys::getDefaultTargetTriple();
@@ -111,6 +70,18 @@ AotModule AotCompiler::compile(const std::string& name, const Chunk& chunk) {
     auto codePtr = llvm::ConstantExpr::getPointerCast(codeGlobal, i8Ptr);
     auto codeSize = llvm::ConstantInt::get(i64, chunk.code().size());
 
+    auto tablesArray = llvm::ConstantDataArray::get(context, tables);
+    auto tablesGlobal = new llvm::GlobalVariable(
+        *module,
+        tablesArray->getType(),
+        true,
+        llvm::GlobalValue::PrivateLinkage,
+        tablesArray,
+        "claw_tables");
+    tablesGlobal->setAlignment(llvm::Align(1));
+    auto tablesPtr = llvm::ConstantExpr::getPointerCast(tablesGlobal, i8Ptr);
+    auto tablesSize = llvm::ConstantInt::get(i64, tables.size());
+
     std::vector<llvm::Constant*> constEntries;
     constEntries.reserve(chunk.constants().size());
 
@@ -170,14 +141,14 @@ AotModule AotCompiler::compile(const std::string& name, const Chunk& chunk) {
         constCount = llvm::ConstantInt::get(i64, constEntries.size());
     }
 
-    auto runTy = llvm::FunctionType::get(i32, {i8Ptr, i64, constStructTy->getPointerTo(), i64}, false);
+    auto runTy = llvm::FunctionType::get(i32, {i8Ptr, i64, constStructTy->getPointerTo(), i64, i8Ptr, i64}, false);
     auto runFn = module->getOrInsertFunction("claw_aot_run", runTy);
 
     auto mainTy = llvm::FunctionType::get(i32, false);
     auto mainFn = llvm::Function::Create(mainTy, llvm::Function::ExternalLinkage, "main", module.get());
     auto entry = llvm::BasicBlock::Create(context, "entry", mainFn);
     llvm::IRBuilder<> builder(entry);
-    auto call = builder.CreateCall(runFn, {codePtr, codeSize, constPtr, constCount});
+    auto call = builder.CreateCall(runFn, {codePtr, codeSize, constPtr, constCount, tablesPtr, tablesSize});
     builder.CreateRet(call);
 
     llvm::PassBuilder passBuilder;
@@ -26,6 +26,14 @@ struct AotConstant {
     uint64_t payload;
 };
 
+// Tables a chunk's code indexes besides its constants: inline cache slot
+// counts, the global slots it names, exception handlers and switch tables,
+// flattened into the object file next to the code. Global slots are
+// numbered per process, so restoring resolves the names again and rewrites
+// the operands. restoreAotTables returns false on malformed data.
+std::vector<uint8_t> serializeAotTables(const Chunk& chunk);
+bool restoreAotTables(Chunk& chunk, const uint8_t* data, uint64_t size);
+
  class AotCompiler {
  public:
      AotCompiler() = default;
@@ -1,13 +1,20 @@
 #include "compiler.h"
+#include "escape.h"
+#include "stack_depth.h"
 #include "features/string_pool.h"
+#include "vm/global_table.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include <cstdint>
 
 namespace claw {
 
 Compiler::Compiler() : currentLine_(0), scopeDepth_(0), enclosing_(nullptr) {}
-Compiler::Compiler(Compiler* enclosing) : currentLine_(0), scopeDepth_(0), enclosing_(enclosing) {}
+Compiler::Compiler(Compiler* enclosing) : currentLine_(0), scopeDepth_(0), enclosing_(enclosing) {
+    escapeAnalysisEnabled_ = enclosing->escapeAnalysisEnabled_;
+    loopIREnabled_ = enclosing->loopIREnabled_;
+}
 
 std::unique_ptr<Chunk> Compiler::compile(const std::vector<StmtPtr>& program) {
     chunk_ = std::make_unique<Chunk>();
@@ -15,14 +22,52 @@ std::unique_ptr<Chunk> Compiler::compile(const std::vector<StmtPtr>& program) {
     upvalues_.clear();
     scopeDepth_ = 0;
     enclosing_ = nullptr;
+    fallbackCount_ = 0;
+    scopedDecls_.clear();
+    if (escapeAnalysisEnabled_) scopedDecls_ = findScopedDecls(program);
+    body_ = &program;
+    capturedNames_.reset();
+    definedGlobals_.clear();
+    programGlobals_.clear();
+    for (const auto& stmt : program) {
+        auto* exprStmt = dynamic_cast<ExprStmt*>(stmt.get());
+        auto* assign = exprStmt ? dynamic_cast<AssignExpr*>(exprStmt->expr.get()) : nullptr;
+        if (assign) {
+            programGlobals_.insert(assign->name);
+        } else if (dynamic_cast<LetStmt*>(stmt.get()) || dynamic_cast<FnStmt*>(stmt.get()) ||
+                   dynamic_cast<ClassStmt*>(stmt.get())) {
+            programGlobals_.insert(std::string(stmt->token.lexeme));
+        }
+    }
+    irStats_ = IRStats{};
     
     for (const auto& stmt : program) {
-        currentLine_ = stmt->token.line;
+        setCurrentToken(stmt->token);
+        size_t codeStart = chunk_->size();
+        size_t constantStart = chunk_->constants().size();
+        unsupported_ = false;
         stmt->accept(*this);
+        if (fallbackEnabled_ && unsupported_) {
+            // Throw the partial code away and let the interpreter run the
+            // whole statement, nested functions included
+            chunk_->truncate(codeStart, constantStart);
+            int index = chunk_->addInterpretedStmt(stmt.get());
+            if (index > UINT16_MAX) error(stmt->token, "Too many interpreted statements in one chunk.");
+            emitOp(OpCode::Interpret);
+            emitByte((index >> 8) & 0xff);
+            emitByte(index & 0xff);
+            fallbackCount_++;
+        } else if (dynamic_cast<LetStmt*>(stmt.get()) || dynamic_cast<FnStmt*>(stmt.get()) ||
+                   dynamic_cast<ClassStmt*>(stmt.get())) {
+            definedGlobals_.insert(std::string(stmt->token.lexeme));
+        }
     }
     
+    emitOp(OpCode::Nil);
     emitOp(OpCode::Return);
-    chunk_->setLoopCount(static_cast<int>(chunk_->countOpcode(OpCode::Loop)));
+    chunk_->setLoopCount(chunk_->cacheSlotCount(CacheKind::Loop));
+    chunk_->setMaxStackDepth(computeMaxStackDepth(*chunk_, 0));
+    peepholeStats_ = peepholeEnabled_ ? fuseSuperinstructions(*chunk_) : PeepholeStats{};
     return std::move(chunk_);
 }
 
@@ -31,10 +76,10 @@ std::unique_ptr<Chunk> Compiler::compile(const std::vector<StmtPtr>& program) {
 Value Compiler::visitLiteralExpr(LiteralExpr* expr) {
     switch (expr->type) {
         case LiteralExpr::Type::Number:
-            emitConstant(numberToValue(expr->numberValue));
+            emitConstant(compactNumberValue(expr->numberValue));
             break;
         case LiteralExpr::Type::String:
-            emitConstant(stringValue(StringPool::intern(expr->stringValue).data()));
+            emitConstant(internedStringValue(expr->stringValue));
             break;
         case LiteralExpr::Type::Bool:
             emitOp(expr->boolValue ? OpCode::True : OpCode::False);
@@ -47,7 +92,12 @@ Value Compiler::visitLiteralExpr(LiteralExpr* expr) {
 }
 
 Value Compiler::visitVariableExpr(VariableExpr* expr) {
-    std::string_view name = expr->token.lexeme;
+    setCurrentToken(expr->token);
+    namedVariable(expr->token.lexeme);
+    return nilValue();
+}
+
+void Compiler::namedVariable(std::string_view name) {
     int arg = resolveLocal(name);
     
     if (arg != -1) {
@@ -57,17 +107,15 @@ Value Compiler::visitVariableExpr(VariableExpr* expr) {
         emitOp(OpCode::GetUpvalue);
         emitByte(static_cast<uint8_t>(arg));
     } else {
-        emitOp(OpCode::GetGlobal);
-        auto sv = StringPool::intern(name);
-        emitByte(makeConstant(stringValue(sv.data())));
+        emitGlobal(OpCode::GetGlobal, name);
     }
-    return nilValue();
 }
 
 Value Compiler::visitBinaryExpr(BinaryExpr* expr) {
     expr->left->accept(*this);
     expr->right->accept(*this);
     
+    setCurrentToken(expr->op);
     switch (expr->op.type) {
         case TokenType::Plus:  emitOp(OpCode::Add); break;
         case TokenType::Minus: emitOp(OpCode::Subtract); break;
@@ -96,7 +144,7 @@ Value Compiler::visitBinaryExpr(BinaryExpr* expr) {
             emitOp(OpCode::Not);
             break;
         }
-        default: return nilValue();
+        default: unsupported(); break;
     }
     return nilValue();
 }
@@ -104,18 +152,32 @@ Value Compiler::visitBinaryExpr(BinaryExpr* expr) {
 Value Compiler::visitUnaryExpr(UnaryExpr* expr) {
     expr->right->accept(*this);
     
+    setCurrentToken(expr->op);
     switch (expr->op.type) {
         case TokenType::Minus: emitOp(OpCode::Negate); break;
         case TokenType::Bang:  emitOp(OpCode::Not); break;
-        default: return nilValue();
+        default: unsupported(); break;
     }
     return nilValue();
 }
 
 Value Compiler::visitLogicalExpr(LogicalExpr* expr) {
-    // Basic logical op - could be optimized with short-circuiting jumps
+    // Short-circuits like the interpreter: the result is the last operand
+    // evaluated, not a boolean
     expr->left->accept(*this);
-    expr->right->accept(*this);
+    if (expr->op.type == TokenType::Or) {
+        int elseJump = emitJump(OpCode::JumpIfFalse);
+        int endJump = emitJump(OpCode::Jump);
+        patchJump(elseJump);
+        emitOp(OpCode::Pop);
+        expr->right->accept(*this);
+        patchJump(endJump);
+    } else {
+        int endJump = emitJump(OpCode::JumpIfFalse);
+        emitOp(OpCode::Pop);
+        expr->right->accept(*this);
+        patchJump(endJump);
+    }
     return nilValue();
 }
 
@@ -125,30 +187,92 @@ Value Compiler::visitGroupingExpr(GroupingExpr* expr) {
 
 Value Compiler::visitCallExpr(CallExpr* expr) {
     if (auto* var = dynamic_cast<VariableExpr*>(expr->callee.get())) {
-        if (var->token.lexeme == std::string_view("num") && expr->arguments.size() == 1) {
-            if (auto* lit = dynamic_cast<LiteralExpr*>(expr->arguments[0].get())) {
-                if (lit->type == LiteralExpr::Type::Number) {
-                    expr->arguments[0]->accept(*this);
-                    return nilValue();
-                }
-            }
+        // A scoped closure is known to be a VMClosure, so the call skips the
+        // callee checks and the call cache
+        int local = resolveLocal(var->token.lexeme);
+        if (local != -1 && locals_[local].scoped) {
+            emitOp(OpCode::GetLocal);
+            emitByte(static_cast<uint8_t>(local));
+            for (const auto& argument : expr->arguments) argument->accept(*this);
+            setCurrentToken(expr->token);
+            emitOp(OpCode::CallScoped);
+            emitByte(static_cast<uint8_t>(expr->arguments.size()));
+            return nilValue();
         }
     }
-    expr->callee->accept(*this);
-    uint8_t argCount = 0;
-    for (const auto& argument : expr->arguments) {
-        argument->accept(*this);
-        argCount++;
+    // obj.name(args) and super.name(args) call the method straight from the
+    // receiver instead of materializing a bound method first
+    if (auto* member = dynamic_cast<MemberExpr*>(expr->callee.get())) {
+        member->object->accept(*this);
+        bool callbacks = passesCallbacks(expr);
+        compileArguments(expr->arguments, callbacks);
+        // Reported where the interpreter looks the method up, and a failed
+        // call where it calls it
+        setCurrentToken(member->token);
+        emitOp(OpCode::Invoke);
+        emitByte(makeConstant(internedStringValue(member->member)));
+        setCurrentToken(expr->token);
+        emitByte(static_cast<uint8_t>(expr->arguments.size()));
+        emitCacheSlot(CacheKind::Invoke);
+        if (callbacks) emitOp(OpCode::ReleaseCallbacks);
+        return nilValue();
+    }
+    if (auto* super = dynamic_cast<SuperExpr*>(expr->callee.get())) {
+        namedVariable("this");
+        for (const auto& argument : expr->arguments) argument->accept(*this);
+        namedVariable("super");
+        setCurrentToken(expr->token);
+        emitOp(OpCode::SuperInvoke);
+        emitByte(makeConstant(internedStringValue(super->method)));
+        emitByte(static_cast<uint8_t>(expr->arguments.size()));
+        return nilValue();
     }
+    expr->callee->accept(*this);
+    bool callbacks = passesCallbacks(expr);
+    compileArguments(expr->arguments, callbacks);
+    setCurrentToken(expr->token);
     emitOp(OpCode::Call);
-    emitByte(argCount);
+    emitByte(static_cast<uint8_t>(expr->arguments.size()));
+    emitCacheSlot(CacheKind::Call);
+    if (callbacks) emitOp(OpCode::ReleaseCallbacks);
     return nilValue();
 }
 
+// Whether the function literals among a call's arguments compile to
+// ScopedCallback. The VM decides when it sees the callee, so any call but
+// super's qualifies; a method call only for the array members that just
+// call their callback, the only ones the VM accepts an array receiver for.
+bool Compiler::passesCallbacks(CallExpr* expr) const {
+    if (!escapeAnalysisEnabled_ || dynamic_cast<SuperExpr*>(expr->callee.get())) return false;
+    if (auto* member = dynamic_cast<MemberExpr*>(expr->callee.get())) {
+        const std::string& name = member->member;
+        if (name != "map" && name != "filter" && name != "forEach" && name != "reduce") return false;
+    }
+    for (const auto& argument : expr->arguments) {
+        if (dynamic_cast<FunctionExpr*>(argument.get())) return true;
+    }
+    return false;
+}
+
+// Pushes a call's arguments above its callee or receiver. With callbacks
+// set, each function literal among them is told how far above the callee
+// it goes, where ScopedCallback looks for it.
+void Compiler::compileArguments(const std::vector<ExprPtr>& arguments, bool callbacks) {
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (callbacks && i < UINT8_MAX && dynamic_cast<FunctionExpr*>(arguments[i].get())) {
+            callbackDepth_ = static_cast<int>(i) + 1;
+        }
+        arguments[i]->accept(*this);
+    }
+}
+
 Value Compiler::visitAssignExpr(AssignExpr* expr) {
     expr->value->accept(*this);
-    
-    std::string_view name = expr->token.lexeme;
+    setNamedVariable(expr->token.lexeme);
+    return nilValue();
+}
+
+void Compiler::setNamedVariable(std::string_view name) {
     int arg = resolveLocal(name);
     if (arg != -1) {
         emitOp(OpCode::SetLocal);
@@ -157,15 +281,24 @@ Value Compiler::visitAssignExpr(AssignExpr* expr) {
         emitOp(OpCode::SetUpvalue);
         emitByte(static_cast<uint8_t>(arg));
     } else {
-        emitOp(OpCode::SetGlobal);
-        auto sv = StringPool::intern(name);
-        emitByte(makeConstant(stringValue(sv.data())));
+        if ((enclosing_ || scopeDepth_ > 0) && !isProgramGlobal(name)) unsupported();
+        emitGlobal(OpCode::SetGlobal, name);
     }
-    return nilValue();
+}
+
+// The interpreter defines an unbound name where an assignment to it runs. At
+// top level that is a global, which SetGlobal defines too. Inside a function
+// or block it is a local the VM cannot create, so an assignment there to a
+// name no top-level statement binds leaves the statement to the interpreter.
+bool Compiler::isProgramGlobal(std::string_view name) {
+    Compiler* root = this;
+    while (root->enclosing_) root = root->enclosing_;
+    return root->programGlobals_.count(std::string(name)) > 0;
 }
 
 Value Compiler::visitCompoundAssignExpr(CompoundAssignExpr* expr) {
     // Load current variable value
+    setCurrentToken(expr->token);
     int local = resolveLocal(expr->name);
     int upv = -1;
     if (local != -1) {
@@ -175,13 +308,12 @@ Value Compiler::visitCompoundAssignExpr(CompoundAssignExpr* expr) {
         emitOp(OpCode::GetUpvalue);
         emitByte(static_cast<uint8_t>(upv));
     } else {
-        emitOp(OpCode::GetGlobal);
-        auto sv = StringPool::intern(expr->name);
-        emitByte(makeConstant(stringValue(sv.data())));
+        emitGlobal(OpCode::GetGlobal, expr->name);
     }
     // Operand
     expr->value->accept(*this);
     // Operation
+    setCurrentToken(expr->op);
     switch (expr->op.type) {
         case TokenType::PlusEqual:        emitOp(OpCode::Add); break;
         case TokenType::MinusEqual:       emitOp(OpCode::Subtract); break;
@@ -192,7 +324,7 @@ Value Compiler::visitCompoundAssignExpr(CompoundAssignExpr* expr) {
         case TokenType::BitXorEqual:      emitOp(OpCode::BitXor); break;
         case TokenType::ShiftLeftEqual:   emitOp(OpCode::ShiftLeft); break;
         case TokenType::ShiftRightEqual:  emitOp(OpCode::ShiftRight); break;
-        default: break;
+        default: unsupported(); break;
     }
     // Store back
     if (local != -1) {
@@ -202,9 +334,7 @@ Value Compiler::visitCompoundAssignExpr(CompoundAssignExpr* expr) {
         emitOp(OpCode::SetUpvalue);
         emitByte(static_cast<uint8_t>(upv));
     } else {
-        emitOp(OpCode::SetGlobal);
-        auto sv = StringPool::intern(expr->name);
-        emitByte(makeConstant(stringValue(sv.data())));
+        emitGlobal(OpCode::SetGlobal, expr->name);
     }
     return nilValue();
 }
@@ -226,13 +356,14 @@ Value Compiler::visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr) {
     emitOp(OpCode::SetLocal);
     emitByte(static_cast<uint8_t>(rhsSlot));
     emitOp(OpCode::Pop);
-    auto svName = StringPool::intern(expr->member);
+    Value name = internedStringValue(expr->member);
     emitOp(OpCode::GetLocal);
     emitByte(static_cast<uint8_t>(objSlot));
     emitOp(OpCode::GetLocal);
     emitByte(static_cast<uint8_t>(rhsSlot));
+    setCurrentToken(expr->op);
     emitOp(OpCode::EnsurePropertyDefault);
-    emitByte(makeConstant(stringValue(svName.data())));
+    emitByte(makeConstant(name));
     switch (expr->op.type) {
         case TokenType::PlusEqual:        emitByte(0); break;
         case TokenType::MinusEqual:       emitByte(1); break;
@@ -243,7 +374,7 @@ Value Compiler::visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr) {
         case TokenType::BitXorEqual:      emitByte(6); break;
         case TokenType::ShiftLeftEqual:   emitByte(7); break;
         case TokenType::ShiftRightEqual:  emitByte(8); break;
-        default:                           emitByte(255); break;
+        default:                           emitByte(255); unsupported(); break;
     }
     emitOp(OpCode::Pop);
     emitOp(OpCode::Pop);
@@ -254,9 +385,11 @@ Value Compiler::visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr) {
     emitOp(OpCode::GetLocal);
     emitByte(static_cast<uint8_t>(objSlot));
     emitOp(OpCode::GetProperty);
-    emitByte(makeConstant(stringValue(svName.data())));
+    emitByte(makeConstant(name));
+    emitCacheSlot(CacheKind::Property);
     emitOp(OpCode::GetLocal);
     emitByte(static_cast<uint8_t>(rhsSlot));
+    setCurrentToken(expr->op);
     switch (expr->op.type) {
         case TokenType::PlusEqual:        emitOp(OpCode::Add); break;
         case TokenType::MinusEqual:       emitOp(OpCode::Subtract); break;
@@ -276,8 +409,9 @@ Value Compiler::visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr) {
     emitByte(static_cast<uint8_t>(objSlot));
     emitOp(OpCode::GetLocal);
     emitByte(static_cast<uint8_t>(resSlot));
+    setCurrentToken(expr->token);
     emitOp(OpCode::SetProperty);
-    emitByte(makeConstant(stringValue(svName.data())));
+    emitByte(makeConstant(name));
     endScope();
     return nilValue();
 }
@@ -309,6 +443,7 @@ Value Compiler::visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) {
     emitByte(static_cast<uint8_t>(rhsSlot));
     emitOp(OpCode::Pop);
     // Ensure default for missing hash keys
+    setCurrentToken(expr->token);
     emitOp(OpCode::GetLocal);
     emitByte(static_cast<uint8_t>(objSlot));
     emitOp(OpCode::GetLocal);
@@ -326,7 +461,7 @@ Value Compiler::visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) {
         case TokenType::BitXorEqual:      emitByte(6); break;
         case TokenType::ShiftLeftEqual:   emitByte(7); break;
         case TokenType::ShiftRightEqual:  emitByte(8); break;
-        default:                           emitByte(255); break;
+        default:                           emitByte(255); unsupported(); break;
     }
     // Clear the temporary stack triplet [obj, idx, rhs] used by EnsureIndexDefault
     emitOp(OpCode::Pop);
@@ -345,6 +480,7 @@ Value Compiler::visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) {
     emitOp(OpCode::GetIndex);
     emitOp(OpCode::GetLocal);
     emitByte(static_cast<uint8_t>(rhsSlot));
+    setCurrentToken(expr->op);
     switch (expr->op.type) {
         case TokenType::PlusEqual:        emitOp(OpCode::Add); break;
         case TokenType::MinusEqual:       emitOp(OpCode::Subtract); break;
@@ -366,30 +502,27 @@ Value Compiler::visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) {
     emitByte(static_cast<uint8_t>(idxSlot));
     emitOp(OpCode::GetLocal);
     emitByte(static_cast<uint8_t>(resSlot));
+    setCurrentToken(expr->token);
     emitOp(OpCode::SetIndex);
     endScope();
     return nilValue();
 }
 Value Compiler::visitUpdateExpr(UpdateExpr* expr) {
-    int slot = resolveLocal(expr->name);
-    if (slot != -1) {
-        emitOp(OpCode::GetLocal);
-        emitByte(static_cast<uint8_t>(slot));
-        emitOp(OpCode::Constant);
-        emitByte(makeConstant(numberToValue(1.0)));
-        if (expr->op.type == TokenType::PlusPlus) {
-            emitOp(OpCode::Add);
-        } else {
-            emitOp(OpCode::Subtract);
-        }
-        emitOp(OpCode::SetLocal);
-        emitByte(static_cast<uint8_t>(slot));
-        return nilValue();
-    }
+    // A postfix update leaves the old value below the new one and drops the
+    // new one once it is stored
+    setCurrentToken(expr->token);
+    namedVariable(expr->name);
+    if (!expr->prefix) namedVariable(expr->name);
+    emitOp(OpCode::Constant);
+    emitByte(makeConstant(intValue(1)));
+    setCurrentToken(expr->op);
+    emitOp(expr->op.type == TokenType::PlusPlus ? OpCode::Add : OpCode::Subtract);
+    setNamedVariable(expr->name);
+    if (!expr->prefix) emitOp(OpCode::Pop);
     return nilValue();
 }
-Value Compiler::visitUpdateMemberExpr(UpdateMemberExpr* expr) { return nilValue(); }
-Value Compiler::visitUpdateIndexExpr(UpdateIndexExpr* expr) { return nilValue(); }
+Value Compiler::visitUpdateMemberExpr(UpdateMemberExpr*) { unsupported(); return nilValue(); }
+Value Compiler::visitUpdateIndexExpr(UpdateIndexExpr*) { unsupported(); return nilValue(); }
 Value Compiler::visitTernaryExpr(TernaryExpr* expr) {
     expr->condition->accept(*this);
     int elseJump = emitJump(OpCode::JumpIfFalse);
@@ -402,10 +535,26 @@ Value Compiler::visitTernaryExpr(TernaryExpr* expr) {
     patchJump(endJump);
     return nilValue();
 }
-Value Compiler::visitArrayExpr(ArrayExpr* expr) { return nilValue(); }
+Value Compiler::visitArrayExpr(ArrayExpr* expr) {
+    emitArray(expr, OpCode::BuildArray);
+    return nilValue();
+}
+// The elements, then BuildArray or ScopedArray
+void Compiler::emitArray(ArrayExpr* expr, OpCode op) {
+    if (expr->elements.size() > UINT16_MAX) {
+        error(expr->token, "Too many elements in one array literal.");
+        return;
+    }
+    for (const auto& element : expr->elements) element->accept(*this);
+    size_t count = expr->elements.size();
+    emitOp(op);
+    emitByte((count >> 8) & 0xff);
+    emitByte(count & 0xff);
+}
 Value Compiler::visitIndexExpr(IndexExpr* expr) {
     expr->object->accept(*this);
     expr->index->accept(*this);
+    setCurrentToken(expr->token);
     emitOp(OpCode::GetIndex);
     return nilValue();
 }
@@ -413,28 +562,59 @@ Value Compiler::visitIndexAssignExpr(IndexAssignExpr* expr) {
     expr->object->accept(*this);
     expr->index->accept(*this);
     expr->value->accept(*this);
+    setCurrentToken(expr->token);
     emitOp(OpCode::SetIndex);
     return nilValue();
 }
-Value Compiler::visitHashMapExpr(HashMapExpr* expr) { return nilValue(); }
+Value Compiler::visitHashMapExpr(HashMapExpr* expr) {
+    if (expr->keyValuePairs.size() > UINT16_MAX) {
+        error(expr->token, "Too many entries in one map literal.");
+        return nilValue();
+    }
+    for (const auto& [key, value] : expr->keyValuePairs) {
+        key->accept(*this);
+        value->accept(*this);
+    }
+    size_t count = expr->keyValuePairs.size();
+    emitOp(OpCode::BuildMap);
+    emitByte((count >> 8) & 0xff);
+    emitByte(count & 0xff);
+    return nilValue();
+}
 Value Compiler::visitMemberExpr(MemberExpr* expr) {
     expr->object->accept(*this);
+    setCurrentToken(expr->token);
     emitOp(OpCode::GetProperty);
-    auto sv = StringPool::intern(expr->member);
-    emitByte(makeConstant(stringValue(sv.data())));
+    emitByte(makeConstant(internedStringValue(expr->member)));
+    emitCacheSlot(CacheKind::Property);
     return nilValue();
 }
 Value Compiler::visitSetExpr(SetExpr* expr) {
     expr->object->accept(*this);
     expr->value->accept(*this);
+    setCurrentToken(expr->token);
     emitOp(OpCode::SetProperty);
-    auto sv = StringPool::intern(expr->member);
-    emitByte(makeConstant(stringValue(sv.data())));
+    emitByte(makeConstant(internedStringValue(expr->member)));
+    return nilValue();
+}
+Value Compiler::visitThisExpr(ThisExpr*) {
+    // Slot 0 of every method; closures inside methods capture it as an upvalue
+    namedVariable("this");
+    return nilValue();
+}
+Value Compiler::visitSuperExpr(SuperExpr* expr) {
+    namedVariable("this");
+    namedVariable("super");
+    setCurrentToken(expr->token);
+    emitOp(OpCode::GetSuper);
+    emitByte(makeConstant(internedStringValue(expr->method)));
     return nilValue();
 }
-Value Compiler::visitThisExpr(ThisExpr* expr) { return nilValue(); }
-Value Compiler::visitSuperExpr(SuperExpr* expr) { return nilValue(); }
 Value Compiler::visitFunctionExpr(FunctionExpr* expr) {
+    bool scoped = scopedClosure_;
+    int callbackDepth = callbackDepth_;
+    scopedClosure_ = false;
+    callbackDepth_ = 0;
     Compiler functionCompiler(this);
     functionCompiler.chunk_ = std::make_unique<Chunk>();
     functionCompiler.beginScope();
@@ -444,28 +624,20 @@ Value Compiler::visitFunctionExpr(FunctionExpr* expr) {
         functionCompiler.addLocal(param);
     }
 
-    for (const auto& stmt : expr->body) {
-        functionCompiler.currentLine_ = stmt->token.line;
-        stmt->accept(functionCompiler);
-    }
+    compileBody(functionCompiler, expr->body);
 
     functionCompiler.emitOp(OpCode::Nil);
     functionCompiler.emitOp(OpCode::Return);
 
     auto function = std::make_shared<VMFunction>();
-    function->name = "<lambda>";
+    function->name = "<anonymous>";
+    function->line = expr->token.line;
     function->arity = static_cast<int>(expr->parameters.size());
+    functionCompiler.chunk_->setMaxStackDepth(computeMaxStackDepth(*functionCompiler.chunk_, function->arity + 1));
     function->upvalueCount = static_cast<int>(functionCompiler.upvalues_.size());
     function->chunk = std::move(functionCompiler.chunk_);
 
-    emitOp(OpCode::Closure);
-    emitByte(makeConstant(vmFunctionValue(function)));
-
-    for (const auto& upvalue : functionCompiler.upvalues_) {
-        emitByte(upvalue.isLocal ? 1 : 0);
-        emitByte(upvalue.index);
-    }
-
+    emitClosure(function, functionCompiler, scoped, callbackDepth);
     return nilValue();
 }
 
@@ -483,7 +655,19 @@ void Compiler::visitPrintStmt(PrintStmt* stmt) {
 
 void Compiler::visitLetStmt(LetStmt* stmt) {
     std::string_view name = stmt->token.lexeme;
-    if (scopeDepth_ > 0) {
+    if (scopeDepth_ > 0 && scopedDecls_.count(stmt)) {
+        // The closure or array is built straight into the local's slot; its
+        // initializer never names the local, so declaring it afterwards
+        // changes nothing
+        if (auto* array = dynamic_cast<ArrayExpr*>(stmt->initializer.get())) {
+            emitArray(array, OpCode::ScopedArray);
+        } else {
+            scopedClosure_ = true;
+            stmt->initializer->accept(*this);
+        }
+        addLocal(name);
+        locals_.back().scoped = true;
+    } else if (scopeDepth_ > 0) {
         addLocal(name);
         int slot = resolveLocal(name);
         emitOp(OpCode::Nil);
@@ -499,15 +683,14 @@ void Compiler::visitLetStmt(LetStmt* stmt) {
         } else {
             emitOp(OpCode::Nil);
         }
-        emitOp(OpCode::DefineGlobal);
-        auto sv = StringPool::intern(name);
-        emitByte(makeConstant(stringValue(sv.data())));
+        emitGlobal(OpCode::DefineGlobal, name);
     }
 }
 
 void Compiler::visitBlockStmt(BlockStmt* stmt) {
     beginScope();
     for (const auto& s : stmt->statements) {
+        setCurrentToken(s->token);
         s->accept(*this);
     }
     endScope();
@@ -532,77 +715,82 @@ void Compiler::visitIfStmt(IfStmt* stmt) {
 }
 
 void Compiler::visitWhileStmt(WhileStmt* stmt) {
+    if (compileLoopIR(stmt)) return;
     int loopStart = static_cast<int>(chunk_->size());
     stmt->condition->accept(*this);
     
     int exitJump = emitJump(OpCode::JumpIfFalse);
     emitOp(OpCode::Pop);
     
+    beginBreakable();
     stmt->body->accept(*this);
     emitLoop(loopStart);
     
     patchJump(exitJump);
     emitOp(OpCode::Pop);
+    endBreakable();
+}
+void Compiler::visitRunUntilStmt(RunUntilStmt*) { unsupported(); }
+// Iterations of a for loop the compiler unrolls: one counting a variable up
+// by a literal step from a literal start to a literal limit, at most 16
+// times. Zero for any other loop.
+int Compiler::unrollCount(ForStmt* stmt) const {
+    if (!stmt->initializer || !stmt->condition || !stmt->increment) return 0;
+    auto initLet = dynamic_cast<LetStmt*>(stmt->initializer.get());
+    auto condBin = dynamic_cast<BinaryExpr*>(stmt->condition.get());
+    auto incAssign = dynamic_cast<AssignExpr*>(stmt->increment.get());
+    auto incUpdate = dynamic_cast<UpdateExpr*>(stmt->increment.get());
+    if (!initLet || !initLet->initializer) return 0;
+    auto initLit = dynamic_cast<LiteralExpr*>(initLet->initializer.get());
+    if (!initLit || initLit->type != LiteralExpr::Type::Number || !condBin) return 0;
+    auto leftVar = dynamic_cast<VariableExpr*>(condBin->left.get());
+    auto rightLit = dynamic_cast<LiteralExpr*>(condBin->right.get());
+    if (!leftVar || !rightLit || rightLit->type != LiteralExpr::Type::Number) return 0;
+    double startVal = initLit->numberValue;
+    double limitVal = rightLit->numberValue;
+    double stepVal = 0.0;
+    bool stepOk = false;
+    if (incAssign) {
+        auto valBin = dynamic_cast<BinaryExpr*>(incAssign->value.get());
+        if (valBin && valBin->op.type == TokenType::Plus) {
+            auto vleft = dynamic_cast<VariableExpr*>(valBin->left.get());
+            auto vright = dynamic_cast<LiteralExpr*>(valBin->right.get());
+            if (vleft && vright && vright->type == LiteralExpr::Type::Number &&
+                vleft->name == leftVar->name) {
+                stepVal = vright->numberValue;
+                stepOk = true;
+            }
+        }
+    } else if (incUpdate && incUpdate->op.type == TokenType::PlusPlus &&
+               incUpdate->name == leftVar->name) {
+        stepVal = 1.0;
+        stepOk = true;
+    }
+    if (!stepOk || stepVal <= 0.0 || leftVar->name != initLet->name) return 0;
+    int iterations = 0;
+    if (condBin->op.type == TokenType::Less) {
+        iterations = static_cast<int>(std::max(0.0, std::ceil((limitVal - startVal) / stepVal)));
+    } else if (condBin->op.type == TokenType::LessEqual) {
+        iterations = static_cast<int>(std::max(0.0, std::floor((limitVal - startVal) / stepVal) + 1.0));
+    }
+    return iterations <= 16 ? iterations : 0;
 }
-void Compiler::visitRunUntilStmt(RunUntilStmt*) {}
+
 void Compiler::visitForStmt(ForStmt* stmt) {
+    int iterations = unrollCount(stmt);
+    if (iterations == 0 && compileLoopIR(stmt)) return;
     beginScope();
     if (stmt->initializer) {
         stmt->initializer->accept(*this);
     }
-    bool unrolled = false;
-    if (stmt->initializer && stmt->condition && stmt->increment) {
-        auto initLet = dynamic_cast<LetStmt*>(stmt->initializer.get());
-        auto condBin = dynamic_cast<BinaryExpr*>(stmt->condition.get());
-        auto incAssign = dynamic_cast<AssignExpr*>(stmt->increment.get());
-        auto incUpdate = dynamic_cast<UpdateExpr*>(stmt->increment.get());
-        if (initLet && initLet->initializer) {
-            auto initLit = dynamic_cast<LiteralExpr*>(initLet->initializer.get());
-            if (initLit && initLit->type == LiteralExpr::Type::Number && condBin) {
-                auto leftVar = dynamic_cast<VariableExpr*>(condBin->left.get());
-                auto rightLit = dynamic_cast<LiteralExpr*>(condBin->right.get());
-                if (leftVar && rightLit && rightLit->type == LiteralExpr::Type::Number) {
-                    double startVal = initLit->numberValue;
-                    double limitVal = rightLit->numberValue;
-                    double stepVal = 0.0;
-                    bool stepOk = false;
-                    if (incAssign) {
-                        auto valBin = dynamic_cast<BinaryExpr*>(incAssign->value.get());
-                        if (valBin && valBin->op.type == TokenType::Plus) {
-                            auto vleft = dynamic_cast<VariableExpr*>(valBin->left.get());
-                            auto vright = dynamic_cast<LiteralExpr*>(valBin->right.get());
-                            if (vleft && vright && vright->type == LiteralExpr::Type::Number &&
-                                vleft->name == leftVar->name) {
-                                stepVal = vright->numberValue;
-                                stepOk = true;
-                            }
-                        }
-                    } else if (incUpdate && incUpdate->op.type == TokenType::PlusPlus &&
-                               incUpdate->name == leftVar->name) {
-                        stepVal = 1.0;
-                        stepOk = true;
-                    }
-                    if (stepOk && stepVal > 0.0 && leftVar->name == initLet->name) {
-                        int iterations = 0;
-                        if (condBin->op.type == TokenType::Less) {
-                            iterations = static_cast<int>(std::max(0.0, std::floor((limitVal - startVal) / stepVal)));
-                        } else if (condBin->op.type == TokenType::LessEqual) {
-                            iterations = static_cast<int>(std::max(0.0, std::floor((limitVal - startVal) / stepVal) + 1.0));
-                        }
-                        if (iterations > 0 && iterations <= 16) {
-                            for (int k = 0; k < iterations; ++k) {
-                                stmt->body->accept(*this);
-                                stmt->increment->accept(*this);
-                                emitOp(OpCode::Pop);
-                            }
-                            unrolled = true;
-                        }
-                    }
-                }
-            }
+    beginBreakable();
+    if (iterations > 0) {
+        for (int k = 0; k < iterations; ++k) {
+            stmt->body->accept(*this);
+            stmt->increment->accept(*this);
+            emitOp(OpCode::Pop);
         }
-    }
-    if (!unrolled) {
+    } else {
         int loopStart = static_cast<int>(chunk_->size());
         int exitJump = -1;
         if (stmt->condition) {
@@ -621,69 +809,337 @@ void Compiler::visitForStmt(ForStmt* stmt) {
             emitOp(OpCode::Pop);
         }
     }
+    endBreakable();
     endScope();
 }
 void Compiler::visitFnStmt(FnStmt* stmt) {
+    bool scoped = scopeDepth_ > 0 && scopedDecls_.count(stmt) > 0;
+    compileFunction(stmt, stmt->name, false, scoped);
+    std::string_view name = stmt->token.lexeme;
+    if (scopeDepth_ > 0) {
+        addLocal(name);
+        locals_.back().scoped = scoped;
+    } else {
+        emitGlobal(OpCode::DefineGlobal, name);
+    }
+}
+void Compiler::visitReturnStmt(ReturnStmt* stmt) {
+    if (initializer_) {
+        // The value of return expr; in init is evaluated and dropped
+        if (stmt->value) {
+            stmt->value->accept(*this);
+            emitOp(OpCode::Pop);
+        }
+        emitOp(OpCode::GetLocal);
+        emitByte(0);
+    } else if (stmt->value) {
+        stmt->value->accept(*this);
+    } else {
+        emitOp(OpCode::Nil);
+    }
+    emitOp(OpCode::Return);
+}
+void Compiler::visitBreakStmt(BreakStmt* stmt) {
+    if (breakTargets_.empty()) {
+        error(stmt->token, "Can't use 'break' outside of a loop or switch.");
+        return;
+    }
+    BreakTarget& target = breakTargets_.back();
+    for (size_t i = locals_.size(); i > target.localCount; i--) {
+        emitLocalPop(locals_[i - 1]);
+    }
+    target.jumps.push_back(emitJump(OpCode::Jump));
+}
+void Compiler::visitContinueStmt(ContinueStmt*) { unsupported(); }
+void Compiler::visitTryStmt(TryStmt* stmt) {
+    if (!stmt->tryBody) return;
+    ExceptionHandler handler{};
+    handler.start = static_cast<uint32_t>(chunk_->size());
+    handler.stackDepth = static_cast<uint32_t>(locals_.size());
+    stmt->tryBody->accept(*this);
+    handler.end = static_cast<uint32_t>(chunk_->size());
+    int skipCatch = emitJump(OpCode::Jump);
+
+    // The VM enters here with the error value pushed on the cut-back stack;
+    // inner handlers were added while compiling the body and so come first.
+    handler.handler = static_cast<uint32_t>(chunk_->size());
+    chunk_->addExceptionHandler(handler);
+    beginScope();
+    addLocal(stmt->exceptionVar);
+    if (stmt->catchBody) stmt->catchBody->accept(*this);
+    endScope();
+    patchJump(skipCatch);
+}
+
+void Compiler::visitThrowStmt(ThrowStmt* stmt) {
+    stmt->expression->accept(*this);
+    emitOp(OpCode::Throw);
+}
+void Compiler::visitImportStmt(ImportStmt*) { unsupported(); }
+void Compiler::visitClassStmt(ClassStmt* stmt) {
+    std::string_view name = stmt->token.lexeme;
+    uint8_t nameConstant = makeConstant(internedStringValue(stmt->name));
+    emitOp(OpCode::Class);
+    emitByte(nameConstant);
+    if (scopeDepth_ > 0) {
+        addLocal(name);
+    } else {
+        emitGlobal(OpCode::DefineGlobal, name);
+    }
+
+    // The superclass stays on the stack as a local named super for the
+    // methods to capture
+    if (stmt->superclass) {
+        stmt->superclass->accept(*this);
+        beginScope();
+        addLocal("super");
+        namedVariable(name);
+        emitOp(OpCode::Inherit);
+    }
+
+    namedVariable(name);
+    for (const auto& method : stmt->methods) {
+        setCurrentToken(method->token);
+        compileFunction(method.get(), "this", method->name == "init", false);
+        emitOp(OpCode::Method);
+        emitByte(makeConstant(internedStringValue(method->name)));
+    }
+    emitOp(OpCode::Pop);
+
+    if (stmt->superclass) endScope();
+}
+namespace {
+
+// Integer value of a case label written as a literal, possibly negated
+bool integerCase(const Expr* expr, int32_t* out) {
+    double value = 0;
+    if (auto* unary = dynamic_cast<const UnaryExpr*>(expr)) {
+        auto* literal = dynamic_cast<const LiteralExpr*>(unary->right.get());
+        if (unary->op.type != TokenType::Minus || !literal || literal->type != LiteralExpr::Type::Number) return false;
+        value = -literal->numberValue;
+    } else if (auto* literal = dynamic_cast<const LiteralExpr*>(expr)) {
+        if (literal->type != LiteralExpr::Type::Number) return false;
+        value = literal->numberValue;
+    } else {
+        return false;
+    }
+    if (value != std::floor(value) || value < INT32_MIN || value > INT32_MAX) return false;
+    *out = static_cast<int32_t>(value);
+    return true;
+}
+
+const LiteralExpr* stringCase(const Expr* expr) {
+    auto* literal = dynamic_cast<const LiteralExpr*>(expr);
+    return literal && literal->type == LiteralExpr::Type::String ? literal : nullptr;
+}
+
+} // namespace
+
+// Switches whose labels are all integer literals dense enough for a table
+// (at least half the range used), or all string literals, dispatch with one
+// Switch instruction. Anything else compares the value against each label
+// in order. Case bodies follow each other, so falling through is free.
+void Compiler::visitSwitchStmt(SwitchStmt* stmt) {
+    std::vector<int32_t> ints;
+    size_t labels = 0;
+    bool allStrings = true;
+    for (const auto& c : stmt->cases) {
+        if (c.isDefault) continue;
+        labels++;
+        int32_t value;
+        if (integerCase(c.match.get(), &value)) ints.push_back(value);
+        if (!stringCase(c.match.get())) allStrings = false;
+    }
+    bool intTable = false;
+    int32_t low = 0;
+    int64_t span = 0;
+    if (labels > 0 && ints.size() == labels) {
+        auto [minIt, maxIt] = std::minmax_element(ints.begin(), ints.end());
+        low = *minIt;
+        span = static_cast<int64_t>(*maxIt) - low + 1;
+        intTable = span <= 2 * static_cast<int64_t>(labels);
+    }
+    bool stringTable = labels > 0 && allStrings;
+
+    beginScope();
+    stmt->expression->accept(*this);
+    int tableIndex = -1;
+    std::vector<int> caseJumps;
+    if (intTable || stringTable) {
+        SwitchTable table;
+        table.low = low;
+        table.ints.assign(static_cast<size_t>(span), UINT32_MAX);
+        tableIndex = chunk_->addSwitchTable(std::move(table));
+        if (tableIndex > UINT16_MAX) error(stmt->token, "Too many switch statements in one function.");
+        emitOp(OpCode::Switch);
+        emitByte((tableIndex >> 8) & 0xff);
+        emitByte(tableIndex & 0xff);
+    } else {
+        // The value stays in a hidden local for the comparisons
+        addLocal("");
+        compileSwitchChain(stmt, caseJumps);
+    }
+
+    beginBreakable();
+    int defaultCase = -1;
+    for (size_t i = 0; i < stmt->cases.size(); i++) {
+        const auto& c = stmt->cases[i];
+        auto start = static_cast<uint32_t>(chunk_->size());
+        if (c.isDefault) {
+            defaultCase = static_cast<int>(i);
+            if (tableIndex >= 0) {
+                chunk_->switchTable(tableIndex).fallback = start;
+            } else {
+                patchJump(caseJumps.back());
+            }
+        } else if (tableIndex >= 0) {
+            // Only the first of duplicate labels is reachable
+            SwitchTable& table = chunk_->switchTable(tableIndex);
+            int32_t value;
+            if (intTable && integerCase(c.match.get(), &value)) {
+                uint32_t& slot = table.ints[static_cast<size_t>(value - low)];
+                if (slot == UINT32_MAX) slot = start;
+            } else if (auto* literal = stringCase(c.match.get())) {
+                table.strings.emplace(StringPool::intern(literal->stringValue).data(), start);
+            }
+        } else {
+            patchJump(caseJumps[i]);
+        }
+        beginScope();
+        for (const auto& bodyStmt : c.body) {
+            setCurrentToken(bodyStmt->token);
+            bodyStmt->accept(*this);
+        }
+        endScope();
+    }
+    if (tableIndex >= 0) {
+        SwitchTable& table = chunk_->switchTable(tableIndex);
+        auto end = static_cast<uint32_t>(chunk_->size());
+        if (defaultCase < 0) table.fallback = end;
+        for (auto& slot : table.ints) {
+            if (slot == UINT32_MAX) slot = table.fallback;
+        }
+    } else if (defaultCase < 0) {
+        patchJump(caseJumps.back());
+    }
+    endBreakable();
+    endScope();
+}
+
+// Emits the comparisons of a switch that has no table. caseJumps gets the
+// jump to each case body by case index, and a final jump taken when no
+// label matches, to the default case or past the switch.
+void Compiler::compileSwitchChain(SwitchStmt* stmt, std::vector<int>& caseJumps) {
+    auto slot = static_cast<uint8_t>(locals_.size() - 1);
+    caseJumps.assign(stmt->cases.size(), -1);
+    for (size_t i = 0; i < stmt->cases.size(); i++) {
+        const auto& c = stmt->cases[i];
+        if (c.isDefault) continue;
+        emitOp(OpCode::GetLocal);
+        emitByte(slot);
+        c.match->accept(*this);
+        emitOp(OpCode::Equal);
+        int next = emitJump(OpCode::JumpIfFalse);
+        emitOp(OpCode::Pop);
+        caseJumps[i] = emitJump(OpCode::Jump);
+        patchJump(next);
+        emitOp(OpCode::Pop);
+    }
+    caseJumps.push_back(emitJump(OpCode::Jump));
+}
+
+// Private helpers
+
+void Compiler::beginBreakable() {
+    breakTargets_.push_back({locals_.size(), {}});
+}
+
+void Compiler::endBreakable() {
+    for (int jump : breakTargets_.back().jumps) patchJump(jump);
+    breakTargets_.pop_back();
+}
+
+// Compiles stmt into a closure left on the stack. Slot 0 holds the callee
+// under slotZero: the function's own name, or this for methods.
+void Compiler::compileFunction(FnStmt* stmt, std::string_view slotZero, bool initializer, bool scoped) {
     Compiler functionCompiler(this);
     functionCompiler.chunk_ = std::make_unique<Chunk>();
+    functionCompiler.initializer_ = initializer;
     functionCompiler.beginScope();
-    functionCompiler.addLocal(stmt->name);
+    functionCompiler.addLocal(slotZero);
 
     for (const auto& param : stmt->parameters) {
         functionCompiler.addLocal(param);
     }
 
-    for (const auto& bodyStmt : stmt->body) {
-        functionCompiler.currentLine_ = bodyStmt->token.line;
-        bodyStmt->accept(functionCompiler);
-    }
+    compileBody(functionCompiler, stmt->body);
 
-    functionCompiler.emitOp(OpCode::Nil);
+    if (initializer) {
+        functionCompiler.emitOp(OpCode::GetLocal);
+        functionCompiler.emitByte(0);
+    } else {
+        functionCompiler.emitOp(OpCode::Nil);
+    }
     functionCompiler.emitOp(OpCode::Return);
 
     auto function = std::make_shared<VMFunction>();
     function->name = stmt->name;
+    function->line = stmt->token.line;
     function->arity = static_cast<int>(stmt->parameters.size());
+    functionCompiler.chunk_->setMaxStackDepth(computeMaxStackDepth(*functionCompiler.chunk_, function->arity + 1));
     function->upvalueCount = static_cast<int>(functionCompiler.upvalues_.size());
     function->chunk = std::move(functionCompiler.chunk_);
 
-    emitOp(OpCode::Closure);
-    emitByte(makeConstant(vmFunctionValue(function)));
+    emitClosure(function, functionCompiler, scoped);
+}
 
-    for (const auto& upvalue : functionCompiler.upvalues_) {
-        emitByte(upvalue.isLocal ? 1 : 0);
-        emitByte(upvalue.index);
+void Compiler::compileBody(Compiler& functionCompiler, const std::vector<StmtPtr>& body) {
+    if (escapeAnalysisEnabled_) functionCompiler.scopedDecls_ = findScopedDecls(body);
+    functionCompiler.body_ = &body;
+    for (const auto& stmt : body) {
+        functionCompiler.setCurrentToken(stmt->token);
+        stmt->accept(functionCompiler);
     }
+}
 
-    std::string_view name = stmt->token.lexeme;
-    if (scopeDepth_ > 0) {
-        addLocal(name);
+// Closure, ScopedClosure for one that never leaves the scope declaring it,
+// or ScopedCallback for an argument callbackDepth slots above its callee,
+// followed by an (isLocal, index) pair per upvalue
+void Compiler::emitClosure(const std::shared_ptr<VMFunction>& function, const Compiler& functionCompiler,
+                           bool scoped, int callbackDepth) {
+    if (callbackDepth > 0) {
+        emitOp(OpCode::ScopedCallback);
+        emitByte(makeConstant(vmFunctionValue(function)));
+        emitByte(static_cast<uint8_t>(callbackDepth));
     } else {
-        emitOp(OpCode::DefineGlobal);
-        auto sv = StringPool::intern(name);
-        emitByte(makeConstant(stringValue(sv.data())));
+        emitOp(scoped ? OpCode::ScopedClosure : OpCode::Closure);
+        emitByte(makeConstant(vmFunctionValue(function)));
+    }
+
+    for (const auto& upvalue : functionCompiler.upvalues_) {
+        emitByte(upvalue.isLocal ? 1 : 0);
+        emitByte(upvalue.index);
     }
 }
-void Compiler::visitReturnStmt(ReturnStmt* stmt) {
-    if (stmt->value) {
-        stmt->value->accept(*this);
+
+void Compiler::emitLocalPop(const Local& local) {
+    if (local.isCaptured) {
+        emitOp(OpCode::CloseUpvalue);
+    } else if (local.scoped) {
+        emitOp(OpCode::ReleaseScoped);
     } else {
-        emitOp(OpCode::Nil);
+        emitOp(OpCode::Pop);
     }
-    emitOp(OpCode::Return);
 }
-void Compiler::visitBreakStmt(BreakStmt*) {}
-void Compiler::visitContinueStmt(ContinueStmt*) {}
-void Compiler::visitTryStmt(TryStmt*) {}
-void Compiler::visitThrowStmt(ThrowStmt*) {}
-void Compiler::visitImportStmt(ImportStmt*) {}
-void Compiler::visitClassStmt(ClassStmt*) {}
-void Compiler::visitSwitchStmt(SwitchStmt*) {}
 
-// Private helpers
+// Code emitted from here on is reported at token's position
+void Compiler::setCurrentToken(const Token& token) {
+    currentLine_ = token.line;
+    currentColumn_ = token.column;
+}
 
 void Compiler::emitByte(uint8_t byte) {
-    chunk_->write(byte, currentLine_);
+    chunk_->write(byte, currentLine_, currentColumn_);
 }
 
 void Compiler::emitBytes(uint8_t byte1, uint8_t byte2) {
@@ -731,11 +1187,34 @@ void Compiler::patchJump(int offset) {
 void Compiler::emitLoop(int loopStart) {
     emitOp(OpCode::Loop);
 
-    int offset = static_cast<int>(chunk_->size() - loopStart + 2);
+    // The offset is applied after both the offset and the cache slot operands are read.
+    int offset = static_cast<int>(chunk_->size() - loopStart + 4);
     if (offset > UINT16_MAX) error(Token(TokenType::Error, "", currentLine_), "Loop body too large.");
 
     emitByte((offset >> 8) & 0xff);
     emitByte(offset & 0xff);
+    emitCacheSlot(CacheKind::Loop);
+}
+
+void Compiler::emitGlobal(OpCode op, std::string_view name) {
+    int slot = GlobalTable::getInstance().resolve(name);
+    if (slot > UINT16_MAX) {
+        error(Token(TokenType::Error, "", currentLine_), "Too many global variables.");
+        slot = 0;
+    }
+    emitOp(op);
+    emitByte((slot >> 8) & 0xff);
+    emitByte(slot & 0xff);
+}
+
+void Compiler::emitCacheSlot(CacheKind kind) {
+    int slot = chunk_->addCacheSlot(kind);
+    if (slot > UINT16_MAX) {
+        error(Token(TokenType::Error, "", currentLine_), "Too many inline cache sites in one function.");
+        slot = 0;
+    }
+    emitByte((slot >> 8) & 0xff);
+    emitByte(slot & 0xff);
 }
 
 void Compiler::beginScope() {
@@ -746,11 +1225,7 @@ void Compiler::endScope() {
     scopeDepth_--;
     
     while (!locals_.empty() && locals_.back().depth > scopeDepth_) {
-        if (locals_.back().isCaptured) {
-            emitOp(OpCode::CloseUpvalue);
-        } else {
-            emitOp(OpCode::Pop);
-        }
+        emitLocalPop(locals_.back());
         locals_.pop_back();
     }
 }
@@ -777,6 +1252,7 @@ void Compiler::addLocal(std::string_view name) {
     local.name = name;
     local.depth = scopeDepth_;
     local.isCaptured = false;
+    local.scoped = false;
     locals_.push_back(local);
 }
 
@@ -823,6 +1299,13 @@ int Compiler::addUpvalue(uint8_t index, bool isLocal) {
     return static_cast<int>(upvalues_.size() - 1);
 }
 
+// Marks the top-level statement being compiled as one the VM cannot run
+void Compiler::unsupported() {
+    Compiler* root = this;
+    while (root->enclosing_) root = root->enclosing_;
+    root->unsupported_ = true;
+}
+
 void Compiler::error(Token token, const std::string& message) {
     std::cerr << "[line " << token.line << "] Error: " << message << std::endl;
 }
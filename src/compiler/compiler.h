@@ -2,6 +2,10 @@
 #include "parser/ast.h"
 #include "parser/stmt.h"
 #include "vm/chunk.h"
+#include "peephole.h"
+#include "ir.h"
+#include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace claw {
@@ -17,6 +21,30 @@ public:
 
     std::unique_ptr<Chunk> compile(const std::vector<StmtPtr>& program);
 
+    // Superinstruction fusion after compile(); on by default
+    void setPeepholeEnabled(bool enabled) { peepholeEnabled_ = enabled; }
+    const PeepholeStats& peepholeStats() const { return peepholeStats_; }
+
+    // With fallback on, a top-level statement using anything the VM cannot
+    // run compiles to one Interpret instruction that hands it to the
+    // interpreter. The program must outlive the chunk. Off by default.
+    void setFallbackEnabled(bool enabled) { fallbackEnabled_ = enabled; }
+    int fallbackCount() const { return fallbackCount_; }
+
+    // Local functions and array literals that escape analysis proves never
+    // leave their scope compile to ScopedClosure/CallScoped and ScopedArray,
+    // and function literals passed to a call to ScopedCallback, and live in
+    // the VM's frame region instead of the heap. On by default; nested
+    // compilers inherit it.
+    void setEscapeAnalysisEnabled(bool enabled) { escapeAnalysisEnabled_ = enabled; }
+
+    // Outermost loops go through the loop-region IR (ir.h) for common
+    // subexpression elimination, copy propagation, dead store elimination
+    // and loop-invariant code motion. On by default; nested compilers
+    // inherit it and add their counts to the outermost one's.
+    void setLoopIREnabled(bool enabled) { loopIREnabled_ = enabled; }
+    const IRStats& irStats() const { return irStats_; }
+
     // ExprVisitor implementation
     Value visitLiteralExpr(LiteralExpr* expr) override;
     Value visitVariableExpr(VariableExpr* expr) override;
@@ -63,16 +91,26 @@ public:
     void visitSwitchStmt(SwitchStmt* stmt) override;
 
 private:
+    friend class LoopIR;
+
     struct Local {
         std::string_view name;
         int depth;
         bool isCaptured;
+        bool scoped; // holds a ScopedClosure or ScopedArray; released instead of popped
     };
     struct Upvalue {
         uint8_t index;
         bool isLocal;
     };
+    // Innermost loop or switch; break pops the locals above localCount and
+    // jumps to the end, patched once the statement is compiled
+    struct BreakTarget {
+        size_t localCount;
+        std::vector<int> jumps;
+    };
 
+    void setCurrentToken(const Token& token);
     void emitByte(uint8_t byte);
     void emitBytes(uint8_t byte1, uint8_t byte2);
     void emitOp(OpCode op);
@@ -82,6 +120,25 @@ private:
     int emitJump(OpCode instruction);
     void patchJump(int offset);
     void emitLoop(int loopStart);
+    void emitCacheSlot(CacheKind kind);
+    void emitGlobal(OpCode op, std::string_view name);
+    void namedVariable(std::string_view name);
+    void setNamedVariable(std::string_view name);
+    bool isProgramGlobal(std::string_view name);
+    void compileFunction(FnStmt* stmt, std::string_view slotZero, bool initializer, bool scoped);
+    void compileBody(Compiler& functionCompiler, const std::vector<StmtPtr>& body);
+    void emitClosure(const std::shared_ptr<VMFunction>& function, const Compiler& functionCompiler, bool scoped,
+                     int callbackDepth = 0);
+    void emitArray(ArrayExpr* expr, OpCode op);
+    bool passesCallbacks(CallExpr* expr) const;
+    void compileArguments(const std::vector<ExprPtr>& arguments, bool callbacks);
+    void emitLocalPop(const Local& local);
+    void beginBreakable();
+    void endBreakable();
+    void compileSwitchChain(SwitchStmt* stmt, std::vector<int>& caseJumps);
+    int unrollCount(ForStmt* stmt) const;
+    bool compileLoopIR(Stmt* loop);
+    const std::unordered_set<std::string>& capturedNames();
 
     void beginScope();
     void endScope();
@@ -90,15 +147,35 @@ private:
     int resolveUpvalue(std::string_view name);
     int addUpvalue(uint8_t index, bool isLocal);
 
+    void unsupported();
     void error(Token token, const std::string& message);
 
     std::unique_ptr<Chunk> chunk_;
     int currentLine_;
+    int currentColumn_ = 0;
     
     std::vector<Local> locals_;
     std::vector<Upvalue> upvalues_;
+    std::vector<BreakTarget> breakTargets_;
     int scopeDepth_;
     Compiler* enclosing_;
+    bool initializer_ = false; // compiling a class init, which always returns this
+    bool peepholeEnabled_ = true;
+    bool escapeAnalysisEnabled_ = true;
+    bool scopedClosure_ = false; // the next FunctionExpr is a scoped let initializer
+    int callbackDepth_ = 0; // or, if set, a call's argument this far above the callee
+    std::unordered_set<const Stmt*> scopedDecls_;
+    bool fallbackEnabled_ = false;
+    bool unsupported_ = false; // set on the outermost compiler
+    int fallbackCount_ = 0;
+    PeepholeStats peepholeStats_;
+    bool loopIREnabled_ = true;
+    bool loweringIR_ = false; // loops inside a region's opaque statements stay as they are
+    const std::vector<StmtPtr>* body_ = nullptr;
+    std::unique_ptr<std::unordered_set<std::string>> capturedNames_; // built on first use
+    std::unordered_set<std::string> definedGlobals_; // by top-level statements compiled so far
+    std::unordered_set<std::string> programGlobals_; // by any top-level statement of the program
+    IRStats irStats_;
 };
 
 } // namespace claw
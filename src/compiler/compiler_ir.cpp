@@ -0,0 +1,680 @@
+#include "compiler.h"
+#include "escape.h"
+#include "features/string_pool.h"
+#include "vm/global_table.h"
+#include <algorithm>
+
+namespace claw {
+
+// Builds the IR of one loop from the AST and lowers the optimized IR back
+// into the compiler's chunk, through the compiler's own emitters and scope
+// bookkeeping.
+class LoopIR {
+public:
+    explicit LoopIR(Compiler& compiler) : c_(compiler), depth_(compiler.scopeDepth_) {}
+
+    bool compile(Stmt* loop);
+
+private:
+    // Building
+    void buildStmt(Stmt* stmt, std::vector<IRStmt>& out);
+    IRStmt buildLoop(Stmt* stmt);
+    int buildExpr(Expr* expr);
+    int buildUpdate(UpdateExpr* expr);
+    int buildResult(Expr* expr);
+    int add(IROp op, std::vector<int> args = {});
+    int opaque(Expr* expr);
+    int at(int value, const Token& token);
+    IRStmt opaqueStmt(Stmt* stmt, std::string_view declares = {}, bool scoped = false);
+    int declare(std::string_view name);
+    IRVar resolve(std::string_view name);
+    int load(const IRVar& var);
+    int store(const IRVar& var, int value);
+
+    // Lowering
+    void lowerStmt(const IRStmt& stmt);
+    void lowerLoop(const IRStmt& stmt);
+    void lowerPasses(const IRStmt& stmt);
+    void lowerValue(int value);
+    void emitInst(int value);
+    void emitTemp(OpCode op, int value);
+    bool inUncheckedCopy(int loop) const;
+    bool unchecked(const IRInst& inst) const;
+    int slotOf(const IRVar& var);
+
+    Compiler& c_;
+    IRRegion region_;
+    std::vector<std::pair<std::string_view, int>> names_; // region locals in scope
+    int depth_;
+    int loop_ = -1;
+    bool abort_ = false;
+    std::vector<int> slots_;     // of region locals, once declared
+    std::vector<int> tempSlots_;
+    int steadyLoop_ = -1;        // loop whose test after a pass is being emitted
+    std::vector<int> uncheckedCopies_; // guarded loops whose unchecked copy is being emitted
+};
+
+bool LoopIR::compile(Stmt* loop) {
+    std::vector<IRStmt> top;
+    buildStmt(loop, top);
+    if (abort_ || top.size() != 1 || top[0].kind != IRStmt::Kind::Loop) return false;
+    region_.root = std::move(top[0]);
+
+    IRStats stats = optimizeRegion(region_);
+    // Nothing gained: the AST compiler emits the loop as it always has.
+    // Loops are emitted with their test twice, so leave headroom for the
+    // constants the copy adds.
+    if (stats.total() == 0) return false;
+    if (c_.locals_.size() + region_.temps + region_.locals.size() > 255) return false;
+    if (c_.chunk_->constants().size() > 192) return false;
+
+    c_.beginScope();
+    for (int i = 0; i < region_.temps; i++) {
+        c_.addLocal("$ir" + std::to_string(i));
+        tempSlots_.push_back(static_cast<int>(c_.locals_.size() - 1));
+        c_.emitOp(OpCode::Nil);
+    }
+    slots_.assign(region_.locals.size(), -1);
+    c_.loweringIR_ = true;
+    lowerStmt(region_.root);
+    c_.loweringIR_ = false;
+    c_.endScope();
+
+    Compiler* root = &c_;
+    while (root->enclosing_) root = root->enclosing_;
+    root->irStats_ += stats;
+    return true;
+}
+
+// Building
+
+void LoopIR::buildStmt(Stmt* stmt, std::vector<IRStmt>& out) {
+    if (auto* s = dynamic_cast<ExprStmt*>(stmt)) {
+        IRStmt eval;
+        eval.kind = IRStmt::Kind::Eval;
+        eval.value = buildResult(s->expr.get());
+        out.push_back(std::move(eval));
+    } else if (auto* s = dynamic_cast<PrintStmt*>(stmt)) {
+        IRStmt print;
+        print.kind = IRStmt::Kind::Print;
+        print.value = buildExpr(s->expr.get());
+        out.push_back(std::move(print));
+    } else if (auto* s = dynamic_cast<LetStmt*>(stmt)) {
+        // A let directly in a top-level loop body defines a global
+        if (depth_ == 0) abort_ = true;
+        // Functions, and arrays built in the frame region, are declared by visitLetStmt
+        if (dynamic_cast<FunctionExpr*>(s->initializer.get()) || c_.scopedDecls_.count(stmt)) {
+            out.push_back(opaqueStmt(stmt, s->token.lexeme, c_.scopedDecls_.count(stmt) > 0));
+            return;
+        }
+        IRStmt let;
+        let.kind = IRStmt::Kind::Let;
+        // Declared before its initializer runs, as visitLetStmt does
+        let.local = declare(s->token.lexeme);
+        if (s->initializer) let.value = buildExpr(s->initializer.get());
+        out.push_back(std::move(let));
+    } else if (auto* s = dynamic_cast<BlockStmt*>(stmt)) {
+        IRStmt block;
+        block.kind = IRStmt::Kind::Block;
+        size_t mark = names_.size();
+        depth_++;
+        for (const auto& inner : s->statements) buildStmt(inner.get(), block.body);
+        depth_--;
+        names_.resize(mark);
+        out.push_back(std::move(block));
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt)) {
+        IRStmt branch;
+        branch.kind = IRStmt::Kind::If;
+        branch.value = buildExpr(s->condition.get());
+        buildStmt(s->thenBranch.get(), branch.body);
+        if (s->elseBranch) buildStmt(s->elseBranch.get(), branch.orElse);
+        out.push_back(std::move(branch));
+    } else if (dynamic_cast<WhileStmt*>(stmt)) {
+        out.push_back(buildLoop(stmt));
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt)) {
+        out.push_back(c_.unrollCount(s) > 0 ? opaqueStmt(stmt) : buildLoop(stmt));
+    } else if (dynamic_cast<BreakStmt*>(stmt)) {
+        IRStmt exit;
+        exit.kind = IRStmt::Kind::Break;
+        exit.stmt = stmt;
+        out.push_back(std::move(exit));
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt)) {
+        if (c_.initializer_) {
+            out.push_back(opaqueStmt(stmt));
+            return;
+        }
+        IRStmt ret;
+        ret.kind = IRStmt::Kind::Return;
+        if (s->value) ret.value = buildExpr(s->value.get());
+        out.push_back(std::move(ret));
+    } else if (dynamic_cast<FnStmt*>(stmt)) {
+        if (depth_ == 0) abort_ = true;
+        out.push_back(opaqueStmt(stmt, stmt->token.lexeme, c_.scopedDecls_.count(stmt) > 0));
+    } else if (dynamic_cast<ClassStmt*>(stmt)) {
+        if (depth_ == 0) abort_ = true;
+        out.push_back(opaqueStmt(stmt, stmt->token.lexeme));
+    } else {
+        out.push_back(opaqueStmt(stmt));
+    }
+}
+
+IRStmt LoopIR::buildLoop(Stmt* stmt) {
+    IRStmt loop;
+    loop.kind = IRStmt::Kind::Loop;
+    loop.loop = static_cast<int>(region_.loops.size());
+    region_.loops.push_back(IRLoop{loop_, false, false, {}});
+    size_t mark = names_.size();
+    Expr* condition = nullptr;
+    Stmt* body = nullptr;
+    Expr* increment = nullptr;
+    if (auto* s = dynamic_cast<WhileStmt*>(stmt)) {
+        condition = s->condition.get();
+        body = s->body.get();
+    } else {
+        auto* f = static_cast<ForStmt*>(stmt);
+        loop.scoped = true;
+        depth_++;
+        if (f->initializer) buildStmt(f->initializer.get(), loop.init);
+        condition = f->condition.get();
+        body = f->body.get();
+        increment = f->increment.get();
+    }
+    int outer = loop_;
+    loop_ = loop.loop;
+    if (condition) loop.value = buildExpr(condition);
+    buildStmt(body, loop.body);
+    if (increment) loop.increment = buildResult(increment);
+    loop_ = outer;
+    if (loop.scoped) depth_--;
+    names_.resize(mark);
+    return loop;
+}
+
+// An expression whose value is dropped: x++ needs no copy of the old value
+int LoopIR::buildResult(Expr* expr) {
+    if (auto* update = dynamic_cast<UpdateExpr*>(expr)) return buildUpdate(update);
+    return buildExpr(expr);
+}
+
+int LoopIR::buildUpdate(UpdateExpr* expr) {
+    IRVar var = resolve(expr->name);
+    int one = add(IROp::Const);
+    region_.insts[one].constant = intValue(1);
+    int value = at(add(IROp::Binary, {at(load(var), expr->token), one}), expr->op);
+    region_.insts[value].opcode = expr->op.type == TokenType::PlusPlus ? OpCode::Add : OpCode::Subtract;
+    return store(var, value);
+}
+
+int LoopIR::buildExpr(Expr* expr) {
+    if (auto* e = dynamic_cast<LiteralExpr*>(expr)) {
+        int value = add(IROp::Const);
+        Value& constant = region_.insts[value].constant;
+        switch (e->type) {
+            case LiteralExpr::Type::Number: constant = compactNumberValue(e->numberValue); break;
+            case LiteralExpr::Type::String:
+                constant = internedStringValue(e->stringValue);
+                break;
+            case LiteralExpr::Type::Bool: constant = boolValue(e->boolValue); break;
+            case LiteralExpr::Type::Nil: constant = nilValue(); break;
+        }
+        return value;
+    }
+    if (auto* e = dynamic_cast<GroupingExpr*>(expr)) return buildExpr(e->expr.get());
+    if (auto* e = dynamic_cast<VariableExpr*>(expr)) return at(load(resolve(e->token.lexeme)), e->token);
+    if (auto* e = dynamic_cast<AssignExpr*>(expr)) {
+        int value = buildExpr(e->value.get());
+        IRVar var = resolve(e->token.lexeme);
+        // Loop bodies are blocks: see Compiler::isProgramGlobal
+        if (var.kind == IRVar::Kind::Global && !c_.isProgramGlobal(var.name)) c_.unsupported();
+        return store(var, value);
+    }
+    if (auto* e = dynamic_cast<BinaryExpr*>(expr)) {
+        OpCode opcode;
+        bool negate = false;
+        switch (e->op.type) {
+            case TokenType::Plus:         opcode = OpCode::Add; break;
+            case TokenType::Minus:        opcode = OpCode::Subtract; break;
+            case TokenType::Star:         opcode = OpCode::Multiply; break;
+            case TokenType::Slash:        opcode = OpCode::Divide; break;
+            case TokenType::BitAnd:       opcode = OpCode::BitAnd; break;
+            case TokenType::BitOr:        opcode = OpCode::BitOr; break;
+            case TokenType::BitXor:       opcode = OpCode::BitXor; break;
+            case TokenType::ShiftLeft:    opcode = OpCode::ShiftLeft; break;
+            case TokenType::ShiftRight:   opcode = OpCode::ShiftRight; break;
+            case TokenType::Greater:      opcode = OpCode::Greater; break;
+            case TokenType::GreaterEqual: opcode = OpCode::Less; negate = true; break;
+            case TokenType::Less:         opcode = OpCode::Less; break;
+            case TokenType::LessEqual:    opcode = OpCode::Greater; negate = true; break;
+            case TokenType::EqualEqual:   opcode = OpCode::Equal; break;
+            case TokenType::BangEqual:    opcode = OpCode::Equal; negate = true; break;
+            default: return opaque(expr);
+        }
+        int left = buildExpr(e->left.get());
+        int right = buildExpr(e->right.get());
+        int value = at(add(IROp::Binary, {left, right}), e->op);
+        region_.insts[value].opcode = opcode;
+        region_.insts[value].negate = negate;
+        return value;
+    }
+    if (auto* e = dynamic_cast<UnaryExpr*>(expr)) {
+        if (e->op.type != TokenType::Minus && e->op.type != TokenType::Bang) return opaque(expr);
+        int value = at(add(IROp::Unary, {buildExpr(e->right.get())}), e->op);
+        region_.insts[value].opcode = e->op.type == TokenType::Minus ? OpCode::Negate : OpCode::Not;
+        return value;
+    }
+    if (auto* e = dynamic_cast<CallExpr*>(expr)) {
+        // Scoped closures and calls passing ScopedCallbacks have their own
+        // code in visitCallExpr
+        if (c_.passesCallbacks(e)) return opaque(expr);
+        if (auto* callee = dynamic_cast<VariableExpr*>(e->callee.get())) {
+            IRVar var = resolve(callee->token.lexeme);
+            if (var.kind == IRVar::Kind::RegionLocal && region_.locals[var.index].scoped) return opaque(expr);
+            if (var.kind == IRVar::Kind::Local && c_.locals_[var.index].scoped) return opaque(expr);
+        } else if (dynamic_cast<SuperExpr*>(e->callee.get())) {
+            return opaque(expr);
+        }
+        std::vector<int> args;
+        IROp op = IROp::Call;
+        Value name = nilValue();
+        const Token* token = &e->token;
+        if (auto* member = dynamic_cast<MemberExpr*>(e->callee.get())) {
+            op = IROp::Invoke;
+            token = &member->token;
+            name = internedStringValue(member->member);
+            args.push_back(buildExpr(member->object.get()));
+        } else {
+            args.push_back(buildExpr(e->callee.get()));
+        }
+        for (const auto& argument : e->arguments) args.push_back(buildExpr(argument.get()));
+        int value = at(add(op, std::move(args)), *token);
+        region_.insts[value].constant = name;
+        if (op == IROp::Invoke) region_.insts[value].callToken = &e->token;
+        return value;
+    }
+    if (auto* e = dynamic_cast<IndexExpr*>(expr)) {
+        int object = buildExpr(e->object.get());
+        return at(add(IROp::GetIndex, {object, buildExpr(e->index.get())}), e->token);
+    }
+    if (auto* e = dynamic_cast<IndexAssignExpr*>(expr)) {
+        int object = buildExpr(e->object.get());
+        int index = buildExpr(e->index.get());
+        return at(add(IROp::SetIndex, {object, index, buildExpr(e->value.get())}), e->token);
+    }
+    if (auto* e = dynamic_cast<MemberExpr*>(expr)) {
+        int object = buildExpr(e->object.get());
+        int value = at(add(e->member == "length" ? IROp::Length : IROp::GetProperty, {object}), e->token);
+        region_.insts[value].constant = internedStringValue(e->member);
+        return value;
+    }
+    if (auto* e = dynamic_cast<SetExpr*>(expr)) {
+        int object = buildExpr(e->object.get());
+        int value = at(add(IROp::SetProperty, {object, buildExpr(e->value.get())}), e->token);
+        region_.insts[value].constant = internedStringValue(e->member);
+        return value;
+    }
+    return opaque(expr);
+}
+
+int LoopIR::add(IROp op, std::vector<int> args) {
+    IRInst inst;
+    inst.op = op;
+    inst.args = std::move(args);
+    inst.loop = loop_;
+    return region_.add(std::move(inst));
+}
+
+// Marks where an error in value is reported, as the interpreter would
+int LoopIR::at(int value, const Token& token) {
+    region_.insts[value].token = &token;
+    return value;
+}
+
+int LoopIR::opaque(Expr* expr) {
+    collectNames(expr, region_.opaqueNames);
+    int value = add(IROp::Opaque);
+    region_.insts[value].expr = expr;
+    return value;
+}
+
+IRStmt LoopIR::opaqueStmt(Stmt* stmt, std::string_view declares, bool scoped) {
+    collectNames(stmt, region_.opaqueNames);
+    IRStmt opaque;
+    opaque.kind = IRStmt::Kind::Opaque;
+    opaque.stmt = stmt;
+    if (!declares.empty()) {
+        int local = declare(declares);
+        region_.locals[local].scoped = scoped;
+        opaque.declares.push_back(local);
+    }
+    return opaque;
+}
+
+int LoopIR::declare(std::string_view name) {
+    IRLocal local;
+    local.name = StringPool::intern(name);
+    local.captured = c_.capturedNames().count(std::string(name)) > 0;
+    region_.locals.push_back(local);
+    int index = static_cast<int>(region_.locals.size() - 1);
+    names_.push_back({local.name, index});
+    return index;
+}
+
+IRVar LoopIR::resolve(std::string_view name) {
+    IRVar var;
+    var.name = StringPool::intern(name);
+    for (auto it = names_.rbegin(); it != names_.rend(); ++it) {
+        if (it->first.data() == var.name.data()) {
+            var.kind = IRVar::Kind::RegionLocal;
+            var.index = it->second;
+            var.captured = region_.locals[it->second].captured;
+            return var;
+        }
+    }
+    int slot = c_.resolveLocal(name);
+    if (slot != -1) {
+        var.kind = IRVar::Kind::Local;
+        var.index = slot;
+        var.captured = c_.locals_[slot].isCaptured || c_.capturedNames().count(std::string(name)) > 0;
+        return var;
+    }
+    int upvalue = c_.resolveUpvalue(name);
+    if (upvalue != -1) {
+        var.kind = IRVar::Kind::Upvalue;
+        var.index = upvalue;
+        return var;
+    }
+    var.kind = IRVar::Kind::Global;
+    var.index = GlobalTable::getInstance().resolve(name);
+    Compiler* root = &c_;
+    while (root->enclosing_) root = root->enclosing_;
+    var.bound = root->definedGlobals_.count(std::string(name)) > 0;
+    return var;
+}
+
+int LoopIR::load(const IRVar& var) {
+    IROp op = var.kind == IRVar::Kind::Upvalue  ? IROp::LoadUpvalue
+              : var.kind == IRVar::Kind::Global ? IROp::LoadGlobal
+                                                : IROp::LoadLocal;
+    int value = add(op);
+    region_.insts[value].var = var;
+    return value;
+}
+
+int LoopIR::store(const IRVar& var, int stored) {
+    IROp op = var.kind == IRVar::Kind::Upvalue  ? IROp::StoreUpvalue
+              : var.kind == IRVar::Kind::Global ? IROp::StoreGlobal
+                                                : IROp::StoreLocal;
+    int value = add(op, {stored});
+    region_.insts[value].var = var;
+    return value;
+}
+
+// Lowering
+
+void LoopIR::lowerStmt(const IRStmt& stmt) {
+    switch (stmt.kind) {
+        case IRStmt::Kind::Eval:
+            if (stmt.value < 0) return;
+            lowerValue(stmt.value);
+            c_.emitOp(OpCode::Pop);
+            break;
+        case IRStmt::Kind::Print:
+            lowerValue(stmt.value);
+            c_.emitOp(OpCode::Print);
+            break;
+        case IRStmt::Kind::Return:
+            if (stmt.value >= 0) {
+                lowerValue(stmt.value);
+            } else {
+                c_.emitOp(OpCode::Nil);
+            }
+            c_.emitOp(OpCode::Return);
+            break;
+        case IRStmt::Kind::Let: {
+            c_.addLocal(region_.locals[stmt.local].name);
+            int slot = static_cast<int>(c_.locals_.size() - 1);
+            slots_[stmt.local] = slot;
+            c_.emitOp(OpCode::Nil);
+            if (stmt.value >= 0) {
+                lowerValue(stmt.value);
+                if (stmt.dead) {
+                    c_.emitOp(OpCode::Pop);
+                } else {
+                    c_.emitOp(OpCode::SetLocal);
+                    c_.emitByte(static_cast<uint8_t>(slot));
+                    c_.emitOp(OpCode::Pop);
+                }
+            }
+            break;
+        }
+        case IRStmt::Kind::Block:
+            c_.beginScope();
+            for (const auto& s : stmt.body) lowerStmt(s);
+            c_.endScope();
+            break;
+        case IRStmt::Kind::If: {
+            lowerValue(stmt.value);
+            int thenJump = c_.emitJump(OpCode::JumpIfFalse);
+            c_.emitOp(OpCode::Pop);
+            for (const auto& s : stmt.body) lowerStmt(s);
+            int elseJump = c_.emitJump(OpCode::Jump);
+            c_.patchJump(thenJump);
+            c_.emitOp(OpCode::Pop);
+            for (const auto& s : stmt.orElse) lowerStmt(s);
+            c_.patchJump(elseJump);
+            break;
+        }
+        case IRStmt::Kind::Loop:
+            lowerLoop(stmt);
+            break;
+        case IRStmt::Kind::Break:
+            c_.visitBreakStmt(static_cast<BreakStmt*>(stmt.stmt));
+            break;
+        case IRStmt::Kind::Opaque:
+            stmt.stmt->accept(c_);
+            for (int local : stmt.declares) slots_[local] = c_.resolveLocal(region_.locals[local].name);
+            break;
+    }
+}
+
+// A guarded loop is emitted twice after its initializer: first the copy
+// whose array accesses skip their checks, entered when the array local
+// holds an array, then the copy as written.
+void LoopIR::lowerLoop(const IRStmt& stmt) {
+    const IRLoop& loop = region_.loops[stmt.loop];
+    if (stmt.scoped) c_.beginScope();
+    for (const auto& s : stmt.init) lowerStmt(s);
+    c_.beginBreakable();
+    int end = -1;
+    if (loop.guarded) {
+        c_.emitOp(OpCode::JumpIfNotArray);
+        c_.emitByte(static_cast<uint8_t>(slotOf(loop.array)));
+        c_.emitByte(0xff);
+        c_.emitByte(0xff);
+        int guard = static_cast<int>(c_.chunk_->size()) - 2;
+        uncheckedCopies_.push_back(stmt.loop);
+        lowerPasses(stmt);
+        uncheckedCopies_.pop_back();
+        end = c_.emitJump(OpCode::Jump);
+        c_.patchJump(guard);
+    }
+    lowerPasses(stmt);
+    if (end != -1) c_.patchJump(end);
+    c_.endBreakable();
+    if (stmt.scoped) c_.endScope();
+}
+
+// A loop with hoisted values is rotated: the first test and the code that
+// computes the hoisted values run once, and the loop jumps back to the
+// start of the body through a second copy of the test.
+void LoopIR::lowerPasses(const IRStmt& stmt) {
+    if (!region_.loops[stmt.loop].rotated) {
+        int loopStart = static_cast<int>(c_.chunk_->size());
+        int exitJump = -1;
+        if (stmt.value >= 0) {
+            lowerValue(stmt.value);
+            exitJump = c_.emitJump(OpCode::JumpIfFalse);
+            c_.emitOp(OpCode::Pop);
+        }
+        for (const auto& s : stmt.body) lowerStmt(s);
+        if (stmt.increment >= 0) {
+            lowerValue(stmt.increment);
+            c_.emitOp(OpCode::Pop);
+        }
+        c_.emitLoop(loopStart);
+        if (exitJump != -1) {
+            c_.patchJump(exitJump);
+            c_.emitOp(OpCode::Pop);
+        }
+    } else {
+        int firstExit = -1;
+        if (stmt.value >= 0) {
+            lowerValue(stmt.value);
+            firstExit = c_.emitJump(OpCode::JumpIfFalse);
+            c_.emitOp(OpCode::Pop);
+        }
+        for (int value : stmt.preheader) {
+            emitInst(value);
+            emitTemp(OpCode::SetLocal, value);
+            c_.emitOp(OpCode::Pop);
+        }
+        int bodyStart = static_cast<int>(c_.chunk_->size());
+        for (const auto& s : stmt.body) lowerStmt(s);
+        if (stmt.increment >= 0) {
+            lowerValue(stmt.increment);
+            c_.emitOp(OpCode::Pop);
+        }
+        if (stmt.value >= 0) {
+            int outer = steadyLoop_;
+            steadyLoop_ = stmt.loop;
+            lowerValue(stmt.value);
+            steadyLoop_ = outer;
+            int exitJump = c_.emitJump(OpCode::JumpIfFalse);
+            c_.emitOp(OpCode::Pop);
+            c_.emitLoop(bodyStart);
+            c_.patchJump(firstExit);
+            c_.patchJump(exitJump);
+            c_.emitOp(OpCode::Pop);
+        } else {
+            c_.emitLoop(bodyStart);
+        }
+    }
+}
+
+void LoopIR::lowerValue(int value) {
+    int source = region_.resolve(value);
+    const IRInst& inst = region_.insts[source];
+    bool steady = inst.hoistLoop == steadyLoop_ &&
+                  (inst.hoist == IRInst::Hoist::Cond ||
+                   (inst.hoist == IRInst::Hoist::Guarded && inUncheckedCopy(inst.hoistLoop)));
+    bool computed = source != value || inst.hoist == IRInst::Hoist::Preheader || steady;
+    if (computed) {
+        emitTemp(OpCode::GetLocal, source);
+        return;
+    }
+    emitInst(value);
+    if (inst.temp >= 0) emitTemp(OpCode::SetLocal, value);
+}
+
+void LoopIR::emitTemp(OpCode op, int value) {
+    c_.emitOp(op);
+    c_.emitByte(static_cast<uint8_t>(tempSlots_[region_.insts[value].temp]));
+}
+
+void LoopIR::emitInst(int value) {
+    const IRInst& inst = region_.insts[value];
+    for (int arg : inst.args) lowerValue(arg);
+    if (inst.token) c_.setCurrentToken(*inst.token);
+    switch (inst.op) {
+        case IROp::Const:
+            if (isNil(inst.constant)) {
+                c_.emitOp(OpCode::Nil);
+            } else if (isBool(inst.constant)) {
+                c_.emitOp(asBool(inst.constant) ? OpCode::True : OpCode::False);
+            } else {
+                c_.emitConstant(inst.constant);
+            }
+            break;
+        case IROp::LoadLocal:
+        case IROp::StoreLocal:
+            c_.emitOp(inst.op == IROp::LoadLocal ? OpCode::GetLocal : OpCode::SetLocal);
+            c_.emitByte(static_cast<uint8_t>(slotOf(inst.var)));
+            break;
+        case IROp::LoadUpvalue:
+        case IROp::StoreUpvalue:
+            c_.emitOp(inst.op == IROp::LoadUpvalue ? OpCode::GetUpvalue : OpCode::SetUpvalue);
+            c_.emitByte(static_cast<uint8_t>(inst.var.index));
+            break;
+        case IROp::LoadGlobal:
+        case IROp::StoreGlobal:
+            c_.emitGlobal(inst.op == IROp::LoadGlobal ? OpCode::GetGlobal : OpCode::SetGlobal, inst.var.name);
+            break;
+        case IROp::Binary:
+        case IROp::Unary:
+            c_.emitOp(inst.opcode);
+            if (inst.negate) c_.emitOp(OpCode::Not);
+            break;
+        case IROp::GetIndex:
+            c_.emitOp(unchecked(inst) ? OpCode::GetIndexUnchecked : OpCode::GetIndex);
+            break;
+        case IROp::SetIndex:
+            c_.emitOp(unchecked(inst) ? OpCode::SetIndexUnchecked : OpCode::SetIndex);
+            break;
+        case IROp::Length:
+        case IROp::GetProperty:
+            c_.emitOp(OpCode::GetProperty);
+            c_.emitByte(c_.makeConstant(inst.constant));
+            c_.emitCacheSlot(CacheKind::Property);
+            break;
+        case IROp::SetProperty:
+            c_.emitOp(OpCode::SetProperty);
+            c_.emitByte(c_.makeConstant(inst.constant));
+            break;
+        case IROp::Call:
+            c_.emitOp(OpCode::Call);
+            c_.emitByte(static_cast<uint8_t>(inst.args.size() - 1));
+            c_.emitCacheSlot(CacheKind::Call);
+            break;
+        case IROp::Invoke:
+            c_.emitOp(OpCode::Invoke);
+            c_.emitByte(c_.makeConstant(inst.constant));
+            c_.setCurrentToken(*inst.callToken);
+            c_.emitByte(static_cast<uint8_t>(inst.args.size() - 1));
+            c_.emitCacheSlot(CacheKind::Invoke);
+            break;
+        case IROp::Opaque:
+            inst.expr->accept(c_);
+            break;
+    }
+}
+
+bool LoopIR::inUncheckedCopy(int loop) const {
+    return std::find(uncheckedCopies_.begin(), uncheckedCopies_.end(), loop) != uncheckedCopies_.end();
+}
+
+bool LoopIR::unchecked(const IRInst& inst) const {
+    return inst.boundsLoop >= 0 && inUncheckedCopy(inst.boundsLoop);
+}
+
+int LoopIR::slotOf(const IRVar& var) {
+    if (var.kind == IRVar::Kind::Local) return var.index;
+    int slot = slots_[var.index];
+    return slot >= 0 ? slot : c_.resolveLocal(var.name);
+}
+
+// Compiler entry points
+
+bool Compiler::compileLoopIR(Stmt* loop) {
+    if (!loopIREnabled_ || loweringIR_) return false;
+    return LoopIR(*this).compile(loop);
+}
+
+const std::unordered_set<std::string>& Compiler::capturedNames() {
+    if (!capturedNames_) {
+        capturedNames_ = std::make_unique<std::unordered_set<std::string>>();
+        if (body_) *capturedNames_ = findCapturedNames(*body_);
+    }
+    return *capturedNames_;
+}
+
+} // namespace claw
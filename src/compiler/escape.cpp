@@ -0,0 +1,467 @@
+#include "escape.h"
+
+namespace claw {
+
+namespace {
+
+// Decides whether name escapes from the code it is run over. For a closure
+// only a direct call through the name, outside any nested function, keeps it
+// local; for an array, indexing it, assigning to one of its elements or
+// reading its length.
+class EscapeScanner : public ExprVisitor, public StmtVisitor {
+public:
+    EscapeScanner(const std::string& name, bool array) : name_(name), array_(array) {}
+
+    bool escapes() const { return escapes_; }
+
+    void scan(const std::vector<StmtPtr>& stmts) {
+        for (const auto& stmt : stmts) {
+            if (escapes_) return;
+            stmt->accept(*this);
+        }
+    }
+    void scanNested(const std::vector<StmtPtr>& stmts) {
+        nested_++;
+        scan(stmts);
+        nested_--;
+    }
+
+    Value visitLiteralExpr(LiteralExpr*) override { return nilValue(); }
+    Value visitVariableExpr(VariableExpr* expr) override {
+        mention(expr->name);
+        return nilValue();
+    }
+    Value visitUnaryExpr(UnaryExpr* expr) override { return visit(expr->right); }
+    Value visitBinaryExpr(BinaryExpr* expr) override {
+        visit(expr->left);
+        return visit(expr->right);
+    }
+    Value visitLogicalExpr(LogicalExpr* expr) override {
+        visit(expr->left);
+        return visit(expr->right);
+    }
+    Value visitGroupingExpr(GroupingExpr* expr) override { return visit(expr->expr); }
+    Value visitCallExpr(CallExpr* expr) override {
+        if (array_ || !named(expr->callee)) visit(expr->callee);
+        for (const auto& argument : expr->arguments) visit(argument);
+        return nilValue();
+    }
+    Value visitAssignExpr(AssignExpr* expr) override {
+        mention(expr->name);
+        return visit(expr->value);
+    }
+    Value visitCompoundAssignExpr(CompoundAssignExpr* expr) override {
+        mention(expr->name);
+        return visit(expr->value);
+    }
+    Value visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->value);
+    }
+    Value visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) override {
+        visitIndexed(expr->object);
+        visit(expr->index);
+        return visit(expr->value);
+    }
+    Value visitUpdateExpr(UpdateExpr* expr) override {
+        mention(expr->name);
+        return nilValue();
+    }
+    Value visitUpdateMemberExpr(UpdateMemberExpr* expr) override { return visit(expr->object); }
+    Value visitUpdateIndexExpr(UpdateIndexExpr* expr) override {
+        visitIndexed(expr->object);
+        return visit(expr->index);
+    }
+    Value visitTernaryExpr(TernaryExpr* expr) override {
+        visit(expr->condition);
+        visit(expr->thenBranch);
+        return visit(expr->elseBranch);
+    }
+    Value visitArrayExpr(ArrayExpr* expr) override {
+        for (const auto& element : expr->elements) visit(element);
+        return nilValue();
+    }
+    Value visitIndexExpr(IndexExpr* expr) override {
+        visitIndexed(expr->object);
+        return visit(expr->index);
+    }
+    Value visitIndexAssignExpr(IndexAssignExpr* expr) override {
+        visitIndexed(expr->object);
+        visit(expr->index);
+        return visit(expr->value);
+    }
+    Value visitHashMapExpr(HashMapExpr* expr) override {
+        for (const auto& [key, value] : expr->keyValuePairs) {
+            visit(key);
+            visit(value);
+        }
+        return nilValue();
+    }
+    Value visitMemberExpr(MemberExpr* expr) override {
+        if (array_ && expr->member == "length") return visitIndexed(expr->object);
+        return visit(expr->object);
+    }
+    Value visitSetExpr(SetExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->value);
+    }
+    Value visitThisExpr(ThisExpr*) override { return nilValue(); }
+    Value visitSuperExpr(SuperExpr*) override { return nilValue(); }
+    Value visitFunctionExpr(FunctionExpr* expr) override {
+        scanNested(expr->body);
+        return nilValue();
+    }
+
+    void visitExprStmt(ExprStmt* stmt) override { visit(stmt->expr); }
+    void visitPrintStmt(PrintStmt* stmt) override { visit(stmt->expr); }
+    void visitLetStmt(LetStmt* stmt) override { visit(stmt->initializer); }
+    void visitBlockStmt(BlockStmt* stmt) override { scan(stmt->statements); }
+    void visitIfStmt(IfStmt* stmt) override {
+        visit(stmt->condition);
+        visit(stmt->thenBranch);
+        visit(stmt->elseBranch);
+    }
+    void visitWhileStmt(WhileStmt* stmt) override {
+        visit(stmt->condition);
+        visit(stmt->body);
+    }
+    void visitRunUntilStmt(RunUntilStmt* stmt) override {
+        visit(stmt->body);
+        visit(stmt->condition);
+    }
+    void visitForStmt(ForStmt* stmt) override {
+        visit(stmt->initializer);
+        visit(stmt->condition);
+        visit(stmt->increment);
+        visit(stmt->body);
+    }
+    void visitFnStmt(FnStmt* stmt) override { scanNested(stmt->body); }
+    void visitReturnStmt(ReturnStmt* stmt) override { visit(stmt->value); }
+    void visitBreakStmt(BreakStmt*) override {}
+    void visitContinueStmt(ContinueStmt*) override {}
+    void visitTryStmt(TryStmt* stmt) override {
+        visit(stmt->tryBody);
+        visit(stmt->catchBody);
+    }
+    void visitThrowStmt(ThrowStmt* stmt) override { visit(stmt->expression); }
+    void visitImportStmt(ImportStmt* stmt) override {
+        for (const auto& imported : stmt->imports) mention(imported);
+    }
+    void visitClassStmt(ClassStmt* stmt) override {
+        visit(stmt->superclass);
+        for (const auto& method : stmt->methods) scanNested(method->body);
+    }
+    void visitSwitchStmt(SwitchStmt* stmt) override {
+        visit(stmt->expression);
+        for (const auto& c : stmt->cases) {
+            visit(c.match);
+            scan(c.body);
+        }
+    }
+
+private:
+    void mention(const std::string& name) {
+        if (name == name_) escapes_ = true;
+    }
+    // Whether expr is the name itself, outside any nested function
+    bool named(const ExprPtr& expr) const {
+        auto* var = dynamic_cast<VariableExpr*>(expr.get());
+        return var && var->name == name_ && nested_ == 0;
+    }
+    // The object of an index or of .length, which an array may be
+    Value visitIndexed(const ExprPtr& object) {
+        if (!array_ || !named(object)) visit(object);
+        return nilValue();
+    }
+    Value visit(const ExprPtr& expr) {
+        if (expr && !escapes_) expr->accept(*this);
+        return nilValue();
+    }
+    void visit(const StmtPtr& stmt) {
+        if (stmt && !escapes_) stmt->accept(*this);
+    }
+
+    const std::string& name_;
+    bool array_;
+    int nested_ = 0;
+    bool escapes_ = false;
+};
+
+// Walks the statement lists of one function body, nested blocks included,
+// and tests each local function and array declaration against the rest of
+// its list.
+class ScopedDeclFinder : public StmtVisitor {
+public:
+    std::unordered_set<const Stmt*> found;
+
+    void scanList(const std::vector<StmtPtr>& stmts) {
+        for (size_t i = 0; i < stmts.size(); i++) {
+            Stmt* stmt = stmts[i].get();
+            if (qualifies(stmt, stmts, i + 1)) found.insert(stmt);
+            stmt->accept(*this);
+        }
+    }
+
+    void visitExprStmt(ExprStmt*) override {}
+    void visitPrintStmt(PrintStmt*) override {}
+    void visitLetStmt(LetStmt*) override {}
+    void visitBlockStmt(BlockStmt* stmt) override { scanList(stmt->statements); }
+    void visitIfStmt(IfStmt* stmt) override {
+        visit(stmt->thenBranch);
+        visit(stmt->elseBranch);
+    }
+    void visitWhileStmt(WhileStmt* stmt) override { visit(stmt->body); }
+    void visitRunUntilStmt(RunUntilStmt* stmt) override { visit(stmt->body); }
+    void visitForStmt(ForStmt* stmt) override { visit(stmt->body); }
+    void visitFnStmt(FnStmt*) override {}
+    void visitReturnStmt(ReturnStmt*) override {}
+    void visitBreakStmt(BreakStmt*) override {}
+    void visitContinueStmt(ContinueStmt*) override {}
+    void visitTryStmt(TryStmt* stmt) override {
+        visit(stmt->tryBody);
+        visit(stmt->catchBody);
+    }
+    void visitThrowStmt(ThrowStmt*) override {}
+    void visitImportStmt(ImportStmt*) override {}
+    void visitClassStmt(ClassStmt*) override {}
+    void visitSwitchStmt(SwitchStmt* stmt) override {
+        // Case bodies share one scope and fall through into each other, so
+        // their own declarations are left alone; nested blocks still count
+        for (const auto& c : stmt->cases) {
+            for (const auto& s : c.body) s->accept(*this);
+        }
+    }
+
+private:
+    void visit(const StmtPtr& stmt) {
+        if (stmt) stmt->accept(*this);
+    }
+
+    static bool qualifies(Stmt* stmt, const std::vector<StmtPtr>& stmts, size_t rest) {
+        const std::string* name = nullptr;
+        const std::vector<StmtPtr>* own = nullptr;
+        ArrayExpr* array = nullptr;
+        if (auto* fn = dynamic_cast<FnStmt*>(stmt)) {
+            name = &fn->name;
+            own = &fn->body;
+        } else if (auto* let = dynamic_cast<LetStmt*>(stmt)) {
+            name = &let->name;
+            if (auto* function = dynamic_cast<FunctionExpr*>(let->initializer.get())) {
+                own = &function->body;
+            } else if (!(array = dynamic_cast<ArrayExpr*>(let->initializer.get()))) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        EscapeScanner scanner(*name, array != nullptr);
+        // An array's elements must not name it either, as they are evaluated
+        // before the local exists
+        if (array) {
+            scanner.visitArrayExpr(array);
+        } else {
+            scanner.scanNested(*own);
+        }
+        for (size_t i = rest; i < stmts.size() && !scanner.escapes(); i++) {
+            stmts[i]->accept(scanner);
+        }
+        return !scanner.escapes();
+    }
+};
+
+// Collects the names the code it is run over mentions. With nestedOnly set
+// only mentions inside nested functions and classes count.
+class NameCollector : public ExprVisitor, public StmtVisitor {
+public:
+    NameCollector(std::unordered_set<std::string>& names, bool nestedOnly)
+        : names_(names), nestedOnly_(nestedOnly) {}
+
+    void scan(const std::vector<StmtPtr>& stmts) {
+        for (const auto& stmt : stmts) stmt->accept(*this);
+    }
+    void scanNested(const std::vector<StmtPtr>& stmts) {
+        nested_++;
+        scan(stmts);
+        nested_--;
+    }
+
+    Value visitLiteralExpr(LiteralExpr*) override { return nilValue(); }
+    Value visitVariableExpr(VariableExpr* expr) override {
+        mention(expr->name);
+        return nilValue();
+    }
+    Value visitUnaryExpr(UnaryExpr* expr) override { return visit(expr->right); }
+    Value visitBinaryExpr(BinaryExpr* expr) override {
+        visit(expr->left);
+        return visit(expr->right);
+    }
+    Value visitLogicalExpr(LogicalExpr* expr) override {
+        visit(expr->left);
+        return visit(expr->right);
+    }
+    Value visitGroupingExpr(GroupingExpr* expr) override { return visit(expr->expr); }
+    Value visitCallExpr(CallExpr* expr) override {
+        visit(expr->callee);
+        for (const auto& argument : expr->arguments) visit(argument);
+        return nilValue();
+    }
+    Value visitAssignExpr(AssignExpr* expr) override {
+        mention(expr->name);
+        return visit(expr->value);
+    }
+    Value visitCompoundAssignExpr(CompoundAssignExpr* expr) override {
+        mention(expr->name);
+        return visit(expr->value);
+    }
+    Value visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->value);
+    }
+    Value visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) override {
+        visit(expr->object);
+        visit(expr->index);
+        return visit(expr->value);
+    }
+    Value visitUpdateExpr(UpdateExpr* expr) override {
+        mention(expr->name);
+        return nilValue();
+    }
+    Value visitUpdateMemberExpr(UpdateMemberExpr* expr) override { return visit(expr->object); }
+    Value visitUpdateIndexExpr(UpdateIndexExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->index);
+    }
+    Value visitTernaryExpr(TernaryExpr* expr) override {
+        visit(expr->condition);
+        visit(expr->thenBranch);
+        return visit(expr->elseBranch);
+    }
+    Value visitArrayExpr(ArrayExpr* expr) override {
+        for (const auto& element : expr->elements) visit(element);
+        return nilValue();
+    }
+    Value visitIndexExpr(IndexExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->index);
+    }
+    Value visitIndexAssignExpr(IndexAssignExpr* expr) override {
+        visit(expr->object);
+        visit(expr->index);
+        return visit(expr->value);
+    }
+    Value visitHashMapExpr(HashMapExpr* expr) override {
+        for (const auto& [key, value] : expr->keyValuePairs) {
+            visit(key);
+            visit(value);
+        }
+        return nilValue();
+    }
+    Value visitMemberExpr(MemberExpr* expr) override { return visit(expr->object); }
+    Value visitSetExpr(SetExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->value);
+    }
+    Value visitThisExpr(ThisExpr*) override {
+        mention("this");
+        return nilValue();
+    }
+    Value visitSuperExpr(SuperExpr*) override {
+        mention("this");
+        mention("super");
+        return nilValue();
+    }
+    Value visitFunctionExpr(FunctionExpr* expr) override {
+        scanNested(expr->body);
+        return nilValue();
+    }
+
+    void visitExprStmt(ExprStmt* stmt) override { visit(stmt->expr); }
+    void visitPrintStmt(PrintStmt* stmt) override { visit(stmt->expr); }
+    void visitLetStmt(LetStmt* stmt) override { visit(stmt->initializer); }
+    void visitBlockStmt(BlockStmt* stmt) override { scan(stmt->statements); }
+    void visitIfStmt(IfStmt* stmt) override {
+        visit(stmt->condition);
+        visit(stmt->thenBranch);
+        visit(stmt->elseBranch);
+    }
+    void visitWhileStmt(WhileStmt* stmt) override {
+        visit(stmt->condition);
+        visit(stmt->body);
+    }
+    void visitRunUntilStmt(RunUntilStmt* stmt) override {
+        visit(stmt->body);
+        visit(stmt->condition);
+    }
+    void visitForStmt(ForStmt* stmt) override {
+        visit(stmt->initializer);
+        visit(stmt->condition);
+        visit(stmt->increment);
+        visit(stmt->body);
+    }
+    void visitFnStmt(FnStmt* stmt) override { scanNested(stmt->body); }
+    void visitReturnStmt(ReturnStmt* stmt) override { visit(stmt->value); }
+    void visitBreakStmt(BreakStmt*) override {}
+    void visitContinueStmt(ContinueStmt*) override {}
+    void visitTryStmt(TryStmt* stmt) override {
+        visit(stmt->tryBody);
+        visit(stmt->catchBody);
+    }
+    void visitThrowStmt(ThrowStmt* stmt) override { visit(stmt->expression); }
+    void visitImportStmt(ImportStmt* stmt) override {
+        for (const auto& imported : stmt->imports) mention(imported);
+    }
+    void visitClassStmt(ClassStmt* stmt) override {
+        visit(stmt->superclass);
+        for (const auto& method : stmt->methods) scanNested(method->body);
+    }
+    void visitSwitchStmt(SwitchStmt* stmt) override {
+        visit(stmt->expression);
+        for (const auto& c : stmt->cases) {
+            visit(c.match);
+            scan(c.body);
+        }
+    }
+
+private:
+    void mention(const std::string& name) {
+        if (!nestedOnly_ || nested_ > 0) names_.insert(name);
+    }
+    Value visit(const ExprPtr& expr) {
+        if (expr) expr->accept(*this);
+        return nilValue();
+    }
+    void visit(const StmtPtr& stmt) {
+        if (stmt) stmt->accept(*this);
+    }
+
+    std::unordered_set<std::string>& names_;
+    bool nestedOnly_;
+    int nested_ = 0;
+};
+
+} // namespace
+
+std::unordered_set<const Stmt*> findScopedDecls(const std::vector<StmtPtr>& body) {
+    ScopedDeclFinder finder;
+    finder.scanList(body);
+    return std::move(finder.found);
+}
+
+std::unordered_set<std::string> findCapturedNames(const std::vector<StmtPtr>& body) {
+    std::unordered_set<std::string> names;
+    NameCollector collector(names, true);
+    collector.scan(body);
+    return names;
+}
+
+void collectNames(Stmt* stmt, std::unordered_set<std::string>& names) {
+    NameCollector collector(names, false);
+    stmt->accept(collector);
+}
+
+void collectNames(Expr* expr, std::unordered_set<std::string>& names) {
+    NameCollector collector(names, false);
+    expr->accept(collector);
+}
+
+} // namespace claw
@@ -0,0 +1,41 @@
+#pragma once
+#include "parser/stmt.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace claw {
+
+/**
+ * @brief Find the local functions and arrays that never leave their scope
+ *
+ * Looks at `fn name() {...}`, `let name = fn(...) {...}` and
+ * `let name = [...]` declarations in body and in the blocks nested in it,
+ * but not inside nested functions, which are analysed when they are
+ * compiled. A function qualifies when every later mention of name in its
+ * block is the callee of a call, and an array when every later mention is
+ * indexed, assigned an element through or has its length read: the value is
+ * never read as a whole, assigned, mentioned by a nested function or class,
+ * or named in its own body or elements. Such a value dies with its scope, so
+ * the VM can allocate it in the frame instead of on the heap. Any mention of
+ * the name counts, even one that a nested declaration shadows.
+ *
+ * A named closure passed as an argument escapes. Function literals passed
+ * straight to a call are left to the VM, which sees the callee: see
+ * OpCode::ScopedCallback.
+ */
+std::unordered_set<const Stmt*> findScopedDecls(const std::vector<StmtPtr>& body);
+
+/**
+ * @brief Names mentioned inside the functions and classes nested in body
+ *
+ * Any local of body a closure could capture is among them, so these are the
+ * locals a call may change behind the back of the code that makes it.
+ */
+std::unordered_set<std::string> findCapturedNames(const std::vector<StmtPtr>& body);
+
+// Adds every name the code mentions, nested functions included
+void collectNames(Stmt* stmt, std::unordered_set<std::string>& names);
+void collectNames(Expr* expr, std::unordered_set<std::string>& names);
+
+} // namespace claw
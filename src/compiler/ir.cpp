@@ -0,0 +1,721 @@
+#include "ir.h"
+#include <algorithm>
+#include <functional>
+
+namespace claw {
+
+namespace {
+
+// What a piece of the region may write
+struct Effects {
+    bool calls = false;  // may run any code: globals, upvalues, captured locals and the heap
+    bool opaque = false; // may also write any local
+    bool heap = false;   // stores into arrays, maps or instances
+    std::vector<IRVar> stores;
+
+    bool stored(const IRVar& var) const {
+        return std::find(stores.begin(), stores.end(), var) != stores.end();
+    }
+};
+
+IRVar regionVar(const IRRegion& region, int local) {
+    IRVar var;
+    var.kind = IRVar::Kind::RegionLocal;
+    var.index = local;
+    var.name = region.locals[local].name;
+    var.captured = region.locals[local].captured;
+    return var;
+}
+
+// Instructions whose value depends only on their operands and the memory
+// they read, so an equal earlier one can stand in for them
+bool numberable(IROp op) {
+    switch (op) {
+        case IROp::Const:
+        case IROp::LoadLocal:
+        case IROp::LoadUpvalue:
+        case IROp::LoadGlobal:
+        case IROp::Binary:
+        case IROp::Unary:
+        case IROp::GetIndex:
+        case IROp::Length:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// One instruction that cannot fail; cheaper to repeat than to keep in a local
+bool cheap(IROp op) {
+    return op == IROp::Const || op == IROp::LoadLocal || op == IROp::LoadUpvalue;
+}
+
+bool mayFault(const IRInst& inst) {
+    switch (inst.op) {
+        case IROp::Const:
+        case IROp::LoadLocal:
+        case IROp::StoreLocal:
+        case IROp::LoadUpvalue:
+        case IROp::StoreUpvalue:
+            return false;
+        case IROp::LoadGlobal:
+        case IROp::StoreGlobal:
+            return !inst.var.bound;
+        case IROp::Binary:
+            return inst.opcode != OpCode::Equal;
+        case IROp::Unary:
+            return inst.opcode != OpCode::Not;
+        default:
+            return true;
+    }
+}
+
+// Whether the instruction changes something code running after an error
+// could still see. Region locals die with the region unless captured.
+bool visible(const IRInst& inst) {
+    switch (inst.op) {
+        case IROp::StoreLocal:
+            return inst.var.kind != IRVar::Kind::RegionLocal || inst.var.captured;
+        case IROp::StoreUpvalue:
+        case IROp::StoreGlobal:
+        case IROp::SetIndex:
+        case IROp::SetProperty:
+        case IROp::Call:
+        case IROp::Invoke:
+        case IROp::Opaque:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool clobbered(const IRInst& inst, const Effects& effects) {
+    switch (inst.op) {
+        case IROp::LoadLocal:
+            return effects.opaque || effects.stored(inst.var) || (effects.calls && inst.var.captured);
+        case IROp::LoadUpvalue:
+        case IROp::LoadGlobal:
+            return effects.opaque || effects.calls || effects.stored(inst.var);
+        case IROp::GetIndex:
+        case IROp::Length:
+            return effects.opaque || effects.calls || effects.heap;
+        default:
+            return false;
+    }
+}
+
+bool varClobbered(const IRVar& var, const Effects& effects) {
+    bool local = var.kind == IRVar::Kind::Local || var.kind == IRVar::Kind::RegionLocal;
+    return effects.opaque || effects.stored(var) || (effects.calls && (!local || var.captured));
+}
+
+void collectEffects(const IRRegion& region, int value, Effects& effects) {
+    const IRInst& inst = region.insts[value];
+    for (int arg : inst.args) collectEffects(region, arg, effects);
+    switch (inst.op) {
+        case IROp::StoreLocal:
+        case IROp::StoreUpvalue:
+        case IROp::StoreGlobal:
+            effects.stores.push_back(inst.var);
+            break;
+        case IROp::SetIndex:
+        case IROp::SetProperty:
+            effects.heap = true;
+            break;
+        case IROp::Call:
+        case IROp::Invoke:
+            effects.calls = true;
+            break;
+        case IROp::Opaque:
+            effects.opaque = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void collectEffects(const IRRegion& region, const std::vector<IRStmt>& stmts, Effects& effects);
+
+void collectEffects(const IRRegion& region, const IRStmt& stmt, Effects& effects) {
+    if (stmt.value >= 0) collectEffects(region, stmt.value, effects);
+    if (stmt.increment >= 0) collectEffects(region, stmt.increment, effects);
+    if (stmt.kind == IRStmt::Kind::Opaque) effects.opaque = true;
+    if (stmt.kind == IRStmt::Kind::Let) effects.stores.push_back(regionVar(region, stmt.local));
+    collectEffects(region, stmt.init, effects);
+    collectEffects(region, stmt.body, effects);
+    collectEffects(region, stmt.orElse, effects);
+}
+
+void collectEffects(const IRRegion& region, const std::vector<IRStmt>& stmts, Effects& effects) {
+    for (const auto& stmt : stmts) collectEffects(region, stmt, effects);
+}
+
+// Everything one pass of the loop may write; the initializer runs once
+// before it and is left out
+Effects loopEffects(const IRRegion& region, const IRStmt& loop) {
+    Effects effects;
+    if (loop.value >= 0) collectEffects(region, loop.value, effects);
+    if (loop.increment >= 0) collectEffects(region, loop.increment, effects);
+    collectEffects(region, loop.body, effects);
+    return effects;
+}
+
+// Calls fn on each statement in the order the code is emitted
+void forEachStmt(IRStmt& stmt, const std::function<void(IRStmt&)>& fn) {
+    fn(stmt);
+    for (auto& s : stmt.init) forEachStmt(s, fn);
+    for (auto& s : stmt.body) forEachStmt(s, fn);
+    for (auto& s : stmt.orElse) forEachStmt(s, fn);
+}
+
+// Calls fn on each instruction that is emitted where it was written, rather
+// than read back from the local of an equal value
+void forEachEmitted(const IRRegion& region, int value, const std::function<void(int)>& fn) {
+    if (value < 0 || region.insts[value].replacedBy >= 0) return;
+    for (int arg : region.insts[value].args) forEachEmitted(region, arg, fn);
+    fn(value);
+}
+
+void forEachEmitted(IRRegion& region, const std::function<void(int)>& fn) {
+    forEachStmt(region.root, [&](IRStmt& stmt) {
+        forEachEmitted(region, stmt.value, fn);
+        forEachEmitted(region, stmt.increment, fn);
+    });
+}
+
+bool loads(const IRRegion& region, int value, const IRVar& var) {
+    const IRInst& inst = region.insts[value];
+    if (inst.op == IROp::LoadLocal && inst.var == var) return true;
+    for (int arg : inst.args) {
+        if (loads(region, arg, var)) return true;
+    }
+    return false;
+}
+
+// Common subexpression elimination and copy propagation over value numbers.
+// A value's number is the first instruction that computed an equal value.
+class ValueNumbering {
+public:
+    ValueNumbering(IRRegion& region, IRStats& stats)
+        : region_(region), stats_(stats), numbers_(region.insts.size(), -1) {}
+
+    void run() { visit(region_.root); }
+
+private:
+    struct Key {
+        IROp op;
+        OpCode opcode;
+        bool negate;
+        Value constant;
+        int a;
+        int b;
+
+        bool operator==(const Key& other) const {
+            return op == other.op && opcode == other.opcode && negate == other.negate &&
+                   constant == other.constant && a == other.a && b == other.b;
+        }
+    };
+    // Facts that hold on every path to the current point
+    struct State {
+        std::vector<std::pair<Key, int>> available;
+        std::vector<std::pair<IRVar, int>> vars; // number of the value each variable holds
+    };
+
+    void visit(IRStmt& stmt) {
+        switch (stmt.kind) {
+            case IRStmt::Kind::Eval:
+            case IRStmt::Kind::Print:
+            case IRStmt::Kind::Return:
+                if (stmt.value >= 0) number(stmt.value);
+                break;
+            case IRStmt::Kind::Let: {
+                // The local exists, holding nil, while its initializer runs
+                IRVar var = regionVar(region_, stmt.local);
+                forget(var);
+                if (stmt.value >= 0) {
+                    number(stmt.value);
+                    remember(var, numbers_[stmt.value]);
+                }
+                break;
+            }
+            case IRStmt::Kind::Block:
+                for (auto& s : stmt.body) visit(s);
+                break;
+            case IRStmt::Kind::If: {
+                number(stmt.value);
+                State before = state_;
+                for (auto& s : stmt.body) visit(s);
+                state_ = before;
+                for (auto& s : stmt.orElse) visit(s);
+                state_ = before;
+                Effects effects;
+                collectEffects(region_, stmt.body, effects);
+                collectEffects(region_, stmt.orElse, effects);
+                invalidate(effects);
+                break;
+            }
+            case IRStmt::Kind::Loop: {
+                for (auto& s : stmt.init) visit(s);
+                // Only what no pass of the loop changes holds at its head
+                invalidate(loopEffects(region_, stmt));
+                State head = state_;
+                if (stmt.value >= 0) number(stmt.value);
+                for (auto& s : stmt.body) visit(s);
+                if (stmt.increment >= 0) number(stmt.increment);
+                state_ = head;
+                break;
+            }
+            case IRStmt::Kind::Break:
+                break;
+            case IRStmt::Kind::Opaque: {
+                Effects effects;
+                effects.opaque = true;
+                invalidate(effects);
+                break;
+            }
+        }
+    }
+
+    void number(int value) {
+        IRInst& inst = region_.insts[value];
+        for (int arg : inst.args) number(arg);
+        numbers_[value] = value;
+        switch (inst.op) {
+            case IROp::LoadLocal:
+            case IROp::LoadUpvalue:
+            case IROp::LoadGlobal: {
+                int known = recall(inst.var);
+                if (known < 0) {
+                    remember(inst.var, value);
+                    break;
+                }
+                numbers_[value] = known;
+                const IRInst& source = region_.insts[known];
+                if (inst.op == IROp::LoadLocal && source.op == IROp::Const) {
+                    inst.op = IROp::Const;
+                    inst.constant = source.constant;
+                    inst.var = IRVar{};
+                    stats_.forwarded++;
+                }
+                break;
+            }
+            case IROp::StoreLocal:
+            case IROp::StoreUpvalue:
+            case IROp::StoreGlobal:
+                numbers_[value] = numbers_[inst.args[0]];
+                forget(inst.var);
+                remember(inst.var, numbers_[value]);
+                break;
+            case IROp::Const:
+            case IROp::Binary:
+            case IROp::Unary:
+            case IROp::GetIndex:
+            case IROp::Length: {
+                Key key{inst.op, inst.opcode, inst.negate, inst.op == IROp::Const ? inst.constant : nilValue(),
+                        inst.args.size() > 0 ? numbers_[inst.args[0]] : -1,
+                        inst.args.size() > 1 ? numbers_[inst.args[1]] : -1};
+                auto found = std::find_if(state_.available.begin(), state_.available.end(),
+                                          [&](const auto& entry) { return entry.first == key; });
+                if (found == state_.available.end()) {
+                    state_.available.push_back({key, value});
+                    break;
+                }
+                numbers_[value] = found->second;
+                // Reading a local back costs one instruction, so only
+                // expressions of three or more are worth keeping
+                if (inst.op != IROp::Const && pure(value) && cost(value) >= 3) {
+                    inst.replacedBy = found->second;
+                    stats_.cse++;
+                }
+                break;
+            }
+            case IROp::SetIndex:
+            case IROp::SetProperty: {
+                Effects effects;
+                effects.heap = true;
+                invalidate(effects);
+                break;
+            }
+            case IROp::Call:
+            case IROp::Invoke: {
+                Effects effects;
+                effects.calls = true;
+                invalidate(effects);
+                break;
+            }
+            case IROp::Opaque: {
+                Effects effects;
+                effects.opaque = true;
+                invalidate(effects);
+                break;
+            }
+            case IROp::GetProperty:
+                break;
+        }
+    }
+
+    // Whether dropping the instruction's own code loses nothing but the value
+    bool pure(int value) const {
+        const IRInst& inst = region_.insts[value];
+        if (!numberable(inst.op)) return false;
+        for (int arg : inst.args) {
+            if (region_.insts[arg].replacedBy < 0 && !pure(arg)) return false;
+        }
+        return true;
+    }
+
+    int cost(int value) const {
+        int total = 1;
+        for (int arg : region_.insts[value].args) {
+            total += region_.insts[arg].replacedBy >= 0 ? 1 : cost(arg);
+        }
+        return total;
+    }
+
+    int recall(const IRVar& var) const {
+        for (const auto& [known, number] : state_.vars) {
+            if (known == var) return number;
+        }
+        return -1;
+    }
+    void remember(const IRVar& var, int number) { state_.vars.push_back({var, number}); }
+    void forget(const IRVar& var) {
+        auto& vars = state_.vars;
+        vars.erase(std::remove_if(vars.begin(), vars.end(), [&](const auto& entry) { return entry.first == var; }),
+                   vars.end());
+    }
+
+    void invalidate(const Effects& effects) {
+        auto& available = state_.available;
+        available.erase(std::remove_if(available.begin(), available.end(),
+                                       [&](const auto& entry) {
+                                           return clobbered(region_.insts[entry.second], effects);
+                                       }),
+                        available.end());
+        auto& vars = state_.vars;
+        vars.erase(std::remove_if(vars.begin(), vars.end(),
+                                  [&](const auto& entry) { return varClobbered(entry.first, effects); }),
+                   vars.end());
+    }
+
+    IRRegion& region_;
+    IRStats& stats_;
+    std::vector<int> numbers_;
+    State state_;
+};
+
+// Loop-invariant code motion, innermost loops first. A value moves only if
+// the first pass of the loop computes it before anything that could fail
+// or be seen, so moving it changes neither which errors happen nor when.
+class LoopMotion {
+public:
+    LoopMotion(IRRegion& region, IRStats& stats) : region_(region), stats_(stats) {}
+
+    void run() { visit(region_.root); }
+
+private:
+    void visit(IRStmt& stmt) {
+        for (auto& s : stmt.init) visit(s);
+        for (auto& s : stmt.body) visit(s);
+        for (auto& s : stmt.orElse) visit(s);
+        if (stmt.kind == IRStmt::Kind::Loop) hoist(stmt);
+    }
+
+    void hoist(IRStmt& loop) {
+        loop_ = &loop;
+        effects_ = loopEffects(region_, loop);
+        barrier_ = false;
+        if (loop.value >= 0) scanCondition(loop.value);
+        for (auto& s : loop.body) scanStmt(s);
+    }
+
+    bool inside(int value) const {
+        for (int l = region_.insts[value].loop; l >= 0; l = region_.loops[l].parent) {
+            if (l == loop_->loop) return true;
+        }
+        return false;
+    }
+
+    bool invariant(int value) const {
+        value = region_.resolve(value);
+        if (!inside(value)) return true;
+        const IRInst& inst = region_.insts[value];
+        if (!numberable(inst.op) || clobbered(inst, effects_)) return false;
+        for (int arg : inst.args) {
+            if (!invariant(arg)) return false;
+        }
+        return true;
+    }
+
+    bool candidate(int value) const {
+        const IRInst& inst = region_.insts[value];
+        return inst.replacedBy < 0 && !cheap(inst.op) && inside(value) && invariant(value);
+    }
+
+    // The first test of the loop computes the condition's invariants and
+    // keeps them for the tests after each pass
+    void scanCondition(int value) {
+        if (region_.insts[value].replacedBy >= 0) return;
+        if (candidate(value)) {
+            mark(value, IRInst::Hoist::Cond);
+            return;
+        }
+        for (int arg : region_.insts[value].args) scanCondition(arg);
+    }
+
+    void scanStmt(IRStmt& stmt) {
+        if (barrier_) return;
+        switch (stmt.kind) {
+            case IRStmt::Kind::Eval:
+            case IRStmt::Kind::Let:
+                scanValue(stmt.value);
+                break;
+            case IRStmt::Kind::Block:
+                for (auto& s : stmt.body) scanStmt(s);
+                break;
+            case IRStmt::Kind::Print:
+            case IRStmt::Kind::Return:
+            case IRStmt::Kind::If:
+                scanValue(stmt.value);
+                barrier_ = true;
+                break;
+            default:
+                barrier_ = true;
+                break;
+        }
+    }
+
+    void scanValue(int value) {
+        if (barrier_ || value < 0 || region_.insts[value].replacedBy >= 0) return;
+        if (candidate(value)) {
+            mark(value, IRInst::Hoist::Preheader);
+            return;
+        }
+        const IRInst& inst = region_.insts[value];
+        for (int arg : inst.args) scanValue(arg);
+        if (mayFault(inst) || visible(inst)) barrier_ = true;
+    }
+
+    void mark(int value, IRInst::Hoist hoist) {
+        IRInst& inst = region_.insts[value];
+        inst.hoist = hoist;
+        inst.hoistLoop = loop_->loop;
+        region_.loops[loop_->loop].rotated = true;
+        if (hoist == IRInst::Hoist::Preheader) {
+            loop_->preheader.push_back(value);
+            // It now runs in the enclosing loop, once per entry to this one
+            forEachEmitted(region_, value, [&](int v) { region_.insts[v].loop = region_.loops[loop_->loop].parent; });
+        }
+        stats_.hoisted++;
+    }
+
+    IRRegion& region_;
+    IRStats& stats_;
+    IRStmt* loop_ = nullptr;
+    Effects effects_;
+    bool barrier_ = false;
+};
+
+// Drops stores to region locals that are never read, and stores that the
+// next store to the same local overwrites before anything reads it
+void removeDeadStores(IRRegion& region, IRStats& stats) {
+    std::vector<bool> read(region.locals.size(), false);
+    for (size_t i = 0; i < region.locals.size(); i++) {
+        const IRLocal& local = region.locals[i];
+        read[i] = local.captured || region.opaqueNames.count(std::string(local.name)) > 0;
+    }
+    forEachEmitted(region, [&](int v) {
+        const IRInst& inst = region.insts[v];
+        if (inst.op == IROp::LoadLocal && inst.var.kind == IRVar::Kind::RegionLocal) read[inst.var.index] = true;
+    });
+
+    auto deadStore = [&](int value) -> const IRInst* {
+        if (value < 0 || region.insts[value].replacedBy >= 0) return nullptr;
+        const IRInst& inst = region.insts[value];
+        if (inst.op != IROp::StoreLocal || inst.var.kind != IRVar::Kind::RegionLocal || inst.var.captured ||
+            region.opaqueNames.count(std::string(inst.var.name))) {
+            return nullptr;
+        }
+        return &inst;
+    };
+
+    forEachStmt(region.root, [&](IRStmt& stmt) {
+        if (stmt.kind == IRStmt::Kind::Let && !read[stmt.local] && stmt.value >= 0 && !stmt.dead) {
+            stmt.dead = true;
+            stats.deadStores++;
+        }
+        if (stmt.kind == IRStmt::Kind::Eval) {
+            const IRInst* store = deadStore(stmt.value);
+            if (store && !read[store->var.index]) {
+                stmt.value = store->args[0];
+                stats.deadStores++;
+            }
+        }
+        if (stmt.kind != IRStmt::Kind::Block) return;
+        auto& list = stmt.body;
+        for (size_t i = 0; i < list.size(); i++) {
+            const IRInst* store = list[i].kind == IRStmt::Kind::Eval ? deadStore(list[i].value) : nullptr;
+            if (!store) continue;
+            IRVar var = store->var;
+            int overwritten = -1;
+            for (size_t j = i + 1; j < list.size(); j++) {
+                const IRStmt& next = list[j];
+                bool simple = next.kind == IRStmt::Kind::Eval || next.kind == IRStmt::Kind::Print ||
+                              next.kind == IRStmt::Kind::Let;
+                if (!simple || (next.value >= 0 && loads(region, next.value, var))) break;
+                const IRInst* later = next.kind == IRStmt::Kind::Eval ? deadStore(next.value) : nullptr;
+                if (later && later->var == var) {
+                    overwritten = list[i].value;
+                    break;
+                }
+            }
+            if (overwritten >= 0) {
+                list[i].value = region.insts[overwritten].args[0];
+                stats.deadStores++;
+            }
+        }
+    });
+}
+
+bool loadOf(const IRRegion& region, int value, const IRVar& var) {
+    const IRInst& inst = region.insts[region.resolve(value)];
+    return inst.op == IROp::LoadLocal && inst.var == var;
+}
+
+bool intConst(const IRRegion& region, int value, int min) {
+    const IRInst& inst = region.insts[region.resolve(value)];
+    return inst.op == IROp::Const && isInt(inst.constant) && asInt(inst.constant) >= min;
+}
+
+// Bounds-check elimination for for (let i = start; i < a.length; i = i + step)
+// with integer start >= 0 and step > 0, where a is a local. If the loop
+// makes no calls and writes neither a nor i outside the increment, nothing
+// in it can shrink a, so while a holds an array each a[i] in the body is in
+// bounds: the test just passed and i only grows. The lowering emits such a
+// loop twice, choosing the copy with unchecked accesses on entry.
+void eliminateBoundsChecks(IRRegion& region, IRStats& stats) {
+    forEachStmt(region.root, [&](IRStmt& loop) {
+        if (loop.kind != IRStmt::Kind::Loop || loop.init.size() != 1 || loop.value < 0 || loop.increment < 0) {
+            return;
+        }
+        const IRStmt& init = loop.init[0];
+        if (init.kind != IRStmt::Kind::Let || init.value < 0 || !intConst(region, init.value, 0)) return;
+        IRVar counter = regionVar(region, init.local);
+
+        const IRInst& test = region.insts[region.resolve(loop.value)];
+        if (test.op != IROp::Binary || test.opcode != OpCode::Less || test.negate) return;
+        const IRInst& length = region.insts[region.resolve(test.args[1])];
+        if (!loadOf(region, test.args[0], counter) || length.op != IROp::Length) return;
+        const IRInst& object = region.insts[region.resolve(length.args[0])];
+        if (object.op != IROp::LoadLocal) return;
+        IRVar array = object.var;
+
+        const IRInst& step = region.insts[loop.increment];
+        if (step.op != IROp::StoreLocal || !(step.var == counter)) return;
+        const IRInst& add = region.insts[region.resolve(step.args[0])];
+        if (add.op != IROp::Binary || add.opcode != OpCode::Add || add.negate ||
+            !loadOf(region, add.args[0], counter) || !intConst(region, add.args[1], 1)) {
+            return;
+        }
+
+        // A let directly in the body would be declared twice in one scope
+        for (const auto& stmt : loop.body) {
+            if (stmt.kind == IRStmt::Kind::Let) return;
+        }
+        Effects effects;
+        collectEffects(region, loop.body, effects);
+        if (effects.calls || effects.opaque || effects.stored(counter) || effects.stored(array)) return;
+
+        int unchecked = 0;
+        for (auto& stmt : loop.body) {
+            forEachStmt(stmt, [&](IRStmt& s) {
+                auto mark = [&](int v) {
+                    IRInst& inst = region.insts[v];
+                    if ((inst.op == IROp::GetIndex || inst.op == IROp::SetIndex) && inst.boundsLoop < 0 &&
+                        loadOf(region, inst.args[0], array) && loadOf(region, inst.args[1], counter)) {
+                        inst.boundsLoop = loop.loop;
+                        unchecked++;
+                    }
+                };
+                forEachEmitted(region, s.value, mark);
+                forEachEmitted(region, s.increment, mark);
+            });
+        }
+        if (unchecked == 0) return;
+        region.loops[loop.loop].guarded = true;
+        region.loops[loop.loop].array = array;
+        stats.boundsChecks += unchecked;
+        // Nothing in the loop can change the length of an array either
+        IRInst& limit = region.insts[region.resolve(test.args[1])];
+        if (limit.hoist == IRInst::Hoist::None) {
+            limit.hoist = IRInst::Hoist::Guarded;
+            limit.hoistLoop = loop.loop;
+            region.loops[loop.loop].rotated = true;
+        }
+    });
+}
+
+// Gives a hidden local to each value read again after it is computed, in
+// the order the code is emitted. A value standing in for one that is never
+// computed first is computed where it was written after all.
+void assignTemps(IRRegion& region, IRStats& stats) {
+    std::vector<bool> computed(region.insts.size(), false);
+    std::vector<bool> kept(region.insts.size(), false);
+    std::function<void(int)> use = [&](int value) {
+        if (value < 0) return;
+        IRInst& inst = region.insts[value];
+        if (inst.replacedBy >= 0) {
+            int source = region.resolve(value);
+            if (computed[source]) {
+                kept[source] = true;
+                return;
+            }
+            inst.replacedBy = -1;
+            stats.cse--;
+        }
+        for (int arg : inst.args) use(arg);
+        if (inst.hoist != IRInst::Hoist::None) kept[value] = true;
+        computed[value] = true;
+    };
+    std::function<void(IRStmt&)> walk = [&](IRStmt& stmt) {
+        for (auto& s : stmt.init) walk(s);
+        use(stmt.value);
+        for (auto& s : stmt.body) walk(s);
+        use(stmt.increment);
+        for (auto& s : stmt.orElse) walk(s);
+    };
+    walk(region.root);
+    for (size_t i = 0; i < region.insts.size(); i++) {
+        if (kept[i]) region.insts[i].temp = region.temps++;
+    }
+}
+
+// A value whose code can be left out when nothing uses it
+bool droppable(const IRRegion& region, int value) {
+    const IRInst& inst = region.insts[value];
+    if (inst.replacedBy >= 0 || inst.hoist == IRInst::Hoist::Preheader) return true;
+    if (inst.temp >= 0 || !cheap(inst.op)) return false;
+    for (int arg : inst.args) {
+        if (!droppable(region, arg)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+IRStats optimizeRegion(IRRegion& region) {
+    IRStats stats;
+    ValueNumbering(region, stats).run();
+    LoopMotion(region, stats).run();
+    eliminateBoundsChecks(region, stats);
+    removeDeadStores(region, stats);
+    assignTemps(region, stats);
+    forEachStmt(region.root, [&](IRStmt& stmt) {
+        bool unused = stmt.kind == IRStmt::Kind::Eval || (stmt.kind == IRStmt::Kind::Let && stmt.dead);
+        if (unused && stmt.value >= 0 && droppable(region, stmt.value)) stmt.value = -1;
+        if (stmt.increment >= 0 && droppable(region, stmt.increment)) stmt.increment = -1;
+    });
+    return stats;
+}
+
+} // namespace claw
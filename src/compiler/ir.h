@@ -0,0 +1,169 @@
+#pragma once
+#include "parser/ast.h"
+#include "parser/stmt.h"
+#include "vm/chunk.h"
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace claw {
+
+/**
+ * @brief Counts of rewrites made by the loop-region IR passes
+ */
+struct IRStats {
+    int cse = 0;        // expressions that reuse an equal value computed earlier
+    int forwarded = 0;  // loads replaced by the constant last stored
+    int hoisted = 0;    // loop-invariant expressions computed once per loop entry
+    int deadStores = 0; // stores to locals nothing reads afterwards
+    int boundsChecks = 0; // array accesses counted loops make without index checks
+
+    int total() const { return cse + forwarded + hoisted + deadStores + boundsChecks; }
+
+    IRStats& operator+=(const IRStats& other) {
+        cse += other.cse;
+        forwarded += other.forwarded;
+        hoisted += other.hoisted;
+        deadStores += other.deadStores;
+        boundsChecks += other.boundsChecks;
+        return *this;
+    }
+};
+
+enum class IROp : uint8_t {
+    Const,        // constant
+    LoadLocal,    // var
+    StoreLocal,   // var = args[0]; the value is the stored one
+    LoadUpvalue,
+    StoreUpvalue,
+    LoadGlobal,
+    StoreGlobal,
+    Binary,       // opcode over args[0], args[1], then Not when negate is set
+    Unary,        // opcode over args[0]
+    GetIndex,     // args[0][args[1]]
+    SetIndex,     // args[0][args[1]] = args[2]
+    Length,       // args[0].length
+    GetProperty,  // args[0].constant
+    SetProperty,  // args[0].constant = args[1]
+    Call,         // args[0](args[1..])
+    Invoke,       // args[0].constant(args[1..])
+    Opaque,       // expr, emitted by the AST compiler
+};
+
+// Storage a load or store names. Locals declared inside the region are
+// numbered by the region, since their slots are only known once the code
+// before them has been emitted.
+struct IRVar {
+    enum class Kind : uint8_t { Local, RegionLocal, Upvalue, Global };
+    Kind kind = Kind::Local;
+    int index = 0;               // slot, region local, upvalue or global slot
+    std::string_view name;
+    bool captured = false;       // a local some closure may write
+    bool bound = false;          // a global already defined wherever this runs
+
+    bool operator==(const IRVar& other) const { return kind == other.kind && index == other.index; }
+};
+
+struct IRInst {
+    // Guarded: like Cond, but only in the unchecked copy of a guarded loop
+    enum class Hoist : uint8_t { None, Cond, Preheader, Guarded };
+
+    IROp op = IROp::Opaque;
+    OpCode opcode = OpCode::Nil;
+    bool negate = false;
+    IRVar var;
+    Value constant = nilValue();
+    std::vector<int> args;
+    Expr* expr = nullptr;
+    const Token* token = nullptr; // where the interpreter reports an error in it
+    const Token* callToken = nullptr; // Invoke: where it reports a failed call
+    int loop = -1;               // innermost loop of the region that evaluates it
+
+    // Set by the passes
+    int replacedBy = -1;         // an equal value computed earlier
+    Hoist hoist = Hoist::None;   // computed by the first test of its loop or before the body
+    int hoistLoop = -1;
+    int temp = -1;               // hidden local holding the value for later uses
+    int boundsLoop = -1;         // GetIndex, SetIndex: in bounds when that loop's array check passed
+};
+
+// Statements keep the structure of the source; only the values in them are
+// flattened into instructions.
+struct IRStmt {
+    enum class Kind : uint8_t { Eval, Print, Return, Let, Block, If, Loop, Break, Opaque };
+
+    Kind kind = Kind::Opaque;
+    int value = -1;              // Eval, Print, Return, Let; condition of If and Loop
+    int local = -1;              // Let: the region local it declares
+    bool dead = false;           // Let: nothing reads the local
+    int increment = -1;          // Loop
+    int loop = -1;               // Loop: index into IRRegion::loops
+    bool scoped = false;         // Loop: a for loop, whose initializer has its own scope
+    Stmt* stmt = nullptr;        // Opaque and Break
+    std::vector<int> declares;   // Opaque: region locals it declares
+    std::vector<IRStmt> body;    // Block statements; then branch; loop body
+    std::vector<IRStmt> orElse;  // else branch
+    std::vector<IRStmt> init;    // Loop initializer
+    std::vector<int> preheader;  // Loop: values hoisted out of the body
+};
+
+struct IRLocal {
+    std::string_view name;
+    bool captured = false;
+    bool scoped = false;         // holds a scoped closure
+};
+
+struct IRLoop {
+    int parent = -1;
+    bool rotated = false;        // has hoisted values, so the test is emitted twice
+    bool guarded = false;        // emitted twice, behind a check that array holds an array
+    IRVar array;
+};
+
+/**
+ * @brief SSA form of one loop and everything nested in it
+ *
+ * Every instruction defines one value, once, in evaluation order; operands
+ * name earlier instructions. Variables are not renamed: they stay in their
+ * slots and are read and written by loads and stores, which is what lets
+ * the region be lowered straight back into the stack VM's code. Anything
+ * the IR does not model stays an Opaque node that the AST compiler emits,
+ * and the passes assume it may read and write anything.
+ */
+struct IRRegion {
+    std::vector<IRInst> insts;
+    IRStmt root;
+    std::vector<IRLocal> locals;
+    std::vector<IRLoop> loops;
+    std::unordered_set<std::string> opaqueNames; // names Opaque nodes mention
+    int temps = 0;
+
+    int add(IRInst inst) {
+        insts.push_back(std::move(inst));
+        return static_cast<int>(insts.size() - 1);
+    }
+    int resolve(int value) const {
+        while (insts[value].replacedBy >= 0) value = insts[value].replacedBy;
+        return value;
+    }
+};
+
+/**
+ * @brief Optimize a region in place and give each value that is used again
+ * after it is computed a hidden local
+ *
+ * Value numbering does common subexpression elimination and copy
+ * propagation: a load after a store gets the stored value's number, and a
+ * load of a constant becomes the constant. Loop-invariant code motion moves
+ * values out of a loop when nothing in the loop writes what they read and
+ * they would be computed on the first pass anyway, before anything that
+ * could fail or be seen: those in the condition are kept from its first
+ * test, those at the head of the body are computed once after it. Dead
+ * store elimination drops stores to region locals nothing reads. In counted
+ * loops over an array, indexing the array by the counter needs no checks
+ * once the loop has checked on entry that it holds an array.
+ */
+IRStats optimizeRegion(IRRegion& region);
+
+} // namespace claw
@@ -0,0 +1,62 @@
+#include "peephole.h"
+
+namespace claw {
+
+namespace {
+
+bool opAt(const std::vector<uint8_t>& code, size_t offset, OpCode op) {
+    return offset < code.size() && code[offset] == static_cast<uint8_t>(op);
+}
+
+// The fused handlers only check the local, so the constant must be a number
+bool numberConstantAt(const Chunk& chunk, size_t offset) {
+    return opAt(chunk.code(), offset, OpCode::Constant) &&
+           offset + 1 < chunk.size() &&
+           isNumber(chunk.constants()[chunk.code()[offset + 1]]);
+}
+
+} // namespace
+
+PeepholeStats fuseSuperinstructions(Chunk& chunk) {
+    PeepholeStats stats;
+    const auto& code = chunk.code();
+    size_t offset = 0;
+    while (offset < code.size()) {
+        if (opAt(code, offset, OpCode::GetLocal)) {
+            // GetLocal a; GetLocal b; Add
+            if (opAt(code, offset + 2, OpCode::GetLocal) && opAt(code, offset + 4, OpCode::Add)) {
+                chunk.patch(offset, OpCode::AddLocals);
+                stats.addLocals++;
+                offset += chunk.instructionLength(offset);
+                continue;
+            }
+            if (numberConstantAt(chunk, offset + 2)) {
+                // GetLocal a; Constant k; Less; JumpIfFalse
+                if (opAt(code, offset + 4, OpCode::Less) && opAt(code, offset + 5, OpCode::JumpIfFalse)) {
+                    chunk.patch(offset, OpCode::LessLocalConstJump);
+                    stats.lessLocalConstJump++;
+                    offset += chunk.instructionLength(offset);
+                    continue;
+                }
+                // GetLocal a; Constant k; Add; SetLocal b; Pop
+                if (opAt(code, offset + 4, OpCode::Add) && opAt(code, offset + 5, OpCode::SetLocal) &&
+                    opAt(code, offset + 7, OpCode::Pop)) {
+                    chunk.patch(offset, OpCode::AddConstSetLocal);
+                    stats.addConstSetLocal++;
+                    offset += chunk.instructionLength(offset);
+                    continue;
+                }
+            }
+        }
+        offset += chunk.instructionLength(offset);
+    }
+
+    for (auto constant : chunk.constants()) {
+        if (!isVMFunction(constant)) continue;
+        auto function = asVMFunction(constant);
+        if (function && function->chunk) stats += fuseSuperinstructions(*function->chunk);
+    }
+    return stats;
+}
+
+} // namespace claw
@@ -0,0 +1,33 @@
+#pragma once
+#include "vm/chunk.h"
+
+namespace claw {
+
+/**
+ * @brief Counts of superinstructions fused by the peephole pass
+ */
+struct PeepholeStats {
+    int addLocals = 0;          // GetLocal; GetLocal; Add
+    int lessLocalConstJump = 0; // GetLocal; Constant; Less; JumpIfFalse
+    int addConstSetLocal = 0;   // GetLocal; Constant; Add; SetLocal; Pop
+
+    int total() const { return addLocals + lessLocalConstJump + addConstSetLocal; }
+
+    PeepholeStats& operator+=(const PeepholeStats& other) {
+        addLocals += other.addLocals;
+        lessLocalConstJump += other.lessLocalConstJump;
+        addConstSetLocal += other.addConstSetLocal;
+        return *this;
+    }
+};
+
+/**
+ * @brief Fuse common instruction sequences into superinstructions
+ *
+ * Rewrites the first opcode of each matched sequence in place and leaves the
+ * rest of the bytes untouched, so code size, jump offsets and line numbers
+ * do not change. Recurses into the chunks of nested function constants.
+ */
+PeepholeStats fuseSuperinstructions(Chunk& chunk);
+
+} // namespace claw
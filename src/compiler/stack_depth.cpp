@@ -0,0 +1,162 @@
+#include "stack_depth.h"
+
+namespace claw {
+
+namespace {
+
+uint16_t shortAt(const std::vector<uint8_t>& code, size_t offset) {
+    return static_cast<uint16_t>((code[offset] << 8) | code[offset + 1]);
+}
+
+// Net change the instruction at offset makes to the stack depth
+int stackEffect(const std::vector<uint8_t>& code, size_t offset) {
+    switch (static_cast<OpCode>(code[offset])) {
+        case OpCode::Constant:
+        case OpCode::Nil:
+        case OpCode::True:
+        case OpCode::False:
+        case OpCode::GetGlobal:
+        case OpCode::GetLocal:
+        case OpCode::GetUpvalue:
+        case OpCode::Closure:
+        case OpCode::ScopedClosure:
+        case OpCode::ScopedCallback:
+        case OpCode::Class:
+        case OpCode::AddLocals:
+        case OpCode::LessLocalConstJump:
+        case OpCode::AddConstSetLocal:
+            return 1;
+        case OpCode::SetGlobal:
+        case OpCode::SetLocal:
+        case OpCode::SetUpvalue:
+        case OpCode::Not:
+        case OpCode::Negate:
+        case OpCode::Jump:
+        case OpCode::JumpIfFalse:
+        case OpCode::JumpIfNotArray:
+        case OpCode::Loop:
+        case OpCode::Return:
+        case OpCode::Throw:
+        case OpCode::GetProperty:
+        case OpCode::EnsureIndexDefault:
+        case OpCode::EnsurePropertyDefault:
+        case OpCode::Interpret:
+        case OpCode::ReleaseCallbacks:
+            return 0;
+        case OpCode::Pop:
+        case OpCode::DefineGlobal:
+        case OpCode::CloseUpvalue:
+        case OpCode::Equal:
+        case OpCode::Greater:
+        case OpCode::Less:
+        case OpCode::Add:
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Divide:
+        case OpCode::BitAnd:
+        case OpCode::BitOr:
+        case OpCode::BitXor:
+        case OpCode::ShiftLeft:
+        case OpCode::ShiftRight:
+        case OpCode::Print:
+        case OpCode::Switch:
+        case OpCode::Inherit:
+        case OpCode::Method:
+        case OpCode::GetSuper:
+        case OpCode::SetProperty:
+        case OpCode::GetIndex:
+        case OpCode::ReleaseScoped:
+        case OpCode::GetIndexUnchecked:
+        case OpCode::AddNum:
+        case OpCode::AddStr:
+        case OpCode::LessNum:
+        case OpCode::GetIndexArray:
+            return -1;
+        case OpCode::SetIndex:
+        case OpCode::SetIndexUnchecked:
+            return -2;
+        // The callee and its arguments leave the result in the callee's slot
+        case OpCode::Call:
+        case OpCode::CallScoped:
+            return -code[offset + 1];
+        case OpCode::Invoke:
+            return -code[offset + 2];
+        case OpCode::SuperInvoke: // the superclass is popped too
+            return -code[offset + 2] - 1;
+        case OpCode::BuildMap:
+            return 1 - 2 * shortAt(code, offset + 1);
+        case OpCode::BuildArray:
+        case OpCode::ScopedArray:
+            return 1 - shortAt(code, offset + 1);
+    }
+    return 0;
+}
+
+} // namespace
+
+int computeMaxStackDepth(const Chunk& chunk, int entryDepth) {
+    const auto& code = chunk.code();
+    // Deepest stack seen on entry to each offset, or -1 if not reached
+    std::vector<int> depthAt(code.size(), -1);
+    std::vector<size_t> pending;
+    int maxDepth = entryDepth;
+    // Well-formed code reaches an offset at one depth only. No path can push
+    // more than once per byte, so a deeper one is a compiler bug and is not
+    // followed around a loop forever.
+    const int limit = entryDepth + static_cast<int>(code.size());
+    auto reach = [&](size_t offset, int depth) {
+        if (offset >= code.size() || depth <= depthAt[offset] || depth > limit) return;
+        depthAt[offset] = depth;
+        pending.push_back(offset);
+    };
+
+    reach(0, entryDepth);
+    // A catch block starts with the slots live at its try and the error
+    for (const auto& handler : chunk.exceptionHandlers()) {
+        reach(handler.handler, static_cast<int>(handler.stackDepth) + 1);
+    }
+
+    while (!pending.empty()) {
+        size_t offset = pending.back();
+        pending.pop_back();
+        int depth = depthAt[offset] + stackEffect(code, offset);
+        maxDepth = std::max(maxDepth, depth);
+        switch (static_cast<OpCode>(code[offset])) {
+            case OpCode::Jump:
+                reach(offset + 3 + shortAt(code, offset + 1), depth);
+                break;
+            case OpCode::JumpIfFalse:
+                reach(offset + 3, depth);
+                reach(offset + 3 + shortAt(code, offset + 1), depth);
+                break;
+            case OpCode::JumpIfNotArray:
+                reach(offset + 4, depth);
+                reach(offset + 4 + shortAt(code, offset + 2), depth);
+                break;
+            case OpCode::Loop:
+                reach(offset + 5 - shortAt(code, offset + 1), depth);
+                break;
+            case OpCode::Switch: {
+                const SwitchTable& table = chunk.switchTable(shortAt(code, offset + 1));
+                for (uint32_t target : table.ints) reach(target, depth);
+                for (const auto& entry : table.strings) reach(entry.second, depth);
+                reach(table.fallback, depth);
+                break;
+            }
+            case OpCode::Return:
+            case OpCode::Throw:
+                break;
+            case OpCode::AddLocals:
+            case OpCode::LessLocalConstJump:
+            case OpCode::AddConstSetLocal:
+                reach(offset + 2, depth); // the GetLocal they replace
+                break;
+            default:
+                reach(offset + chunk.instructionLength(offset), depth);
+                break;
+        }
+    }
+    return maxDepth;
+}
+
+} // namespace claw
@@ -0,0 +1,17 @@
+#pragma once
+#include "vm/chunk.h"
+
+namespace claw {
+
+/**
+ * @brief Deepest the value stack gets in a frame running a chunk
+ *
+ * Follows every path through the code, branches, switch targets and catch
+ * blocks included, starting from entryDepth slots (the callee and its
+ * arguments). Depths count from the base of the frame, so locals are part
+ * of them. A superinstruction is followed along the generic sequence it
+ * starts, which is never shallower than its fused path.
+ */
+int computeMaxStackDepth(const Chunk& chunk, int entryDepth);
+
+} // namespace claw
@@ -10,7 +10,7 @@
 namespace claw {
 
 ClawArray::ClawArray(std::vector<Value> elements)
-    : elements_(std::move(elements)) {}
+    : HeapObject(ObjectType::Array), elements_(std::move(elements)) {}
 
 Value ClawArray::get(size_t index) const {
     if (index >= elements_.size()) {
@@ -41,12 +41,17 @@ void ClawArray::set(size_t index, Value value) {
             profilerRecordAlloc(delta, "array.grow");
         }
     }
-    gcBarrierWrite(this, value);
+    gcBarrierWrite(this, elements_[index], value);
+    elements_[index] = value;
+}
+
+void ClawArray::setUnchecked(size_t index, Value value) {
+    gcBarrierWrite(this, elements_[index], value);
     elements_[index] = value;
 }
 
 void ClawArray::push(Value value) {
-    gcBarrierWrite(this, value);
+    gcBarrierWrite(this, nilValue(), value);
     size_t oldCap = elements_.capacity();
     elements_.push_back(value);
     size_t newCap = elements_.capacity();
@@ -61,6 +66,7 @@ Value ClawArray::pop() {
         return claw::nilValue();  // Return nil for empty array
     }
     Value last = elements_.back();
+    gcBarrierDelete(last);
     elements_.pop_back();
     return last;
 }
@@ -70,7 +76,7 @@ void ClawArray::reverse() {
 }
 
 void ClawArray::fill(Value v, size_t n) {
-    gcBarrierWrite(this, v);
+    gcBarrierWrite(this, nilValue(), v);
     elements_.clear();
     size_t oldCap = elements_.capacity();
     elements_.reserve(n);
@@ -265,12 +271,13 @@ std::shared_ptr<ClawArray> ClawArray::splice(int start, int deleteCount, const s
 Value ClawArray::shift() {
     if (elements_.empty()) return claw::nilValue();
     Value first = elements_[0];
+    gcBarrierDelete(first);
     elements_.erase(elements_.begin());
     return first;
 }
 
 void ClawArray::unshift(const Value& value) {
-    gcBarrierWrite(this, value);
+    gcBarrierWrite(this, nilValue(), value);
     elements_.insert(elements_.begin(), value);
 }
 
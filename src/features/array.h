@@ -7,14 +7,17 @@
 
 namespace claw {
 
-class ClawArray {
+class ClawArray : public HeapObject {
 public:
-    ClawArray() = default;
+    ClawArray() : HeapObject(ObjectType::Array) {}
     explicit ClawArray(std::vector<Value> elements);
     
     // Element access
     Value get(size_t index) const;
     void set(size_t index, Value value);
+    // For callers that have already checked index < length()
+    Value getUnchecked(size_t index) const { return elements_[index]; }
+    void setUnchecked(size_t index, Value value);
     
     // Array operations
     void push(Value value);
@@ -63,4 +66,8 @@ private:
     std::vector<Value> elements_;
 };
 
+inline ClawArray* asArray(Value v) {
+    return isArray(v) ? static_cast<ClawArray*>(asHeapObject(v)) : nullptr;
+}
+
 } // namespace claw
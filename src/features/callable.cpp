@@ -52,6 +52,9 @@ Value ClawFunction::call(Interpreter& interpreter,
         // If it's an initializer, we always return 'this' (the instance)
         if (isInitializer_) return closure_->get("this");
         
+        // The return statement let go of it, but the caller may hold it
+        // while it allocates
+        gcRootValue(returnValue.value);
         return returnValue.value;
     } catch (...) {
         // Ensure we pop even on other exceptions (like RuntimeErrors)
@@ -81,6 +84,9 @@ std::string ClawFunction::toString() const {
 NativeFunction::NativeFunction(int arity, NativeFn function, std::string name)
     : arity_(arity), function_(function), name_(std::move(name)) {}
 
+NativeFunction::NativeFunction(NativeSignature signature, FastNativeFn function, std::string name)
+    : arity_(signature.arity), fast_(function), signature_(signature), name_(std::move(name)) {}
+
 Value NativeFunction::call(Interpreter& interpreter, 
                           const std::vector<Value>& arguments) {
     // Just call the C++ function we wrapped
@@ -93,7 +99,15 @@ Value NativeFunction::call(Interpreter& interpreter,
     }
 
     try {
-        Value result = function_(arguments);
+        Value result;
+        if (fast_) {
+            if (!signature_.accepts(arguments.data(), static_cast<int>(arguments.size()))) {
+                throw std::runtime_error(signature_.typeError);
+            }
+            result = fast_(interpreter, arguments.data(), static_cast<int>(arguments.size()));
+        } else {
+            result = function_(arguments);
+        }
         interpreter.getCallStack().pop();
         return result;
     } catch (...) {
@@ -22,8 +22,9 @@ class Environment;
  * This interface allows both user-defined functions and native functions
  * to work the same way in the interpreter.
  */
-class Callable {
+class Callable : public HeapObject {
 public:
+    explicit Callable(ObjectType type = ObjectType::Callable) : HeapObject(type) {}
     virtual ~Callable() = default;
     
     // Execute the function with given arguments
@@ -37,6 +38,10 @@ public:
     virtual std::string toString() const = 0;
 };
 
+inline Callable* asCallable(Value v) {
+    return isCallable(v) ? static_cast<Callable*>(asHeapObject(v)) : nullptr;
+}
+
 /**
  * VoltFunction - User-defined functions from VoltScript code
  * 
@@ -63,6 +68,25 @@ private:
     bool isInitializer_;
 };
 
+/**
+ * NativeSignature - What a fast native accepts
+ *
+ * The caller checks the arity and the number arguments once, before the
+ * call, so the native reads its arguments without testing them again.
+ */
+struct NativeSignature {
+    int arity;                       // -1 for any number of arguments
+    uint32_t numberArgs = 0;         // bit i set: argument i must be a number
+    const char* typeError = nullptr; // message when one of them is not
+
+    bool accepts(const Value* args, int argc) const {
+        for (int i = 0; i < argc && i < 32; i++) {
+            if ((numberArgs >> i & 1u) && !isNumber(args[i])) return false;
+        }
+        return true;
+    }
+};
+
 /**
  * NativeFunction - Built-in functions implemented in C++
  * 
@@ -72,18 +96,33 @@ private:
 class NativeFunction : public Callable {
 public:
     using NativeFn = std::function<Value(const std::vector<Value>&)>;
+    // Fast natives are plain functions reading their arguments in place,
+    // straight off the VM stack when the VM calls them. They must not keep
+    // the argument pointer past the call.
+    using FastNativeFn = Value (*)(Interpreter& interpreter, const Value* args, int argc);
     
     NativeFunction(int arity, NativeFn function, std::string name);
+    NativeFunction(NativeSignature signature, FastNativeFn function, std::string name);
     
     Value call(Interpreter& interpreter, 
               const std::vector<Value>& arguments) override;
     
     int arity() const override;
     std::string toString() const override;
+
+    FastNativeFn fast() const { return fast_; }
+    const NativeSignature& signature() const { return signature_; }
+    // Set on natives that only use their arguments while they run, so the
+    // VM may hand them closures that live in its frame region
+    bool borrowsArguments() const { return borrowsArguments_; }
+    void setBorrowsArguments() { borrowsArguments_ = true; }
     
 private:
     int arity_;
     NativeFn function_;
+    FastNativeFn fast_ = nullptr;
+    NativeSignature signature_{};
+    bool borrowsArguments_ = false;
     std::string name_;
 };
 
@@ -2,31 +2,126 @@
 #include "interpreter.h"
 #include "interpreter/gc_alloc.h"
 #include "errors.h"
+#include <algorithm>
 
 namespace claw {
 
+// ========================================
+// Shape Implementation
+// ========================================
+
+int Shape::lookup(const char* name) const {
+    if (names_.size() > INDEX_THRESHOLD) {
+        auto it = index_.find(name);
+        return it != index_.end() ? static_cast<int>(it->second) : -1;
+    }
+    for (size_t i = 0; i < names_.size(); i++) {
+        if (names_[i] == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+Shape* Shape::withField(const char* name) {
+    auto& next = transitions_[name];
+    if (!next) {
+        next = std::make_unique<Shape>();
+        next->names_ = names_;
+        next->names_.push_back(name);
+        if (next->names_.size() > INDEX_THRESHOLD) {
+            for (size_t i = 0; i < next->names_.size(); i++) {
+                next->index_.emplace(next->names_[i], static_cast<uint32_t>(i));
+            }
+        }
+    }
+    return next.get();
+}
+
 // ========================================
 // ClawClass Implementation
 // ========================================
 
-std::shared_ptr<ClawFunction> ClawClass::findMethod(const std::string& name) const {
-    auto it = methods_.find(name);
-    if (it != methods_.end()) {
-        return it->second;
+ClawClass::ClawClass(std::string name, std::shared_ptr<ClawClass> superclass,
+                     std::unordered_map<std::string, std::shared_ptr<ClawFunction>> methods)
+    : Callable(ObjectType::Class), name_(std::move(name)), superclass_(std::move(superclass)), methods_(std::move(methods)) {
+    if (superclass_) superclass_->subclasses_.push_back(this);
+    rebuildMethodTable();
+}
+
+ClawClass::~ClawClass() {
+    if (superclass_) {
+        auto& siblings = superclass_->subclasses_;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), this));
     }
+}
 
+void ClawClass::rebuildMethodTable() {
     if (superclass_) {
-        return superclass_->findMethod(name);
+        table_ = superclass_->table_;
+    } else {
+        table_.methods.clear();
+        table_.vmMethods.clear();
+    }
+    for (const auto& [name, method] : methods_) {
+        table_.methods[StringPool::intern(name).data()] = method;
     }
+    for (const auto& [name, method] : vmMethods_) {
+        table_.vmMethods[name] = method.get();
+    }
+    rebuildSubclassTables();
+}
 
-    return nullptr;
+void ClawClass::rebuildSubclassTables() {
+    for (ClawClass* subclass : subclasses_) subclass->rebuildMethodTable();
+}
+
+void ClawClass::setSuperclass(std::shared_ptr<ClawClass> superclass) {
+    gcBarrierWrite(this, superclass_ ? objectValue(superclass_.get()) : nilValue(),
+                   superclass ? objectValue(superclass.get()) : nilValue());
+    if (superclass_) {
+        auto& siblings = superclass_->subclasses_;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), this));
+    }
+    superclass_ = std::move(superclass);
+    if (superclass_) superclass_->subclasses_.push_back(this);
+    rebuildMethodTable();
+}
+
+std::shared_ptr<ClawFunction> ClawClass::findMethod(const std::string& name) const {
+    return findInternedMethod(StringPool::intern(name).data());
+}
+
+std::shared_ptr<ClawFunction> ClawClass::findInternedMethod(const char* name) const {
+    const auto& methods = table_.methods;
+    auto it = methods.find(name);
+    return it != methods.end() ? it->second : nullptr;
+}
+
+void ClawClass::setVMMethod(const char* name, std::shared_ptr<VMClosure> method) {
+    auto& slot = vmMethods_[name];
+    gcBarrierWrite(this, slot ? objectValue(slot.get()) : nilValue(), objectValue(method.get()));
+    slot = std::move(method);
+    // A class's own method overrides whatever it inherited
+    table_.vmMethods[name] = slot.get();
+    rebuildSubclassTables();
+}
+
+void ClawClass::forEachReference(const std::function<void(Value)>& fn) const {
+    if (superclass_) fn(objectValue(superclass_.get()));
+    for (const auto& entry : vmMethods_) fn(objectValue(entry.second.get()));
+}
+
+VMClosure* ClawClass::findVMMethod(const char* name) const {
+    const auto& methods = table_.vmMethods;
+    auto it = methods.find(name);
+    return it != methods.end() ? it->second : nullptr;
 }
 
 Value ClawClass::call(Interpreter& interpreter, const std::vector<Value>& arguments) {
     auto instance = gcNewInstance(shared_from_this());
     
     // Look for initializer
-    auto initializer = findMethod("init");
+    static const char* const initName = StringPool::intern("init").data();
+    auto initializer = findInternedMethod(initName);
     if (initializer) {
         // Bind 'this' to the instance and call init
         initializer->bind(instance)->call(interpreter, arguments);
@@ -36,7 +131,8 @@ Value ClawClass::call(Interpreter& interpreter, const std::vector<Value>& argume
 }
 
 int ClawClass::arity() const {
-    auto initializer = findMethod("init");
+    static const char* const initName = StringPool::intern("init").data();
+    auto initializer = findInternedMethod(initName);
     if (initializer) {
         return initializer->arity();
     }
@@ -51,9 +147,9 @@ Value ClawInstance::get(const Token& name) {
     std::string_view sv = StringPool::intern(name.lexeme);
     
     // 1. Check fields
-    auto it = fields_.find(sv);
-    if (it != fields_.end()) {
-        return it->second;
+    int slot = shape_->lookup(sv.data());
+    if (slot >= 0) {
+        return slots_[slot];
     }
 
     // 2. Check methods
@@ -61,28 +157,54 @@ Value ClawInstance::get(const Token& name) {
     if (cacheIt != ic_get_cache_.end()) {
         return cacheIt->second;
     }
-    auto method = class_->findMethod(std::string(sv));
+    auto method = class_->findInternedMethod(sv.data());
     if (method) {
         Value bound = callableValue(method->bind(shared_from_this()));
+        gcBarrierWrite(this, nilValue(), bound);
         ic_get_cache_[sv] = bound;
         return bound;
     }
+    // Compiled methods bind to VM bound methods, which the interpreter calls
+    // through its foreign call hook
+    if (VMClosure* vmMethod = class_->findVMMethod(sv.data())) {
+        return vmBoundMethodValue(std::make_shared<VMBoundMethod>(objectValue(this), vmMethod));
+    }
 
     throw RuntimeError(name, ErrorCode::RUNTIME_ERROR, "Undefined property '" + std::string(sv) + "'.", {});
 }
 
 void ClawInstance::set(const Token& name, Value value) {
-    std::string_view sv = StringPool::intern(name.lexeme);
-    gcBarrierWrite(this, value);
-    fields_[sv] = value;
+    setField(StringPool::intern(name.lexeme).data(), value);
+}
+
+void ClawInstance::setField(const char* name, Value value) {
+    int slot = shape_->lookup(name);
+    if (slot >= 0) {
+        gcBarrierWrite(this, slots_[slot], value);
+        slots_[slot] = value;
+        return;
+    }
+    gcBarrierWrite(this, nilValue(), value);
+    shape_ = shape_->withField(name);
+    slots_.push_back(value);
 }
 
 void ClawInstance::forEachField(const std::function<void(Value)>& fn) const {
-    for (const auto& kv : fields_) fn(kv.second);
+    for (Value v : slots_) fn(v);
+}
+void ClawInstance::forEachReference(const std::function<void(Value)>& fn) const {
+    fn(objectValue(class_.get()));
+    for (Value v : slots_) fn(v);
+    for (const auto& entry : ic_get_cache_) fn(entry.second);
 }
 bool ClawInstance::has(const Token& name) const {
-    std::string_view sv = StringPool::intern(name.lexeme);
-    return fields_.find(sv) != fields_.end();
+    return shape_->lookup(StringPool::intern(name.lexeme).data()) >= 0;
+}
+bool ClawInstance::getField(const char* name, Value* out) const {
+    int slot = shape_->lookup(name);
+    if (slot < 0) return false;
+    *out = slots_[slot];
+    return true;
 }
 
 } // namespace claw
@@ -14,19 +14,56 @@ namespace claw {
 
 class ClawInstance;
 
+/**
+ * Shape - The field layout shared by instances of a class
+ *
+ * Instances that received the same fields in the same order share a shape,
+ * which maps each field name to an index in the instance's slot vector.
+ * The shapes of a class form a transition tree rooted at the class: adding a
+ * field moves an instance to the child shape for that name. Shapes live as
+ * long as their class, so caches holding the class may compare shape pointers.
+ */
+class Shape {
+public:
+    // Slot of an interned field name, or -1 when the shape has no such field
+    int lookup(const char* name) const;
+    // The shape reached by adding a field, created on first use
+    Shape* withField(const char* name);
+    uint32_t slotCount() const { return static_cast<uint32_t>(names_.size()); }
+
+private:
+    static constexpr size_t INDEX_THRESHOLD = 8;
+    std::vector<const char*> names_; // slot order
+    std::unordered_map<const char*, uint32_t> index_; // only past INDEX_THRESHOLD fields
+    std::unordered_map<const char*, std::unique_ptr<Shape>> transitions_;
+};
+
 /**
  * Represents a class in VoltScript
  */
 class ClawClass : public Callable, public std::enable_shared_from_this<ClawClass> {
 public:
     ClawClass(std::string name, std::shared_ptr<ClawClass> superclass, 
-              std::unordered_map<std::string, std::shared_ptr<ClawFunction>> methods)
-        : name_(std::move(name)), superclass_(std::move(superclass)), methods_(std::move(methods)) {}
+              std::unordered_map<std::string, std::shared_ptr<ClawFunction>> methods);
+    ~ClawClass() override;
 
     const std::string& getName() const { return name_; }
     std::shared_ptr<ClawClass> getSuperclass() const { return superclass_; }
+    void setSuperclass(std::shared_ptr<ClawClass> superclass);
     
     std::shared_ptr<ClawFunction> findMethod(const std::string& name) const;
+    // Same lookup by interned name
+    std::shared_ptr<ClawFunction> findInternedMethod(const char* name) const;
+
+    // Methods compiled for the VM, keyed by interned name. The VM calls them
+    // with the receiver in slot 0 instead of binding them first.
+    void setVMMethod(const char* name, std::shared_ptr<VMClosure> method);
+    VMClosure* findVMMethod(const char* name) const;
+    // The superclass and compiled methods, for the collector
+    void forEachReference(const std::function<void(Value)>& fn) const;
+
+    // Shape of an instance without fields
+    Shape* rootShape() { return &rootShape_; }
 
     // Callable interface (creating an instance)
     Value call(Interpreter& interpreter, const std::vector<Value>& arguments) override;
@@ -34,28 +71,59 @@ public:
     std::string toString() const override { return "<class " + name_ + ">"; }
 
 private:
+    // Every method the class responds to, inherited ones copied down, keyed
+    // by interned name. Built with the class and kept complete as the VM
+    // adds its methods; giving a class a superclass or a method rebuilds
+    // only its subclasses' tables.
+    struct MethodTable {
+        std::unordered_map<const char*, std::shared_ptr<ClawFunction>> methods;
+        std::unordered_map<const char*, VMClosure*> vmMethods;
+    };
+    void rebuildMethodTable();
+    void rebuildSubclassTables();
+
     std::string name_;
     std::shared_ptr<ClawClass> superclass_;
+    // Not owned: a subclass holds its superclass and leaves this list when
+    // it is destroyed
+    std::vector<ClawClass*> subclasses_;
     std::unordered_map<std::string, std::shared_ptr<ClawFunction>> methods_;
+    std::unordered_map<const char*, std::shared_ptr<VMClosure>> vmMethods_;
+    MethodTable table_;
+    Shape rootShape_;
 };
 
 /**
  * Represents an instance of a class
  */
-class ClawInstance : public std::enable_shared_from_this<ClawInstance> {
+class ClawInstance : public HeapObject, public std::enable_shared_from_this<ClawInstance> {
 public:
-    explicit ClawInstance(std::shared_ptr<ClawClass> cls) : class_(std::move(cls)) {}
+    explicit ClawInstance(std::shared_ptr<ClawClass> cls)
+        : HeapObject(ObjectType::Instance), class_(std::move(cls)), shape_(class_->rootShape()) {}
 
     Value get(const Token& name);
     void set(const Token& name, Value value);
     void forEachField(const std::function<void(Value)>& fn) const;
+    // The class, fields and the methods get() bound and cached, for the
+    // collector
+    void forEachReference(const std::function<void(Value)>& fn) const;
     bool has(const Token& name) const;
+    // Field access by interned name; methods are not consulted
+    bool getField(const char* name, Value* out) const;
+    void setField(const char* name, Value value);
+
+    // Slot-indexed access for callers that resolved a name on shape()
+    const Shape* shape() const { return shape_; }
+    Value slot(uint32_t index) const { return slots_[index]; }
 
     std::string toString() const { return "<" + class_->getName() + " instance>"; }
     std::shared_ptr<ClawClass> getClass() const { return class_; }
+    ClawClass* getClassPtr() const { return class_.get(); }
 
 private:
     std::shared_ptr<ClawClass> class_;
+    Shape* shape_;
+    std::vector<Value> slots_;
     struct InternedStringHash {
         size_t operator()(std::string_view sv) const {
             return std::hash<const char*>{}(sv.data());
@@ -66,8 +134,15 @@ private:
             return sv1.data() == sv2.data();
         }
     };
-    std::unordered_map<std::string_view, Value, InternedStringHash, InternedStringEqual> fields_;
     std::unordered_map<std::string_view, Value, InternedStringHash, InternedStringEqual> ic_get_cache_;
 };
 
+inline ClawClass* asClass(Value v) {
+    return isClass(v) ? static_cast<ClawClass*>(asHeapObject(v)) : nullptr;
+}
+
+inline ClawInstance* asInstance(Value v) {
+    return isInstance(v) ? static_cast<ClawInstance*>(asHeapObject(v)) : nullptr;
+}
+
 } // namespace claw
@@ -18,16 +18,17 @@ using HashMapPtr = std::shared_ptr<ClawHashMap>;
  * 
  * Stores key-value pairs where keys are strings and values can be any VoltScript type
  */
-struct ClawHashMap {
+struct ClawHashMap : HeapObject {
     std::unordered_map<std::string, Value> data;
     size_t lastBuckets = 0;
     mutable std::mutex mu;
     
     // Constructor
-    ClawHashMap() = default;
+    ClawHashMap() : HeapObject(ObjectType::HashMap) {}
     
     // Copy constructor
-    ClawHashMap(const std::unordered_map<std::string, Value>& initialData) : data(initialData) {}
+    ClawHashMap(const std::unordered_map<std::string, Value>& initialData)
+        : HeapObject(ObjectType::HashMap), data(initialData) {}
     
     // Get the number of key-value pairs
     size_t size() const { return data.size(); }
@@ -51,9 +52,10 @@ struct ClawHashMap {
     
     // Set key-value pair
     void set(const std::string& key, const Value& value) {
-        gcBarrierWrite(this, value);
         size_t oldBuckets = data.bucket_count();
-        data[key] = value;
+        Value& slot = data[key];
+        gcBarrierWrite(this, slot, value);
+        slot = value;
         size_t newBuckets = data.bucket_count();
         if (newBuckets > oldBuckets) {
             size_t deltaBuckets = newBuckets - oldBuckets;
@@ -66,7 +68,7 @@ struct ClawHashMap {
     void ensureDefault(const std::string& key, const Value& defaultValue) {
         std::lock_guard<std::mutex> lock(mu);
         if (data.find(key) == data.end()) {
-            gcBarrierWrite(this, defaultValue);
+            gcBarrierWrite(this, nilValue(), defaultValue);
             size_t oldBuckets = data.bucket_count();
             data[key] = defaultValue;
             size_t newBuckets = data.bucket_count();
@@ -80,7 +82,11 @@ struct ClawHashMap {
     
     // Remove a key-value pair
     bool remove(const std::string& key) {
-        return data.erase(key) > 0;
+        auto it = data.find(key);
+        if (it == data.end()) return false;
+        gcBarrierDelete(it->second);
+        data.erase(it);
+        return true;
     }
     
     // Get all keys as a vector (optimized)
@@ -107,7 +113,7 @@ struct ClawHashMap {
         return values;
     }
     
-    // Clear all entries
+    // Clear all entries; only the collector clears maps, so no barrier
     void clear() { data.clear(); }
     
     // Equality comparison
@@ -118,9 +124,15 @@ struct ClawHashMap {
     // Merge another hash map into this one
     void merge(const ClawHashMap& other) {
         for (const auto& [key, value] : other.data) {
-            data[key] = value;
+            Value& slot = data[key];
+            gcBarrierWrite(this, slot, value);
+            slot = value;
         }
     }
 };
 
+inline ClawHashMap* asHashMap(Value v) {
+    return isHashMap(v) ? static_cast<ClawHashMap*>(asHeapObject(v)) : nullptr;
+}
+
 } // namespace claw
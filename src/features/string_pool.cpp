@@ -1,25 +1,29 @@
 #include "string_pool.h"
+#include "interpreter/value.h"
 #include <mutex>
+#include <new>
 
 namespace claw {
 
-std::string_view StringPool::internImpl(const std::string& str) {
-    {
-        std::shared_lock<std::shared_mutex> rlock(mutex_);
-        auto it = pool_.find(str);
-        if (it != pool_.end()) return *it;
-    }
-    {
-        std::unique_lock<std::shared_mutex> wlock(mutex_);
-        auto it = pool_.find(str);
-        if (it != pool_.end()) return *it;
-        auto [inserted_it, inserted] = pool_.insert(str);
-        (void)inserted;
-        return *inserted_it;
-    }
+size_t StringPool::TransparentHash::operator()(std::string_view sv) const noexcept {
+    return ClawString::hashOf(sv);
 }
 
-std::string_view StringPool::internImpl(std::string_view str) {
+// Pooled strings are hashed as they are interned, so growing the pool
+// rehashes nothing
+size_t StringPool::TransparentHash::operator()(const ClawString* s) const noexcept {
+    return s->hash_;
+}
+
+bool StringPool::TransparentEqual::operator()(const ClawString* a, std::string_view b) const noexcept {
+    return a->flatView() == b;
+}
+
+std::string_view StringPool::intern(std::string_view str) {
+    return internString(str)->flatView();
+}
+
+const ClawString* StringPool::internImpl(std::string_view str) {
     {
         std::shared_lock<std::shared_mutex> rlock(mutex_);
         auto it = pool_.find(str);
@@ -29,15 +33,35 @@ std::string_view StringPool::internImpl(std::string_view str) {
         std::unique_lock<std::shared_mutex> wlock(mutex_);
         auto it = pool_.find(str);
         if (it != pool_.end()) return *it;
-        auto [inserted_it, inserted] = pool_.insert(std::string(str));
-        (void)inserted;
-        return *inserted_it;
+        void* memory = ::operator new(sizeof(ClawString) + str.size() + 1);
+        auto* string = new (memory) ClawString(static_cast<uint32_t>(str.size()), true);
+        char* chars = const_cast<char*>(string->flatView().data());
+        str.copy(chars, str.size());
+        chars[str.size()] = '\0';
+        // Cached before other threads can see the string
+        string->hash_ = ClawString::hashOf(str);
+        pool_.insert(string);
+        return string;
     }
 }
 
-void StringPool::clear() {
-    std::unique_lock<std::shared_mutex> lock(mutex_);
-    pool_.clear();
+const ClawString* StringPool::findImpl(std::string_view str) const {
+    std::shared_lock<std::shared_mutex> rlock(mutex_);
+    auto it = pool_.find(str);
+    return it != pool_.end() ? *it : nullptr;
+}
+
+const ClawString* StringPool::findImpl(const HashedKey& key) const {
+    std::shared_lock<std::shared_mutex> rlock(mutex_);
+    auto it = pool_.find(key);
+    return it != pool_.end() ? *it : nullptr;
+}
+
+StringPool::~StringPool() {
+    for (const ClawString* string : pool_) {
+        string->~ClawString();
+        ::operator delete(const_cast<ClawString*>(string));
+    }
 }
 
 } // namespace claw
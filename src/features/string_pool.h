@@ -3,14 +3,19 @@
 #include <unordered_set>
 #include <string_view>
 #include <shared_mutex>
+#include <cstdint>
 
 namespace claw {
 
+struct ClawString;
+
 /**
  * @brief Thread-safe String Pool for string interning
- * 
+ *
  * This ensures that identical strings share the same memory location,
  * allowing for fast string comparisons (pointer comparison instead of content).
+ * Only identifiers and constants are interned; interned strings live until
+ * the pool goes away.
  */
 class StringPool {
 public:
@@ -21,42 +26,60 @@ public:
 
     // Intern a string and return a stable string_view to it
     static std::string_view intern(const std::string& str) {
-        return getInstance().internImpl(str);
+        return intern(std::string_view(str));
+    }
+    static std::string_view intern(std::string_view str);
+    static std::string_view intern(const char* str) {
+        return intern(std::string_view(str ? str : ""));
     }
-    static std::string_view intern(std::string_view str) {
+    // The interned string object, for string Values
+    static const ClawString* internString(std::string_view str) {
         return getInstance().internImpl(str);
     }
-    static std::string_view intern(const char* str) {
-        return getInstance().internImpl(std::string_view(str ? str : ""));
+    // The interned string equal to str, or nullptr; never interns it
+    static const ClawString* find(std::string_view str) {
+        return getInstance().findImpl(str);
+    }
+    // The same for characters whose hash the caller already has, such as
+    // the one a string object caches
+    static const ClawString* find(std::string_view str, uint32_t hash) {
+        return getInstance().findImpl(HashedKey{str, hash});
     }
 
     // Statistics
     size_t size() const { return pool_.size(); }
-    void clear();
 
 private:
     StringPool() = default;
-    ~StringPool() = default;
+    ~StringPool();
     StringPool(const StringPool&) = delete;
     StringPool& operator=(const StringPool&) = delete;
 
-    std::string_view internImpl(const std::string& str);
-    std::string_view internImpl(std::string_view str);
+    const ClawString* internImpl(std::string_view str);
+    const ClawString* findImpl(std::string_view str) const;
 
+    // Characters to look up with their hash already known
+    struct HashedKey {
+        std::string_view text;
+        size_t hash;
+    };
+    const ClawString* findImpl(const HashedKey& key) const;
     struct TransparentHash {
         using is_transparent = void;
-        size_t operator()(std::string_view sv) const noexcept { return std::hash<std::string_view>{}(sv); }
-        size_t operator()(const std::string& s) const noexcept { return std::hash<std::string_view>{}(s); }
+        size_t operator()(std::string_view sv) const noexcept;
+        size_t operator()(const ClawString* s) const noexcept;
+        size_t operator()(const HashedKey& key) const noexcept { return key.hash; }
     };
     struct TransparentEqual {
         using is_transparent = void;
-        bool operator()(std::string_view a, std::string_view b) const noexcept { return a == b; }
-        bool operator()(const std::string& a, const std::string& b) const noexcept { return a == b; }
-        bool operator()(const std::string& a, std::string_view b) const noexcept { return a == b; }
-        bool operator()(std::string_view a, const std::string& b) const noexcept { return a == b; }
+        bool operator()(const ClawString* a, const ClawString* b) const noexcept { return a == b; }
+        bool operator()(const ClawString* a, std::string_view b) const noexcept;
+        bool operator()(std::string_view a, const ClawString* b) const noexcept { return (*this)(b, a); }
+        bool operator()(const ClawString* a, const HashedKey& b) const noexcept { return (*this)(a, b.text); }
+        bool operator()(const HashedKey& a, const ClawString* b) const noexcept { return (*this)(b, a.text); }
     };
 
-    std::unordered_set<std::string, TransparentHash, TransparentEqual> pool_;
+    std::unordered_set<const ClawString*, TransparentHash, TransparentEqual> pool_;
     mutable std::shared_mutex mutex_;
 };
 
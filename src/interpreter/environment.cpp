@@ -19,21 +19,20 @@ Value Environment::get(std::string_view name) const {
     // Intern the name to ensure pointer-based comparison works
     name = StringPool::intern(name);
 
-    // 0. Check cache
+    // 1. Check current scope. Own variables are not cached: the VM writes
+    // globals through slot() pointers, which would leave a cached copy stale.
+    auto it = values_.find(name);
+    if (it != values_.end()) {
+        return it->second;
+    }
+
+    // 2. Check cache of enclosing lookups
     auto cache_it = lookup_cache_.find(name);
     if (cache_it != lookup_cache_.end()) {
         return cache_it->second.value;
     }
-
-    // 1. Check current scope
-    auto it = values_.find(name);
-    if (it != values_.end()) {
-        Value val = it->second;
-        lookup_cache_[name] = {nullptr, val, true};
-        return val;
-    }
     
-    // 2. Check enclosing scope
+    // 3. Check enclosing scope
     if (enclosing_) {
         try {
             Value val = enclosing_->get(name);
@@ -56,7 +55,6 @@ void Environment::assign(std::string_view name, Value value) {
     auto it = values_.find(name);
     if (it != values_.end()) {
         it->second = value;
-        lookup_cache_[name] = {nullptr, value, true}; // Update cache
         return;
     }
     
@@ -83,6 +81,12 @@ bool Environment::exists(std::string_view name) const {
     return false;
 }
 
+Value* Environment::slot(std::string_view name) {
+    name = StringPool::intern(name);
+    auto it = values_.find(name);
+    return it != values_.end() ? &it->second : nullptr;
+}
+
 void Environment::forEachValue(const std::function<void(Value)>& fn) const {
     for (const auto& kv : values_) {
         fn(kv.second);
@@ -90,6 +94,28 @@ void Environment::forEachValue(const std::function<void(Value)>& fn) const {
     if (enclosing_) enclosing_->forEachValue(fn);
 }
 
+// Every environment alive, linked through prevLive_ and nextLive_
+static Environment* g_liveEnvironments = nullptr;
+
+void Environment::linkLive() {
+    nextLive_ = g_liveEnvironments;
+    if (nextLive_) nextLive_->prevLive_ = this;
+    g_liveEnvironments = this;
+}
+
+void Environment::unlinkLive() {
+    if (prevLive_) prevLive_->nextLive_ = nextLive_;
+    else g_liveEnvironments = nextLive_;
+    if (nextLive_) nextLive_->prevLive_ = prevLive_;
+}
+
+void Environment::forEachLiveValue(const std::function<void(Value)>& fn) {
+    for (const Environment* env = g_liveEnvironments; env; env = env->nextLive_) {
+        for (const auto& kv : env->values_) fn(kv.second);
+        for (const auto& kv : env->lookup_cache_) fn(kv.second.value);
+    }
+}
+
 void Environment::forEachKey(const std::function<void(std::string_view)>& fn) const {
     for (const auto& kv : values_) {
         fn(kv.first);
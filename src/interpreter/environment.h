@@ -25,7 +25,7 @@ public:
                     allowOutput_(true),
                     allowNetwork_(false),
                     logPath_("claw.log"),
-                    logHmacKey_("") {}
+                    logHmacKey_("") { linkLive(); }
     explicit Environment(std::shared_ptr<Environment> enclosing) 
         : enclosing_(enclosing),
           sandboxMode_(SandboxMode::Full),
@@ -37,7 +37,10 @@ public:
           allowNetwork_(false),
           logPath_("claw.log"),
           logHmacKey_(""),
-          logMetaRequired_(false) {}
+          logMetaRequired_(false) { linkLive(); }
+    ~Environment() { unlinkLive(); }
+    Environment(const Environment&) = delete;
+    Environment& operator=(const Environment&) = delete;
     
     // Define new variable
     void define(std::string_view name, Value value);
@@ -52,6 +55,10 @@ public:
     // Check if variable exists
     bool exists(std::string_view name) const;
 
+    // Storage of a variable defined in this scope, or nullptr. The pointer stays
+    // valid for the lifetime of the environment (variables are never removed).
+    Value* slot(std::string_view name);
+
     // Sandbox
     void setSandbox(SandboxMode mode);
     SandboxMode sandbox() const { return sandboxMode_; }
@@ -111,6 +118,9 @@ public:
     void forEachValue(const std::function<void(Value)>& fn) const;
     void forEachKey(const std::function<void(std::string_view)>& fn) const;
     std::shared_ptr<Environment> enclosing() const { return enclosing_; }
+    // Variables of every environment still alive, enclosing ones included
+    // once each; the collector's roots for the interpreter
+    static void forEachLiveValue(const std::function<void(Value)>& fn);
 
 private:
     // Using string_view as key for performance (guaranteed interned)
@@ -136,6 +146,11 @@ private:
     bool antiDebugEnforced_ = false;
     bool dynamicCodeEncryption_ = false;
     std::string cryptoPreferred_ = "AES_GCM";
+
+    void linkLive();
+    void unlinkLive();
+    Environment* prevLive_ = nullptr;
+    Environment* nextLive_ = nullptr;
 };
 
 } // namespace claw
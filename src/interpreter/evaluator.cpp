@@ -54,7 +54,7 @@ Value Evaluator::evaluateLiteral(LiteralExpr* expr) {
             return numberToValue(expr->numberValue);
         
         case LiteralExpr::Type::String:
-            return stringValue(StringPool::intern(expr->stringValue).data());
+            return internedStringValue(expr->stringValue);
         
         case LiteralExpr::Type::Bool:
             return boolValue(expr->boolValue);
@@ -101,14 +101,14 @@ Value Evaluator::evaluateBinary(BinaryExpr* expr) {
                 return numberToValue(asNumber(left) + asNumber(right));
             }
             if (isString(left) && isString(right)) {
-                return stringValue(StringPool::intern(asString(left) + asString(right)).data());
+                return concatStrings(left, right);
             }
             // Type coercion: string + number or number + string
             if (isString(left) && isNumber(right)) {
-                return stringValue(StringPool::intern(asString(left) + valueToString(right)).data());
+                return concatStrings(left, valueToString(right));
             }
             if (isNumber(left) && isString(right)) {
-                return stringValue(StringPool::intern(valueToString(left) + asString(right)).data());
+                return concatStrings(valueToString(left), right);
             }
             throw RuntimeError(expr->op, "Operands must be two numbers or two strings");
         
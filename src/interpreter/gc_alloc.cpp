@@ -1,10 +1,82 @@
 #include "gc_alloc.h"
 #include "observability/profiler.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
 namespace claw {
+static constexpr size_t NURSERY_CHUNK = 32 * 1024;
+static constexpr size_t NURSERY_MAX_OBJECT = 1024;
+static constexpr size_t NURSERY_FREE_CHUNKS_MAX = 64;
+
+// Chunks are aligned to their size, so an object finds its chunk's header
+// by masking its address
+struct alignas(16) NurseryChunk {
+    NurseryChunk* nextFree;
+    size_t live;
+};
+
+// Plain pointers, so objects freed during static destruction still find
+// their chunks
+static NurseryChunk* g_nurseryChunk = nullptr;
+static char* g_nurseryBump = nullptr;
+static char* g_nurseryLimit = nullptr;
+static NurseryChunk* g_freeChunks = nullptr;
+static size_t g_freeChunkCount = 0;
+
+static char* chunkStart(NurseryChunk* chunk) { return reinterpret_cast<char*>(chunk + 1); }
+
+static void nurseryRefill() {
+    if (!g_nurseryChunk || g_nurseryChunk->live != 0) {
+        if (g_freeChunks) {
+            g_nurseryChunk = g_freeChunks;
+            g_freeChunks = g_freeChunks->nextFree;
+            g_freeChunkCount--;
+        } else {
+            g_nurseryChunk = static_cast<NurseryChunk*>(std::aligned_alloc(NURSERY_CHUNK, NURSERY_CHUNK));
+            if (!g_nurseryChunk) throw std::bad_alloc();
+            profilerRecordAlloc(NURSERY_CHUNK, "nursery.chunk");
+        }
+        g_nurseryChunk->nextFree = nullptr;
+        g_nurseryChunk->live = 0;
+    }
+    g_nurseryBump = chunkStart(g_nurseryChunk);
+    g_nurseryLimit = reinterpret_cast<char*>(g_nurseryChunk) + NURSERY_CHUNK;
+}
+
+void* gcNurseryAllocate(size_t size) {
+    if (size > NURSERY_MAX_OBJECT) return ::operator new(size);
+    size = (size + 15) & ~static_cast<size_t>(15);
+    if (static_cast<size_t>(g_nurseryLimit - g_nurseryBump) < size) nurseryRefill();
+    void* p = g_nurseryBump;
+    g_nurseryBump += size;
+    g_nurseryChunk->live++;
+    return p;
+}
+
+void gcNurseryFree(void* p, size_t size) {
+    if (size > NURSERY_MAX_OBJECT) {
+        ::operator delete(p);
+        return;
+    }
+    auto* chunk = reinterpret_cast<NurseryChunk*>(
+        reinterpret_cast<uintptr_t>(p) & ~static_cast<uintptr_t>(NURSERY_CHUNK - 1));
+    if (--chunk->live > 0) return;
+    if (chunk == g_nurseryChunk) {
+        // Everything handed out from the current chunk died; start it over
+        g_nurseryBump = chunkStart(chunk);
+    } else if (g_freeChunkCount < NURSERY_FREE_CHUNKS_MAX) {
+        chunk->nextFree = g_freeChunks;
+        g_freeChunks = chunk;
+        g_freeChunkCount++;
+    } else {
+        std::free(chunk);
+    }
+}
+
 std::shared_ptr<ClawArray> gcNewArray() {
     auto a = gcAcquireArrayFromPool();
     if (a) return a;
-    auto p = std::make_shared<ClawArray>();
+    auto p = gcNurseryNew<ClawArray>();
     profilerRecordAlloc(sizeof(ClawArray), "array");
     return p;
 }
@@ -17,14 +89,14 @@ std::shared_ptr<ClawArray> gcNewArray(const std::vector<Value>& elements) {
         profilerRecordAlloc(sizeof(ClawArray) + elements.size() * sizeof(Value), "array");
         return a;
     }
-    auto p = std::make_shared<ClawArray>(elements);
+    auto p = gcNurseryNew<ClawArray>(elements);
     profilerRecordAlloc(sizeof(ClawArray) + elements.size() * sizeof(Value), "array");
     return p;
 }
 std::shared_ptr<ClawArray> gcNewArrayReserved(size_t reserve) {
     auto a = gcAcquireArrayFromPool();
     if (!a) {
-        a = std::make_shared<ClawArray>();
+        a = gcNurseryNew<ClawArray>();
         profilerRecordAlloc(sizeof(ClawArray) + reserve * sizeof(Value), "array");
     } else {
         profilerRecordAlloc(sizeof(ClawArray) + reserve * sizeof(Value), "array");
@@ -36,7 +108,7 @@ std::shared_ptr<ClawArray> gcNewArrayReserved(size_t reserve) {
 std::shared_ptr<ClawArray> gcNewArrayFilled(size_t n, Value v) {
     auto a = gcAcquireArrayFromPool();
     if (!a) {
-        auto p = std::make_shared<ClawArray>(std::vector<Value>(n, v));
+        auto p = gcNurseryNew<ClawArray>(std::vector<Value>(n, v));
         profilerRecordAlloc(sizeof(ClawArray) + n * sizeof(Value), "array");
         return p;
     }
@@ -47,12 +119,12 @@ std::shared_ptr<ClawArray> gcNewArrayFilled(size_t n, Value v) {
 std::shared_ptr<ClawHashMap> gcNewHashMap() {
     auto m = gcAcquireHashMapFromPool();
     if (m) return m;
-    auto p = std::make_shared<ClawHashMap>();
+    auto p = gcNurseryNew<ClawHashMap>();
     profilerRecordAlloc(sizeof(ClawHashMap), "hashmap");
     return p;
 }
 std::shared_ptr<ClawInstance> gcNewInstance(std::shared_ptr<ClawClass> cls) {
-    auto p = std::make_shared<ClawInstance>(std::move(cls));
+    auto p = gcNurseryNew<ClawInstance>(std::move(cls));
     profilerRecordAlloc(sizeof(ClawInstance), "instance");
     return p;
 }
@@ -3,7 +3,36 @@
 #include "features/hashmap.h"
 #include "features/class.h"
 #include <memory>
+#include <cstddef>
+#include <utility>
 namespace claw {
+// The nursery: young arrays, maps and instances are bump-allocated from
+// aligned chunks. A chunk counts the objects still in it and is reused once
+// they have all died. Objects never move, so survivors are promoted where
+// they are.
+void* gcNurseryAllocate(size_t size);
+void gcNurseryFree(void* p, size_t size);
+
+template <typename T>
+struct NurseryAllocator {
+    using value_type = T;
+    NurseryAllocator() = default;
+    template <typename U>
+    NurseryAllocator(const NurseryAllocator<U>&) {}
+    T* allocate(size_t n) { return static_cast<T*>(gcNurseryAllocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) { gcNurseryFree(p, n * sizeof(T)); }
+    template <typename U>
+    bool operator==(const NurseryAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const NurseryAllocator<U>&) const { return false; }
+};
+
+template <typename T, typename... Args>
+std::shared_ptr<T> gcNurseryNew(Args&&... args) {
+    static_assert(alignof(T) <= 16, "nursery objects are 16-byte aligned");
+    return std::allocate_shared<T>(NurseryAllocator<T>(), std::forward<Args>(args)...);
+}
+
 std::shared_ptr<ClawArray> gcNewArray();
 std::shared_ptr<ClawArray> gcNewArray(const std::vector<Value>& elements);
 std::shared_ptr<ClawArray> gcNewArrayReserved(size_t reserve);
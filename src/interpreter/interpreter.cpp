@@ -114,18 +114,18 @@ void Interpreter::defineNatives() {
     // type(val) - get type of value as string
     globals_->define("type", std::make_shared<NativeFunction>(
         1,
-        [](const std::vector<Value>& args) -> Value {
+        [this](const std::vector<Value>& args) -> Value {
             const Value& v = args[0];
             std::string t = "unknown";
             if (isNil(v)) t = "nil";
             else if (isBool(v)) t = "bool";
             else if (isNumber(v)) t = "number";
             else if (isString(v)) t = "string";
-            else if (isCallable(v)) t = "function";
+            else if (isCallableValue(v)) t = "function";
             else if (isArray(v)) t = "array";
             else if (isHashMap(v)) t = "hashmap";
-            auto sv = StringPool::intern(t);
-            return stringValue(sv.data());
+            else if (isStringBuilder(v)) t = "stringbuilder";
+            return newStringValue(t);
         },
         "type"
     ));
@@ -143,8 +143,7 @@ void Interpreter::defineNatives() {
             
             auto resultArray = gcNewArray();
             for (const auto& key : keysVec) {
-                auto sv = StringPool::intern(key);
-                resultArray->push(stringValue(sv.data()));
+                resultArray->push(newStringValue(key));
             }
             
             return arrayValue(resultArray);
@@ -250,8 +249,7 @@ void Interpreter::defineNatives() {
                 throw std::runtime_error("Character code must be between 0 and 255");
             }
             
-            auto sv = StringPool::intern(std::string(1, static_cast<char>(code)));
-            return stringValue(sv.data());
+            return newStringValue(std::string(1, static_cast<char>(code)));
         },
         "fromCharCode"
     ));
@@ -261,10 +259,10 @@ void Interpreter::defineNatives() {
     // compose(...functions) - compose functions from right to left
     globals_->define("compose", std::make_shared<NativeFunction>(
         -1, // Variable arity
-        [](const std::vector<Value>& args) -> Value {
+        [this](const std::vector<Value>& args) -> Value {
             // Verify all arguments are callable
             for (const auto& arg : args) {
-                if (!isCallable(arg)) {
+                if (!isCallableValue(arg)) {
                     throw std::runtime_error("E2001: All arguments to compose() must be functions");
                 }
             }
@@ -292,10 +290,10 @@ void Interpreter::defineNatives() {
     // pipe(...functions) - pipe value through functions from left to right
     globals_->define("pipe", std::make_shared<NativeFunction>(
         -1, // Variable arity
-        [](const std::vector<Value>& args) -> Value {
+        [this](const std::vector<Value>& args) -> Value {
             // Verify all arguments are callable
             for (const auto& arg : args) {
-                if (!isCallable(arg)) {
+                if (!isCallableValue(arg)) {
                     throw std::runtime_error("E2001: All arguments to pipe() must be functions");
                 }
             }
@@ -327,15 +325,15 @@ void Interpreter::defineNatives() {
     globals_->define("benchmark", std::make_shared<NativeFunction>(
         -1, // Variable arity: function + any number of arguments
         [this](const std::vector<Value>& args) -> Value {
-            if (args.empty() || !isCallable(args[0])) {
+            if (args.empty() || !isCallableValue(args[0])) {
                 throw std::runtime_error("benchmark() requires a function as first argument");
             }
             
-            auto func = asCallable(args[0]);
+            Value func = args[0];
             std::vector<Value> callArgs(args.begin() + 1, args.end());
             
             auto start = std::chrono::high_resolution_clock::now();
-            Value result = func->call(*this, callArgs);
+            Value result = callArgument(func, callArgs);
             auto end = std::chrono::high_resolution_clock::now();
             
             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
@@ -366,12 +364,22 @@ void Interpreter::defineNatives() {
 // STATEMENT EXECUTION
 // ========================================
 
+// What a statement allocates stays reachable until it finishes, however
+// long C++ code holds it
 void Interpreter::execute(Stmt* stmt) {
     if (stmt) {
+        GCRootScope roots;
         stmt->accept(*this);
     }
 }
 
+// A loop's condition and increment run once per iteration, so what they
+// allocate is let go each time rather than with the whole loop
+bool Interpreter::loopCondition(Expr* condition) {
+    GCRootScope roots;
+    return isTruthy(evaluate(condition));
+}
+
 void Interpreter::execute(const std::vector<StmtPtr>& statements) {
     for (const auto& stmt : statements) {
         execute(stmt.get());
@@ -428,7 +436,7 @@ void Interpreter::visitIfStmt(IfStmt* stmt) {
 }
 
 void Interpreter::visitWhileStmt(WhileStmt* stmt) {
-    while (isTruthy(evaluate(stmt->condition.get()))) {
+    while (loopCondition(stmt->condition.get())) {
         try {
             execute(stmt->body.get());
         } catch (const ContinueException&) {
@@ -449,7 +457,7 @@ void Interpreter::visitRunUntilStmt(RunUntilStmt* stmt) {
         } catch (const BreakException&) {
             break; // Exit the loop
         }
-    } while (!isTruthy(evaluate(stmt->condition.get())));
+    } while (!loopCondition(stmt->condition.get()));
 }
 
 void Interpreter::visitForStmt(ForStmt* stmt) {
@@ -467,7 +475,7 @@ void Interpreter::visitForStmt(ForStmt* stmt) {
         // Condition (default to true if omitted)
         auto checkCondition = [&]() {
             if (stmt->condition) {
-                return isTruthy(evaluate(stmt->condition.get()));
+                return loopCondition(stmt->condition.get());
             }
             return true;
         };
@@ -484,6 +492,7 @@ void Interpreter::visitForStmt(ForStmt* stmt) {
             
             // Execute increment
             if (stmt->increment) {
+                GCRootScope roots;
                 evaluate(stmt->increment.get());
             }
         }
@@ -534,8 +543,7 @@ void Interpreter::visitTryStmt(TryStmt* stmt) {
         
         // Formatted error message with error code
         std::string errorMsg = errorCodeToString(e.code) + ": " + e.what();
-        auto sv = StringPool::intern(errorMsg);
-        catchEnv->define(stmt->exceptionVar, stringValue(sv.data()));
+        catchEnv->define(stmt->exceptionVar, newStringValue(errorMsg));
         
         auto previousEnv = environment_;
         try {
@@ -550,8 +558,7 @@ void Interpreter::visitTryStmt(TryStmt* stmt) {
         if (!stmt->catchBody) return;
         
         auto catchEnv = std::make_shared<Environment>(environment_);
-        auto sv2 = StringPool::intern(std::string(e.what()));
-        catchEnv->define(stmt->exceptionVar, stringValue(sv2.data()));
+        catchEnv->define(stmt->exceptionVar, newStringValue(e.what()));
         
         auto previousEnv = environment_;
         try {
@@ -640,7 +647,7 @@ Value Interpreter::visitLiteralExpr(LiteralExpr* expr) {
         case LiteralExpr::Type::Number:
             return numberToValue(expr->numberValue);
         case LiteralExpr::Type::String:
-            return stringValue(StringPool::intern(expr->stringValue).data());
+            return internedStringValue(expr->stringValue);
         case LiteralExpr::Type::Bool:
             return boolValue(expr->boolValue);
         case LiteralExpr::Type::Nil:
@@ -686,14 +693,14 @@ Value Interpreter::visitBinaryExpr(BinaryExpr* expr) {
                 return numberToValue(asNumber(left) + asNumber(right));
             }
             if (isString(left) && isString(right)) {
-                return stringValue(StringPool::intern(asString(left) + asString(right)).data());
+                return concatStrings(left, right);
             }
             // Type coercion: string + number or number + string
             if (isString(left) && isNumber(right)) {
-                return stringValue(StringPool::intern(asString(left) + valueToString(right)).data());
+                return concatStrings(left, valueToString(right));
             }
             if (isNumber(left) && isString(right)) {
-                return stringValue(StringPool::intern(valueToString(left) + asString(right)).data());
+                return concatStrings(valueToString(left), right);
             }
             throwRuntimeError(expr->op, ErrorCode::TYPE_MISMATCH, "Operands must be two numbers or two strings");
             
@@ -806,9 +813,32 @@ Value Interpreter::visitCallExpr(CallExpr* expr) {
         arguments.push_back(evaluate(arg.get()));
     }
     
+    return callValue(callee, arguments, expr->token);
+}
+
+bool Interpreter::isCallableValue(Value value) const {
+    if (isCallable(value)) return true;
+    return foreignCall_ && (isVMClosure(value) || isVMFunction(value) || isVMBoundMethod(value));
+}
+
+// Calls a function handed to a native, which may be a foreign one. Like the
+// natives always have, this skips the arity check of callValue.
+Value Interpreter::callArgument(Value function, const std::vector<Value>& arguments) {
+    Value result;
+    if (!isCallable(function) && foreignCall_ && foreignCall_(function, arguments, &result)) return result;
+    return asCallable(function)->call(*this, arguments);
+}
+
+Value Interpreter::callValue(Value callee, const std::vector<Value>& arguments, const Token& token) {
+    // Classes go to the hook too, since compiled ones construct in the VM
+    Value result;
+    if ((!isCallable(callee) || isClass(callee)) && foreignCall_ && foreignCall_(callee, arguments, &result)) {
+        return result;
+    }
+
     if (!isCallable(callee) && !isClass(callee)) {
         throwRuntimeError(
-            expr->token,
+            token,
             ErrorCode::NOT_CALLABLE,
             "Can only call functions and classes"
         );
@@ -816,15 +846,15 @@ Value Interpreter::visitCallExpr(CallExpr* expr) {
     
     std::shared_ptr<Callable> function;
     if (isClass(callee)) {
-        function = asClass(callee);
+        function = shareObject(asClass(callee));
     } else {
-        function = asCallable(callee);
+        function = shareObject(asCallable(callee));
     }
     
     // Check arity (number of arguments)
     if (function->arity() != -1 && arguments.size() != static_cast<size_t>(function->arity())) {
         throwRuntimeError(
-            expr->token,
+            token,
             ErrorCode::ARGUMENT_COUNT_MISMATCH,
             "Expected " + std::to_string(function->arity()) +
             " arguments but got " + std::to_string(arguments.size())
@@ -862,11 +892,9 @@ Value Interpreter::visitCompoundAssignExpr(CompoundAssignExpr* expr) {
             if (isNumber(current) && isNumber(operand)) {
                 result = numberToValue(asNumber(current) + asNumber(operand));
             } else if (isString(current) && isString(operand)) {
-                auto sv = StringPool::intern(asString(current) + asString(operand));
-                result = stringValue(sv.data());
+                result = concatStrings(current, operand);
             } else if (isString(current) && isNumber(operand)) {
-                auto sv = StringPool::intern(asString(current) + valueToString(operand));
-                result = stringValue(sv.data());
+                result = concatStrings(current, valueToString(operand));
             } else {
                 throwRuntimeError(expr->op, ErrorCode::TYPE_MISMATCH, "Operands must be compatible for +=");
             }
@@ -1100,7 +1128,7 @@ Value Interpreter::visitSuperExpr(SuperExpr* expr) {
         }
 
         // 4. Bind instance to method
-        return callableValue(method->bind(instance));
+        return callableValue(method->bind(shareObject(instance)));
     } catch (const ClawError& e) {
         throwRuntimeError(expr->token, e.code, e.what());
     }
@@ -1264,11 +1292,9 @@ Value Interpreter::visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr)
             if (isNumber(current) && isNumber(operand)) {
                 result = numberToValue(asNumber(current) + asNumber(operand));
             } else if (isString(current) && isString(operand)) {
-                auto sv = StringPool::intern(asString(current) + asString(operand));
-                result = stringValue(sv.data());
+                result = concatStrings(current, operand);
             } else if (isString(current) && isNumber(operand)) {
-                auto sv = StringPool::intern(asString(current) + valueToString(operand));
-                result = stringValue(sv.data());
+                result = concatStrings(current, valueToString(operand));
             } else {
                 throwRuntimeError(expr->op, ErrorCode::TYPE_MISMATCH, "Operands must be compatible for +=");
             }
@@ -1365,11 +1391,9 @@ Value Interpreter::visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) {
                 if (isNumber(current) && isNumber(operand)) {
                     result = numberToValue(asNumber(current) + asNumber(operand));
                 } else if (isString(current) && isString(operand)) {
-                    auto sv = StringPool::intern(asString(current) + asString(operand));
-                    result = stringValue(sv.data());
+                    result = concatStrings(current, operand);
                 } else if (isString(current) && isNumber(operand)) {
-                    auto sv = StringPool::intern(asString(current) + valueToString(operand));
-                    result = stringValue(sv.data());
+                    result = concatStrings(current, valueToString(operand));
                 } else {
                     throwRuntimeError(expr->op, ErrorCode::TYPE_MISMATCH, "Operands must be compatible for +=");
                 }
@@ -1464,11 +1488,9 @@ Value Interpreter::visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) {
                 if (isNumber(current) && isNumber(operand)) {
                     result = numberToValue(asNumber(current) + asNumber(operand));
                 } else if (isString(current) && isString(operand)) {
-                    auto sv = StringPool::intern(asString(current) + asString(operand));
-                    result = stringValue(sv.data());
+                    result = concatStrings(current, operand);
                 } else if (isString(current) && isNumber(operand)) {
-                    auto sv = StringPool::intern(asString(current) + valueToString(operand));
-                    result = stringValue(sv.data());
+                    result = concatStrings(current, valueToString(operand));
                 } else {
                     throwRuntimeError(expr->op, ErrorCode::TYPE_MISMATCH, "Operands must be compatible for +=");
                 }
@@ -1541,19 +1563,22 @@ Value Interpreter::visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) {
     throwRuntimeError(expr->token, ErrorCode::NOT_INDEXABLE, "Can only index arrays and hash maps");
 }
 Value Interpreter::visitMemberExpr(MemberExpr* expr) {
-    Value object = evaluate(expr->object.get());
-    
+    return getMember(evaluate(expr->object.get()), expr->member, expr->token);
+}
+
+Value Interpreter::getMember(Value object, const std::string& member, const Token& token) {
     // Handle arrays
     if (isArray(object)) {
-        auto array = asArray(object);
+        // Methods returned below hold on to it
+        auto array = shareObject(asArray(object));
         
         // Handle array.length
-        if (expr->member == "length") {
+        if (member == "length") {
             return numberToValue(static_cast<double>(array->length()));
         }
         
         // Handle array.push - return a callable that modifies the array
-        if (expr->member == "push") {
+        if (member == "push") {
             return callableValue(std::make_shared<NativeFunction>(
                 1,
                 [array](const std::vector<Value>& args) -> Value {
@@ -1567,7 +1592,7 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
         }
         
         // Handle array.pop
-        if (expr->member == "pop") {
+        if (member == "pop") {
             return callableValue(std::make_shared<NativeFunction>(
                 0,
                 [array](const std::vector<Value>&) -> Value {
@@ -1581,7 +1606,7 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
         }
         
         // Handle array.reverse
-        if (expr->member == "reverse") {
+        if (member == "reverse") {
             return callableValue(std::make_shared<NativeFunction>(
                 0,
                 [array](const std::vector<Value>&) -> Value {
@@ -1593,20 +1618,19 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
         }
         
         // Handle array.map
-        if (expr->member == "map") {
+        if (member == "map") {
             return callableValue(std::make_shared<NativeFunction>(
                 1,
                 [this, array](const std::vector<Value>& args) -> Value {
-                    if (!isCallable(args[0])) {
+                    if (!isCallableValue(args[0])) {
                         throw std::runtime_error("E2001: map() requires a function argument");
                     }
                     
-                    auto function = asCallable(args[0]);
                     auto newArray = std::make_shared<ClawArray>();
                     
                     for (size_t i = 0; i < array->size(); ++i) {
                         std::vector<Value> callArgs = { array->get(static_cast<int>(i)) };
-                        newArray->push(function->call(*this, callArgs));
+                        newArray->push(callArgument(args[0], callArgs));
                     }
                     
                     return arrayValue(newArray);
@@ -1616,21 +1640,20 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
         }
         
         // Handle array.filter
-        if (expr->member == "filter") {
+        if (member == "filter") {
             return callableValue(std::make_shared<NativeFunction>(
                 1,
                 [this, array](const std::vector<Value>& args) -> Value {
-                    if (!isCallable(args[0])) {
+                    if (!isCallableValue(args[0])) {
                         throw std::runtime_error("E2001: filter() requires a function argument");
                     }
                     
-                    auto function = asCallable(args[0]);
                     auto newArray = std::make_shared<ClawArray>();
                     
                     for (size_t i = 0; i < array->size(); ++i) {
                         Value item = array->get(static_cast<int>(i));
                         std::vector<Value> callArgs = { item };
-                        if (isTruthy(function->call(*this, callArgs))) {
+                        if (isTruthy(callArgument(args[0], callArgs))) {
                             newArray->push(item);
                         }
                     }
@@ -1642,20 +1665,19 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
         }
         
         // Handle array.reduce
-        if (expr->member == "reduce") {
+        if (member == "reduce") {
             return callableValue(std::make_shared<NativeFunction>(
                 2, // accumulator function and initial value
                 [this, array](const std::vector<Value>& args) -> Value {
-                    if (!isCallable(args[0])) {
+                    if (!isCallableValue(args[0])) {
                         throw std::runtime_error("E2001: reduce() requires a function argument");
                     }
                     
-                    auto function = asCallable(args[0]);
                     Value accumulator = args[1];
                     
                     for (size_t i = 0; i < array->size(); ++i) {
                         std::vector<Value> callArgs = { accumulator, array->get(static_cast<int>(i)) };
-                        accumulator = function->call(*this, callArgs);
+                        accumulator = callArgument(args[0], callArgs);
                     }
                     
                     return accumulator;
@@ -1665,19 +1687,18 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
         }
         
         // Handle array.forEach
-        if (expr->member == "forEach") {
+        if (member == "forEach") {
             return callableValue(std::make_shared<NativeFunction>(
                 1,
                 [this, array](const std::vector<Value>& args) -> Value {
-                    if (!isCallable(args[0])) {
+                    if (!isCallableValue(args[0])) {
                         throw std::runtime_error("E2001: forEach() requires a function argument");
                     }
                     
-                    auto function = asCallable(args[0]);
                     
                     for (size_t i = 0; i < array->size(); ++i) {
                         std::vector<Value> callArgs = { array->get(static_cast<int>(i)) };
-                        function->call(*this, callArgs);
+                        callArgument(args[0], callArgs);
                     }
                     
                     return nilValue();
@@ -1687,7 +1708,7 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
         }
         
         // Handle array.join
-        if (expr->member == "join") {
+        if (member == "join") {
             return callableValue(std::make_shared<NativeFunction>(
                 1,
                 [array](const std::vector<Value>& args) -> Value {
@@ -1695,26 +1716,25 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
                     if (!args.empty() && isString(args[0])) {
                         separator = asString(args[0]);
                     }
-                    auto sv = StringPool::intern(array->join(separator));
-                    return stringValue(sv.data());
+                    return newStringValue(array->join(separator));
                 },
                 "join"
             ));
         }
         
-        throwRuntimeError(expr->token, ErrorCode::UNDEFINED_VARIABLE, "Unknown array member: " + expr->member);
+        throwRuntimeError(token, ErrorCode::UNDEFINED_VARIABLE, "Unknown array member: " + member);
     }
     
     // Handle hash maps
     if (isHashMap(object)) {
-        auto map = asHashMap(object);
+        auto map = shareObject(asHashMap(object));
         
         // Handle hash map properties/methods
-        if (expr->member == "size") {
+        if (member == "size") {
             return numberToValue(static_cast<double>(map->size()));
         }
         
-        if (expr->member == "keys") {
+        if (member == "keys") {
             return callableValue(std::make_shared<NativeFunction>(
                 0,
                 [map](const std::vector<Value>&) -> Value {
@@ -1722,8 +1742,7 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
                     
                     auto resultArray = gcNewArray();
                     for (const auto& key : keysVec) {
-                        auto sv = StringPool::intern(key);
-                        resultArray->push(stringValue(sv.data()));
+                        resultArray->push(newStringValue(key));
                     }
                     
                     return arrayValue(resultArray);
@@ -1732,7 +1751,7 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
             ));
         }
         
-        if (expr->member == "values") {
+        if (member == "values") {
             return callableValue(std::make_shared<NativeFunction>(
                 0,
                 [map](const std::vector<Value>&) -> Value {
@@ -1749,7 +1768,7 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
             ));
         }
         
-        if (expr->member == "has") {
+        if (member == "has") {
             return callableValue(std::make_shared<NativeFunction>(
                 1,
                 [map](const std::vector<Value>& args) -> Value {
@@ -1761,7 +1780,7 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
             ));
         }
         
-        if (expr->member == "remove") {
+        if (member == "remove") {
             return callableValue(std::make_shared<NativeFunction>(
                 1,
                 [map](const std::vector<Value>& args) -> Value {
@@ -1774,19 +1793,63 @@ Value Interpreter::visitMemberExpr(MemberExpr* expr) {
         }
         
         // Dynamic key lookup for hash maps
-        if (map->contains(expr->member)) {
-            return map->get(expr->member);
+        if (map->contains(member)) {
+            return map->get(member);
         }
         
-        throwRuntimeError(expr->token, ErrorCode::UNDEFINED_VARIABLE, "Unknown hash map member: " + expr->member);
+        throwRuntimeError(token, ErrorCode::UNDEFINED_VARIABLE, "Unknown hash map member: " + member);
     }
-    
+
+    // Handle string builders
+    if (isStringBuilder(object)) {
+        auto builder = shareObject(asStringBuilder(object));
+
+        if (member == "length") {
+            return numberToValue(static_cast<double>(builder->buffer.size()));
+        }
+
+        // Returns the builder, so appends chain
+        if (member == "append") {
+            return callableValue(std::make_shared<NativeFunction>(
+                1,
+                [builder](const std::vector<Value>& args) -> Value {
+                    builder->append(args[0]);
+                    return stringBuilderValue(builder);
+                },
+                "StringBuilder.append"
+            ));
+        }
+
+        if (member == "toString") {
+            return callableValue(std::make_shared<NativeFunction>(
+                0,
+                [builder](const std::vector<Value>&) -> Value {
+                    return newStringValue(builder->buffer);
+                },
+                "StringBuilder.toString"
+            ));
+        }
+
+        if (member == "clear") {
+            return callableValue(std::make_shared<NativeFunction>(
+                0,
+                [builder](const std::vector<Value>&) -> Value {
+                    builder->buffer.clear();
+                    return nilValue();
+                },
+                "StringBuilder.clear"
+            ));
+        }
+
+        throwRuntimeError(token, ErrorCode::UNDEFINED_VARIABLE, "Unknown StringBuilder member: " + member);
+    }
+
     // Handle class instances
     if (isInstance(object)) {
-        return asInstance(object)->get(expr->token);
+        return asInstance(object)->get(token);
     }
     
-   throwRuntimeError(expr->token, ErrorCode::NOT_INDEXABLE, "Only arrays, hash maps, and class instances have members");
+   throwRuntimeError(token, ErrorCode::NOT_INDEXABLE, "Only arrays, hash maps, and class instances have members");
 }
 
 
@@ -1797,7 +1860,7 @@ void Interpreter::visitClassStmt(ClassStmt* stmt) {
         if (!isClass(super)) {
             throwRuntimeError(stmt->token, ErrorCode::RUNTIME_ERROR, "Superclass must be a class.");
         }
-        superclass = asClass(super);
+        superclass = shareObject(asClass(super));
     }
 
     environment_->define(stmt->name, nilValue());
@@ -9,6 +9,7 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <functional>
 #include <exception>
 #include <stdexcept>
 #include <sstream>
@@ -76,6 +77,19 @@ public:
     // Reset interpreter state
     void reset();
 
+    // Calls values the interpreter does not own, such as closures compiled
+    // for the VM. The hook returns false when the callee is not one of them.
+    using ForeignCall = std::function<bool(Value callee, const std::vector<Value>& arguments, Value* result)>;
+    void setForeignCall(ForeignCall call) { foreignCall_ = std::move(call); }
+    bool isCallableValue(Value value) const;
+    // Calls a function handed to a native, foreign or not
+    Value callArgument(Value function, const std::vector<Value>& arguments);
+
+    // Call and member access on values that are already evaluated, shared
+    // by the visitors and by the VM
+    Value callValue(Value callee, const std::vector<Value>& arguments, const Token& token);
+    Value getMember(Value object, const std::string& member, const Token& token);
+
     // ExprVisitor implementation
     Value visitLiteralExpr(LiteralExpr* expr) override;
     Value visitVariableExpr(VariableExpr* expr) override;
@@ -129,6 +143,7 @@ public:
     
 private:
     // Helper methods
+    bool loopCondition(Expr* condition);
     void checkNumberOperand(const Token& op, const Value& operand);
     void checkNumberOperands(const Token& op, const Value& left, const Value& right);
     
@@ -148,6 +163,7 @@ private:
     std::shared_ptr<Environment> environment_;
     std::shared_ptr<Environment> globals_;
     ModuleManager module_manager_;
+    ForeignCall foreignCall_;
 };
 
 } // namespace claw
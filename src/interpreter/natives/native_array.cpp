@@ -27,21 +27,21 @@ void registerNativeArray(const std::shared_ptr<Environment>& globals, Interprete
         "reverse"
     ));
 
-    globals->define("filter", std::make_shared<NativeFunction>(
+    auto filter = std::make_shared<NativeFunction>(
         2,
         [&interpreter](const std::vector<Value>& args) -> Value {
             if (!isArray(args[0])) {
                 throw std::runtime_error("filter() requires an array as first argument");
             }
-            if (!isCallable(args[1])) {
+            if (!interpreter.isCallableValue(args[1])) {
                 throw std::runtime_error("filter() requires a function as second argument");
             }
             auto array = asArray(args[0]);
-            auto func = asCallable(args[1]);
+            Value func = args[1];
             auto result = std::make_shared<ClawArray>();
             for (size_t i = 0; i < array->size(); i++) {
                 Value element = array->get(i);
-                Value predicateResult = func->call(interpreter, {element});
+                Value predicateResult = interpreter.callArgument(func, {element});
                 if (isTruthy(predicateResult)) {
                     result->push(element);
                 }
@@ -49,29 +49,35 @@ void registerNativeArray(const std::shared_ptr<Environment>& globals, Interprete
             return arrayValue(result);
         },
         "filter"
-    ));
+    );
+    // Calls its callback and lets go of it, so compiled code may pass a
+    // function literal from its frame region
+    filter->setBorrowsArguments();
+    globals->define("filter", filter);
 
-    globals->define("map", std::make_shared<NativeFunction>(
+    auto map = std::make_shared<NativeFunction>(
         2,
         [&interpreter](const std::vector<Value>& args) -> Value {
             if (!isArray(args[0])) {
                 throw std::runtime_error("map() requires an array as first argument");
             }
-            if (!isCallable(args[1])) {
+            if (!interpreter.isCallableValue(args[1])) {
                 throw std::runtime_error("map() requires a function as second argument");
             }
             auto array = asArray(args[0]);
-            auto func = asCallable(args[1]);
+            Value func = args[1];
             auto result = std::make_shared<ClawArray>();
             for (size_t i = 0; i < array->size(); i++) {
                 Value element = array->get(i);
-                Value mappedValue = func->call(interpreter, {element});
+                Value mappedValue = interpreter.callArgument(func, {element});
                 result->push(mappedValue);
             }
             return arrayValue(result);
         },
         "map"
-    ));
+    );
+    map->setBorrowsArguments();
+    globals->define("map", map);
 
     globals->define("map_add_scalar", std::make_shared<NativeFunction>(
         2,
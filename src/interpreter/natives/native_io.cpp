@@ -224,8 +224,7 @@ void registerNativeIO(const std::shared_ptr<Environment>& globals) {
             }
             std::string line;
             std::getline(std::cin, line);
-            auto sv = StringPool::intern(line);
-            return stringValue(sv.data());
+            return newStringValue(line);
         },
         "input"
     ));
@@ -256,8 +255,7 @@ void registerNativeIO(const std::shared_ptr<Environment>& globals) {
                         const std::string magicStr = "VENC1";
                         std::vector<uint8_t> aad(magicStr.begin(), magicStr.end());
                         auto pt = aesGcmDecrypt(key, nonce, aad, ct, tag);
-                        auto sv = StringPool::intern(std::string(pt.begin(), pt.end()));
-                        return stringValue(sv.data());
+                        return newStringValue(std::string(pt.begin(), pt.end()));
 #elif defined(CLAW_HAS_OPENSSL)
                         std::vector<uint8_t> salt(16), nonce(12), tag(16);
                         f.read(reinterpret_cast<char*>(salt.data()), (std::streamsize)salt.size());
@@ -268,8 +266,7 @@ void registerNativeIO(const std::shared_ptr<Environment>& globals) {
                         const std::string magicStr = "VENC1";
                         std::vector<uint8_t> aad(magicStr.begin(), magicStr.end());
                         auto pt = aesGcmDecryptOpenSSL(key, nonce, aad, ct, tag);
-                        auto sv = StringPool::intern(std::string(pt.begin(), pt.end()));
-                        return stringValue(sv.data());
+                        return newStringValue(std::string(pt.begin(), pt.end()));
 #else
                         throw std::runtime_error("Encrypted I/O not supported on this platform");
 #endif
@@ -282,8 +279,7 @@ void registerNativeIO(const std::shared_ptr<Environment>& globals) {
             }
             std::stringstream buffer;
             buffer << file.rdbuf();
-            auto sv = StringPool::intern(buffer.str());
-            return stringValue(sv.data());
+            return newStringValue(buffer.str());
         },
         "readFile"
     ));
@@ -740,8 +736,7 @@ void registerNativeIO(const std::shared_ptr<Environment>& globals) {
             SSL_CTX_free(ctx);
             size_t sep = resp.find("\r\n\r\n");
             std::string body = (sep == std::string::npos) ? resp : resp.substr(sep + 4);
-            auto sv = StringPool::intern(body);
-            return stringValue(sv.data());
+            return newStringValue(body);
 #endif
         },
         "tlsGet"
@@ -835,8 +830,7 @@ void registerNativeIO(const std::shared_ptr<Environment>& globals) {
             SSL_CTX_free(ctx);
             size_t sep = resp.find("\r\n\r\n");
             std::string respBody = (sep == std::string::npos) ? resp : resp.substr(sep + 4);
-            auto sv = StringPool::intern(respBody);
-            return stringValue(sv.data());
+            return newStringValue(respBody);
 #endif
         },
         "tlsPost"
@@ -922,8 +916,7 @@ void registerNativeIO(const std::shared_ptr<Environment>& globals) {
             const std::string magicStr = "VENC1";
             std::vector<uint8_t> aad(magicStr.begin(), magicStr.end());
             auto pt = aesGcmDecrypt(key, nonce, aad, ct, tag);
-            auto sv = StringPool::intern(std::string(pt.begin(), pt.end()));
-            return stringValue(sv.data());
+            return newStringValue(std::string(pt.begin(), pt.end()));
 #elif defined(CLAW_HAS_OPENSSL)
             std::string path = asString(args[0]);
             std::string pass = asString(args[1]);
@@ -941,8 +934,7 @@ void registerNativeIO(const std::shared_ptr<Environment>& globals) {
             const std::string magicStr = "VENC1";
             std::vector<uint8_t> aad(magicStr.begin(), magicStr.end());
             auto pt = aesGcmDecryptOpenSSL(key, nonce, aad, ct, tag);
-            auto sv = StringPool::intern(std::string(pt.begin(), pt.end()));
-            return stringValue(sv.data());
+            return newStringValue(std::string(pt.begin(), pt.end()));
 #else
             throw std::runtime_error("Encrypted I/O not supported on this platform");
 #endif
@@ -125,8 +125,7 @@ private:
             pos_++;
         }
         consume('"');
-        auto sv = StringPool::intern(result);
-        return stringValue(sv.data());
+        return newStringValue(result);
     }
 
     Value parseNumber() {
@@ -270,8 +269,7 @@ void registerNativeJSON(const std::shared_ptr<Environment>& globals) {
     globals->define("jsonEncode", std::make_shared<NativeFunction>(
         1,
         [](const std::vector<Value>& args) -> Value {
-            auto sv = StringPool::intern(JSONEncoder::encode(args[0]));
-            return stringValue(sv.data());
+            return newStringValue(JSONEncoder::encode(args[0]));
         },
         "jsonEncode"
     ));
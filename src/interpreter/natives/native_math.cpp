@@ -22,19 +22,19 @@ double fastPow(double base, int exp) {
 }
 
 void registerNativeMath(const std::shared_ptr<Environment>& globals) {
+    // Leaf math natives use the fast ABI: the VM calls them on its stack
+    // after checking the signature, so the bodies do not test their operands
     globals->define("abs", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("abs() requires a number");
+        NativeSignature{1, 0b1, "abs() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::abs(asNumber(args[0])));
         },
         "abs"
     ));
 
     globals->define("sqrt", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("sqrt() requires a number");
+        NativeSignature{1, 0b1, "sqrt() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             double val = asNumber(args[0]);
             if (val < 0) throw std::runtime_error("sqrt() argument must be non-negative");
             return numberToValue(std::sqrt(val));
@@ -43,11 +43,8 @@ void registerNativeMath(const std::shared_ptr<Environment>& globals) {
     ));
 
     globals->define("pow", std::make_shared<NativeFunction>(
-        2,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0]) || !isNumber(args[1])) {
-                throw std::runtime_error("pow() requires two numbers");
-            }
+        NativeSignature{2, 0b11, "pow() requires two numbers"},
+        [](Interpreter&, const Value* args, int) -> Value {
             double base = asNumber(args[0]);
             double exp = asNumber(args[1]);
             
@@ -62,93 +59,80 @@ void registerNativeMath(const std::shared_ptr<Environment>& globals) {
     ));
 
     globals->define("min", std::make_shared<NativeFunction>(
-        2,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0]) || !isNumber(args[1])) {
-                throw std::runtime_error("min() requires two numbers");
-            }
+        NativeSignature{2, 0b11, "min() requires two numbers"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::min(asNumber(args[0]), asNumber(args[1])));
         },
         "min"
     ));
 
     globals->define("max", std::make_shared<NativeFunction>(
-        2,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0]) || !isNumber(args[1])) {
-                throw std::runtime_error("max() requires two numbers");
-            }
+        NativeSignature{2, 0b11, "max() requires two numbers"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::max(asNumber(args[0]), asNumber(args[1])));
         },
         "max"
     ));
 
     globals->define("round", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("round() requires a number");
+        NativeSignature{1, 0b1, "round() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::round(asNumber(args[0])));
         },
         "round"
     ));
 
     globals->define("floor", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("floor() requires a number");
+        NativeSignature{1, 0b1, "floor() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::floor(asNumber(args[0])));
         },
         "floor"
     ));
 
     globals->define("ceil", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("ceil() requires a number");
+        NativeSignature{1, 0b1, "ceil() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::ceil(asNumber(args[0])));
         },
         "ceil"
     ));
 
     globals->define("random", std::make_shared<NativeFunction>(
-        0,
-        [](const std::vector<Value>&) -> Value {
+        NativeSignature{0},
+        [](Interpreter&, const Value*, int) -> Value {
             return numberToValue(static_cast<double>(std::rand()) / RAND_MAX);
         },
         "random"
     ));
 
     globals->define("sin", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("sin() requires a number");
+        NativeSignature{1, 0b1, "sin() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::sin(asNumber(args[0])));
         },
         "sin"
     ));
 
     globals->define("cos", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("cos() requires a number");
+        NativeSignature{1, 0b1, "cos() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::cos(asNumber(args[0])));
         },
         "cos"
     ));
 
     globals->define("tan", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("tan() requires a number");
+        NativeSignature{1, 0b1, "tan() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::tan(asNumber(args[0])));
         },
         "tan"
     ));
 
     globals->define("log", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("log() requires a number");
+        NativeSignature{1, 0b1, "log() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             double x = asNumber(args[0]);
             if (x <= 0) throw std::runtime_error("log() argument must be positive");
             return numberToValue(std::log(x));
@@ -157,9 +141,8 @@ void registerNativeMath(const std::shared_ptr<Environment>& globals) {
     ));
 
     globals->define("exp", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
-            if (!isNumber(args[0])) throw std::runtime_error("exp() requires a number");
+        NativeSignature{1, 0b1, "exp() requires a number"},
+        [](Interpreter&, const Value* args, int) -> Value {
             return numberToValue(std::exp(asNumber(args[0])));
         },
         "exp"
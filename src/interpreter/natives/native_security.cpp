@@ -200,7 +200,7 @@ void registerNativeSecurity(const std::shared_ptr<Environment>& globals, Interpr
             std::string aIn = asString(args[0]);
             std::string a = cryptoAlgoNormalize(aIn);
             globals->setCryptoPreferred(a);
-            return stringValue(StringPool::intern(a).data());
+            return newStringValue(a);
         },
         "cryptoPrefer"
     ));
@@ -339,8 +339,7 @@ void registerNativeSecurity(const std::shared_ptr<Environment>& globals, Interpr
             int ok = EVP_DecryptFinal_ex(ctx, nullptr, &outlen);
             EVP_CIPHER_CTX_free(ctx);
             if (ok != 1) throw std::runtime_error("Decrypt failed");
-            auto sv = StringPool::intern(std::string(pt.begin(), pt.end()));
-            return stringValue(sv.data());
+            return newStringValue(std::string(pt.begin(), pt.end()));
         },
         "readFileEncAlgo"
     ));
@@ -351,7 +350,7 @@ void registerNativeSecurity(const std::shared_ptr<Environment>& globals, Interpr
             auto m = std::make_shared<ClawHashMap>();
             std::string sbox = (globals->sandbox() == Environment::SandboxMode::Strict ? std::string("strict") :
                 globals->sandbox() == Environment::SandboxMode::Network ? std::string("network") : std::string("full"));
-            m->set("sandbox", stringValue(StringPool::intern(sbox).data()));
+            m->set("sandbox", newStringValue(sbox));
             m->set("file.read", boolValue(globals->canFileRead()));
             m->set("file.write", boolValue(globals->canFileWrite()));
             m->set("file.delete", boolValue(globals->canFileDelete()));
@@ -360,7 +359,7 @@ void registerNativeSecurity(const std::shared_ptr<Environment>& globals, Interpr
             m->set("network", boolValue(globals->canNetwork()));
             m->set("antiDebug", boolValue(globals->antiDebugEnforced()));
             m->set("dynamicCodeEnc", boolValue(globals->dynamicCodeEncryption()));
-            m->set("cryptoPreferred", stringValue(StringPool::intern(globals->cryptoPreferred()).data()));
+            m->set("cryptoPreferred", newStringValue(globals->cryptoPreferred()));
             m->set("ids.enabled", boolValue(gRuntimeFlags.idsEnabled));
             m->set("ids.stack.max", numberToValue((double)gRuntimeFlags.idsStackMax));
             m->set("ids.alloc.rate.max", numberToValue((double)gRuntimeFlags.idsAllocRateMax));
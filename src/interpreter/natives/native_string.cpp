@@ -13,10 +13,10 @@ namespace claw {
 
 void registerNativeString(const std::shared_ptr<Environment>& globals) {
     globals->define("len", std::make_shared<NativeFunction>(
-        1,
-        [](const std::vector<Value>& args) -> Value {
+        NativeSignature{1},
+        [](Interpreter&, const Value* args, int) -> Value {
             if (isString(args[0])) {
-                return numberToValue(static_cast<double>(asString(args[0]).length()));
+                return numberToValue(static_cast<double>(asStringObject(args[0])->length));
             }
             if (isArray(args[0])) {
                 return numberToValue(static_cast<double>(asArray(args[0])->length()));
@@ -32,20 +32,28 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
     globals->define("str", std::make_shared<NativeFunction>(
         1,
         [](const std::vector<Value>& args) -> Value {
-            auto sv = StringPool::intern(valueToString(args[0]));
-            return stringValue(sv.data());
+            return newStringValue(valueToString(args[0]));
         },
         "str"
     ));
 
+    // StringBuilder() - an empty builder with append(x), toString(),
+    // clear() and length
+    globals->define("StringBuilder", std::make_shared<NativeFunction>(
+        0,
+        [](const std::vector<Value>&) -> Value {
+            return stringBuilderValue(std::make_shared<ClawStringBuilder>());
+        },
+        "StringBuilder"
+    ));
+
     globals->define("toUpper", std::make_shared<NativeFunction>(
         1,
         [](const std::vector<Value>& args) -> Value {
             if (!isString(args[0])) throw std::runtime_error("toUpper() requires a string");
             std::string s = asString(args[0]);
             for (auto& c : s) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
-            auto sv = StringPool::intern(s);
-            return stringValue(sv.data());
+            return newStringValue(s);
         },
         "toUpper"
     ));
@@ -56,8 +64,7 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
             if (!isString(args[0])) throw std::runtime_error("toLower() requires a string");
             std::string s = asString(args[0]);
             for (auto& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-            auto sv = StringPool::intern(s);
-            return stringValue(sv.data());
+            return newStringValue(s);
         },
         "toLower"
     ));
@@ -73,15 +80,13 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
             int length = static_cast<int>(asNumber(args[2]));
             if (start < 0) start = 0;
             if (start >= static_cast<int>(s.length())) {
-                auto sv = StringPool::intern(std::string(""));
-                return stringValue(sv.data());
+                return newStringValue("");
             }
             if (length < 0) length = 0;
             if (start + length > static_cast<int>(s.length())) {
                 length = static_cast<int>(s.length()) - start;
             }
-            auto sv = StringPool::intern(s.substr(start, length));
-            return stringValue(sv.data());
+            return newStringValue(s.substr(start, length));
         },
         "substr"
     ));
@@ -111,8 +116,7 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
             while (start < s.length() && std::isspace(static_cast<unsigned char>(s[start]))) start++;
             size_t end = s.length();
             while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) end--;
-            auto sv = StringPool::intern(s.substr(start, end - start));
-            return stringValue(sv.data());
+            return newStringValue(s.substr(start, end - start));
         },
         "trim"
     ));
@@ -127,8 +131,7 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
             auto result = std::make_shared<ClawArray>();
             if (delimiter.empty()) {
                 for (char c : s) {
-                    auto sv = StringPool::intern(std::string(1, c));
-                    result->push(stringValue(sv.data()));
+                    result->push(newStringValue(std::string(1, c)));
                 }
                 return arrayValue(result);
             }
@@ -136,12 +139,10 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
             while (true) {
                 size_t next = s.find(delimiter, pos);
                 if (next == std::string::npos) {
-                    auto sv = StringPool::intern(s.substr(pos));
-                    result->push(stringValue(sv.data()));
+                    result->push(newStringValue(s.substr(pos)));
                     break;
                 }
-                auto sv = StringPool::intern(s.substr(pos, next - pos));
-                result->push(stringValue(sv.data()));
+                result->push(newStringValue(s.substr(pos, next - pos)));
                 pos = next + delimiter.length();
             }
             return arrayValue(result);
@@ -159,8 +160,7 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
             std::string search = asString(args[1]);
             std::string replacement = asString(args[2]);
             if (search.empty()) {
-                auto sv0 = StringPool::intern(s);
-                return stringValue(sv0.data());
+                return newStringValue(s);
             }
             std::string result = s;
             size_t pos = 0;
@@ -169,8 +169,7 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
                 pos += replacement.length();
                 if (replacement.empty()) pos++;
             }
-            auto sv = StringPool::intern(result);
-            return stringValue(sv.data());
+            return newStringValue(result);
         },
         "replace"
     ));
@@ -213,11 +212,44 @@ void registerNativeString(const std::shared_ptr<Environment>& globals) {
             for (int i = 0; i < count; i++) {
                 oss << s;
             }
-            auto sv = StringPool::intern(oss.str());
-            return stringValue(sv.data());
+            return newStringValue(oss.str());
         },
         "repeat"
     ));
 }
 
+const NativeFunction* stringBuilderMethod(const char* name) {
+    static const char* const appendName = StringPool::intern("append").data();
+    static const char* const toStringName = StringPool::intern("toString").data();
+    static const char* const clearName = StringPool::intern("clear").data();
+    // Returns the builder, so appends chain
+    static const NativeFunction append(
+        NativeSignature{2},
+        [](Interpreter&, const Value* args, int) -> Value {
+            asStringBuilder(args[0])->append(args[1]);
+            return args[0];
+        },
+        "StringBuilder.append"
+    );
+    static const NativeFunction toString(
+        NativeSignature{1},
+        [](Interpreter&, const Value* args, int) -> Value {
+            return newStringValue(asStringBuilder(args[0])->buffer);
+        },
+        "StringBuilder.toString"
+    );
+    static const NativeFunction clear(
+        NativeSignature{1},
+        [](Interpreter&, const Value* args, int) -> Value {
+            asStringBuilder(args[0])->buffer.clear();
+            return nilValue();
+        },
+        "StringBuilder.clear"
+    );
+    if (name == appendName) return &append;
+    if (name == toStringName) return &toString;
+    if (name == clearName) return &clear;
+    return nullptr;
+}
+
 } // namespace claw
@@ -3,6 +3,12 @@
 
 namespace claw {
 class Environment;
+class NativeFunction;
 
 void registerNativeString(const std::shared_ptr<Environment>& globals);
+
+// StringBuilder's append, toString and clear as fast natives taking the
+// builder as their first argument, or null for any other name. The VM calls
+// these on a builder receiver instead of binding a closure per call.
+const NativeFunction* stringBuilderMethod(const char* name);
 } // namespace claw
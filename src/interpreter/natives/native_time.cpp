@@ -52,8 +52,7 @@ void registerNativeTime(const std::shared_ptr<Environment>& globals) {
             if (format.find('%') != std::string::npos) {
                 char buf[128];
                 std::strftime(buf, sizeof(buf), format.c_str(), &tm);
-                auto sv = StringPool::intern(std::string(buf));
-                return stringValue(sv.data());
+                return newStringValue(buf);
             } else {
                 auto pad2 = [](int v) {
                     std::ostringstream oss;
@@ -77,13 +76,11 @@ void registerNativeTime(const std::shared_ptr<Environment>& globals) {
                     out = replaceAll(out, "HH", pad2(tm.tm_hour));
                     out = replaceAll(out, "mm", pad2(tm.tm_min));
                     out = replaceAll(out, "ss", pad2(tm.tm_sec));
-                    auto sv = StringPool::intern(out);
-                    return stringValue(sv.data());
+                    return newStringValue(out);
                 } else {
                     std::ostringstream oss;
                     oss << "Date(" << static_cast<long long>(timestampMs) << ") formatted as '" << format << "'";
-                    auto sv = StringPool::intern(oss.str());
-                    return stringValue(sv.data());
+                    return newStringValue(oss.str());
                 }
             }
         },
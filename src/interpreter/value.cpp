@@ -6,235 +6,625 @@
 #include <iomanip>
 #include <cmath>
 #include <set>
-#include <unordered_map>
 #include <unordered_set>
 #include <atomic>
 #include <algorithm>
 #include <vector>
+#include <chrono>
+#include <utility>
+#include <new>
 #include "features/class.h"
 #include "observability/profiler.h"
 #include "vm/vm.h"
+#include "interpreter/environment.h"
+#include "interpreter/gc_alloc.h"
+#include "features/string_pool.h"
 
 namespace claw {
 
 // Thread-local set to track visited objects for cycle detection during string conversion
 thread_local std::set<const void*> visitedObjects;
 
-// Global registries to keep shared_ptr lifetimes while storing raw pointers in Values
-static std::unordered_map<void*, std::shared_ptr<Callable>> g_callableRegistry;
-static std::unordered_map<void*, std::shared_ptr<ClawArray>> g_arrayRegistry;
-static std::unordered_map<void*, std::shared_ptr<ClawHashMap>> g_hashMapRegistry;
-static std::unordered_map<void*, std::shared_ptr<ClawClass>> g_classRegistry;
-static std::unordered_map<void*, std::shared_ptr<ClawInstance>> g_instanceRegistry;
-static std::unordered_map<void*, std::shared_ptr<VMFunction>> g_vmFunctionRegistry;
-static std::unordered_map<void*, std::shared_ptr<VMClosure>> g_vmClosureRegistry;
-static std::unordered_map<void*, uint8_t> g_objectGeneration;
-static std::unordered_set<const void*> g_rememberedSet;
+// Declared ahead of the heap so it outlives it: closures still tracked at
+// exit release their upvalues into it
+static std::vector<VMUpvalue*> g_upvaluePool;
+static constexpr size_t UPVALUE_POOL_MAX = 4096;
+
+// The tracked objects of each generation, each at its heapIndex. A minor
+// collection walks only the young vector, the old objects whose card is
+// marked and the remembered upvalues; every young survivor moves to the old
+// vector, so afterwards no old object points at a young one until a write
+// barrier marks its card again.
+static std::vector<HeapObject*> g_young;
+static std::vector<HeapObject*> g_old;
+// The young vector of the last collection with its survivors taken out:
+// dead objects, still at their heapIndex, that allocations free a few at a
+// time. g_survivors collects the young objects marking reaches.
+static std::vector<HeapObject*> g_pending;
+static size_t g_pendingSwept = 0;
+static std::vector<HeapObject*> g_survivors;
+static std::vector<HeapObject*> g_dirtyObjects;
+// What GCRootScopes keep reachable, and whether new objects are added
+static std::vector<HeapObject*> g_scopeRoots;
+static bool g_rootAllocations = false;
+static std::vector<VMUpvalue*> g_dirtyUpvalues;
 static std::vector<class VM*> g_vmRegistry;
 static std::atomic<uint64_t> g_youngAllocations{0};
 static std::vector<std::shared_ptr<ClawArray>> g_arrayPool;
 static std::vector<std::shared_ptr<ClawHashMap>> g_hashMapPool;
-static thread_local std::vector<std::vector<void*>> g_ephemeralStack;
 static std::atomic<bool> g_benchmarkMode{false};
 
+// A minor collection runs once the nursery holds this many objects; a full
+// one starts once the old generation has doubled since the last one
+static constexpr size_t NURSERY_OBJECTS = 100000;
+static constexpr size_t MIN_FULL_THRESHOLD = 1000000;
+// While a full collection runs, minor collections wait and every this many
+// allocations run one of its steps instead
+static constexpr uint64_t STEP_ALLOCATIONS = NURSERY_OBJECTS / 8;
+// Dead objects each allocation frees; the last nursery is gone well before
+// the next one fills
+static constexpr size_t FREES_PER_ALLOCATION = 4;
+static size_t g_fullThreshold = MIN_FULL_THRESHOLD;
+static bool g_minorMarking = false;
+
+// A full collection marks incrementally, then sweeps the old generation
+// incrementally, then promotes the nursery's survivors like a minor one.
+// Objects tracked while it runs start marked.
+enum class GCPhase { Idle, Marking, Sweeping };
+static GCPhase g_phase = GCPhase::Idle;
+bool gGCMarking = false;
+// Gray objects: marked but not traced yet
+static std::vector<HeapObject*> g_markStack;
+// Old objects below g_sweepRead were swept; the survivors among them were
+// compacted below g_sweepWrite
+static size_t g_sweepRead = 0;
+static size_t g_sweepWrite = 0;
+static std::chrono::steady_clock::time_point g_lastStepEnd;
+
+static std::vector<HeapObject*>& gcGeneration(const HeapObject* object) {
+    return object->generation ? g_old : g_young;
+}
+
+// Strings have no heapRef: the collector owns them outright
+static size_t stringAllocationSize(size_t length) { return sizeof(ClawString) + length + 1; }
+static constexpr size_t ROPE_ALLOCATION_SIZE = sizeof(ClawString) + 2 * sizeof(ClawString*);
+// Concatenations at least this long are ropes; shorter ones are cheaper to copy
+static constexpr size_t ROPE_MIN_LENGTH = 256;
+static void gcFreeString(ClawString* string) {
+    size_t size = string->rope ? ROPE_ALLOCATION_SIZE : stringAllocationSize(string->length);
+    string->~ClawString();
+    gcNurseryFree(string, size);
+}
+
+// Objects hold the collector's reference to themselves, so whatever is
+// still tracked at exit is released here, after the pools it may return
+// upvalues to and before the heap vectors go away
+static struct HeapTeardown {
+    ~HeapTeardown() {
+        std::vector<std::shared_ptr<void>> refs;
+        std::vector<HeapObject*> strings;
+        refs.reserve(g_young.size() + g_old.size() + g_pending.size());
+        for (auto* generation : {&g_young, &g_old, &g_pending}) {
+            for (HeapObject* object : *generation) {
+                if (!object) continue;
+                object->heapIndex = HeapObject::UNTRACKED;
+                if (object->type == ObjectType::String) {
+                    strings.push_back(object);
+                } else {
+                    refs.push_back(std::move(object->heapRef));
+                }
+            }
+            generation->clear();
+        }
+        for (HeapObject* string : strings) gcFreeString(static_cast<ClawString*>(string));
+    }
+} g_heapTeardown;
+
 static void gcMark(Value v);
 static void gcMinor();
-static void gcFull();
+static void gcStep(double budgetMs);
+static bool gcSweepPending(size_t count);
 void gcRegisterVM(VM* vm) { g_vmRegistry.push_back(vm); }
 void gcUnregisterVM(VM* vm) { g_vmRegistry.erase(std::remove(g_vmRegistry.begin(), g_vmRegistry.end(), vm), g_vmRegistry.end()); }
-void gcBarrierWrite(const void* parent, Value child) {
-    if (!isObject(child)) return;
-    auto itParentGen = g_objectGeneration.find(const_cast<void*>(parent));
-    if (itParentGen == g_objectGeneration.end()) return;
-    auto itChildGen = g_objectGeneration.find(asObjectPtr(child));
-    if (itChildGen == g_objectGeneration.end()) return;
-    if (itParentGen->second == 1 && itChildGen->second == 0) {
-        g_rememberedSet.insert(parent);
-    }
+void gcRemember(HeapObject* parent) {
+    parent->dirty = 1;
+    g_dirtyObjects.push_back(parent);
 }
+void gcRememberUpvalue(VMUpvalue* upvalue) {
+    upvalue->dirty = true;
+    g_dirtyUpvalues.push_back(upvalue);
+}
+void gcShade(Value v) { gcMark(v); }
 void gcMaybeCollect() {
     if (g_benchmarkMode.load(std::memory_order_relaxed)) return;
     uint64_t n = ++g_youngAllocations;
-    if (n % 100000 == 0) gcMinor();
-    if (g_objectGeneration.size() > 1000000) gcFull();
-}
-static void gcMarkObject(void* p) {
-    if (!p) return;
-    g_objectGeneration[p] |= 0x80;
-    auto arrIt = g_arrayRegistry.find(p);
-    if (arrIt != g_arrayRegistry.end()) {
-        const auto& elems = arrIt->second->elements();
-        for (const auto& e : elems) gcMark(e);
+    if (g_pendingSwept < g_pending.size()) gcSweepPending(FREES_PER_ALLOCATION);
+    if (g_phase != GCPhase::Idle) {
+        if (n % STEP_ALLOCATIONS == 0) gcStep(gRuntimeFlags.gcMaxPauseMs);
         return;
     }
-    auto mapIt = g_hashMapRegistry.find(p);
-    if (mapIt != g_hashMapRegistry.end()) {
-        for (const auto& kv : mapIt->second->data) {
-            gcMark(kv.second);
-        }
-        return;
+    if (g_young.size() >= NURSERY_OBJECTS) gcMinor();
+    if (g_old.size() > g_fullThreshold) gcStartFull();
+}
+void gcCollect() {
+    if (g_benchmarkMode.load(std::memory_order_relaxed)) return;
+    if (g_phase != GCPhase::Idle) {
+        gcStep(0);
+    } else {
+        gcMinor();
     }
-    auto instIt = g_instanceRegistry.find(p);
-    if (instIt != g_instanceRegistry.end()) {
-        instIt->second->forEachField([](Value v){ gcMark(v); });
-        return;
+    gcSweepPending(0);
+}
+bool gcFullRunning() { return g_phase != GCPhase::Idle; }
+void gcSafepoint() {
+    if (g_phase == GCPhase::Idle) return;
+    double budget = gRuntimeFlags.gcMaxPauseMs;
+    auto sinceLast = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - g_lastStepEnd);
+    if (sinceLast.count() >= budget) gcStep(budget);
+}
+
+// The object being handed out while its allocation collects; nothing
+// else reaches it yet
+static HeapObject* g_allocating = nullptr;
+
+// Takes a dead object the last collection left for freeing back, as
+// untracked; false if the object is anywhere else
+static bool gcTakePending(HeapObject* object) {
+    if (object->generation != 0 || object->heapIndex >= g_pending.size()) return false;
+    if (g_pending[object->heapIndex] != object) return false;
+    g_pending[object->heapIndex] = nullptr;
+    object->heapIndex = HeapObject::UNTRACKED;
+    return true;
+}
+
+// Starts tracking an object a new Value points at. Something may still
+// share an object a collection found dead, and hand it out again.
+static void gcTrack(HeapObject* object, std::shared_ptr<void> ref, uint8_t generation, bool collect) {
+    if (!object->tracked() || gcTakePending(object)) {
+        object->generation = generation;
+        object->marked = g_phase != GCPhase::Idle;
+        if (object->marked && generation == 0) g_survivors.push_back(object);
+        object->dirty = 0;
+        auto& objects = gcGeneration(object);
+        object->heapIndex = static_cast<uint32_t>(objects.size());
+        object->heapRef = std::move(ref);
+        objects.push_back(object);
+    }
+    if (g_rootAllocations) g_scopeRoots.push_back(object);
+    if (collect) {
+        g_allocating = object;
+        gcMaybeCollect();
+        g_allocating = nullptr;
     }
 }
-static void gcMark(Value v) {
-    if (isObject(v)) {
-        void* p = asObjectPtr(v);
-        if (!p) return;
-        if ((g_objectGeneration[p] & 0x80) == 0) {
-            gcMarkObject(p);
-        }
+
+// Arrays and maps nothing else shares go back to their pools; anything
+// else is freed unless something else still shares it
+static void gcRelease(HeapObject* object, std::shared_ptr<void> ref) {
+    if (object->type == ObjectType::String) {
+        gcFreeString(static_cast<ClawString*>(object));
+        return;
+    }
+    if (ref.use_count() != 1) return;
+    if (object->type == ObjectType::Array) {
+        auto* array = static_cast<ClawArray*>(object);
+        array->reserve(array->size());
+        array->fill(nilValue(), 0);
+        g_arrayPool.push_back(std::shared_ptr<ClawArray>(std::move(ref), array));
+    } else if (object->type == ObjectType::HashMap) {
+        auto* map = static_cast<ClawHashMap*>(object);
+        map->clear();
+        g_hashMapPool.push_back(std::shared_ptr<ClawHashMap>(std::move(ref), map));
     }
 }
-static void gcMarkVMRoots(VM* vm);
-static void gcMinor() {
-    for (auto vm : g_vmRegistry) gcMarkVMRoots(vm);
-    for (const void* parent : g_rememberedSet) gcMarkObject(const_cast<void*>(parent));
-    std::vector<void*> toFree;
-    toFree.reserve(g_objectGeneration.size());
-    for (auto& [p, meta] : g_objectGeneration) {
-        bool marked = (meta & 0x80) != 0;
-        uint8_t gen = meta & 0x1;
-        if (gen == 0) {
-            if (!marked) {
-                toFree.push_back(p);
-            } else {
-                g_objectGeneration[p] = 0x81;
+
+static void gcTrace(HeapObject* object) {
+    switch (object->type) {
+        case ObjectType::Array:
+            for (const auto& e : static_cast<ClawArray*>(object)->elements()) gcMark(e);
+            break;
+        case ObjectType::HashMap:
+            for (const auto& kv : static_cast<ClawHashMap*>(object)->data) gcMark(kv.second);
+            break;
+        case ObjectType::Class:
+            static_cast<ClawClass*>(object)->forEachReference([](Value v){ gcMark(v); });
+            break;
+        case ObjectType::Instance:
+            static_cast<ClawInstance*>(object)->forEachReference([](Value v){ gcMark(v); });
+            break;
+        case ObjectType::VMFunction: {
+            const auto* function = static_cast<VMFunction*>(object);
+            if (function->chunk) {
+                for (Value constant : function->chunk->constants()) gcMark(constant);
             }
-        } else {
-            g_objectGeneration[p] &= 0x81;
+            break;
         }
-    }
-    for (void* p : toFree) {
-        {
-            auto it = g_arrayRegistry.find(p);
-            if (it != g_arrayRegistry.end()) {
-                it->second->reserve(it->second->size());
-                it->second->fill(nilValue(), 0);
-                g_arrayPool.push_back(std::move(it->second));
-                g_arrayRegistry.erase(it);
-                continue;
+        case ObjectType::VMClosure: {
+            const auto* closure = static_cast<VMClosure*>(object);
+            gcMark(objectValue(closure->function.get()));
+            for (int i = 0; i < closure->upvalueCount; i++) {
+                if (VMUpvalue* upvalue = closure->upvalue(i)) gcMark(*upvalue->location);
             }
+            break;
+        }
+        case ObjectType::VMBoundMethod:
+            gcMark(static_cast<VMBoundMethod*>(object)->receiver);
+            break;
+        case ObjectType::String: {
+            const ClawString** parts = static_cast<ClawString*>(object)->parts();
+            gcMark(stringValue(parts[0]));
+            if (parts[1]) gcMark(stringValue(parts[1]));
+            break;
         }
-        {
-            auto it = g_hashMapRegistry.find(p);
-            if (it != g_hashMapRegistry.end()) {
-                it->second->clear();
-                g_hashMapPool.push_back(std::move(it->second));
-                g_hashMapRegistry.erase(it);
-                continue;
+        default:
+            break;
+    }
+}
+// Marks an object and queues it for tracing, so deep structures do not
+// recurse. The VM's scoped closures and arrays are not tracked but may
+// hold what is; nothing else untracked is reachable. A minor collection
+// stops at old objects: what they point at is young only if their card
+// says so.
+static void gcMark(Value v) {
+    if (!isHeapValue(v)) return;
+    HeapObject* object = asHeapObject(v);
+    if (!object) return;
+    if (object->tracked()) {
+        if (object->marked || (g_minorMarking && object->generation)) return;
+        object->marked = 1;
+        if (object->generation == 0) {
+            // A stale Value a native kept may still reach a dead object
+            if (gcTakePending(object)) {
+                object->heapIndex = static_cast<uint32_t>(g_young.size());
+                g_young.push_back(object);
             }
+            g_survivors.push_back(object);
+        }
+        // Only ropes among strings hold references
+        if (object->type != ObjectType::String || static_cast<ClawString*>(object)->rope) {
+            g_markStack.push_back(object);
         }
-        if (g_instanceRegistry.erase(p)) continue;
-        if (g_classRegistry.erase(p)) continue;
-        if (g_callableRegistry.erase(p)) continue;
-        if (g_vmFunctionRegistry.erase(p)) continue;
-        if (g_vmClosureRegistry.erase(p)) continue;
-        g_objectGeneration.erase(p);
+    } else if (object->type == ObjectType::VMClosure || object->type == ObjectType::Array) {
+        gcTrace(object);
     }
-    g_rememberedSet.clear();
-    for (auto& [p, meta] : g_objectGeneration) { meta &= 0x01; }
 }
-static void gcFull() {
+// When a bounded step has to stop; the clock is read every 256 objects
+struct GCDeadline {
+    bool bounded;
+    std::chrono::steady_clock::time_point at;
+    size_t count = 0;
+    bool passed() { return bounded && ++count % 256 == 0 && std::chrono::steady_clock::now() >= at; }
+};
+static GCDeadline gcDeadline(double budgetMs) {
+    return {budgetMs > 0, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double, std::milli>(budgetMs))};
+}
+// Traces gray objects until none are left or the deadline passes. Returns
+// whether marking finished.
+static bool gcDrain(GCDeadline& deadline) {
+    while (!g_markStack.empty()) {
+        HeapObject* object = g_markStack.back();
+        g_markStack.pop_back();
+        gcTrace(object);
+        if (deadline.passed()) return false;
+    }
+    return true;
+}
+static void gcMarkVMRoots(VM* vm);
+static void gcMarkRoots() {
     for (auto vm : g_vmRegistry) gcMarkVMRoots(vm);
-    for (const void* parent : g_rememberedSet) gcMarkObject(const_cast<void*>(parent));
-    std::vector<void*> toFree;
-    toFree.reserve(g_objectGeneration.size());
-    for (auto& [p, meta] : g_objectGeneration) {
-        bool marked = (meta & 0x80) != 0;
-        if (!marked) {
-            toFree.push_back(p);
+    Environment::forEachLiveValue([](Value v) { gcMark(v); });
+    if (g_allocating) gcMark(objectValue(g_allocating));
+    for (HeapObject* object : g_scopeRoots) gcMark(objectValue(object));
+    if (g_minorMarking) {
+        for (HeapObject* parent : g_dirtyObjects) gcTrace(parent);
+        for (VMUpvalue* upvalue : g_dirtyUpvalues) gcMark(upvalue->closed);
+    }
+}
+// Every young survivor is promoted, so the cards can be cleared
+static void gcClearCards() {
+    for (HeapObject* parent : g_dirtyObjects) parent->dirty = 0;
+    for (VMUpvalue* upvalue : g_dirtyUpvalues) upvalue->dirty = false;
+    g_dirtyObjects.clear();
+    g_dirtyUpvalues.clear();
+}
+static void gcFree(HeapObject* object) {
+    object->heapIndex = HeapObject::UNTRACKED;
+    object->generation = 0;
+    if (object->dirty) {
+        g_dirtyObjects.erase(std::find(g_dirtyObjects.begin(), g_dirtyObjects.end(), object));
+        object->dirty = 0;
+    }
+    gcRelease(object, std::move(object->heapRef));
+}
+// Frees up to count objects left by the last collection, or all of them
+// when count is 0. Returns whether none are left.
+static bool gcSweepPending(size_t count) {
+    size_t end = count ? std::min(g_pending.size(), g_pendingSwept + count) : g_pending.size();
+    while (g_pendingSwept < end) {
+        // Cleared first: the freed memory may come back as a new object
+        if (HeapObject* object = std::exchange(g_pending[g_pendingSwept], nullptr)) gcFree(object);
+        g_pendingSwept++;
+    }
+    if (g_pendingSwept < g_pending.size()) return false;
+    g_pending.clear();
+    g_pendingSwept = 0;
+    return true;
+}
+// Ends a collection's work on the nursery: the marked young objects move
+// to the end of the old generation and the rest are left for allocations
+// to free, so the pause is proportional to the survivors
+static void gcRetireNursery() {
+    gcSweepPending(0);
+    std::swap(g_pending, g_young);
+    for (HeapObject* object : g_survivors) {
+        g_pending[object->heapIndex] = nullptr;
+        object->marked = 0;
+        object->generation = 1;
+        object->heapIndex = static_cast<uint32_t>(g_old.size());
+        g_old.push_back(object);
+    }
+    g_survivors.clear();
+}
+static void gcMinor() {
+    g_minorMarking = true;
+    gcMarkRoots();
+    GCDeadline unbounded = gcDeadline(0);
+    gcDrain(unbounded);
+    g_minorMarking = false;
+    gcRetireNursery();
+    gcClearCards();
+}
+// Snapshots the roots; the write barriers shade whatever the mutator
+// unlinks from then on
+void gcStartFull() {
+    if (g_phase != GCPhase::Idle) return;
+    g_phase = GCPhase::Marking;
+    gGCMarking = true;
+    gcMarkRoots();
+    g_lastStepEnd = std::chrono::steady_clock::now();
+    gcStep(gRuntimeFlags.gcMaxPauseMs);
+}
+// Sweeps old objects until all are done or the deadline passes
+static bool gcSweepOld(GCDeadline& deadline) {
+    // Objects tracked meanwhile are appended, marked
+    while (g_sweepRead < g_old.size()) {
+        HeapObject* object = g_old[g_sweepRead++];
+        if (object->marked) {
+            object->marked = 0;
+            object->heapIndex = static_cast<uint32_t>(g_sweepWrite);
+            g_old[g_sweepWrite++] = object;
         } else {
-            if ((meta & 0x1) == 0) meta = 0x01; // promote survivors
+            gcFree(object);
         }
+        if (deadline.passed()) return false;
     }
-    for (void* p : toFree) {
-        {
-            auto it = g_arrayRegistry.find(p);
-            if (it != g_arrayRegistry.end()) {
-                it->second->reserve(it->second->size());
-                it->second->fill(nilValue(), 0);
-                g_arrayPool.push_back(std::move(it->second));
-                g_arrayRegistry.erase(it);
-                continue;
-            }
-        }
-        {
-            auto it = g_hashMapRegistry.find(p);
-            if (it != g_hashMapRegistry.end()) {
-                it->second->clear();
-                g_hashMapPool.push_back(std::move(it->second));
-                g_hashMapRegistry.erase(it);
-                continue;
-            }
+    g_old.resize(g_sweepWrite);
+    return true;
+}
+// Advances a running full collection by up to budgetMs; 0 runs it to the end
+static void gcStep(double budgetMs) {
+    GCDeadline deadline = gcDeadline(budgetMs);
+    if (g_phase == GCPhase::Marking) {
+        if (gcDrain(deadline)) {
+            g_phase = GCPhase::Sweeping;
+            gGCMarking = false;
+            g_sweepRead = g_sweepWrite = 0;
         }
-        if (g_instanceRegistry.erase(p)) continue;
-        if (g_classRegistry.erase(p)) continue;
-        if (g_callableRegistry.erase(p)) continue;
-        if (g_vmFunctionRegistry.erase(p)) continue;
-        if (g_vmClosureRegistry.erase(p)) continue;
-        g_objectGeneration.erase(p);
     }
-    g_rememberedSet.clear();
-    for (auto& [p, meta] : g_objectGeneration) { meta &= 0x01; }
+    if (g_phase == GCPhase::Sweeping && gcSweepOld(deadline)) {
+        gcRetireNursery();
+        gcClearCards();
+        g_phase = GCPhase::Idle;
+        g_fullThreshold = std::max(MIN_FULL_THRESHOLD, g_old.size() * 2);
+    }
+    g_lastStepEnd = std::chrono::steady_clock::now();
 }
 
+Value internedStringValue(std::string_view s) {
+    return stringValue(StringPool::internString(s));
+}
+// A flat string of length characters, to be filled in and tracked
+static ClawString* gcAllocateString(size_t length) {
+    void* memory = gcNurseryAllocate(stringAllocationSize(length));
+    auto* string = new (memory) ClawString(static_cast<uint32_t>(length), false);
+    const_cast<char*>(string->chars())[length] = '\0';
+    profilerRecordAlloc(stringAllocationSize(length), "string");
+    return string;
+}
+// The characters are copied before the string is tracked, so a collection
+// its allocation runs may free the strings they came from
+Value newStringValue(std::string_view a, std::string_view b) {
+    ClawString* string = gcAllocateString(a.size() + b.size());
+    char* chars = const_cast<char*>(string->chars());
+    a.copy(chars, a.size());
+    b.copy(chars + a.size(), b.size());
+    gcTrack(string, nullptr, 0, true);
+    return stringValue(string);
+}
+Value newStringValue(std::string_view s) {
+    return newStringValue(s, std::string_view());
+}
+
+// The halves are in place before the rope is tracked, so a collection its
+// allocation runs keeps them
+static Value gcNewRope(const ClawString* left, const ClawString* right) {
+    void* memory = gcNurseryAllocate(ROPE_ALLOCATION_SIZE);
+    auto* rope = new (memory) ClawString(left->length + right->length, false, true);
+    rope->parts()[0] = left;
+    rope->parts()[1] = right;
+    gcTrack(rope, nullptr, 0, true);
+    profilerRecordAlloc(ROPE_ALLOCATION_SIZE, "string");
+    return stringValue(rope);
+}
+// A piece a rope is about to take, tracked without collecting: the other
+// half may be held only by the caller until the rope holds both
+static const ClawString* gcNewRopePiece(std::string_view s) {
+    ClawString* string = gcAllocateString(s.size());
+    s.copy(const_cast<char*>(string->chars()), s.size());
+    gcTrack(string, nullptr, 0, false);
+    return string;
+}
+Value concatStrings(Value a, Value b) {
+    const ClawString* left = asStringObject(a);
+    const ClawString* right = asStringObject(b);
+    if (size_t(left->length) + right->length < ROPE_MIN_LENGTH) return newStringValue(left->view(), right->view());
+    if (right->length == 0) return a;
+    if (left->length == 0) return b;
+    return gcNewRope(left, right);
+}
+Value concatStrings(Value a, std::string_view b) {
+    const ClawString* left = asStringObject(a);
+    if (left->length + b.size() < ROPE_MIN_LENGTH) return newStringValue(left->view(), b);
+    return gcNewRope(left, gcNewRopePiece(b));
+}
+Value concatStrings(std::string_view a, Value b) {
+    const ClawString* right = asStringObject(b);
+    if (a.size() + right->length < ROPE_MIN_LENGTH) return newStringValue(a, right->view());
+    return gcNewRope(gcNewRopePiece(a), right);
+}
+
+// Copies the leaves right to left into a new string that replaces the
+// halves. Nothing collects meanwhile: the caller may hold the rope only in
+// a local.
+const ClawString* ClawString::flatten() const {
+    ClawString* flat = gcAllocateString(length);
+    char* out = const_cast<char*>(flat->chars()) + length;
+    std::vector<const ClawString*> pending{this};
+    while (!pending.empty()) {
+        const ClawString* string = pending.back();
+        pending.pop_back();
+        if (string->rope && !string->flattened()) {
+            pending.push_back(string->parts()[0]);
+            pending.push_back(string->parts()[1]);
+        } else {
+            out -= string->length;
+            std::memcpy(out, string->chars(), string->length);
+        }
+    }
+    gcTrack(flat, nullptr, 0, false);
+    const ClawString** halves = parts();
+    gcBarrierDelete(stringValue(halves[1]));
+    gcBarrierWrite(this, stringValue(halves[0]), stringValue(flat));
+    halves[0] = flat;
+    halves[1] = nullptr;
+    return flat;
+}
 Value callableValue(std::shared_ptr<Callable> fn) {
-    void* p = fn.get();
-    g_callableRegistry[p] = std::move(fn);
-    g_objectGeneration[p] = 0;
-    gcMaybeCollect();
+    Callable* p = fn.get();
+    gcTrack(p, std::move(fn), 0, true);
     profilerRecordAlloc(sizeof(Callable), "callable");
     return objectValue(p);
 }
 Value arrayValue(std::shared_ptr<ClawArray> arr) {
-    void* p = arr.get();
-    g_arrayRegistry[p] = std::move(arr);
-    g_objectGeneration[p] = 0;
-    if (!g_ephemeralStack.empty()) g_ephemeralStack.back().push_back(p);
-    gcMaybeCollect();
+    ClawArray* p = arr.get();
+    gcTrack(p, std::move(arr), 0, true);
     profilerRecordAlloc(sizeof(ClawArray), "array");
     return objectValue(p);
 }
 Value hashMapValue(std::shared_ptr<ClawHashMap> map) {
-    void* p = map.get();
-    g_hashMapRegistry[p] = std::move(map);
-    g_objectGeneration[p] = 0;
-    if (!g_ephemeralStack.empty()) g_ephemeralStack.back().push_back(p);
-    gcMaybeCollect();
+    ClawHashMap* p = map.get();
+    gcTrack(p, std::move(map), 0, true);
     profilerRecordAlloc(sizeof(ClawHashMap), "hashmap");
     return objectValue(p);
 }
 Value classValue(std::shared_ptr<ClawClass> cls) {
-    void* p = cls.get();
-    g_classRegistry[p] = std::move(cls);
-    g_objectGeneration[p] = 0;
-    gcMaybeCollect();
+    ClawClass* p = cls.get();
+    gcTrack(p, std::move(cls), 0, true);
     profilerRecordAlloc(sizeof(ClawClass), "class");
     return objectValue(p);
 }
 Value instanceValue(std::shared_ptr<ClawInstance> inst) {
-    void* p = inst.get();
-    g_instanceRegistry[p] = std::move(inst);
-    g_objectGeneration[p] = 0;
-    gcMaybeCollect();
+    ClawInstance* p = inst.get();
+    gcTrack(p, std::move(inst), 0, true);
     profilerRecordAlloc(sizeof(ClawInstance), "instance");
     return objectValue(p);
 }
 Value vmFunctionValue(std::shared_ptr<VMFunction> fn) {
-    void* p = fn.get();
-    g_vmFunctionRegistry[p] = std::move(fn);
-    g_objectGeneration[p] = 1;
+    VMFunction* p = fn.get();
+    gcTrack(p, std::move(fn), 1, false);
     profilerRecordAlloc(sizeof(VMFunction), "vmfunc");
     return objectValue(p);
 }
 Value vmClosureValue(std::shared_ptr<VMClosure> closure) {
-    void* p = closure.get();
-    g_vmClosureRegistry[p] = std::move(closure);
-    g_objectGeneration[p] = 1;
+    VMClosure* p = closure.get();
+    gcTrack(p, std::move(closure), 1, false);
+    return objectValue(p);
+}
+std::shared_ptr<VMClosure> VMClosure::create(std::shared_ptr<VMFunction> function) {
+    void* memory = ::operator new(allocationSize(function->upvalueCount));
+    VMClosure* closure = createAt(memory, std::move(function));
+    return std::shared_ptr<VMClosure>(closure, [](VMClosure* c) {
+        c->~VMClosure();
+        ::operator delete(c);
+    });
+}
+
+VMClosure* VMClosure::createAt(void* memory, std::shared_ptr<VMFunction> function) {
+    int count = function->upvalueCount;
+    auto* closure = new (memory) VMClosure();
+    closure->function = std::move(function);
+    closure->upvalueCount = count;
+    std::fill_n(closure->upvalues(), count, nullptr);
+    return closure;
+}
+
+VMClosure::~VMClosure() {
+    for (int i = 0; i < upvalueCount; i++) {
+        if (upvalues()[i]) gcReleaseUpvalue(upvalues()[i]);
+    }
+}
+
+void VMClosure::setUpvalue(int i, VMUpvalue* upvalue) {
+    upvalue->refs++;
+    if (upvalues()[i]) gcReleaseUpvalue(upvalues()[i]);
+    upvalues()[i] = upvalue;
+}
+
+VMUpvalue* gcNewUpvalue(Value* slot) {
+    VMUpvalue* upvalue;
+    if (!g_upvaluePool.empty()) {
+        upvalue = g_upvaluePool.back();
+        g_upvaluePool.pop_back();
+    } else {
+        upvalue = new VMUpvalue();
+        profilerRecordAlloc(sizeof(VMUpvalue), "upvalue");
+    }
+    upvalue->location = slot;
+    upvalue->closed = nilValue();
+    upvalue->next = nullptr;
+    upvalue->refs = 0;
+    return upvalue;
+}
+
+void gcReleaseUpvalue(VMUpvalue* upvalue) {
+    if (--upvalue->refs > 0) return;
+    // A remembered upvalue stays allocated until the next minor collection
+    // reads it
+    if (g_upvaluePool.size() < UPVALUE_POOL_MAX || upvalue->dirty) {
+        g_upvaluePool.push_back(upvalue);
+    } else {
+        delete upvalue;
+    }
+}
+
+Value vmBoundMethodValue(std::shared_ptr<VMBoundMethod> bound) {
+    VMBoundMethod* p = bound.get();
+    gcTrack(p, std::move(bound), 0, true);
+    profilerRecordAlloc(sizeof(VMBoundMethod), "boundmethod");
+    return objectValue(p);
+}
+void ClawStringBuilder::append(Value v) {
+    if (isString(v)) {
+        buffer += asStringView(v);
+    } else {
+        buffer += valueToString(v);
+    }
+}
+Value stringBuilderValue(std::shared_ptr<ClawStringBuilder> builder) {
+    ClawStringBuilder* p = builder.get();
+    gcTrack(p, std::move(builder), 0, true);
+    profilerRecordAlloc(sizeof(ClawStringBuilder), "stringbuilder");
     return objectValue(p);
 }
 
@@ -242,7 +632,7 @@ bool isTruthy(Value v) {
     if (isNil(v)) return false;
     if (isBool(v)) return asBool(v);
     if (isNumber(v)) return asNumber(v) != 0.0;
-    if (isString(v)) return *asStringPtr(v) != '\0';
+    if (isString(v)) return asStringObject(v)->length != 0;
     if (isArray(v)) return asArray(v)->length() > 0;
     if (isHashMap(v)) return asHashMap(v)->size() > 0;  // Added!
     return true;
@@ -256,7 +646,7 @@ bool isEqual(Value a, Value b) {
         return asNumber(a) == asNumber(b);
     }
     if (isString(a) && isString(b)) {
-        return asStringPtr(a) == asStringPtr(b);
+        return stringsEqual(asStringObject(a), asStringObject(b));
     }
     if (isBool(a) && isBool(b)) {
         return asBool(a) == asBool(b);
@@ -307,7 +697,7 @@ std::string valueToStringWithCycleDetection(const Value& v, std::set<const void*
     } else if (isArray(v)) {
         // For arrays, we need to also check for circular references
         auto arr = asArray(v);
-        const void* ptr = arr.get();
+        const void* ptr = arr;
         
         if (visited.count(ptr)) {
             return "[Circular Array]";
@@ -319,7 +709,7 @@ std::string valueToStringWithCycleDetection(const Value& v, std::set<const void*
         return result;
     } else if (isHashMap(v)) {  // Added!
         auto map = asHashMap(v);
-        const void* ptr = map.get();
+        const void* ptr = map;
         
         // Check if this map is already being processed (cycle detection)
         if (visited.count(ptr)) {
@@ -342,28 +732,13 @@ std::string valueToStringWithCycleDetection(const Value& v, std::set<const void*
         // Unmark this map after processing
         visited.erase(ptr);
         return oss.str();
+    } else if (isStringBuilder(v)) {
+        return asStringBuilder(v)->buffer;
     }
     return "unknown";
 }
 bool diagnosticsEnabled() { return gRuntimeFlags.icDiagnostics; }
 
-bool isCallable(Value v) { return isObject(v) && g_callableRegistry.count(asObjectPtr(v)) > 0; }
-bool isArray(Value v) { return isObject(v) && g_arrayRegistry.count(asObjectPtr(v)) > 0; }
-bool isHashMap(Value v) { return isObject(v) && g_hashMapRegistry.count(asObjectPtr(v)) > 0; }
-bool isClass(Value v) { return isObject(v) && g_classRegistry.count(asObjectPtr(v)) > 0; }
-bool isInstance(Value v) { return isObject(v) && g_instanceRegistry.count(asObjectPtr(v)) > 0; }
-bool isVMFunction(Value v) { return isObject(v) && g_vmFunctionRegistry.count(asObjectPtr(v)) > 0; }
-bool isVMClosure(Value v) { return isObject(v) && g_vmClosureRegistry.count(asObjectPtr(v)) > 0; }
-
-std::shared_ptr<ClawArray> asArray(Value v) { auto it = g_arrayRegistry.find(asObjectPtr(v)); return it != g_arrayRegistry.end() ? it->second : nullptr; }
-std::shared_ptr<ClawHashMap> asHashMap(Value v) { auto it = g_hashMapRegistry.find(asObjectPtr(v)); return it != g_hashMapRegistry.end() ? it->second : nullptr; }
-std::shared_ptr<ClawClass> asClass(Value v) { auto it = g_classRegistry.find(asObjectPtr(v)); return it != g_classRegistry.end() ? it->second : nullptr; }
-std::shared_ptr<ClawInstance> asInstance(Value v) { auto it = g_instanceRegistry.find(asObjectPtr(v)); return it != g_instanceRegistry.end() ? it->second : nullptr; }
-std::shared_ptr<Callable> asCallable(Value v) { auto it = g_callableRegistry.find(asObjectPtr(v)); return it != g_callableRegistry.end() ? it->second : nullptr; }
-std::shared_ptr<VMFunction> asVMFunction(Value v) { auto it = g_vmFunctionRegistry.find(asObjectPtr(v)); return it != g_vmFunctionRegistry.end() ? it->second : nullptr; }
-std::shared_ptr<VMClosure> asVMClosure(Value v) { auto it = g_vmClosureRegistry.find(asObjectPtr(v)); return it != g_vmClosureRegistry.end() ? it->second : nullptr; }
-VMClosure* asVMClosurePtr(Value v) { auto it = g_vmClosureRegistry.find(asObjectPtr(v)); return it != g_vmClosureRegistry.end() ? it->second.get() : nullptr; }
-
 static void gcMarkVMRoots(VM* vm) {
     if (!vm) return;
     std::vector<Value> roots;
@@ -401,63 +776,15 @@ void gcReleaseHashMapToPool(std::shared_ptr<ClawHashMap> map) {
     }
 }
 
-void gcEphemeralFrameEnter() { g_ephemeralStack.emplace_back(); }
-void gcEphemeralEscape(Value v) {
-    if (g_ephemeralStack.empty()) return;
-    if (!isObject(v)) return;
-    void* p = asObjectPtr(v);
-    auto& top = g_ephemeralStack.back();
-    for (auto it = top.begin(); it != top.end(); ++it) {
-        if (*it == p) { top.erase(it); break; }
-    }
+GCRootScope::GCRootScope(bool root) : mark_(g_scopeRoots.size()), previous_(g_rootAllocations) {
+    g_rootAllocations = root;
 }
-void gcEphemeralEscapeDeep(Value v) {
-    if (g_ephemeralStack.empty()) return;
-    if (!isObject(v)) return;
-    void* p = asObjectPtr(v);
-    auto& top = g_ephemeralStack.back();
-    for (auto it = top.begin(); it != top.end(); ++it) {
-        if (*it == p) { top.erase(it); break; }
-    }
-    auto ait = g_arrayRegistry.find(p);
-    if (ait != g_arrayRegistry.end()) {
-        const auto& elems = ait->second->elements();
-        for (const auto& e : elems) gcEphemeralEscapeDeep(e);
-        return;
-    }
-    auto mit = g_hashMapRegistry.find(p);
-    if (mit != g_hashMapRegistry.end()) {
-        for (const auto& kv : mit->second->data) gcEphemeralEscapeDeep(kv.second);
-        return;
-    }
-    auto iit = g_instanceRegistry.find(p);
-    if (iit != g_instanceRegistry.end()) {
-        iit->second->forEachField([](Value v){ gcEphemeralEscapeDeep(v); });
-        return;
-    }
+GCRootScope::~GCRootScope() {
+    g_scopeRoots.resize(mark_);
+    g_rootAllocations = previous_;
 }
-void gcEphemeralFrameLeave() {
-    if (g_ephemeralStack.empty()) return;
-    auto list = std::move(g_ephemeralStack.back());
-    g_ephemeralStack.pop_back();
-    for (void* p : list) {
-        auto ait = g_arrayRegistry.find(p);
-        if (ait != g_arrayRegistry.end()) {
-            auto arr = std::move(ait->second);
-            ait = g_arrayRegistry.erase(ait), void();
-            gcReleaseArrayToPool(std::move(arr));
-            g_objectGeneration.erase(p);
-            continue;
-        }
-        auto mit = g_hashMapRegistry.find(p);
-        if (mit != g_hashMapRegistry.end()) {
-            auto map = std::move(mit->second);
-            mit = g_hashMapRegistry.erase(mit), void();
-            gcReleaseHashMapToPool(std::move(map));
-            g_objectGeneration.erase(p);
-            continue;
-        }
-    }
+void gcRootValue(Value v) {
+    if (g_rootAllocations && isHeapValue(v)) g_scopeRoots.push_back(asHeapObject(v));
 }
 
 void gcSetBenchmarkMode(bool enable) { g_benchmarkMode.store(enable, std::memory_order_relaxed); }
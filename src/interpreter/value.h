@@ -1,10 +1,12 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <vector>
 #include <set>
 #include <cstring>
+#include <cmath>
 
 namespace claw {
 
@@ -31,8 +33,13 @@ struct VMUpvalue;
  * 000: Nil
  * 001: False
  * 010: True
- * 011: String (interned string_view pointer)
- * 100: Object (shared_ptr or raw pointer to VoltObject)
+ * 100: String (pointer to the ClawString header)
+ * 101: Object (pointer to the HeapObject header)
+ * 110: Int (int32 in bits 3..34; counts as a number everywhere)
+ *
+ * Ints are produced by the bytecode compiler and VM for integral values that
+ * fit in 32 bits. isNumber/asNumber accept both forms, so code that only deals
+ * in doubles never has to know about the int tag.
  */
 
 typedef uint64_t Value;
@@ -46,6 +53,7 @@ constexpr uint64_t TAG_FALSE  = 2; // 010
 constexpr uint64_t TAG_TRUE   = 3; // 011
 constexpr uint64_t TAG_STRING = 4; // 100
 constexpr uint64_t TAG_OBJECT = 5; // 101
+constexpr uint64_t TAG_INT    = 6; // 110
 
 inline uint64_t payload(Value v) { return v & ~(QNAN | 0x7); }
 inline uint64_t tagBits(Value v) { return v & (QNAN | 0x7); }
@@ -58,6 +66,10 @@ inline Value numberToValue(double num) {
     return v;
 }
 
+inline Value intValue(int32_t i) {
+    return QNAN | TAG_INT | (static_cast<uint64_t>(static_cast<uint32_t>(i)) << 3);
+}
+
 inline Value nilValue() {
     return QNAN | TAG_NIL;
 }
@@ -66,65 +78,299 @@ inline Value boolValue(bool b) {
     return QNAN | (b ? TAG_TRUE : TAG_FALSE);
 }
 
-// Objects are stored as pointers. For now, we use raw pointers to shared_ptr or similar.
-// To keep it simple and safe, we'll store a pointer to a wrapper or the object itself.
-inline Value stringValue(const char* interned_ptr) {
-    return QNAN | TAG_STRING | reinterpret_cast<uint64_t>(interned_ptr);
+// The kind of object behind an object or string Value
+enum class ObjectType : uint8_t {
+    Callable,
+    Array,
+    HashMap,
+    Class,
+    Instance,
+    VMFunction,
+    VMClosure,
+    VMBoundMethod,
+    String,
+    StringBuilder
+};
+
+/**
+ * HeapObject - Header every object a Value can point at starts with
+ *
+ * Object Values point at the header, so isArray() and friends read the type
+ * tag and asArray() and friends are a cast. The collector keeps its mark bit,
+ * the object's generation and its card bit here. Objects it tracks sit in
+ * the vector of their generation at heapIndex and are kept alive by heapRef
+ * until a collection finds them unreachable; the objects that Values point
+ * at are always tracked, except the VM's scoped closures and arrays.
+ */
+struct HeapObject {
+    static constexpr uint32_t UNTRACKED = UINT32_MAX;
+
+    explicit HeapObject(ObjectType objectType) : type(objectType) {}
+    // A copy is a new object the collector has not seen yet
+    HeapObject(const HeapObject& other) : type(other.type) {}
+    HeapObject& operator=(const HeapObject&) { return *this; }
+
+    bool tracked() const { return heapIndex != UNTRACKED; }
+
+    const ObjectType type;
+    uint8_t marked = 0;
+    uint8_t generation = 0; // 0 young, 1 old
+    uint8_t dirty = 0;      // old and written a young reference since the last minor collection
+    uint32_t heapIndex = UNTRACKED;
+    std::shared_ptr<void> heapRef;
+};
+
+inline Value objectValue(HeapObject* object) {
+    return QNAN | TAG_OBJECT | reinterpret_cast<uint64_t>(object);
+}
+
+/**
+ * ClawString - A string, with its characters stored right after it
+ *
+ * Identifiers and constants are interned: StringPool owns them for the
+ * whole run, equal interned strings are the same object, and they are never
+ * tracked. Every other string comes from newStringValue, starts in the
+ * nursery and is collected like any object.
+ *
+ * A long concatenation is a rope instead: two string pointers after the
+ * header, its halves. The first read of its characters flattens it into a
+ * new string that replaces the halves, so building a string piece by piece
+ * copies it once, when it is used.
+ */
+struct ClawString : HeapObject {
+    ClawString(uint32_t stringLength, bool isInterned, bool isRope = false)
+        : HeapObject(ObjectType::String), length(stringLength), interned(isInterned), rope(isRope) {}
+
+    const char* chars() const {
+        if (rope) return flat()->chars();
+        return flatView().data();
+    }
+    std::string_view view() const { return {chars(), length}; }
+    // The characters of a string known not to be a rope, such as an interned one
+    std::string_view flatView() const { return {reinterpret_cast<const char*>(this + 1), length}; }
+    uint32_t hash() const {
+        if (hash_ == 0) hash_ = hashOf(view());
+        return hash_;
+    }
+    // FNV-1a, never 0 so that 0 can mean not computed yet
+    static uint32_t hashOf(std::string_view s) {
+        uint32_t h = 2166136261u;
+        for (unsigned char c : s) h = (h ^ c) * 16777619u;
+        return h ? h : 1;
+    }
+
+    // A rope's halves; once flattened, the flat string and nullptr
+    const ClawString** parts() const { return reinterpret_cast<const ClawString**>(const_cast<ClawString*>(this) + 1); }
+    bool flattened() const { return parts()[1] == nullptr; }
+
+    const uint32_t length;
+    const bool interned;
+    const bool rope;
+
+private:
+    const ClawString* flat() const { return flattened() ? parts()[0] : flatten(); }
+    const ClawString* flatten() const;
+
+    // Set by the pool for interned strings
+    friend class StringPool;
+    mutable uint32_t hash_ = 0;
+};
+
+inline Value stringValue(const ClawString* string) {
+    return QNAN | TAG_STRING | reinterpret_cast<uint64_t>(string);
 }
+// The interned string for an identifier or constant
+Value internedStringValue(std::string_view s);
+// A new collectible string, or the concatenation of two
+Value newStringValue(std::string_view s);
+Value newStringValue(std::string_view a, std::string_view b);
+// The concatenation of a string Value and another string; a rope when the
+// result is long
+Value concatStrings(Value a, Value b);
+Value concatStrings(Value a, std::string_view b);
+Value concatStrings(std::string_view a, Value b);
 
-inline Value objectValue(void* obj_ptr) {
-    return QNAN | TAG_OBJECT | reinterpret_cast<uint64_t>(obj_ptr);
+// Shares the collector's ownership of an object, for holders that keep it
+// past the Values pointing at it (a superclass, a call site cache)
+template <typename T>
+std::shared_ptr<T> shareObject(T* object) {
+    return std::shared_ptr<T>(object->heapRef, object);
 }
 
-struct VMFunction {
+struct VMFunction : HeapObject {
+    VMFunction() : HeapObject(ObjectType::VMFunction) {}
+
     std::string name;
+    int line = 0;            // of the declaration, as stack traces show it
     int arity = 0;
     int upvalueCount = 0;
     std::shared_ptr<Chunk> chunk;
 };
 
+// A variable captured by closures. While open it points at a stack slot
+// and sits on the VM's list of open upvalues, linked through next in
+// descending slot order; closing copies the value into closed. refs counts
+// the closures holding it plus the open list, and the last release returns
+// it to a pool (gcNewUpvalue/gcReleaseUpvalue).
 struct VMUpvalue {
     Value* location = nullptr;
     Value closed = 0;
+    VMUpvalue* next = nullptr;
+    uint32_t refs = 0;
+    bool dirty = false;     // closed over a young object since the last minor collection
 };
 
-struct VMClosure {
+// A function with its captured variables. The upvalue pointers live in an
+// array allocated right after the closure, so create() is the only way to
+// build one that captures anything.
+struct VMClosure : HeapObject {
     std::shared_ptr<VMFunction> function;
-    std::vector<std::shared_ptr<VMUpvalue>> upvalues;
+    int upvalueCount = 0;
+
+    static std::shared_ptr<VMClosure> create(std::shared_ptr<VMFunction> function);
+    // Builds one in caller-owned memory of allocationSize() bytes; the
+    // caller runs the destructor
+    static VMClosure* createAt(void* memory, std::shared_ptr<VMFunction> function);
+    static size_t allocationSize(int upvalueCount) {
+        return sizeof(VMClosure) + static_cast<size_t>(upvalueCount) * sizeof(VMUpvalue*);
+    }
+    VMClosure() : HeapObject(ObjectType::VMClosure) {}
+    VMClosure(const VMClosure&) = delete;
+    VMClosure& operator=(const VMClosure&) = delete;
+    ~VMClosure();
+
+    VMUpvalue* upvalue(int i) const { return upvalues()[i]; }
+    void setUpvalue(int i, VMUpvalue* upvalue);
+
+private:
+    VMUpvalue** upvalues() const {
+        return reinterpret_cast<VMUpvalue**>(const_cast<VMClosure*>(this) + 1);
+    }
+};
+
+// A compiled method read off an instance without calling it. The method
+// belongs to the receiver's class chain, which keeps it alive.
+struct VMBoundMethod : HeapObject {
+    VMBoundMethod(Value boundReceiver, VMClosure* boundMethod)
+        : HeapObject(ObjectType::VMBoundMethod), receiver(boundReceiver), method(boundMethod) {}
+
+    Value receiver;
+    VMClosure* method;
+};
+
+// What StringBuilder() makes: append copies each piece onto the end of one
+// buffer, so a string built from n pieces costs amortized O(n)
+struct ClawStringBuilder : HeapObject {
+    ClawStringBuilder() : HeapObject(ObjectType::StringBuilder) {}
+
+    // Strings are appended as they are, anything else as print shows it
+    void append(Value v);
+
+    std::string buffer;
 };
 
 // Type checks
-inline bool isNumber(Value v) { return (v & QNAN) != QNAN; }
+inline bool isInt(Value v) { return tagBits(v) == (QNAN | TAG_INT); }
+inline bool isDouble(Value v) { return (v & QNAN) != QNAN; }
+inline bool isNumber(Value v) { return isDouble(v) || isInt(v); }
 inline bool isNil(Value v) { return v == nilValue(); }
-inline bool isBool(Value v) { return (v & (QNAN | TAG_FALSE)) == (QNAN | TAG_FALSE) || (v & (QNAN | TAG_TRUE)) == (QNAN | TAG_TRUE); }
+inline bool isBool(Value v) { return v == (QNAN | TAG_FALSE) || v == (QNAN | TAG_TRUE); }
 inline bool isString(Value v) { return tagBits(v) == (QNAN | TAG_STRING); }
 inline bool isObject(Value v) { return tagBits(v) == (QNAN | TAG_OBJECT); }
+// Objects and strings: anything that points at a HeapObject
+inline bool isHeapValue(Value v) { return (v & (QNAN | 0x6)) == (QNAN | TAG_STRING); }
 
 // Value extractors
+inline int32_t asInt(Value v) {
+    return static_cast<int32_t>(static_cast<uint32_t>(v >> 3));
+}
+
 inline double asNumber(Value v) {
+    if (isInt(v)) return asInt(v);
     double num;
     std::memcpy(&num, &v, sizeof(double));
     return num;
 }
 
+// Int form when the value is integral and fits in 32 bits, double otherwise.
+// -0.0 stays a double so that it keeps its sign.
+inline Value compactNumberValue(double num) {
+    if (num >= -2147483648.0 && num <= 2147483647.0) {
+        auto i = static_cast<int32_t>(num);
+        if (static_cast<double>(i) == num && (i != 0 || !std::signbit(num))) return intValue(i);
+    }
+    return numberToValue(num);
+}
+
+// Arithmetic on two number values. Int operands stay ints until the result
+// leaves the int32 range, then the result overflows to a double.
+inline Value addNumbers(Value a, Value b) {
+    if (isInt(a) && isInt(b)) {
+        int64_t r = static_cast<int64_t>(asInt(a)) + asInt(b);
+        if (r == static_cast<int32_t>(r)) return intValue(static_cast<int32_t>(r));
+    }
+    return numberToValue(asNumber(a) + asNumber(b));
+}
+
+inline Value subtractNumbers(Value a, Value b) {
+    if (isInt(a) && isInt(b)) {
+        int64_t r = static_cast<int64_t>(asInt(a)) - asInt(b);
+        if (r == static_cast<int32_t>(r)) return intValue(static_cast<int32_t>(r));
+    }
+    return numberToValue(asNumber(a) - asNumber(b));
+}
+
+inline Value multiplyNumbers(Value a, Value b) {
+    if (isInt(a) && isInt(b)) {
+        int64_t r = static_cast<int64_t>(asInt(a)) * asInt(b);
+        // A zero product with a negative operand is -0.0 as a double
+        if (r == static_cast<int32_t>(r) && (r != 0 || (asInt(a) >= 0 && asInt(b) >= 0))) {
+            return intValue(static_cast<int32_t>(r));
+        }
+    }
+    return numberToValue(asNumber(a) * asNumber(b));
+}
+
 inline bool asBool(Value v) {
     return v == (QNAN | TAG_TRUE);
 }
 
+inline const ClawString* asStringObject(Value v) {
+    return reinterpret_cast<const ClawString*>(payload(v));
+}
+
 inline const char* asStringPtr(Value v) {
-    return reinterpret_cast<const char*>(payload(v));
+    return asStringObject(v)->chars();
+}
+
+inline std::string_view asStringView(Value v) {
+    return asStringObject(v)->view();
 }
 
 inline std::string asString(Value v) {
-    const char* p = asStringPtr(v);
-    return p ? std::string(p) : std::string();
+    return std::string(asStringView(v));
+}
+
+// Interned strings are equal only when they are the same object
+inline bool stringsEqual(const ClawString* a, const ClawString* b) {
+    if (a == b) return true;
+    if ((a->interned && b->interned) || a->length != b->length) return false;
+    return std::memcmp(a->chars(), b->chars(), a->length) == 0;
 }
 
 inline void* asObjectPtr(Value v) {
     return reinterpret_cast<void*>(payload(v));
 }
 
-// Object Value creators using global registries
+inline HeapObject* asHeapObject(Value v) {
+    return reinterpret_cast<HeapObject*>(payload(v));
+}
+
+inline bool isObjectType(Value v, ObjectType type) {
+    return isObject(v) && asHeapObject(v)->type == type;
+}
+
+// Object Value creators; each hands the object to the collector
 Value callableValue(std::shared_ptr<Callable> fn);
 Value arrayValue(std::shared_ptr<ClawArray> arr);
 Value hashMapValue(std::shared_ptr<ClawHashMap> map);
@@ -132,6 +378,8 @@ Value classValue(std::shared_ptr<ClawClass> cls);
 Value instanceValue(std::shared_ptr<ClawInstance> inst);
 Value vmFunctionValue(std::shared_ptr<VMFunction> fn);
 Value vmClosureValue(std::shared_ptr<VMClosure> closure);
+Value vmBoundMethodValue(std::shared_ptr<VMBoundMethod> bound);
+Value stringBuilderValue(std::shared_ptr<ClawStringBuilder> builder);
 
 // Legacy-compatible helpers (will be updated as we refactor)
 bool isTruthy(Value v);
@@ -140,37 +388,105 @@ std::string valueToString(const Value& v);
 std::string valueToStringWithCycleDetection(const Value& v, std::set<const void*>& visited);
 bool diagnosticsEnabled();
 
-// Specialized object checks (to be refined)
-bool isCallable(Value v);
-bool isArray(Value v);
-bool isHashMap(Value v);
-bool isClass(Value v);
-bool isInstance(Value v);
-bool isVMFunction(Value v);
-bool isVMClosure(Value v);
-
-std::shared_ptr<ClawArray> asArray(Value v);
-std::shared_ptr<ClawHashMap> asHashMap(Value v);
-std::shared_ptr<ClawClass> asClass(Value v);
-std::shared_ptr<ClawInstance> asInstance(Value v);
-std::shared_ptr<Callable> asCallable(Value v);
-std::shared_ptr<VMFunction> asVMFunction(Value v);
-std::shared_ptr<VMClosure> asVMClosure(Value v);
-VMClosure* asVMClosurePtr(Value v);
+// Object checks read the header's type tag
+inline bool isCallable(Value v) { return isObjectType(v, ObjectType::Callable); }
+inline bool isArray(Value v) { return isObjectType(v, ObjectType::Array); }
+inline bool isHashMap(Value v) { return isObjectType(v, ObjectType::HashMap); }
+inline bool isClass(Value v) { return isObjectType(v, ObjectType::Class); }
+inline bool isInstance(Value v) { return isObjectType(v, ObjectType::Instance); }
+inline bool isVMFunction(Value v) { return isObjectType(v, ObjectType::VMFunction); }
+inline bool isVMClosure(Value v) { return isObjectType(v, ObjectType::VMClosure); }
+inline bool isVMBoundMethod(Value v) { return isObjectType(v, ObjectType::VMBoundMethod); }
+inline bool isStringBuilder(Value v) { return isObjectType(v, ObjectType::StringBuilder); }
+
+// The object a Value points at, or nullptr when it holds something else.
+// asArray, asHashMap, asClass, asInstance and asCallable are defined next
+// to their classes.
+inline VMFunction* asVMFunction(Value v) {
+    return isVMFunction(v) ? static_cast<VMFunction*>(asHeapObject(v)) : nullptr;
+}
+inline VMClosure* asVMClosure(Value v) {
+    return isVMClosure(v) ? static_cast<VMClosure*>(asHeapObject(v)) : nullptr;
+}
+inline VMBoundMethod* asVMBoundMethod(Value v) {
+    return isVMBoundMethod(v) ? static_cast<VMBoundMethod*>(asHeapObject(v)) : nullptr;
+}
+inline ClawStringBuilder* asStringBuilder(Value v) {
+    return isStringBuilder(v) ? static_cast<ClawStringBuilder*>(asHeapObject(v)) : nullptr;
+}
 
 // GC APIs
+VMUpvalue* gcNewUpvalue(Value* slot);
+void gcReleaseUpvalue(VMUpvalue* upvalue);
 void gcRegisterVM(class VM* vm);
 void gcUnregisterVM(class VM* vm);
-void gcBarrierWrite(const void* parent, Value child);
+void gcRemember(HeapObject* parent);
+void gcRememberUpvalue(VMUpvalue* upvalue);
+void gcShade(Value v);
+// True while an incremental full collection is marking
+extern bool gGCMarking;
+// Snapshot-at-the-beginning half of the barriers: while a full collection
+// marks, a reference about to be overwritten or removed is shaded first, so
+// everything reachable when marking started is marked
+inline void gcBarrierDelete(Value previous) {
+    if (gGCMarking && isHeapValue(previous)) gcShade(previous);
+}
+// Called before a heap object's slot changes from previous (nil for a new
+// slot) to child. Besides the snapshot shading, it marks the card of an old
+// object that now points at a young one; a minor collection traces only the
+// marked old objects.
+inline void gcBarrierWrite(const HeapObject* parent, Value previous, Value child) {
+    gcBarrierDelete(previous);
+    if (parent->generation == 0 || parent->dirty || !isHeapValue(child)) return;
+    const HeapObject* object = asHeapObject(child);
+    if (object && object->generation == 0 && object->tracked() && parent->tracked()) {
+        gcRemember(const_cast<HeapObject*>(parent));
+    }
+}
+// Closed upvalues are not traced by a minor collection either, so one that
+// takes a young object is remembered the same way
+inline void gcBarrierUpvalue(VMUpvalue* upvalue, Value previous, Value child) {
+    if (upvalue->location != &upvalue->closed) return;
+    gcBarrierDelete(previous);
+    if (upvalue->dirty || !isHeapValue(child)) return;
+    const HeapObject* object = asHeapObject(child);
+    if (object && object->generation == 0 && object->tracked()) gcRememberUpvalue(upvalue);
+}
 void gcMaybeCollect();
+// C++ code holds new objects in locals and containers the collector does
+// not see, such as the tree interpreter's operands and a native's result
+// under construction. While a rooting scope is open, every object handed to
+// the collector stays reachable until the scope closes. The interpreter
+// opens one per statement and the VM one per host call; compiled code keeps
+// its values on the VM stack and opens a scope that does not root.
+class GCRootScope {
+public:
+    explicit GCRootScope(bool root = true);
+    ~GCRootScope();
+    GCRootScope(const GCRootScope&) = delete;
+    GCRootScope& operator=(const GCRootScope&) = delete;
+
+private:
+    size_t mark_;
+    bool previous_;
+};
+// Keeps a value that left a closed scope, such as a call's result,
+// reachable in the enclosing one
+void gcRootValue(Value v);
+// Finishes a running full collection, or runs a minor one, and frees what
+// it found dead right away
+void gcCollect();
+// Starts an incremental full collection unless one is running; allocations
+// and VM safepoints run its steps
+void gcStartFull();
+bool gcFullRunning();
+// Runs a step of a running full collection once the mutator has run for a
+// pause budget (gRuntimeFlags.gcMaxPauseMs) since the last one
+void gcSafepoint();
 std::shared_ptr<ClawArray> gcAcquireArrayFromPool();
 void gcReleaseArrayToPool(std::shared_ptr<ClawArray> arr);
 std::shared_ptr<ClawHashMap> gcAcquireHashMapFromPool();
 void gcReleaseHashMapToPool(std::shared_ptr<ClawHashMap> map);
-void gcEphemeralFrameEnter();
-void gcEphemeralFrameLeave();
-void gcEphemeralEscape(Value v);
-void gcEphemeralEscapeDeep(Value v);
 void gcSetBenchmarkMode(bool enable);
 uint64_t gcGetYoungAllocations();
 
@@ -4,6 +4,7 @@
 #include "interpreter/environment.h"
 #include "ast.h"
 #include "stmt.h"
+#include "optimizer.h"
 #include "token.h"
 #include "version.h"
 #include "compiler/compiler.h"
@@ -19,6 +20,7 @@
 #include <vector>
 #include <filesystem>
 #include <cstdlib>
+#include <algorithm>
 #include "observability/profiler.h"
 #include <map>
 
@@ -30,6 +32,7 @@
 /***************************************************************/
 
 static claw::Environment::SandboxMode g_cliSandboxMode = claw::Environment::SandboxMode::Full;
+static int g_cliOptLevel = 2;
 static std::map<std::string, std::string> g_policyKVs;
 
 static std::string trim(const std::string& s) {
@@ -198,7 +201,7 @@ void printRuntimeError(const claw::RuntimeError& e) {
     }
 }
 
-void runFile(const std::string& path, claw::Interpreter& interpreter, bool debugMode) {
+void runFile(const std::string& path, claw::Interpreter& interpreter, bool debugMode, bool useVM) {
     std::ifstream file(path);
     if (!file) {
         std::cerr << "Could not open file: " << path << "\n";
@@ -229,12 +232,25 @@ void runFile(const std::string& path, claw::Interpreter& interpreter, bool debug
         exit(65);
     }
     
+    claw::optimizeProgram(statements, g_cliOptLevel);
+
     // Debug: print AST
     if (debugMode) {
         dumpStatements(statements);
     }
     
-    // Execute
+    // Execute. The VM runs what compiles and hands every top-level statement
+    // it cannot compile, with the functions it declares, to the interpreter.
+    if (useVM) {
+        claw::Compiler compiler;
+        compiler.setFallbackEnabled(true);
+        auto chunk = compiler.compile(statements);
+        claw::VM vm(interpreter);
+        if (vm.interpret(*chunk) != claw::InterpretResult::Ok) {
+            exit(70);
+        }
+        return;
+    }
     try {
         interpreter.execute(statements);
     } catch (const claw::RuntimeError& e) {
@@ -271,12 +287,34 @@ bool compileFileToChunk(const std::string& path, std::unique_ptr<claw::Chunk>& c
         return false;
     }
 
+    auto optimized = claw::optimizeProgram(statements, g_cliOptLevel);
+
     if (debugMode) {
         dumpStatements(statements);
     }
 
     claw::Compiler compiler;
     chunk = compiler.compile(statements);
+    if (debugMode) {
+        std::cout << "AST rewrites: " << optimized.total()
+                  << " (folded " << optimized.folded
+                  << ", propagated " << optimized.propagated
+                  << ", dead branches " << optimized.deadBranches
+                  << ", unreachable " << optimized.unreachable
+                  << ", inlined " << optimized.inlined << ")\n";
+        const auto& stats = compiler.peepholeStats();
+        std::cout << "Superinstructions fused: " << stats.total()
+                  << " (add-locals " << stats.addLocals
+                  << ", less-const-jump " << stats.lessLocalConstJump
+                  << ", add-const-set " << stats.addConstSetLocal << ")\n";
+        const auto& ir = compiler.irStats();
+        std::cout << "Loop IR rewrites: " << ir.total()
+                  << " (cse " << ir.cse
+                  << ", forwarded " << ir.forwarded
+                  << ", hoisted " << ir.hoisted
+                  << ", dead stores " << ir.deadStores
+                  << ", unchecked indexes " << ir.boundsChecks << ")\n";
+    }
     return true;
 }
 
@@ -420,6 +458,8 @@ int main(int argc, char** argv) {
     std::string scriptPath;
     std::string aotOutputPath;
     bool jitAggressive = false;
+    bool useVM = false;
+    int firstOption = 1;
     bool disableCallIC = false;
     bool icDiagnostics = false;
     bool enableProfile = false;
@@ -502,11 +542,13 @@ int main(int argc, char** argv) {
                 return 64;
             }
             jitAggressive = true;
+            useVM = true;
             scriptPath = argv[2];
+            firstOption = 3;
         }
     }
     // Parse command-line arguments
-    for (int i = 1; i < argc; i++) {
+    for (int i = firstOption; i < argc; i++) {
         std::string arg = argv[i];
         if (arg == "--debug" || arg == "-d") {
             debugMode = true;
@@ -524,10 +566,14 @@ int main(int argc, char** argv) {
             std::cout << "  --profile[=file]    Enable sampling + heap profiler and write HTML\n";
             std::cout << "  --profile-hz=NUM    Sampling frequency in Hz (default 100)\n";
             std::cout << "  --sandbox=MODE      Set sandbox mode: strict|network|full\n";
+            std::cout << "  --vm-max-frames=NUM VM call depth limit (default 100000)\n";
+            std::cout << "  --gc-max-pause-ms=N Longest incremental GC step in ms; 0 collects in one pause (default 1)\n";
+            std::cout << "  --engine=vm|tree    Run on the bytecode VM (default for run) or the tree-walker\n";
+            std::cout << "  --opt-level=N       AST optimization: 0 off, 1 fold + dead code, 2 + propagate + inline (default 2)\n";
             std::cout << "\nCommands:\n";
             std::cout << "  init <project>      Create boilerplate main.claw + claw.json\n";
             std::cout << "  build <script>      Emit bytecode (.vbc) and AOT native\n";
-            std::cout << "  run <script>        Run with JIT/AoT hybrid\n";
+            std::cout << "  run <script>        Run on the VM, interpreting what it cannot compile\n";
             return 0;
         } else if (arg == "--version") {
             std::cout << "ClawScript " << claw::CLAW_VERSION << "\n";
@@ -565,6 +611,21 @@ int main(int argc, char** argv) {
             enableProfile = true;
         } else if (arg.rfind("--profile-hz=", 0) == 0) {
             try { profileHz = std::stoi(arg.substr(std::string("--profile-hz=").size())); } catch (...) {}
+        } else if (arg == "--engine=vm") {
+            useVM = true;
+        } else if (arg == "--engine=tree") {
+            useVM = false;
+        } else if (arg.rfind("--opt-level=", 0) == 0) {
+            std::string level = arg.substr(std::string("--opt-level=").size());
+            if (level != "0" && level != "1" && level != "2") {
+                std::cerr << "Unknown optimization level: " << level << "\n";
+                return 64;
+            }
+            g_cliOptLevel = level[0] - '0';
+        } else if (arg.rfind("--vm-max-frames=", 0) == 0) {
+            try { claw::gRuntimeFlags.vmMaxFrames = std::max(1, std::stoi(arg.substr(std::string("--vm-max-frames=").size()))); } catch (...) {}
+        } else if (arg.rfind("--gc-max-pause-ms=", 0) == 0) {
+            try { claw::gRuntimeFlags.gcMaxPauseMs = std::max(0.0, std::stod(arg.substr(std::string("--gc-max-pause-ms=").size()))); } catch (...) {}
         } else if (arg[0] == '-') {
             std::cerr << "Unknown option: " << arg << "\n";
             return 64;
@@ -660,7 +721,7 @@ int main(int argc, char** argv) {
     
     if (!scriptPath.empty()) {
         // Run file
-        runFile(scriptPath, interpreter, debugMode);
+        runFile(scriptPath, interpreter, debugMode, useVM);
     } else {
         // Interactive REPL
         runPrompt();
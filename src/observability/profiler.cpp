@@ -1,6 +1,7 @@
  #include "observability/profiler.h"
  #include "interpreter/interpreter.h"
  #include "interpreter/stack_trace.h"
+ #include "vm/safepoint.h"
  #include <fstream>
  #include <chrono>
  #include <sstream>
@@ -37,6 +38,7 @@
  void Profiler::run() {
      while (running_.load(std::memory_order_relaxed)) {
          sampleOnce();
+         vmRequestSafepoint(SafepointProfile);
          std::this_thread::sleep_for(std::chrono::milliseconds(periodMs_));
      }
  }
@@ -62,6 +64,12 @@
      std::lock_guard<std::mutex> lk(mu_);
      cpuStacks_[key] += 1;
  }
+ // Sample taken by a VM at a safepoint, in the same collapsed format
+ void Profiler::recordSample(const std::string& stack) {
+     if (!enabled_.load(std::memory_order_relaxed)) return;
+     std::lock_guard<std::mutex> lk(mu_);
+     cpuStacks_[stack.empty() ? std::string("<idle>") : stack] += 1;
+ }
  void Profiler::recordAlloc(size_t bytes, const char* kind) {
      if (!isEnabled()) return;
      Interpreter* cur = nullptr;
@@ -274,5 +282,6 @@
  void profilerPause() { Profiler::instance().pause(); }
  void profilerResume() { Profiler::instance().resume(); }
  void profilerRecordAlloc(size_t bytes, const char* kind) { Profiler::instance().recordAlloc(bytes, kind); }
+ void profilerRecordSample(const std::string& stack) { Profiler::instance().recordSample(stack); }
  bool profilerEnabled() { return Profiler::instance().isEnabled(); }
  }
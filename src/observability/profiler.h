@@ -18,6 +18,7 @@
      void pause();
      void resume();
      void recordAlloc(size_t bytes, const char* kind);
+     void recordSample(const std::string& stack);
      bool isEnabled() const;
      void writeHtml(const std::string& path);
      void writeSpeedscope(const std::string& path);
@@ -44,5 +45,6 @@
  void profilerPause();
  void profilerResume();
  void profilerRecordAlloc(size_t bytes, const char* kind);
+ void profilerRecordSample(const std::string& stack);
  bool profilerEnabled();
  }
@@ -0,0 +1,868 @@
+#include "optimizer.h"
+#include "features/string_pool.h"
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace claw {
+
+namespace {
+
+constexpr int MAX_INLINE_NODES = 16;
+
+bool isLiteral(const ExprPtr& expr) {
+    return dynamic_cast<LiteralExpr*>(expr.get()) != nullptr;
+}
+
+Value literalValue(const LiteralExpr* literal) {
+    switch (literal->type) {
+        case LiteralExpr::Type::Number: return numberToValue(literal->numberValue);
+        case LiteralExpr::Type::String: return internedStringValue(literal->stringValue);
+        case LiteralExpr::Type::Bool: return boolValue(literal->boolValue);
+        case LiteralExpr::Type::Nil: return nilValue();
+    }
+    return nilValue();
+}
+
+ExprPtr makeLiteral(const Token& token, Value value) {
+    if (isNumber(value)) return std::make_unique<LiteralExpr>(token, asNumber(value));
+    if (isString(value)) return std::make_unique<LiteralExpr>(token, asString(value));
+    if (isBool(value)) return std::make_unique<LiteralExpr>(token, asBool(value));
+    return LiteralExpr::nil(token);
+}
+
+ExprPtr cloneLiteral(const LiteralExpr* literal, const Token& token) {
+    return makeLiteral(token, literalValue(literal));
+}
+
+// Folds a binary operator over two literals exactly as the interpreter
+// evaluates it. Returns false for anything that would raise an error.
+bool foldBinary(TokenType op, Value left, Value right, Value& out) {
+    bool numbers = isNumber(left) && isNumber(right);
+    switch (op) {
+        case TokenType::Plus:
+            if (numbers) {
+                out = numberToValue(asNumber(left) + asNumber(right));
+            } else if (isString(left) && isString(right)) {
+                out = internedStringValue(asString(left) + asString(right));
+            } else if (isString(left) && isNumber(right)) {
+                out = internedStringValue(asString(left) + valueToString(right));
+            } else if (isNumber(left) && isString(right)) {
+                out = internedStringValue(valueToString(left) + asString(right));
+            } else {
+                return false;
+            }
+            return true;
+        case TokenType::Minus:
+            if (!numbers) return false;
+            out = numberToValue(asNumber(left) - asNumber(right));
+            return true;
+        case TokenType::Star:
+            if (!numbers) return false;
+            out = numberToValue(asNumber(left) * asNumber(right));
+            return true;
+        case TokenType::Slash:
+            if (!numbers || asNumber(right) == 0.0) return false;
+            out = numberToValue(asNumber(left) / asNumber(right));
+            return true;
+        case TokenType::Percent:
+            if (!numbers || asNumber(right) == 0.0) return false;
+            out = numberToValue(std::fmod(asNumber(left), asNumber(right)));
+            return true;
+        case TokenType::Greater:
+            if (!numbers) return false;
+            out = boolValue(asNumber(left) > asNumber(right));
+            return true;
+        case TokenType::GreaterEqual:
+            if (!numbers) return false;
+            out = boolValue(asNumber(left) >= asNumber(right));
+            return true;
+        case TokenType::Less:
+            if (!numbers) return false;
+            out = boolValue(asNumber(left) < asNumber(right));
+            return true;
+        case TokenType::LessEqual:
+            if (!numbers) return false;
+            out = boolValue(asNumber(left) <= asNumber(right));
+            return true;
+        case TokenType::EqualEqual:
+            out = boolValue(isEqual(left, right));
+            return true;
+        case TokenType::BangEqual:
+            out = boolValue(!isEqual(left, right));
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isTerminator(const Stmt* stmt) {
+    return dynamic_cast<const ReturnStmt*>(stmt) || dynamic_cast<const BreakStmt*>(stmt) ||
+           dynamic_cast<const ContinueStmt*>(stmt) || dynamic_cast<const ThrowStmt*>(stmt);
+}
+
+// Counts every declaration of every name in the program, nested functions
+// and classes included, and records which names are ever assigned.
+class DeclarationCounter : public ExprVisitor, public StmtVisitor {
+public:
+    std::unordered_map<std::string, int> declarations;
+    std::unordered_set<std::string> assigned;
+
+    void scan(const std::vector<StmtPtr>& stmts) {
+        for (const auto& stmt : stmts) visit(stmt);
+    }
+
+    Value visitLiteralExpr(LiteralExpr*) override { return nilValue(); }
+    Value visitVariableExpr(VariableExpr*) override { return nilValue(); }
+    Value visitUnaryExpr(UnaryExpr* expr) override { return visit(expr->right); }
+    Value visitBinaryExpr(BinaryExpr* expr) override {
+        visit(expr->left);
+        return visit(expr->right);
+    }
+    Value visitLogicalExpr(LogicalExpr* expr) override {
+        visit(expr->left);
+        return visit(expr->right);
+    }
+    Value visitGroupingExpr(GroupingExpr* expr) override { return visit(expr->expr); }
+    Value visitCallExpr(CallExpr* expr) override {
+        visit(expr->callee);
+        for (const auto& argument : expr->arguments) visit(argument);
+        return nilValue();
+    }
+    Value visitAssignExpr(AssignExpr* expr) override {
+        assigned.insert(expr->name);
+        return visit(expr->value);
+    }
+    Value visitCompoundAssignExpr(CompoundAssignExpr* expr) override {
+        assigned.insert(expr->name);
+        return visit(expr->value);
+    }
+    Value visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->value);
+    }
+    Value visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) override {
+        visit(expr->object);
+        visit(expr->index);
+        return visit(expr->value);
+    }
+    Value visitUpdateExpr(UpdateExpr* expr) override {
+        assigned.insert(expr->name);
+        return nilValue();
+    }
+    Value visitUpdateMemberExpr(UpdateMemberExpr* expr) override { return visit(expr->object); }
+    Value visitUpdateIndexExpr(UpdateIndexExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->index);
+    }
+    Value visitTernaryExpr(TernaryExpr* expr) override {
+        visit(expr->condition);
+        visit(expr->thenBranch);
+        return visit(expr->elseBranch);
+    }
+    Value visitArrayExpr(ArrayExpr* expr) override {
+        for (const auto& element : expr->elements) visit(element);
+        return nilValue();
+    }
+    Value visitIndexExpr(IndexExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->index);
+    }
+    Value visitIndexAssignExpr(IndexAssignExpr* expr) override {
+        visit(expr->object);
+        visit(expr->index);
+        return visit(expr->value);
+    }
+    Value visitHashMapExpr(HashMapExpr* expr) override {
+        for (const auto& [key, value] : expr->keyValuePairs) {
+            visit(key);
+            visit(value);
+        }
+        return nilValue();
+    }
+    Value visitMemberExpr(MemberExpr* expr) override { return visit(expr->object); }
+    Value visitSetExpr(SetExpr* expr) override {
+        visit(expr->object);
+        return visit(expr->value);
+    }
+    Value visitThisExpr(ThisExpr*) override { return nilValue(); }
+    Value visitSuperExpr(SuperExpr*) override { return nilValue(); }
+    Value visitFunctionExpr(FunctionExpr* expr) override {
+        for (const auto& param : expr->parameters) declarations[param]++;
+        scan(expr->body);
+        return nilValue();
+    }
+
+    void visitExprStmt(ExprStmt* stmt) override { visit(stmt->expr); }
+    void visitPrintStmt(PrintStmt* stmt) override { visit(stmt->expr); }
+    void visitLetStmt(LetStmt* stmt) override {
+        declarations[stmt->name]++;
+        visit(stmt->initializer);
+    }
+    void visitBlockStmt(BlockStmt* stmt) override { scan(stmt->statements); }
+    void visitIfStmt(IfStmt* stmt) override {
+        visit(stmt->condition);
+        visit(stmt->thenBranch);
+        visit(stmt->elseBranch);
+    }
+    void visitWhileStmt(WhileStmt* stmt) override {
+        visit(stmt->condition);
+        visit(stmt->body);
+    }
+    void visitRunUntilStmt(RunUntilStmt* stmt) override {
+        visit(stmt->body);
+        visit(stmt->condition);
+    }
+    void visitForStmt(ForStmt* stmt) override {
+        visit(stmt->initializer);
+        visit(stmt->condition);
+        visit(stmt->increment);
+        visit(stmt->body);
+    }
+    void visitFnStmt(FnStmt* stmt) override {
+        declarations[stmt->name]++;
+        for (const auto& param : stmt->parameters) declarations[param]++;
+        scan(stmt->body);
+    }
+    void visitReturnStmt(ReturnStmt* stmt) override { visit(stmt->value); }
+    void visitBreakStmt(BreakStmt*) override {}
+    void visitContinueStmt(ContinueStmt*) override {}
+    void visitTryStmt(TryStmt* stmt) override {
+        visit(stmt->tryBody);
+        declarations[stmt->exceptionVar]++;
+        visit(stmt->catchBody);
+    }
+    void visitThrowStmt(ThrowStmt* stmt) override { visit(stmt->expression); }
+    void visitImportStmt(ImportStmt* stmt) override {
+        for (const auto& imported : stmt->imports) declarations[imported]++;
+    }
+    void visitClassStmt(ClassStmt* stmt) override {
+        declarations[stmt->name]++;
+        visit(stmt->superclass);
+        for (const auto& method : stmt->methods) {
+            for (const auto& param : method->parameters) declarations[param]++;
+            scan(method->body);
+        }
+    }
+    void visitSwitchStmt(SwitchStmt* stmt) override {
+        visit(stmt->expression);
+        for (const auto& c : stmt->cases) {
+            visit(c.match);
+            scan(c.body);
+        }
+    }
+
+private:
+    Value visit(const ExprPtr& expr) {
+        if (expr) expr->accept(*this);
+        return nilValue();
+    }
+    void visit(const StmtPtr& stmt) {
+        if (stmt) stmt->accept(*this);
+    }
+};
+
+// Decides whether an expression can stand in for a call: small, free of
+// side effects on variables, closures, this and super, and not naming the
+// function itself. Collects the variables it reads.
+class InlineBodyChecker : public ExprVisitor {
+public:
+    explicit InlineBodyChecker(const std::string& self) : self_(self) {}
+
+    bool ok = true;
+    bool calls = false;
+    int nodes = 0;
+    std::unordered_map<std::string, int> reads;
+
+    Value visitLiteralExpr(LiteralExpr*) override { return count(); }
+    Value visitVariableExpr(VariableExpr* expr) override {
+        if (expr->name == self_) ok = false;
+        reads[expr->name]++;
+        return count();
+    }
+    Value visitUnaryExpr(UnaryExpr* expr) override {
+        visit(expr->right);
+        return count();
+    }
+    Value visitBinaryExpr(BinaryExpr* expr) override {
+        visit(expr->left);
+        visit(expr->right);
+        return count();
+    }
+    Value visitLogicalExpr(LogicalExpr* expr) override {
+        visit(expr->left);
+        visit(expr->right);
+        return count();
+    }
+    Value visitGroupingExpr(GroupingExpr* expr) override {
+        visit(expr->expr);
+        return count();
+    }
+    Value visitCallExpr(CallExpr* expr) override {
+        calls = true;
+        visit(expr->callee);
+        for (const auto& argument : expr->arguments) visit(argument);
+        return count();
+    }
+    Value visitAssignExpr(AssignExpr*) override { return reject(); }
+    Value visitCompoundAssignExpr(CompoundAssignExpr*) override { return reject(); }
+    Value visitCompoundMemberAssignExpr(CompoundMemberAssignExpr*) override { return reject(); }
+    Value visitCompoundIndexAssignExpr(CompoundIndexAssignExpr*) override { return reject(); }
+    Value visitUpdateExpr(UpdateExpr*) override { return reject(); }
+    Value visitUpdateMemberExpr(UpdateMemberExpr*) override { return reject(); }
+    Value visitUpdateIndexExpr(UpdateIndexExpr*) override { return reject(); }
+    Value visitTernaryExpr(TernaryExpr* expr) override {
+        visit(expr->condition);
+        visit(expr->thenBranch);
+        visit(expr->elseBranch);
+        return count();
+    }
+    Value visitArrayExpr(ArrayExpr* expr) override {
+        for (const auto& element : expr->elements) visit(element);
+        return count();
+    }
+    Value visitIndexExpr(IndexExpr* expr) override {
+        visit(expr->object);
+        visit(expr->index);
+        return count();
+    }
+    Value visitIndexAssignExpr(IndexAssignExpr*) override { return reject(); }
+    Value visitHashMapExpr(HashMapExpr* expr) override {
+        for (const auto& [key, value] : expr->keyValuePairs) {
+            visit(key);
+            visit(value);
+        }
+        return count();
+    }
+    Value visitMemberExpr(MemberExpr* expr) override {
+        visit(expr->object);
+        return count();
+    }
+    Value visitSetExpr(SetExpr*) override { return reject(); }
+    Value visitThisExpr(ThisExpr*) override { return reject(); }
+    Value visitSuperExpr(SuperExpr*) override { return reject(); }
+    Value visitFunctionExpr(FunctionExpr*) override { return reject(); }
+
+private:
+    void visit(const ExprPtr& expr) {
+        if (expr && ok) expr->accept(*this);
+    }
+    Value count() {
+        if (++nodes > MAX_INLINE_NODES) ok = false;
+        return nilValue();
+    }
+    Value reject() {
+        ok = false;
+        return nilValue();
+    }
+
+    const std::string& self_;
+};
+
+// Deep-copies an expression that passed InlineBodyChecker, replacing reads
+// of the parameters with copies of the matching arguments.
+class ExprCloner : public ExprVisitor {
+public:
+    ExprCloner() = default;
+    explicit ExprCloner(const std::unordered_map<std::string, const Expr*>* substitutions)
+        : substitutions_(substitutions) {}
+
+    ExprPtr clone(const Expr* expr) {
+        if (!expr) return nullptr;
+        const_cast<Expr*>(expr)->accept(*this);
+        return std::move(result_);
+    }
+    ExprPtr clone(const ExprPtr& expr) { return clone(expr.get()); }
+
+    Value visitLiteralExpr(LiteralExpr* expr) override {
+        return set(cloneLiteral(expr, expr->token));
+    }
+    Value visitVariableExpr(VariableExpr* expr) override {
+        if (substitutions_) {
+            auto it = substitutions_->find(expr->name);
+            if (it != substitutions_->end()) return set(ExprCloner().clone(it->second));
+        }
+        return set(std::make_unique<VariableExpr>(expr->token, expr->name));
+    }
+    Value visitUnaryExpr(UnaryExpr* expr) override {
+        return set(std::make_unique<UnaryExpr>(expr->op, clone(expr->right)));
+    }
+    Value visitBinaryExpr(BinaryExpr* expr) override {
+        auto left = clone(expr->left);
+        return set(std::make_unique<BinaryExpr>(std::move(left), expr->op, clone(expr->right)));
+    }
+    Value visitLogicalExpr(LogicalExpr* expr) override {
+        auto left = clone(expr->left);
+        return set(std::make_unique<LogicalExpr>(std::move(left), expr->op, clone(expr->right)));
+    }
+    Value visitGroupingExpr(GroupingExpr* expr) override {
+        return set(std::make_unique<GroupingExpr>(expr->token, clone(expr->expr)));
+    }
+    Value visitCallExpr(CallExpr* expr) override {
+        auto callee = clone(expr->callee);
+        std::vector<ExprPtr> arguments;
+        for (const auto& argument : expr->arguments) arguments.push_back(clone(argument));
+        return set(std::make_unique<CallExpr>(expr->token, std::move(callee), std::move(arguments)));
+    }
+    Value visitAssignExpr(AssignExpr*) override { return nilValue(); }
+    Value visitCompoundAssignExpr(CompoundAssignExpr*) override { return nilValue(); }
+    Value visitCompoundMemberAssignExpr(CompoundMemberAssignExpr*) override { return nilValue(); }
+    Value visitCompoundIndexAssignExpr(CompoundIndexAssignExpr*) override { return nilValue(); }
+    Value visitUpdateExpr(UpdateExpr*) override { return nilValue(); }
+    Value visitUpdateMemberExpr(UpdateMemberExpr*) override { return nilValue(); }
+    Value visitUpdateIndexExpr(UpdateIndexExpr*) override { return nilValue(); }
+    Value visitTernaryExpr(TernaryExpr* expr) override {
+        auto condition = clone(expr->condition);
+        auto thenBranch = clone(expr->thenBranch);
+        return set(std::make_unique<TernaryExpr>(expr->token, std::move(condition), std::move(thenBranch),
+                                                 clone(expr->elseBranch)));
+    }
+    Value visitArrayExpr(ArrayExpr* expr) override {
+        std::vector<ExprPtr> elements;
+        for (const auto& element : expr->elements) elements.push_back(clone(element));
+        return set(std::make_unique<ArrayExpr>(expr->token, std::move(elements)));
+    }
+    Value visitIndexExpr(IndexExpr* expr) override {
+        auto object = clone(expr->object);
+        return set(std::make_unique<IndexExpr>(expr->token, std::move(object), clone(expr->index)));
+    }
+    Value visitIndexAssignExpr(IndexAssignExpr*) override { return nilValue(); }
+    Value visitHashMapExpr(HashMapExpr* expr) override {
+        std::vector<std::pair<ExprPtr, ExprPtr>> pairs;
+        for (const auto& [key, value] : expr->keyValuePairs) {
+            auto k = clone(key);
+            pairs.emplace_back(std::move(k), clone(value));
+        }
+        return set(std::make_unique<HashMapExpr>(expr->token, std::move(pairs)));
+    }
+    Value visitMemberExpr(MemberExpr* expr) override {
+        return set(std::make_unique<MemberExpr>(expr->token, clone(expr->object), expr->member));
+    }
+    Value visitSetExpr(SetExpr*) override { return nilValue(); }
+    Value visitThisExpr(ThisExpr*) override { return nilValue(); }
+    Value visitSuperExpr(SuperExpr*) override { return nilValue(); }
+    Value visitFunctionExpr(FunctionExpr*) override { return nilValue(); }
+
+private:
+    Value set(ExprPtr expr) {
+        result_ = std::move(expr);
+        return nilValue();
+    }
+
+    const std::unordered_map<std::string, const Expr*>* substitutions_ = nullptr;
+    ExprPtr result_;
+};
+
+struct InlineCandidate {
+    std::vector<std::string> parameters;
+    std::unordered_map<std::string, int> reads;
+    bool calls = false;
+    ExprPtr body;
+};
+
+// One lexical scope of the rewrite walk. Holds the constants and inline
+// candidates declared so far, which is all that code later in the scope
+// may use: there is no hoisting, so anything declared further down is not
+// bound yet when earlier code runs.
+struct Scope {
+    std::unordered_set<std::string> declared;
+    std::unordered_map<std::string, ExprPtr> constants;
+    std::unordered_map<std::string, InlineCandidate> functions;
+    bool switchCases = false;
+};
+
+class AstOptimizer : public ExprVisitor, public StmtVisitor {
+public:
+    AstOptimizer(int level, const DeclarationCounter& counts) : level_(level), counts_(counts) {}
+
+    OptimizerStats stats;
+
+    void optimizeProgram(std::vector<StmtPtr>& program) {
+        scopes_.emplace_back();
+        // A top-level return ends the script, but the host may still look up
+        // what the rest of the program declares, so only bodies are pruned
+        optimizeList(program, false);
+        scopes_.pop_back();
+    }
+
+    Value visitLiteralExpr(LiteralExpr*) override { return nilValue(); }
+    Value visitVariableExpr(VariableExpr* expr) override {
+        if (level_ < 2 || inlining_) return nilValue();
+        for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it) {
+            auto found = it->constants.find(expr->name);
+            if (found == it->constants.end()) continue;
+            replace(cloneLiteral(static_cast<LiteralExpr*>(found->second.get()), expr->token));
+            stats.propagated++;
+            break;
+        }
+        return nilValue();
+    }
+    Value visitUnaryExpr(UnaryExpr* expr) override {
+        rewrite(expr->right);
+        auto* right = dynamic_cast<LiteralExpr*>(expr->right.get());
+        if (!right) return nilValue();
+        Value value = literalValue(right);
+        if (expr->op.type == TokenType::Minus && isNumber(value)) {
+            fold(expr->op, numberToValue(-asNumber(value)));
+        } else if (expr->op.type == TokenType::Bang) {
+            fold(expr->op, boolValue(!isTruthy(value)));
+        }
+        return nilValue();
+    }
+    Value visitBinaryExpr(BinaryExpr* expr) override {
+        rewrite(expr->left);
+        rewrite(expr->right);
+        auto* left = dynamic_cast<LiteralExpr*>(expr->left.get());
+        auto* right = dynamic_cast<LiteralExpr*>(expr->right.get());
+        Value result;
+        if (left && right && foldBinary(expr->op.type, literalValue(left), literalValue(right), result)) {
+            fold(expr->op, result);
+        }
+        return nilValue();
+    }
+    Value visitLogicalExpr(LogicalExpr* expr) override {
+        rewrite(expr->left);
+        auto* left = dynamic_cast<LiteralExpr*>(expr->left.get());
+        if (!left) {
+            rewrite(expr->right);
+            return nilValue();
+        }
+        // && and || yield one of their operands, never a converted bool
+        bool truthy = isTruthy(literalValue(left));
+        bool takeLeft = expr->op.type == TokenType::Or ? truthy : !truthy;
+        stats.folded++;
+        if (takeLeft) {
+            replace(std::move(expr->left));
+        } else {
+            rewrite(expr->right);
+            replace(std::move(expr->right));
+        }
+        return nilValue();
+    }
+    Value visitGroupingExpr(GroupingExpr* expr) override {
+        rewrite(expr->expr);
+        if (isLiteral(expr->expr)) replace(std::move(expr->expr));
+        return nilValue();
+    }
+    Value visitCallExpr(CallExpr* expr) override {
+        rewrite(expr->callee);
+        for (auto& argument : expr->arguments) rewrite(argument);
+        if (level_ >= 2 && !inlining_) inlineCall(expr);
+        return nilValue();
+    }
+    Value visitAssignExpr(AssignExpr* expr) override {
+        rewrite(expr->value);
+        return nilValue();
+    }
+    Value visitCompoundAssignExpr(CompoundAssignExpr* expr) override {
+        rewrite(expr->value);
+        return nilValue();
+    }
+    Value visitCompoundMemberAssignExpr(CompoundMemberAssignExpr* expr) override {
+        rewrite(expr->object);
+        rewrite(expr->value);
+        return nilValue();
+    }
+    Value visitCompoundIndexAssignExpr(CompoundIndexAssignExpr* expr) override {
+        rewrite(expr->object);
+        rewrite(expr->index);
+        rewrite(expr->value);
+        return nilValue();
+    }
+    Value visitUpdateExpr(UpdateExpr*) override { return nilValue(); }
+    Value visitUpdateMemberExpr(UpdateMemberExpr* expr) override {
+        rewrite(expr->object);
+        return nilValue();
+    }
+    Value visitUpdateIndexExpr(UpdateIndexExpr* expr) override {
+        rewrite(expr->object);
+        rewrite(expr->index);
+        return nilValue();
+    }
+    Value visitTernaryExpr(TernaryExpr* expr) override {
+        rewrite(expr->condition);
+        auto* condition = dynamic_cast<LiteralExpr*>(expr->condition.get());
+        if (!condition) {
+            rewrite(expr->thenBranch);
+            rewrite(expr->elseBranch);
+            return nilValue();
+        }
+        ExprPtr& taken = isTruthy(literalValue(condition)) ? expr->thenBranch : expr->elseBranch;
+        rewrite(taken);
+        stats.folded++;
+        replace(std::move(taken));
+        return nilValue();
+    }
+    Value visitArrayExpr(ArrayExpr* expr) override {
+        for (auto& element : expr->elements) rewrite(element);
+        return nilValue();
+    }
+    Value visitIndexExpr(IndexExpr* expr) override {
+        rewrite(expr->object);
+        rewrite(expr->index);
+        return nilValue();
+    }
+    Value visitIndexAssignExpr(IndexAssignExpr* expr) override {
+        rewrite(expr->object);
+        rewrite(expr->index);
+        rewrite(expr->value);
+        return nilValue();
+    }
+    Value visitHashMapExpr(HashMapExpr* expr) override {
+        for (auto& [key, value] : expr->keyValuePairs) {
+            rewrite(key);
+            rewrite(value);
+        }
+        return nilValue();
+    }
+    Value visitMemberExpr(MemberExpr* expr) override {
+        rewrite(expr->object);
+        return nilValue();
+    }
+    Value visitSetExpr(SetExpr* expr) override {
+        rewrite(expr->object);
+        rewrite(expr->value);
+        return nilValue();
+    }
+    Value visitThisExpr(ThisExpr*) override { return nilValue(); }
+    Value visitSuperExpr(SuperExpr*) override { return nilValue(); }
+    Value visitFunctionExpr(FunctionExpr* expr) override {
+        optimizeFunction(expr->parameters, expr->body);
+        return nilValue();
+    }
+
+    void visitExprStmt(ExprStmt* stmt) override { rewrite(stmt->expr); }
+    void visitPrintStmt(PrintStmt* stmt) override { rewrite(stmt->expr); }
+    void visitLetStmt(LetStmt* stmt) override {
+        rewrite(stmt->initializer);
+        scopes_.back().declared.insert(stmt->name);
+        auto* literal = dynamic_cast<LiteralExpr*>(stmt->initializer.get());
+        if (level_ >= 2 && literal && isConstantName(stmt->name) && !scopes_.back().switchCases) {
+            scopes_.back().constants[stmt->name] = cloneLiteral(literal, literal->token);
+        }
+    }
+    void visitBlockStmt(BlockStmt* stmt) override {
+        scopes_.emplace_back();
+        optimizeList(stmt->statements, true);
+        scopes_.pop_back();
+    }
+    void visitIfStmt(IfStmt* stmt) override {
+        rewrite(stmt->condition);
+        auto* condition = dynamic_cast<LiteralExpr*>(stmt->condition.get());
+        if (!condition) {
+            rewriteBody(stmt->thenBranch);
+            if (stmt->elseBranch) rewriteBody(stmt->elseBranch);
+            return;
+        }
+        stats.deadBranches++;
+        StmtPtr& taken = isTruthy(literalValue(condition)) ? stmt->thenBranch : stmt->elseBranch;
+        if (!taken) {
+            removeStmt_ = true;
+            return;
+        }
+        rewriteBody(taken);
+        stmtReplacement_ = std::move(taken);
+    }
+    void visitWhileStmt(WhileStmt* stmt) override {
+        rewrite(stmt->condition);
+        auto* condition = dynamic_cast<LiteralExpr*>(stmt->condition.get());
+        if (condition && !isTruthy(literalValue(condition))) {
+            stats.deadBranches++;
+            removeStmt_ = true;
+            return;
+        }
+        rewriteBody(stmt->body);
+    }
+    void visitRunUntilStmt(RunUntilStmt* stmt) override {
+        rewriteBody(stmt->body);
+        rewrite(stmt->condition);
+    }
+    void visitForStmt(ForStmt* stmt) override {
+        scopes_.emplace_back();
+        rewrite(stmt->initializer);
+        rewrite(stmt->condition);
+        rewriteBody(stmt->body);
+        rewrite(stmt->increment);
+        scopes_.pop_back();
+    }
+    void visitFnStmt(FnStmt* stmt) override {
+        scopes_.back().declared.insert(stmt->name);
+        optimizeFunction(stmt->parameters, stmt->body);
+        if (level_ >= 2 && !scopes_.back().switchCases) addInlineCandidate(stmt);
+    }
+    void visitReturnStmt(ReturnStmt* stmt) override { rewrite(stmt->value); }
+    void visitBreakStmt(BreakStmt*) override {}
+    void visitContinueStmt(ContinueStmt*) override {}
+    void visitTryStmt(TryStmt* stmt) override {
+        rewriteBody(stmt->tryBody);
+        scopes_.emplace_back();
+        scopes_.back().declared.insert(stmt->exceptionVar);
+        rewriteBody(stmt->catchBody);
+        scopes_.pop_back();
+    }
+    void visitThrowStmt(ThrowStmt* stmt) override { rewrite(stmt->expression); }
+    void visitImportStmt(ImportStmt* stmt) override {
+        for (const auto& imported : stmt->imports) scopes_.back().declared.insert(imported);
+    }
+    void visitClassStmt(ClassStmt* stmt) override {
+        scopes_.back().declared.insert(stmt->name);
+        rewrite(stmt->superclass);
+        for (auto& method : stmt->methods) optimizeFunction(method->parameters, method->body);
+    }
+    void visitSwitchStmt(SwitchStmt* stmt) override {
+        rewrite(stmt->expression);
+        // Cases can be entered part way down, past declarations in the
+        // cases above, so their own lets and functions are never bound
+        scopes_.emplace_back();
+        scopes_.back().switchCases = true;
+        for (auto& c : stmt->cases) {
+            rewrite(c.match);
+            optimizeList(c.body, true);
+        }
+        scopes_.pop_back();
+    }
+
+private:
+    void rewrite(ExprPtr& expr) {
+        if (!expr) return;
+        expr->accept(*this);
+        if (exprReplacement_) expr = std::move(exprReplacement_);
+    }
+    // Rewrites a statement in place; a statement that optimizes away is reset
+    void rewrite(StmtPtr& stmt) {
+        if (!stmt) return;
+        stmt->accept(*this);
+        if (removeStmt_) {
+            removeStmt_ = false;
+            stmt.reset();
+        } else if (stmtReplacement_) {
+            stmt = std::move(stmtReplacement_);
+        }
+    }
+    // Rewrites a statement that must stay, such as a branch or loop body.
+    // Anything but a block gets a scope of its own, as in the backends.
+    void rewriteBody(StmtPtr& stmt) {
+        Token token = stmt->token;
+        bool block = dynamic_cast<BlockStmt*>(stmt.get()) != nullptr;
+        if (!block) scopes_.emplace_back();
+        rewrite(stmt);
+        if (!block) scopes_.pop_back();
+        if (!stmt) stmt = std::make_unique<BlockStmt>(token, std::vector<StmtPtr>{});
+    }
+    void optimizeList(std::vector<StmtPtr>& stmts, bool pruneUnreachable) {
+        for (size_t i = 0; i < stmts.size();) {
+            rewrite(stmts[i]);
+            if (!stmts[i]) {
+                stmts.erase(stmts.begin() + static_cast<std::ptrdiff_t>(i));
+                continue;
+            }
+            if (pruneUnreachable && isTerminator(stmts[i].get()) && i + 1 < stmts.size()) {
+                stats.unreachable += static_cast<int>(stmts.size() - i - 1);
+                stmts.resize(i + 1);
+            }
+            i++;
+        }
+    }
+    void optimizeFunction(const std::vector<std::string>& parameters, std::vector<StmtPtr>& body) {
+        scopes_.emplace_back();
+        for (const auto& param : parameters) scopes_.back().declared.insert(param);
+        optimizeList(body, true);
+        scopes_.pop_back();
+    }
+
+    void replace(ExprPtr expr) { exprReplacement_ = std::move(expr); }
+    void fold(const Token& token, Value value) {
+        stats.folded++;
+        replace(makeLiteral(token, value));
+    }
+
+    bool isConstantName(const std::string& name) const {
+        auto it = counts_.declarations.find(name);
+        return it != counts_.declarations.end() && it->second == 1 && !counts_.assigned.count(name);
+    }
+    bool isVisible(const std::string& name) const {
+        for (const auto& scope : scopes_) {
+            if (scope.declared.count(name)) return true;
+        }
+        return false;
+    }
+
+    void addInlineCandidate(FnStmt* stmt) {
+        if (!isConstantName(stmt->name) || stmt->body.size() != 1) return;
+        auto* ret = dynamic_cast<ReturnStmt*>(stmt->body[0].get());
+        if (!ret || !ret->value) return;
+        InlineBodyChecker checker(stmt->name);
+        ret->value->accept(checker);
+        if (!checker.ok) return;
+        // Every other name must mean the same thing at each call site as it
+        // does here: unique and already bound, or never declared at all
+        for (const auto& [name, uses] : checker.reads) {
+            bool param = false;
+            for (const auto& p : stmt->parameters) param = param || p == name;
+            if (param) continue;
+            auto it = counts_.declarations.find(name);
+            bool undeclared = it == counts_.declarations.end() || it->second == 0;
+            if (!undeclared && !(it->second == 1 && isVisible(name))) return;
+        }
+        InlineCandidate candidate;
+        candidate.parameters = stmt->parameters;
+        candidate.reads = std::move(checker.reads);
+        candidate.calls = checker.calls;
+        candidate.body = ExprCloner().clone(ret->value);
+        scopes_.back().functions[stmt->name] = std::move(candidate);
+    }
+
+    void inlineCall(CallExpr* expr) {
+        auto* callee = dynamic_cast<VariableExpr*>(expr->callee.get());
+        if (!callee) return;
+        const InlineCandidate* candidate = nullptr;
+        for (auto it = scopes_.rbegin(); it != scopes_.rend() && !candidate; ++it) {
+            auto found = it->functions.find(callee->name);
+            if (found != it->functions.end()) candidate = &found->second;
+        }
+        if (!candidate || candidate->parameters.size() != expr->arguments.size()) return;
+
+        std::unordered_map<std::string, const Expr*> substitutions;
+        for (size_t i = 0; i < expr->arguments.size(); i++) {
+            const Expr* argument = expr->arguments[i].get();
+            const std::string& param = candidate->parameters[i];
+            if (auto* variable = dynamic_cast<const VariableExpr*>(argument)) {
+                // The body reads the variable where it uses the parameter:
+                // no call in it may run first and change the variable, and
+                // the variable must be defined, since the call reads it even
+                // where the body does not
+                if (candidate->calls || !isVisible(variable->name)) return;
+            } else if (!dynamic_cast<const LiteralExpr*>(argument)) {
+                return;
+            }
+            substitutions[param] = argument;
+        }
+        ExprPtr body = ExprCloner(&substitutions).clone(candidate->body);
+        inlining_ = true;
+        rewrite(body);
+        inlining_ = false;
+        stats.inlined++;
+        replace(std::move(body));
+    }
+
+    int level_;
+    const DeclarationCounter& counts_;
+    std::vector<Scope> scopes_;
+    ExprPtr exprReplacement_;
+    StmtPtr stmtReplacement_;
+    bool removeStmt_ = false;
+    bool inlining_ = false;
+};
+
+} // namespace
+
+OptimizerStats optimizeProgram(std::vector<StmtPtr>& program, int level) {
+    if (level <= 0) return {};
+    DeclarationCounter counts;
+    counts.scan(program);
+    AstOptimizer optimizer(level, counts);
+    optimizer.optimizeProgram(program);
+    return optimizer.stats;
+}
+
+} // namespace claw
@@ -0,0 +1,36 @@
+#pragma once
+#include "stmt.h"
+#include <vector>
+
+namespace claw {
+
+/**
+ * @brief Counts of rewrites made by the AST optimizer
+ */
+struct OptimizerStats {
+    int folded = 0;       // operators and conditionals over literals
+    int propagated = 0;   // reads of constant lets replaced by their literal
+    int deadBranches = 0; // if/while statements with a literal condition
+    int unreachable = 0;  // statements after return, break, continue or throw
+    int inlined = 0;      // calls replaced by the callee's return expression
+
+    int total() const { return folded + propagated + deadBranches + unreachable + inlined; }
+};
+
+/**
+ * @brief Optimize a parsed program in place before it is run or compiled
+ *
+ * Level 0 leaves the program alone. Level 1 folds operators over literals
+ * with the interpreter's own semantics, drops the untaken side of literal
+ * conditions and removes statements that can never run. Level 2 also
+ * replaces reads of `let` constants with their literal and inlines calls to
+ * small functions whose body is a single `return expr;`.
+ *
+ * Level 2 only touches names declared once in the whole program and never
+ * assigned, and only from the point of declaration on, so no rewrite can
+ * see a different binding than the original code would. An expression that
+ * would raise a runtime error is left for the backend to raise.
+ */
+OptimizerStats optimizeProgram(std::vector<StmtPtr>& program, int level);
+
+} // namespace claw
@@ -1,11 +1,46 @@
 #pragma once
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <cstdint>
+#include <unordered_map>
 #include "opcodes.h"
 #include "interpreter/value.h"
 
 namespace claw {
 
+struct Stmt;
+
+// Kinds of inline cache side tables. Every IC-bearing instruction carries a
+// 16-bit slot index into the table of its kind for the enclosing function.
+enum class CacheKind : uint8_t {
+    Property, // GetProperty
+    Call,     // Call
+    Invoke,   // Invoke
+    Loop,     // Loop back-edge counter
+    Count
+};
+
+// A protected bytecode range [start, end) and the offset of its catch block.
+// stackDepth is the number of frame slots live at the try, which is where
+// the stack is cut back to before the thrown value is pushed.
+struct ExceptionHandler {
+    uint32_t start;
+    uint32_t end;
+    uint32_t handler;
+    uint32_t stackDepth;
+};
+
+// Targets of one Switch instruction, as absolute code offsets. A switch on
+// integer literals gets a dense table indexed by value - low; a switch on
+// string literals maps interned pointers, since equal strings share one.
+struct SwitchTable {
+    int32_t low = 0;
+    std::vector<uint32_t> ints;
+    std::unordered_map<const char*, uint32_t> strings;
+    uint32_t fallback = 0; // default case, or the end of the switch
+};
+
 /**
  * @brief A sequence of bytecode instructions and constants
  */
@@ -13,15 +48,16 @@ class Chunk {
 public:
     Chunk() = default;
 
-    // Write a byte to the chunk
-    void write(uint8_t byte, int line) {
+    // Write a byte to the chunk, with the source position it came from
+    void write(uint8_t byte, int line, int column = 0) {
         code_.push_back(byte);
         lines_.push_back(line);
+        columns_.push_back(column);
     }
 
     // Write an opcode to the chunk
-    void write(OpCode opcode, int line) {
-        write(static_cast<uint8_t>(opcode), line);
+    void write(OpCode opcode, int line, int column = 0) {
+        write(static_cast<uint8_t>(opcode), line, column);
     }
 
     // Add a constant and return its index
@@ -34,22 +70,140 @@ public:
     const std::vector<uint8_t>& code() const { return code_; }
     const std::vector<Value>& constants() const { return constants_; }
     int getLine(int offset) const { return lines_[offset]; }
+    int getColumn(int offset) const { return columns_[offset]; }
     size_t size() const { return code_.size(); }
+    // Instructions with the given opcode; operand bytes are skipped
     int countOpcode(OpCode op) const {
         int c = 0;
-        for (auto b : code_) {
-            if (b == static_cast<uint8_t>(op)) c++;
+        for (size_t offset = 0; offset < code_.size(); offset += instructionLength(offset)) {
+            if (code_[offset] == static_cast<uint8_t>(op)) c++;
         }
         return c;
     }
     void setLoopCount(int c) { loopCount_ = c; }
     int loopCount() const { return loopCount_; }
+    // Deepest the stack gets above the base of a frame running this chunk,
+    // recorded by the compiler; the VM makes room for it on every call
+    void setMaxStackDepth(int depth) { maxStackDepth_ = depth; }
+    int maxStackDepth() const { return maxStackDepth_; }
+
+    // Reserve the next inline cache slot of the given kind and return its index
+    int addCacheSlot(CacheKind kind) { return cacheSlots_[static_cast<size_t>(kind)]++; }
+    int cacheSlotCount(CacheKind kind) const { return cacheSlots_[static_cast<size_t>(kind)]; }
+    // For a chunk rebuilt from a serialized one
+    void setCacheSlotCount(CacheKind kind, int count) { cacheSlots_[static_cast<size_t>(kind)] = count; }
+
+    // Exception table, consulted only when an error is raised. Handlers are
+    // added innermost first, so the first range containing an offset wins.
+    void addExceptionHandler(const ExceptionHandler& handler) { handlers_.push_back(handler); }
+    const std::vector<ExceptionHandler>& exceptionHandlers() const { return handlers_; }
+    const ExceptionHandler* findExceptionHandler(size_t offset) const {
+        for (const auto& h : handlers_) {
+            if (offset >= h.start && offset < h.end) return &h;
+        }
+        return nullptr;
+    }
+
+    int addSwitchTable(SwitchTable table) {
+        switchTables_.push_back(std::move(table));
+        return static_cast<int>(switchTables_.size() - 1);
+    }
+    SwitchTable& switchTable(size_t index) { return switchTables_[index]; }
+    const SwitchTable& switchTable(size_t index) const { return switchTables_[index]; }
+    size_t switchTableCount() const { return switchTables_.size(); }
+
+    // Statements run by Interpret instructions. The chunk only points at
+    // them; the program they belong to must outlive it.
+    int addInterpretedStmt(Stmt* stmt) {
+        interpretedStmts_.push_back(stmt);
+        return static_cast<int>(interpretedStmts_.size() - 1);
+    }
+    Stmt* interpretedStmt(size_t index) const { return interpretedStmts_[index]; }
+    size_t interpretedStmtCount() const { return interpretedStmts_.size(); }
+
+    // Drop the code from offset size on, the constants from constantCount on
+    // and the handlers of any try in the dropped code
+    void truncate(size_t size, size_t constantCount) {
+        code_.resize(size);
+        lines_.resize(size);
+        columns_.resize(size);
+        constants_.resize(constantCount);
+        handlers_.erase(std::remove_if(handlers_.begin(), handlers_.end(),
+                                       [size](const ExceptionHandler& h) { return h.start >= size; }),
+                        handlers_.end());
+    }
+
+    // Overwrite the opcode at offset; used by bytecode rewriting passes
+    void patch(size_t offset, OpCode opcode) { code_[offset] = static_cast<uint8_t>(opcode); }
+    void patchShort(size_t offset, uint16_t value) {
+        code_[offset] = static_cast<uint8_t>(value >> 8);
+        code_[offset + 1] = static_cast<uint8_t>(value & 0xff);
+    }
+
+    // Length in bytes of the instruction starting at offset, operands included
+    size_t instructionLength(size_t offset) const {
+        switch (static_cast<OpCode>(code_[offset])) {
+            case OpCode::Constant:
+            case OpCode::GetLocal:
+            case OpCode::SetLocal:
+            case OpCode::GetUpvalue:
+            case OpCode::SetUpvalue:
+            case OpCode::SetProperty:
+            case OpCode::EnsureIndexDefault:
+            case OpCode::Class:
+            case OpCode::Method:
+            case OpCode::GetSuper:
+            case OpCode::CallScoped:
+                return 2;
+            case OpCode::GetGlobal:
+            case OpCode::DefineGlobal:
+            case OpCode::SetGlobal:
+            case OpCode::Jump:
+            case OpCode::JumpIfFalse:
+            case OpCode::EnsurePropertyDefault:
+            case OpCode::SuperInvoke:
+            case OpCode::Switch:
+            case OpCode::BuildMap:
+            case OpCode::BuildArray:
+            case OpCode::Interpret:
+            case OpCode::ScopedArray:
+                return 3;
+            case OpCode::Call:
+            case OpCode::GetProperty:
+            case OpCode::JumpIfNotArray:
+                return 4;
+            case OpCode::Loop:
+            case OpCode::AddLocals:
+            case OpCode::Invoke:
+                return 5;
+            case OpCode::LessLocalConstJump:
+            case OpCode::AddConstSetLocal:
+                return 8;
+            case OpCode::Closure:
+            case OpCode::ScopedClosure: {
+                auto function = asVMFunction(constants_[code_[offset + 1]]);
+                return 2 + 2 * static_cast<size_t>(function ? function->upvalueCount : 0);
+            }
+            case OpCode::ScopedCallback: { // and the callee's distance from the top
+                auto function = asVMFunction(constants_[code_[offset + 1]]);
+                return 3 + 2 * static_cast<size_t>(function ? function->upvalueCount : 0);
+            }
+            default:
+                return 1;
+        }
+    }
 
 private:
     std::vector<uint8_t> code_;
     std::vector<int> lines_; // For error reporting
+    std::vector<int> columns_;
     std::vector<Value> constants_;
+    std::vector<ExceptionHandler> handlers_;
+    std::vector<SwitchTable> switchTables_;
+    std::vector<Stmt*> interpretedStmts_;
     int loopCount_ = 0;
+    int maxStackDepth_ = 0;
+    std::array<int, static_cast<size_t>(CacheKind::Count)> cacheSlots_{};
 };
 
 } // namespace claw
@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <string_view>
+#include <shared_mutex>
+#include <mutex>
+#include "features/string_pool.h"
+
+namespace claw {
+
+/**
+ * @brief Thread-safe table of global variable names resolved to dense slots
+ *
+ * The compiler resolves every global reference to a slot index at compile
+ * time and emits it as the instruction operand. Each VM binds a slot to the
+ * storage of that name in its globals Environment on first use, so slot
+ * numbers are shared by every chunk while values stay per VM.
+ */
+class GlobalTable {
+public:
+    static GlobalTable& getInstance() {
+        static GlobalTable instance;
+        return instance;
+    }
+
+    // Return the slot of a global name, assigning the next free one if needed
+    int resolve(std::string_view name) {
+        const char* key = StringPool::intern(name).data();
+        {
+            std::shared_lock<std::shared_mutex> rlock(mutex_);
+            auto it = slots_.find(key);
+            if (it != slots_.end()) return it->second;
+        }
+        std::unique_lock<std::shared_mutex> wlock(mutex_);
+        auto [it, inserted] = slots_.try_emplace(key, static_cast<int>(names_.size()));
+        if (inserted) names_.push_back(key);
+        return it->second;
+    }
+
+    // Interned name of a slot, or nullptr for one never handed out
+    const char* name(int slot) const {
+        std::shared_lock<std::shared_mutex> rlock(mutex_);
+        if (slot < 0 || static_cast<size_t>(slot) >= names_.size()) return nullptr;
+        return names_[slot];
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> rlock(mutex_);
+        return names_.size();
+    }
+
+private:
+    GlobalTable() = default;
+    GlobalTable(const GlobalTable&) = delete;
+    GlobalTable& operator=(const GlobalTable&) = delete;
+
+    std::unordered_map<const char*, int> slots_;
+    std::vector<const char*> names_;
+    mutable std::shared_mutex mutex_;
+};
+
+} // namespace claw
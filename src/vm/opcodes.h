@@ -38,22 +38,52 @@ enum class OpCode : uint8_t {
     Jump,        // Jump forward
     JumpIfFalse, // Jump forward if false
     Loop,        // Jump backward
+    Switch,      // Jump through a SwitchTable of the chunk
     
     Call,        // Call function
     Closure,     // Create closure
     Return,      // Return from function
+    Throw,       // Raise the value on top of the stack
     
     Class,       // Define class
     Inherit,     // Set up inheritance
     Method,      // Define method
     Invoke,      // Call method directly
     SuperInvoke, // Call super method
+    GetSuper,    // Bind super method without calling it
     GetProperty, // Get instance property
     SetProperty, // Set instance property
     GetIndex,    // Get array/map element by index/key
     SetIndex,    // Set array/map element by index/key
     EnsureIndexDefault, // Ensure hash key exists with default for compound ops
     EnsurePropertyDefault, // Ensure instance field exists with default for compound ops
+    BuildMap,    // Build a hash map from n key/value pairs
+    BuildArray,  // Build an array from n elements
+    Interpret,   // Run a statement the compiler left to the interpreter
+    ScopedClosure, // Closure in the frame region, for one that never escapes
+    CallScoped,  // Call a scoped closure local
+    ReleaseScoped, // Pop a scoped local and free it
+    ScopedArray, // BuildArray in the frame region, for a local that never escapes
+    ScopedCallback, // Closure for an argument, in the frame region if the callee only borrows it
+    ReleaseCallbacks, // Free the scoped callbacks of the call just made
+    JumpIfNotArray, // Jump unless a local holds an array; guards a counted loop
+    GetIndexUnchecked, // array[index] the compiler proved in bounds
+    SetIndexUnchecked, // array[index] = value, proved in bounds
+
+    // Quickened forms, never emitted by the compiler. The VM rewrites a
+    // generic instruction in place once it has seen its operand types and
+    // rewrites it back when the guard of the quickened form fails.
+    AddNum,      // + on two numbers
+    AddStr,      // + on two strings
+    LessNum,     // < on two numbers
+    GetIndexArray, // array[number]
+
+    // Superinstructions written by the peephole pass over the first byte of
+    // the sequence they replace. The remaining bytes are left intact, so a
+    // jump into the middle of a fused sequence still runs the original code.
+    AddLocals,          // GetLocal a; GetLocal b; Add
+    LessLocalConstJump, // GetLocal a; Constant k; Less; JumpIfFalse
+    AddConstSetLocal,   // GetLocal a; Constant k; Add; SetLocal b; Pop
 };
 
 } // namespace claw
@@ -0,0 +1,23 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace claw {
+
+// Work delivered to running VMs at their next safepoint. VMs poll at loop
+// back-edges and calls, so a request is served within one loop iteration or
+// call of the script being run.
+enum SafepointRequest : uint32_t {
+    SafepointInterrupt = 1u << 0, // stop the running script with a runtime error
+    SafepointGC        = 1u << 1, // run a minor collection, or finish a running full one
+    SafepointProfile   = 1u << 2, // record the VM call stack as a profiler sample
+};
+
+extern std::atomic<uint32_t> gSafepointRequests;
+
+// Safe to call from any thread and from signal handlers
+inline void vmRequestSafepoint(uint32_t requests) {
+    gSafepointRequests.fetch_or(requests, std::memory_order_relaxed);
+}
+
+} // namespace claw
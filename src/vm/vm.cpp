@@ -1,4 +1,5 @@
 #include "vm.h"
+#include "global_table.h"
 #include <iostream>
 #include <cstdio>
 #include <chrono>
@@ -12,30 +13,75 @@
 #include "features/hashmap.h"
 #include "lexer/token.h"
 #include "interpreter/interpreter.h"
+#include "interpreter/gc_alloc.h"
+#include "interpreter/natives/native_string.h"
+#include "observability/profiler.h"
 
 namespace claw {
 
 RuntimeFlags gRuntimeFlags;
+std::atomic<uint32_t> gSafepointRequests{0};
+
+namespace {
+
+// Bitwise operators work on the 64-bit pattern of their operands. Ints are
+// sign-extended, which matches what the double conversion produces.
+inline uint64_t bitOperand(Value v) {
+    if (isInt(v)) return static_cast<uint64_t>(static_cast<int64_t>(asInt(v)));
+    return static_cast<uint64_t>(asNumber(v));
+}
+
+inline Value bitResult(uint64_t bits) {
+    if (bits <= static_cast<uint64_t>(INT32_MAX)) return intValue(static_cast<int32_t>(bits));
+    return numberToValue(static_cast<double>(bits));
+}
+
+inline int indexOperand(Value index) {
+    return isInt(index) ? asInt(index) : static_cast<int>(asNumber(index));
+}
+
+
+// A compiled method read as a value rather than called
+Value boundMethodValue(Value receiver, VMClosure* method) {
+    return vmBoundMethodValue(std::make_shared<VMBoundMethod>(receiver, method));
+}
+
+// Whether callee only calls a closure handed to it while it runs: an array,
+// whose map, filter, forEach and reduce are the only members ScopedCallback
+// is emitted for, or a native declared to borrow its arguments
+bool borrowsCallback(Value callee) {
+    if (isArray(callee)) return true;
+    if (!isCallable(callee)) return false;
+    auto native = dynamic_cast<NativeFunction*>(asCallable(callee));
+    return native && native->borrowsArguments();
+}
+
+// The fast native a call to receiver.name runs with the receiver as its
+// first argument, for host objects whose methods need no bound closure
+const NativeFunction* hostMethod(Value receiver, const char* name) {
+    if (isStringBuilder(receiver)) return stringBuilderMethod(name);
+    return nullptr;
+}
+
+} // namespace
 
 VM::VM()
     : chunk_(nullptr),
       ip_(nullptr),
+      stackStorage_(STACK_INITIAL),
+      stack_(stackStorage_.data()),
+      stackEnd_(stack_ + STACK_INITIAL),
       stackTop_(stack_),
-      frames_(),
+      frames_(FRAMES_INITIAL),
       frameCount_(0),
-      openUpvalues_(),
+      openUpvalues_(nullptr),
 #ifdef CLAW_ENABLE_JIT
       jit_(),
 #endif
       globals_(nullptr),
       interpreter_(nullptr),
-      globalVersion_(0),
-      globalInlineCache_(),
-      propertyInlineCache_(),
-      instanceVersions_(),
-      callInlineCache_(),
-      functionHotness_(),
-      loopHotness_()
+      globalSlots_(),
+      cacheTables_()
 #ifdef CLAW_ENABLE_JIT
       , jitConfig_()
 #endif
@@ -47,28 +93,29 @@ VM::VM()
     ownedInterpreter_ = std::make_unique<Interpreter>();
     interpreter_ = ownedInterpreter_.get();
     globals_ = interpreter_->getGlobals();
+    interpreter_->setForeignCall([this](Value callee, const std::vector<Value>& arguments, Value* result) {
+        return callFromHost(callee, arguments, result);
+    });
     gcRegisterVM(this);
 }
 
 VM::VM(Interpreter& interpreter)
     : chunk_(nullptr),
       ip_(nullptr),
+      stackStorage_(STACK_INITIAL),
+      stack_(stackStorage_.data()),
+      stackEnd_(stack_ + STACK_INITIAL),
       stackTop_(stack_),
-      frames_(),
+      frames_(FRAMES_INITIAL),
       frameCount_(0),
-      openUpvalues_(),
+      openUpvalues_(nullptr),
 #ifdef CLAW_ENABLE_JIT
       jit_(),
 #endif
       globals_(interpreter.getGlobals()),
       interpreter_(&interpreter),
-      globalVersion_(0),
-      globalInlineCache_(),
-      propertyInlineCache_(),
-      instanceVersions_(),
-      callInlineCache_(),
-      functionHotness_(),
-      loopHotness_()
+      globalSlots_(),
+      cacheTables_()
 #ifdef CLAW_ENABLE_JIT
       , jitConfig_()
 #endif
@@ -77,20 +124,30 @@ VM::VM(Interpreter& interpreter)
     jit_.setConfig(gJitConfig);
     jitConfig_ = gJitConfig;
 #endif
+    interpreter_->setForeignCall([this](Value callee, const std::vector<Value>& arguments, Value* result) {
+        return callFromHost(callee, arguments, result);
+    });
     gcRegisterVM(this);
 }
 
-VM::~VM() { gcUnregisterVM(this); }
+VM::~VM() {
+    // Closures may outlive the VM; their upvalues must not point at its stack
+    closeUpvalues(stack_);
+    releaseScoped(stack_);
+    interpreter_->setForeignCall(nullptr);
+    gcUnregisterVM(this);
+}
 InterpretResult VM::interpret(const Chunk& chunk) {
     chunk_ = &chunk;
     stackTop_ = stack_;
     frameCount_ = 0;
-    openUpvalues_.clear();
-    globalVersion_ = 0;
-    globalInlineCache_.clear();
-    propertyInlineCache_.clear();
-    instanceVersions_.clear();
-    callInlineCache_.clear();
+    baseFrame_ = 0;
+    hostCalls_ = 0;
+    safepointCountdown_ = std::max<uint32_t>(1, gRuntimeFlags.safepointInterval);
+    closeUpvalues(stack_);
+    releaseScoped(stack_);
+    globalSlots_.resize(GlobalTable::getInstance().size(), nullptr);
+    cacheTables_.clear();
 
     auto function = std::make_shared<VMFunction>();
     function->name = "<script>";
@@ -98,173 +155,363 @@ InterpretResult VM::interpret(const Chunk& chunk) {
     function->upvalueCount = 0;
     function->chunk = std::make_shared<Chunk>(chunk);
 
-    auto closure = std::make_shared<VMClosure>();
-    closure->function = std::move(function);
-    closure->upvalues.clear();
+    auto closure = VMClosure::create(std::move(function));
     vmClosureValue(closure);
 
-    frames_[frameCount_++] = {closure.get(), closure->function->chunk->code().data(), stack_};
+    if (stackEnd_ - stack_ < chunk.maxStackDepth() && !growStack(chunk.maxStackDepth())) {
+        reportError();
+        return InterpretResult::RuntimeError;
+    }
+    frames_[frameCount_++] = {closure.get(), closure->function->chunk->code().data(), stack_,
+                              cacheTableFor(closure->function)};
     ip_ = frames_[frameCount_ - 1].ip;
     return run();
 }
 
+#if defined(CLAW_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define CLAW_COMPUTED_GOTO 1
+#endif
+
+bool VM::idsCheck() {
+    static std::chrono::steady_clock::time_point lastCheck = std::chrono::steady_clock::now();
+    static uint64_t lastAlloc = 0;
+    if (frameCount_ > gRuntimeFlags.idsStackMax) {
+        return runtimeError(ErrorCode::STACK_OVERFLOW, "Stack depth anomaly detected");
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastCheck).count();
+    if (dt >= 200) {
+        uint64_t cur = gcGetYoungAllocations();
+        uint64_t diff = cur >= lastAlloc ? (cur - lastAlloc) : 0;
+        uint64_t rate = (uint64_t)((double)diff * 1000.0 / (double)dt);
+        lastAlloc = cur;
+        lastCheck = now;
+        if (gRuntimeFlags.idsAllocRateMax && rate > gRuntimeFlags.idsAllocRateMax) {
+            return runtimeError(ErrorCode::RUNTIME_ERROR, "Allocation rate anomaly detected");
+        }
+    }
+    return true;
+}
+
+// Serves pending safepoint requests. Runs the periodic IDS check whenever the
+// poll countdown expires. Returns false, with the error recorded, when the
+// script must stop.
+bool VM::safepoint() {
+    uint32_t requests = gSafepointRequests.exchange(0, std::memory_order_relaxed);
+    if (safepointCountdown_ == 0) {
+        safepointCountdown_ = std::max<uint32_t>(1, gRuntimeFlags.safepointInterval);
+        if (gRuntimeFlags.idsEnabled && !idsCheck()) return false;
+        gcSafepoint();
+    }
+    if (requests & SafepointInterrupt) {
+        return runtimeError(ErrorCode::RUNTIME_ERROR, "Interrupted");
+    }
+    if (requests & SafepointGC) {
+        gcCollect();
+    }
+    if (requests & SafepointProfile) {
+        std::string stack;
+        for (int i = 0; i < frameCount_; i++) {
+            if (i) stack += ';';
+            stack += frames_[i].closure->function->name;
+        }
+        profilerRecordSample(stack);
+    }
+    return true;
+}
+
+// Compiled code keeps its values on the stack, so it roots nothing it
+// allocates; host calls open their own rooting scopes
 InterpretResult VM::run() {
+    GCRootScope compiled(false);
+#ifdef CLAW_COMPUTED_GOTO
+    if (!gRuntimeFlags.forceSwitchDispatch) return runLoop<true>();
+#endif
+    return runLoop<false>();
+}
+
+// Computed-goto dispatch: every handler ends with its own indirect jump to the
+// next handler instead of funnelling back through a single switch, which gives
+// the branch predictor one history per opcode. The switch is kept as the
+// portable fallback and is what runLoop<false> uses.
+#ifdef CLAW_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+template <bool Threaded>
+InterpretResult VM::runLoop() {
     CallFrame* frame = &frames_[frameCount_ - 1];
     Value* stackTop = stackTop_;
 #ifdef CLAW_ENABLE_JIT
     (void)jit_;
 #endif
-    static std::chrono::steady_clock::time_point lastCheck = std::chrono::steady_clock::now();
-    static uint64_t lastAlloc = 0;
 
 #define READ_BYTE() (*frame->ip++)
 #define READ_SHORT() \
     (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
 #define READ_CONSTANT() frame->closure->function->chunk->constants()[READ_BYTE()]
 #define READ_STRING_PTR() asStringPtr(READ_CONSTANT())
-#define BINARY_OP(op) \
+// Raise the pending error: resume at the innermost handler or stop the run
+#define VM_THROW() \
+    do { \
+        stackTop_ = stackTop; \
+        if (!throwError()) return InterpretResult::RuntimeError; \
+        goto caught; \
+    } while (false)
+#define VM_ERROR(code, ...) \
+    do { \
+        runtimeError(ErrorCode::code, __VA_ARGS__); \
+        VM_THROW(); \
+    } while (false)
+#define NUMERIC_OP(fn) \
     do { \
         if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) { \
-            stackTop_ = stackTop; \
-            std::cerr << "Operands must be numbers." << std::endl; \
-            return InterpretResult::RuntimeError; \
+            VM_ERROR(TYPE_MISMATCH, "Operands must be numbers"); \
         } \
-        double b = asNumber(*(--stackTop)); \
-        double a = asNumber(*(--stackTop)); \
-        *stackTop++ = numberToValue(a op b); \
+        stackTop[-2] = fn(stackTop[-2], stackTop[-1]); \
+        stackTop--; \
     } while (false)
 #define COMPARE_OP(op) \
     do { \
         if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) { \
-            stackTop_ = stackTop; \
-            std::cerr << "Operands must be numbers." << std::endl; \
-            return InterpretResult::RuntimeError; \
+            VM_ERROR(TYPE_MISMATCH, "Operands must be numbers"); \
         } \
         double b = asNumber(*(--stackTop)); \
         double a = asNumber(*(--stackTop)); \
         *stackTop++ = boolValue(a op b); \
     } while (false)
+// Publishes the run loop's stack top before an instruction that can
+// allocate: a minor collection scans the stack only up to stackTop_, so the
+// operands still being combined must lie below it.
+#define SYNC_STACK_TOP() (stackTop_ = stackTop)
+// Safepoint poll at loop back-edges and calls: one decrement and one relaxed
+// atomic load when nothing is pending.
+#define SAFEPOINT_POLL() \
+    do { \
+        if (--safepointCountdown_ == 0 || gSafepointRequests.load(std::memory_order_relaxed)) { \
+            stackTop_ = stackTop; \
+            if (!safepoint()) return stopAtSafepoint(); \
+        } \
+    } while (false)
+// Quickening rewrites the opcode byte of the instruction being executed. The
+// chunk is only const to the VM by convention; every quickened form guards its
+// operands and restores the generic opcode before re-executing it, so a chunk
+// shared between VMs stays correct whichever form a site is in.
+#define QUICKEN(op) \
+    do { \
+        if (!gRuntimeFlags.disableQuickening) \
+            const_cast<uint8_t*>(frame->ip)[-1] = static_cast<uint8_t>(OpCode::op); \
+    } while (false)
+#define DEQUICKEN(op) \
+    do { \
+        const_cast<uint8_t*>(--frame->ip)[0] = static_cast<uint8_t>(OpCode::op); \
+    } while (false)
+
+#ifdef CLAW_COMPUTED_GOTO
+#define VM_CASE(op) op_##op: case OpCode::op
+#define VM_TARGET(op) dispatchTable[static_cast<uint8_t>(OpCode::op)] = &&op_##op
+#define VM_NEXT() \
+    if constexpr (Threaded) { \
+        instruction = static_cast<OpCode>(READ_BYTE()); \
+        goto *dispatchTable[static_cast<uint8_t>(instruction)]; \
+    } else break
+    void* dispatchTable[256];
+    for (auto& target : dispatchTable) target = &&op_Unknown;
+    VM_TARGET(Constant); VM_TARGET(Nil); VM_TARGET(True); VM_TARGET(False); VM_TARGET(Pop);
+    VM_TARGET(GetGlobal); VM_TARGET(DefineGlobal); VM_TARGET(SetGlobal);
+    VM_TARGET(GetLocal); VM_TARGET(SetLocal);
+    VM_TARGET(GetUpvalue); VM_TARGET(SetUpvalue); VM_TARGET(CloseUpvalue);
+    VM_TARGET(Equal); VM_TARGET(Greater); VM_TARGET(Less);
+    VM_TARGET(Add); VM_TARGET(Subtract); VM_TARGET(Multiply); VM_TARGET(Divide);
+    VM_TARGET(BitAnd); VM_TARGET(BitOr); VM_TARGET(BitXor); VM_TARGET(ShiftLeft); VM_TARGET(ShiftRight);
+    VM_TARGET(Not); VM_TARGET(Negate); VM_TARGET(Print);
+    VM_TARGET(Jump); VM_TARGET(JumpIfFalse); VM_TARGET(Loop); VM_TARGET(Switch);
+    VM_TARGET(Call); VM_TARGET(Closure); VM_TARGET(Return); VM_TARGET(Throw);
+    VM_TARGET(Class); VM_TARGET(Inherit); VM_TARGET(Method);
+    VM_TARGET(Invoke); VM_TARGET(SuperInvoke); VM_TARGET(GetSuper);
+    VM_TARGET(GetProperty); VM_TARGET(SetProperty); VM_TARGET(GetIndex); VM_TARGET(SetIndex);
+    VM_TARGET(EnsureIndexDefault); VM_TARGET(EnsurePropertyDefault); VM_TARGET(BuildMap); VM_TARGET(BuildArray);
+    VM_TARGET(Interpret); VM_TARGET(ScopedClosure); VM_TARGET(CallScoped); VM_TARGET(ReleaseScoped);
+    VM_TARGET(ScopedArray); VM_TARGET(ScopedCallback); VM_TARGET(ReleaseCallbacks);
+    VM_TARGET(JumpIfNotArray); VM_TARGET(GetIndexUnchecked); VM_TARGET(SetIndexUnchecked);
+    VM_TARGET(AddNum); VM_TARGET(AddStr); VM_TARGET(LessNum); VM_TARGET(GetIndexArray);
+    VM_TARGET(AddLocals); VM_TARGET(LessLocalConstJump); VM_TARGET(AddConstSetLocal);
+#else
+#define VM_CASE(op) case OpCode::op
+#define VM_NEXT() break
+#endif
 
+    OpCode instruction;
     for (;;) {
-        if (gRuntimeFlags.idsEnabled) {
-            if (frameCount_ > gRuntimeFlags.idsStackMax) {
-                stackTop_ = stackTop;
-                std::cerr << "Stack depth anomaly detected." << std::endl;
-                return InterpretResult::RuntimeError;
-            }
-            auto now = std::chrono::steady_clock::now();
-            auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastCheck).count();
-            if (dt >= 200) {
-                uint64_t cur = gcGetYoungAllocations();
-                uint64_t diff = cur >= lastAlloc ? (cur - lastAlloc) : 0;
-                uint64_t rate = (uint64_t)((double)diff * 1000.0 / (double)dt);
-                lastAlloc = cur;
-                lastCheck = now;
-                if (gRuntimeFlags.idsAllocRateMax && rate > gRuntimeFlags.idsAllocRateMax) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Allocation rate anomaly detected." << std::endl;
-                    return InterpretResult::RuntimeError;
-                }
-            }
-        }
-        OpCode instruction = static_cast<OpCode>(READ_BYTE());
+        instruction = static_cast<OpCode>(READ_BYTE());
+#ifdef CLAW_COMPUTED_GOTO
+        if constexpr (Threaded) goto *dispatchTable[static_cast<uint8_t>(instruction)];
+#endif
         switch (instruction) {
-            case OpCode::Constant: {
+            VM_CASE(Constant): {
                 Value constant = READ_CONSTANT();
                 *stackTop++ = constant;
-                break;
+                VM_NEXT();
             }
-            case OpCode::Nil: *stackTop++ = nilValue(); break;
-            case OpCode::True: *stackTop++ = boolValue(true); break;
-            case OpCode::False: *stackTop++ = boolValue(false); break;
-            case OpCode::Pop: stackTop--; break;
+            VM_CASE(Nil): *stackTop++ = nilValue(); VM_NEXT();
+            VM_CASE(True): *stackTop++ = boolValue(true); VM_NEXT();
+            VM_CASE(False): *stackTop++ = boolValue(false); VM_NEXT();
+            VM_CASE(Pop): stackTop--; VM_NEXT();
             
-            case OpCode::DefineGlobal: {
-                const char* namePtr = READ_STRING_PTR();
-                globals_->define(namePtr, *(--stackTop));
-                globalVersion_++;
-                break;
+            VM_CASE(DefineGlobal): {
+                uint16_t slot = READ_SHORT();
+                if (Value* binding = boundGlobal(slot)) {
+                    *binding = *(--stackTop);
+                } else {
+                    globals_->define(GlobalTable::getInstance().name(slot), *(--stackTop));
+                    bindGlobal(slot);
+                }
+                VM_NEXT();
             }
-            case OpCode::GetGlobal: {
-                const uint8_t* cacheKey = frame->ip - 1;
-                const char* namePtr = READ_STRING_PTR();
-                auto cacheIt = globalInlineCache_.find(cacheKey);
-                if (cacheIt != globalInlineCache_.end()) {
-                    const auto& entry = cacheIt->second;
-                    if (entry.name == namePtr && entry.version == globalVersion_) {
-                        *stackTop++ = entry.value;
-                        break;
+            VM_CASE(GetGlobal): {
+                uint16_t slot = READ_SHORT();
+                Value* binding = boundGlobal(slot);
+                if (!binding && !(binding = bindGlobal(slot))) {
+                    const char* namePtr = GlobalTable::getInstance().name(slot);
+                    if (!globals_->exists(namePtr)) {
+                        VM_ERROR(UNDEFINED_VARIABLE, "Undefined variable: " + std::string(namePtr));
                     }
+                    *stackTop++ = globals_->get(namePtr);
+                    VM_NEXT();
                 }
-                if (!globals_->exists(namePtr)) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Undefined variable '" << namePtr << "'." << std::endl;
-                    return InterpretResult::RuntimeError;
-                }
-                Value value = globals_->get(namePtr);
-                globalInlineCache_[cacheKey] = {namePtr, globalVersion_, value};
-                *stackTop++ = value;
-                break;
+                *stackTop++ = *binding;
+                VM_NEXT();
             }
-            case OpCode::SetGlobal: {
-                const char* namePtr = READ_STRING_PTR();
-                if (!globals_->exists(namePtr)) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Undefined variable '" << namePtr << "'." << std::endl;
-                    return InterpretResult::RuntimeError;
+            VM_CASE(SetGlobal): {
+                uint16_t slot = READ_SHORT();
+                Value* binding = boundGlobal(slot);
+                if (!binding && !(binding = bindGlobal(slot))) {
+                    // Assigning an unbound name defines it, as in the interpreter
+                    const char* namePtr = GlobalTable::getInstance().name(slot);
+                    if (!globals_->exists(namePtr)) {
+                        globals_->define(namePtr, stackTop[-1]);
+                        bindGlobal(slot);
+                    } else {
+                        globals_->assign(namePtr, stackTop[-1]);
+                    }
+                    VM_NEXT();
                 }
-                globals_->assign(namePtr, stackTop[-1]);
-                globalVersion_++;
-                break;
+                *binding = stackTop[-1];
+                VM_NEXT();
             }
-            case OpCode::GetLocal: {
+            VM_CASE(GetLocal): {
                 uint8_t slot = READ_BYTE();
                 *stackTop++ = frame->slots[slot];
                 if (gRuntimeFlags.icDiagnostics) {
                     std::cerr << "[GetLocal] slot=" << (int)slot << " val=" << valueToString(frame->slots[slot]) << std::endl;
                 }
-                break;
+                VM_NEXT();
             }
-            case OpCode::SetLocal: {
+            VM_CASE(SetLocal): {
                 uint8_t slot = READ_BYTE();
                 frame->slots[slot] = stackTop[-1];
                 if (gRuntimeFlags.icDiagnostics) {
                     std::cerr << "[SetLocal] slot=" << (int)slot << " val=" << valueToString(stackTop[-1]) << std::endl;
                 }
-                break;
+                VM_NEXT();
             }
-            case OpCode::GetUpvalue: {
+            VM_CASE(GetUpvalue): {
                 uint8_t slot = READ_BYTE();
-                *stackTop++ = *frame->closure->upvalues[slot]->location;
-                break;
+                *stackTop++ = *frame->closure->upvalue(slot)->location;
+                VM_NEXT();
             }
-            case OpCode::SetUpvalue: {
+            VM_CASE(SetUpvalue): {
                 uint8_t slot = READ_BYTE();
-                *frame->closure->upvalues[slot]->location = stackTop[-1];
-                break;
+                VMUpvalue* upvalue = frame->closure->upvalue(slot);
+                gcBarrierUpvalue(upvalue, *upvalue->location, stackTop[-1]);
+                *upvalue->location = stackTop[-1];
+                VM_NEXT();
             }
-            case OpCode::CloseUpvalue: {
+            VM_CASE(CloseUpvalue): {
                 closeUpvalues(stackTop - 1);
                 stackTop--;
-                break;
+                VM_NEXT();
             }
 
-            case OpCode::Jump: {
+            // Superinstructions take the fused path on numbers. Anything else
+            // runs the first GetLocal and leaves ip on the original sequence.
+            VM_CASE(AddLocals): {
+                Value a = frame->slots[frame->ip[0]];
+                Value b = frame->slots[frame->ip[2]];
+                if (isNumber(a) && isNumber(b)) {
+                    *stackTop++ = addNumbers(a, b);
+                    frame->ip += 4;
+                    VM_NEXT();
+                }
+                *stackTop++ = a;
+                frame->ip++;
+                VM_NEXT();
+            }
+            VM_CASE(LessLocalConstJump): {
+                Value a = frame->slots[frame->ip[0]];
+                if (!isNumber(a)) {
+                    *stackTop++ = a;
+                    frame->ip++;
+                    VM_NEXT();
+                }
+                Value k = frame->closure->function->chunk->constants()[frame->ip[2]];
+                bool less = isInt(a) && isInt(k) ? asInt(a) < asInt(k) : asNumber(a) < asNumber(k);
+                uint16_t offset = static_cast<uint16_t>((frame->ip[5] << 8) | frame->ip[6]);
+                frame->ip += 7;
+                *stackTop++ = boolValue(less);
+                if (!less) frame->ip += offset;
+                VM_NEXT();
+            }
+            VM_CASE(AddConstSetLocal): {
+                Value a = frame->slots[frame->ip[0]];
+                if (!isNumber(a)) {
+                    *stackTop++ = a;
+                    frame->ip++;
+                    VM_NEXT();
+                }
+                Value k = frame->closure->function->chunk->constants()[frame->ip[2]];
+                frame->slots[frame->ip[5]] = addNumbers(a, k);
+                frame->ip += 7;
+                VM_NEXT();
+            }
+
+            VM_CASE(Jump): {
                 uint16_t offset = READ_SHORT();
                 frame->ip += offset;
-                break;
+                VM_NEXT();
             }
-            case OpCode::JumpIfFalse: {
+            VM_CASE(JumpIfFalse): {
                 uint16_t offset = READ_SHORT();
                 if (isFalsey(stackTop[-1])) frame->ip += offset;
-                break;
+                VM_NEXT();
             }
-            case OpCode::Loop: {
+            VM_CASE(Switch): {
+                const Chunk& chunk = *frame->closure->function->chunk;
+                const SwitchTable& table = chunk.switchTable(READ_SHORT());
+                Value value = *(--stackTop);
+                uint32_t target = table.fallback;
+                if (isString(value)) {
+                    // Labels are interned; a string built at run time matches
+                    // through its interned twin, if there is one
+                    const ClawString* label = asStringObject(value);
+                    if (!label->interned) label = StringPool::find(label->view(), label->hash());
+                    auto it = label ? table.strings.find(label->chars()) : table.strings.end();
+                    if (it != table.strings.end()) target = it->second;
+                } else if (isNumber(value) && !table.ints.empty()) {
+                    double index = asNumber(value) - table.low;
+                    if (index >= 0 && index < static_cast<double>(table.ints.size()) && index == std::floor(index)) {
+                        target = table.ints[static_cast<size_t>(index)];
+                    }
+                }
+                frame->ip = chunk.code().data() + target;
+                VM_NEXT();
+            }
+            VM_CASE(Loop): {
                 uint16_t offset = READ_SHORT();
+                uint16_t slot = READ_SHORT();
 #ifdef CLAW_ENABLE_JIT
-                auto& c = loopHotness_[frame->ip];
-                c++;
-                if (c.load() >= (jitConfig_.aggressive ? std::max(1u, jitConfig_.loopThreshold / 4) : jitConfig_.loopThreshold)) {
+                uint32_t c = ++frame->caches->loops[slot];
+                if (c >= (jitConfig_.aggressive ? std::max(1u, jitConfig_.loopThreshold / 4) : jitConfig_.loopThreshold)) {
                     const uint8_t* header = frame->ip - offset;
                     if (!jit_.hasBaseline(frame->closure->function.get())) {
                         std::vector<JitEntry> entries;
@@ -272,176 +519,191 @@ InterpretResult VM::run() {
                         jit_.registerBaseline(frame->closure->function.get(), entries);
                     }
                     if (jit_.enterOSR(this, frame->closure->function.get(), header)) {
-                        break;
+                        VM_NEXT();
                     }
                 }
+#else
+                (void)slot;
 #endif
                 frame->ip -= offset;
-                break;
+                SAFEPOINT_POLL();
+                VM_NEXT();
             }
 
-            case OpCode::Add: {
+            VM_CASE(Add): {
+                SYNC_STACK_TOP();
                 Value vb = *(--stackTop);
                 Value va = *(--stackTop);
                 if (isString(va) && isString(vb)) {
-                    auto sv = StringPool::intern(asString(va) + asString(vb));
-                    *stackTop++ = stringValue(sv.data());
+                    *stackTop++ = concatStrings(va, vb);
+                    QUICKEN(AddStr);
                 } else if (isNumber(va) && isNumber(vb)) {
-                    *stackTop++ = numberToValue(asNumber(va) + asNumber(vb));
+                    *stackTop++ = addNumbers(va, vb);
+                    QUICKEN(AddNum);
                 } else if (isString(va) && isNumber(vb)) {
-                    auto sv = StringPool::intern(asString(va) + valueToString(vb));
-                    *stackTop++ = stringValue(sv.data());
+                    *stackTop++ = concatStrings(va, valueToString(vb));
                 } else if (isNumber(va) && isString(vb)) {
-                    auto sv = StringPool::intern(valueToString(va) + asString(vb));
-                    *stackTop++ = stringValue(sv.data());
+                    *stackTop++ = concatStrings(valueToString(va), vb);
                 } else {
-                    stackTop_ = stackTop;
-                    std::cerr << "Operands must be numbers or strings (supported: string+string, number+number, string+number, number+string)." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(TYPE_MISMATCH, "Operands must be two numbers or two strings");
+                }
+                VM_NEXT();
+            }
+            VM_CASE(AddNum): {
+                if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) {
+                    DEQUICKEN(Add);
+                    VM_NEXT();
+                }
+                stackTop[-2] = addNumbers(stackTop[-2], stackTop[-1]);
+                stackTop--;
+                VM_NEXT();
+            }
+            VM_CASE(AddStr): {
+                SYNC_STACK_TOP();
+                if (!isString(stackTop[-1]) || !isString(stackTop[-2])) {
+                    DEQUICKEN(Add);
+                    VM_NEXT();
                 }
-                break;
+                stackTop[-2] = concatStrings(stackTop[-2], stackTop[-1]);
+                stackTop--;
+                VM_NEXT();
             }
-            case OpCode::Subtract: BINARY_OP(-); break;
-            case OpCode::Multiply: BINARY_OP(*); break;
+            VM_CASE(Subtract): NUMERIC_OP(subtractNumbers); VM_NEXT();
+            VM_CASE(Multiply): NUMERIC_OP(multiplyNumbers); VM_NEXT();
             // Override Divide to handle divide-by-zero with a clear error
-            case OpCode::Divide: {
+            VM_CASE(Divide): {
                 if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Operands must be numbers." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(TYPE_MISMATCH, "Operands must be numbers");
                 }
                 double b = asNumber(*(--stackTop));
                 double a = asNumber(*(--stackTop));
                 if (b == 0.0) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Division by zero." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(DIVISION_BY_ZERO, "Division by zero");
                 }
                 *stackTop++ = numberToValue(a / b);
-                break;
+                VM_NEXT();
             }
-            case OpCode::BitAnd: {
+            VM_CASE(BitAnd): {
                 if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Operands must be numbers for bitwise AND." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(TYPE_MISMATCH, "Operands must be numbers");
                 }
-                uint64_t b = static_cast<uint64_t>(asNumber(*(--stackTop)));
-                uint64_t a = static_cast<uint64_t>(asNumber(*(--stackTop)));
-                *stackTop++ = numberToValue(static_cast<double>(a & b));
-                break;
+                uint64_t b = bitOperand(*(--stackTop));
+                uint64_t a = bitOperand(*(--stackTop));
+                *stackTop++ = bitResult(a & b);
+                VM_NEXT();
             }
-            case OpCode::BitOr: {
+            VM_CASE(BitOr): {
                 if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Operands must be numbers for bitwise OR." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(TYPE_MISMATCH, "Operands must be numbers");
                 }
-                uint64_t b = static_cast<uint64_t>(asNumber(*(--stackTop)));
-                uint64_t a = static_cast<uint64_t>(asNumber(*(--stackTop)));
-                *stackTop++ = numberToValue(static_cast<double>(a | b));
-                break;
+                uint64_t b = bitOperand(*(--stackTop));
+                uint64_t a = bitOperand(*(--stackTop));
+                *stackTop++ = bitResult(a | b);
+                VM_NEXT();
             }
-            case OpCode::BitXor: {
+            VM_CASE(BitXor): {
                 if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Operands must be numbers for bitwise XOR." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(TYPE_MISMATCH, "Operands must be numbers");
                 }
-                uint64_t b = static_cast<uint64_t>(asNumber(*(--stackTop)));
-                uint64_t a = static_cast<uint64_t>(asNumber(*(--stackTop)));
-                *stackTop++ = numberToValue(static_cast<double>(a ^ b));
-                break;
+                uint64_t b = bitOperand(*(--stackTop));
+                uint64_t a = bitOperand(*(--stackTop));
+                *stackTop++ = bitResult(a ^ b);
+                VM_NEXT();
             }
-            case OpCode::ShiftLeft: {
+            VM_CASE(ShiftLeft): {
                 if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Operands must be numbers for shift left." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(TYPE_MISMATCH, "Operands must be numbers");
                 }
                 double bDouble = asNumber(*(--stackTop));
                 if (gRuntimeFlags.icDiagnostics) {
                     std::fprintf(stderr, "[ShiftLeft] count=%f\n", bDouble);
                 }
-                uint64_t a = static_cast<uint64_t>(asNumber(*(--stackTop)));
+                uint64_t a = bitOperand(*(--stackTop));
                 int64_t bSigned = static_cast<int64_t>(bDouble);
                 if (bDouble < 0.0 || bSigned < 0) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Shift count must be non-negative." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(RUNTIME_ERROR, "Shift count must be non-negative");
                 }
                 uint64_t b = static_cast<uint64_t>(bDouble);
                 if (b > 0x7FFFFFFFFFFFFFFFULL) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Shift count must be non-negative." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(RUNTIME_ERROR, "Shift count must be non-negative");
                 }
                 int sh = static_cast<int>(b) & 63;
-                *stackTop++ = numberToValue(static_cast<double>(static_cast<uint64_t>(a) << sh));
-                break;
+                *stackTop++ = bitResult(a << sh);
+                VM_NEXT();
             }
-            case OpCode::ShiftRight: {
+            VM_CASE(ShiftRight): {
                 if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Operands must be numbers for shift right." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(TYPE_MISMATCH, "Operands must be numbers");
                 }
                 double bDouble = asNumber(*(--stackTop));
                 if (gRuntimeFlags.icDiagnostics) {
                     std::fprintf(stderr, "[ShiftRight] count=%f\n", bDouble);
                 }
-                uint64_t a = static_cast<uint64_t>(asNumber(*(--stackTop)));
+                uint64_t a = bitOperand(*(--stackTop));
                 int64_t bSigned = static_cast<int64_t>(bDouble);
                 if (bDouble < 0.0 || bSigned < 0) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Shift count must be non-negative." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(RUNTIME_ERROR, "Shift count must be non-negative");
                 }
                 uint64_t b = static_cast<uint64_t>(bDouble);
                 if (b > 0x7FFFFFFFFFFFFFFFULL) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Shift count must be non-negative." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(RUNTIME_ERROR, "Shift count must be non-negative");
                 }
                 int sh = static_cast<int>(b) & 63;
-                *stackTop++ = numberToValue(static_cast<double>(static_cast<uint64_t>(a) >> sh));
-                break;
+                *stackTop++ = bitResult(a >> sh);
+                VM_NEXT();
             }
             
-            case OpCode::Equal: {
+            VM_CASE(Equal): {
                 Value b = *(--stackTop);
                 Value a = *(--stackTop);
                 *stackTop++ = boolValue(isEqual(a, b));
-                break;
+                VM_NEXT();
+            }
+            VM_CASE(Greater):  COMPARE_OP(>); VM_NEXT();
+            VM_CASE(Less):     COMPARE_OP(<); QUICKEN(LessNum); VM_NEXT();
+
+            VM_CASE(LessNum): {
+                if (!isNumber(stackTop[-1]) || !isNumber(stackTop[-2])) {
+                    DEQUICKEN(Less);
+                    VM_NEXT();
+                }
+                if (isInt(stackTop[-2]) && isInt(stackTop[-1])) {
+                    stackTop[-2] = boolValue(asInt(stackTop[-2]) < asInt(stackTop[-1]));
+                } else {
+                    stackTop[-2] = boolValue(asNumber(stackTop[-2]) < asNumber(stackTop[-1]));
+                }
+                stackTop--;
+                VM_NEXT();
             }
-            case OpCode::Greater:  COMPARE_OP(>); break;
-            case OpCode::Less:     COMPARE_OP(<); break;
 
-            case OpCode::Not: {
+            VM_CASE(Not): {
                 Value val = *(--stackTop);
                 *stackTop++ = boolValue(isFalsey(val));
-                break;
+                VM_NEXT();
             }
-            case OpCode::Negate: {
+            VM_CASE(Negate): {
                 if (!isNumber(stackTop[-1])) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Operand must be a number." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(TYPE_MISMATCH, "Operand must be a number");
+                }
+                Value operand = stackTop[-1];
+                if (isInt(operand) && asInt(operand) != 0 && asInt(operand) != INT32_MIN) {
+                    stackTop[-1] = intValue(-asInt(operand));
+                } else {
+                    stackTop[-1] = numberToValue(-asNumber(operand));
                 }
-                double val = asNumber(*(--stackTop));
-                *stackTop++ = numberToValue(-val);
-                break;
+                VM_NEXT();
             }
 
-            case OpCode::Print: {
+            VM_CASE(Print): {
                 Value val = *(--stackTop);
                 std::cout << valueToString(val) << std::endl;
-                break;
+                VM_NEXT();
             }
 
-            case OpCode::Call: {
-                const uint8_t* cacheKey = frame->ip;
+            VM_CASE(Call): {
+                const uint8_t* siteIp = frame->ip;
                 uint8_t argCount = READ_BYTE();
+                auto& cache = frame->caches->calls[READ_SHORT()];
                 size_t avail = static_cast<size_t>(stackTop - stack_);
                 if (static_cast<size_t>(argCount + 1) > avail) {
                     stackTop_ = stackTop;
@@ -450,211 +712,371 @@ InterpretResult VM::run() {
                 }
                 Value callee = stackTop[-1 - argCount];
                 if (!gRuntimeFlags.disableCallIC) {
-                    auto cacheIt = callInlineCache_.find(cacheKey);
-                    if (cacheIt != callInlineCache_.end()) {
-                        auto& entry = cacheIt->second;
-                        if (entry.callee == asObjectPtr(callee)) {
-                            if (entry.kind == CallCacheKind::VMClosure && entry.closure) {
-                                stackTop_ = stackTop;
-                                if (!call(entry.closure, argCount)) {
-                                    stackTop_ = stackTop;
-                                    return InterpretResult::RuntimeError;
-                                }
-                                stackTop = stackTop_;
-                                frame = &frames_[frameCount_ - 1];
-                                break;
-                            }
-                            if (entry.kind == CallCacheKind::VMFunction && entry.closure) {
-                                stackTop_ = stackTop;
-                                if (!call(entry.closure, argCount)) {
-                                    stackTop_ = stackTop;
-                                    return InterpretResult::RuntimeError;
-                                }
-                                stackTop = stackTop_;
-                                frame = &frames_[frameCount_ - 1];
-                                break;
-                            }
-                        }
+                    if (cache.kind == CallCacheKind::FastNative && isObject(callee) &&
+                        cache.callee == asObjectPtr(callee)) {
+                        stackTop_ = stackTop;
+                        if (!callNative(*cache.native, argCount)) VM_THROW();
+                        stackTop = stackTop_;
+                        VM_NEXT();
+                    }
+                    if (cache.callee == asObjectPtr(callee) && cache.closure &&
+                        (cache.kind == CallCacheKind::VMClosure || cache.kind == CallCacheKind::VMFunction)) {
+                        stackTop_ = stackTop;
+                        if (!call(cache.closure, argCount)) VM_THROW();
+                        stackTop = stackTop_;
+                        frame = &frames_[frameCount_ - 1];
+                        SAFEPOINT_POLL();
+                        VM_NEXT();
                     }
                 } else if (gRuntimeFlags.icDiagnostics) {
                     std::fprintf(stderr, "[IC] disabled path key=%p argc=%u callee=%p sp=%p ip=%p\n",
-                                 (const void*)cacheKey, (unsigned)argCount, (void*)asObjectPtr(callee),
+                                 (const void*)siteIp, (unsigned)argCount, (void*)asObjectPtr(callee),
                                  (void*)stackTop, (const void*)frame->ip);
                 }
                 stackTop_ = stackTop;
-                if (!callValue(callee, argCount)) {
-                    stackTop_ = stackTop;
-                    return InterpretResult::RuntimeError;
-                }
+                if (!callValue(callee, argCount)) VM_THROW();
                 if (!gRuntimeFlags.disableCallIC) {
                     if (isObject(callee)) {
                         if (isVMClosure(callee)) {
-                            auto closure = asVMClosurePtr(callee);
+                            auto closure = asVMClosure(callee);
                             if (closure) {
-                                callInlineCache_[cacheKey] = {asObjectPtr(callee), CallCacheKind::VMClosure, closure};
+                                cache = {asObjectPtr(callee), CallCacheKind::VMClosure, closure, nullptr};
                                 if (gRuntimeFlags.icDiagnostics) {
                                     std::fprintf(stderr, "[IC] cache store closure key=%p callee=%p closure=%p\n",
-                                                 (const void*)cacheKey, (void*)asObjectPtr(callee), (void*)closure);
+                                                 (const void*)siteIp, (void*)asObjectPtr(callee), (void*)closure);
                                 }
                             }
                         } else if (isVMFunction(callee)) {
                             auto function = asVMFunction(callee);
                             if (function && function->upvalueCount == 0) {
-                                auto closure = std::make_shared<VMClosure>();
-                                closure->function = function;
-                                closure->upvalues.resize(function->upvalueCount);
+                                auto closure = VMClosure::create(shareObject(function));
                                 vmClosureValue(closure);
-                                callInlineCache_[cacheKey] = {asObjectPtr(callee), CallCacheKind::VMFunction, closure.get()};
+                                cache = {asObjectPtr(callee), CallCacheKind::VMFunction, closure.get(), nullptr};
                                 if (gRuntimeFlags.icDiagnostics) {
                                     std::fprintf(stderr, "[IC] cache store function key=%p callee=%p closure=%p\n",
-                                                 (const void*)cacheKey, (void*)asObjectPtr(callee), (void*)closure.get());
+                                                 (const void*)siteIp, (void*)asObjectPtr(callee), (void*)closure.get());
                                 }
                             }
+                        } else if (isCallable(callee)) {
+                            auto native = std::dynamic_pointer_cast<NativeFunction>(shareObject(asCallable(callee)));
+                            if (native && native->fast()) {
+                                cache = {asObjectPtr(callee), CallCacheKind::FastNative, nullptr, std::move(native)};
+                            }
                         }
                     }
                 }
                 stackTop = stackTop_;
                 frame = &frames_[frameCount_ - 1];
-                break;
+                SAFEPOINT_POLL();
+                VM_NEXT();
             }
 
-            case OpCode::Closure: {
+            VM_CASE(Closure): {
+                SYNC_STACK_TOP();
                 Value functionVal = READ_CONSTANT();
                 auto function = asVMFunction(functionVal);
                 if (!function) {
-                    stackTop_ = stackTop;
                     std::cerr << "Expected function constant." << std::endl;
                     return InterpretResult::RuntimeError;
                 }
 
-                auto closure = std::make_shared<VMClosure>();
-                closure->function = function;
-                closure->upvalues.resize(function->upvalueCount);
-
+                auto closure = VMClosure::create(shareObject(function));
                 for (int i = 0; i < function->upvalueCount; i++) {
                     uint8_t isLocal = READ_BYTE();
                     uint8_t index = READ_BYTE();
-                    if (isLocal) {
-                        closure->upvalues[i] = captureUpvalue(frame->slots + index);
-                    } else {
-                        closure->upvalues[i] = frame->closure->upvalues[index];
-                    }
+                    closure->setUpvalue(i, isLocal ? captureUpvalue(frame->slots + index)
+                                                   : frame->closure->upvalue(index));
                 }
 
                 *stackTop++ = vmClosureValue(closure);
-                break;
+                VM_NEXT();
+            }
+            VM_CASE(ScopedClosure): {
+                SYNC_STACK_TOP();
+                // Pushed into the slot of the local that holds it; only
+                // CallScoped and ReleaseScoped ever see the value
+                auto function = asVMFunction(READ_CONSTANT());
+                VMClosure* closure = allocateScopedClosure(shareObject(function), stackTop);
+                for (int i = 0; i < function->upvalueCount; i++) {
+                    uint8_t isLocal = READ_BYTE();
+                    uint8_t index = READ_BYTE();
+                    closure->setUpvalue(i, isLocal ? captureUpvalue(frame->slots + index)
+                                                   : frame->closure->upvalue(index));
+                }
+                *stackTop++ = objectValue(closure);
+                VM_NEXT();
+            }
+            VM_CASE(CallScoped): {
+                uint8_t argCount = READ_BYTE();
+                auto* closure = static_cast<VMClosure*>(asHeapObject(stackTop[-1 - argCount]));
+                stackTop_ = stackTop;
+                if (!call(closure, argCount)) VM_THROW();
+                stackTop = stackTop_;
+                frame = &frames_[frameCount_ - 1];
+                SAFEPOINT_POLL();
+                VM_NEXT();
+            }
+            VM_CASE(ReleaseScoped): {
+                releaseScoped(--stackTop);
+                VM_NEXT();
+            }
+            VM_CASE(ScopedArray): {
+                // BuildArray for a local that only ever indexes the array or
+                // reads its length; it takes the slot the first element is in
+                uint16_t count = READ_SHORT();
+                Value* elements = stackTop - count;
+                ClawArray* array = allocateScopedArray(elements, count, elements);
+                stackTop = elements;
+                *stackTop++ = objectValue(array);
+                VM_NEXT();
+            }
+            VM_CASE(ScopedCallback): {
+                SYNC_STACK_TOP();
+                // A function literal passed to map, filter, forEach or reduce.
+                // The callee, depth slots down, is only known here: when it
+                // just calls the closure while it runs, the closure goes in
+                // the frame region and ReleaseCallbacks frees it after the
+                // call; anything else gets a heap closure, as Closure makes.
+                auto function = asVMFunction(READ_CONSTANT());
+                uint8_t depth = READ_BYTE();
+                std::shared_ptr<VMClosure> heap;
+                VMClosure* closure;
+                if (borrowsCallback(stackTop[-depth])) {
+                    closure = allocateScopedClosure(shareObject(function), stackTop);
+                } else {
+                    heap = VMClosure::create(shareObject(function));
+                    closure = heap.get();
+                }
+                for (int i = 0; i < function->upvalueCount; i++) {
+                    uint8_t isLocal = READ_BYTE();
+                    uint8_t index = READ_BYTE();
+                    closure->setUpvalue(i, isLocal ? captureUpvalue(frame->slots + index)
+                                                   : frame->closure->upvalue(index));
+                }
+                *stackTop++ = heap ? vmClosureValue(std::move(heap)) : objectValue(closure);
+                VM_NEXT();
+            }
+            VM_CASE(ReleaseCallbacks): {
+                // The call's result is in the callee's slot, just below
+                // where its arguments were
+                releaseScoped(stackTop);
+                VM_NEXT();
             }
 
-            case OpCode::Return: {
+            VM_CASE(Return): {
                 Value result = *(--stackTop);
                 Value* frameSlots = frame->slots;
                 closeUpvalues(frame->slots);
-                gcEphemeralEscape(result);
-                gcEphemeralFrameLeave();
+                // Slot 0 is the callee, which may be a caller's scoped closure
+                releaseScoped(frame->slots + 1);
                 frameCount_--;
-                if (frameCount_ == 0) {
-                    stackTop_ = stackTop;
+                if (frameCount_ == baseFrame_) {
+                    stackTop_ = frameSlots;
+                    *stackTop_++ = result;
                     return InterpretResult::Ok;
                 }
                 stackTop = frameSlots;
                 *stackTop++ = result;
                 stackTop_ = stackTop;
                 frame = &frames_[frameCount_ - 1];
-                break;
+                VM_NEXT();
+            }
+            VM_CASE(Throw): {
+                std::string message = valueToString(*(--stackTop));
+                VM_ERROR(RUNTIME_ERROR, message);
+            }
+
+            VM_CASE(Class): {
+                SYNC_STACK_TOP();
+                const char* namePtr = READ_STRING_PTR();
+                *stackTop++ = classValue(std::make_shared<ClawClass>(
+                    namePtr, nullptr, std::unordered_map<std::string, std::shared_ptr<ClawFunction>>{}));
+                VM_NEXT();
+            }
+            VM_CASE(Inherit): {
+                // [superclass, class] -> [superclass], left behind as the 'super' local
+                if (!isClass(stackTop[-2])) {
+                    VM_ERROR(RUNTIME_ERROR, "Superclass must be a class.");
+                }
+                asClass(stackTop[-1])->setSuperclass(shareObject(asClass(stackTop[-2])));
+                stackTop--;
+                VM_NEXT();
+            }
+            VM_CASE(Method): {
+                const char* namePtr = READ_STRING_PTR();
+                asClass(stackTop[-2])->setVMMethod(namePtr, shareObject(asVMClosure(stackTop[-1])));
+                stackTop--;
+                VM_NEXT();
+            }
+            VM_CASE(Invoke): {
+                // receiver.name(args) in one step: a compiled method is called
+                // with the receiver already in its slot 0, so no bound method
+                // is allocated. Fields shadow methods, as in GetProperty.
+                const char* namePtr = READ_STRING_PTR();
+                // Lookup errors are reported at the name, call errors at the
+                // bytes after it, as the interpreter reports them
+                const uint8_t* lookupIp = frame->ip;
+                uint8_t argCount = READ_BYTE();
+                auto& cache = frame->caches->invokes[READ_SHORT()];
+                Value* receiver = &stackTop[-1 - argCount];
+                if (!isInstance(*receiver)) {
+                    SYNC_STACK_TOP();
+                    if (const NativeFunction* method = hostMethod(*receiver, namePtr)) {
+                        if (!callNative(*method, argCount, true)) VM_THROW();
+                        stackTop = stackTop_;
+                        VM_NEXT();
+                    }
+                    // Array and map members are natives bound by the interpreter
+                    if (!getHostMember(receiver, namePtr)) {
+                        frame->ip = lookupIp;
+                        VM_THROW();
+                    }
+                    if (!callValue(*receiver, argCount)) VM_THROW();
+                    stackTop = stackTop_;
+                    frame = &frames_[frameCount_ - 1];
+                    VM_NEXT();
+                }
+                auto instance = asInstance(*receiver);
+                ClawClass* klass = instance->getClassPtr();
+                VMClosure* method = nullptr;
+                if (cache.shape == instance->shape()) {
+                    // a shape known to have no field by this name
+                    method = cache.method;
+                } else if (instance->getField(namePtr, receiver)) {
+                    // calls whatever the field holds
+                } else if (cache.klass.get() == klass) {
+                    method = cache.method;
+                    cache.shape = instance->shape();
+                } else if ((method = klass->findVMMethod(namePtr))) {
+                    cache = {instance->getClass(), instance->shape(), method};
+                } else if (klass->findInternedMethod(namePtr)) {
+                    *receiver = instance->get(Token(TokenType::Identifier, namePtr, 0));
+                } else {
+                    frame->ip = lookupIp;
+                    VM_ERROR(RUNTIME_ERROR, "Undefined property '" + std::string(namePtr) + "'.");
+                }
+                stackTop_ = stackTop;
+                if (method ? !call(method, argCount) : !callValue(*receiver, argCount)) VM_THROW();
+                stackTop = stackTop_;
+                frame = &frames_[frameCount_ - 1];
+                SAFEPOINT_POLL();
+                VM_NEXT();
+            }
+            VM_CASE(SuperInvoke): {
+                // [this, args..., superclass]
+                const char* namePtr = READ_STRING_PTR();
+                uint8_t argCount = READ_BYTE();
+                auto superclass = asClass(*(--stackTop));
+                Value* receiver = &stackTop[-1 - argCount];
+                stackTop_ = stackTop;
+                if (VMClosure* method = superclass->findVMMethod(namePtr)) {
+                    if (!call(method, argCount)) VM_THROW();
+                } else if (!bindSuperMethod(*superclass, namePtr, receiver) || !callValue(*receiver, argCount)) {
+                    VM_THROW();
+                }
+                stackTop = stackTop_;
+                frame = &frames_[frameCount_ - 1];
+                SAFEPOINT_POLL();
+                VM_NEXT();
+            }
+            VM_CASE(GetSuper): {
+                SYNC_STACK_TOP();
+                // [this, superclass] -> [bound method]
+                const char* namePtr = READ_STRING_PTR();
+                auto superclass = asClass(*(--stackTop));
+                if (!bindSuperMethod(*superclass, namePtr, &stackTop[-1])) VM_THROW();
+                VM_NEXT();
             }
 
-            case OpCode::GetProperty: {
-                const uint8_t* cacheKey = frame->ip - 1;
-                lastPropertySiteIp_ = cacheKey;
+            VM_CASE(GetProperty): {
+                const uint8_t* siteIp = frame->ip - 1;
+                lastPropertySiteIp_ = siteIp;
                 const char* namePtr = READ_STRING_PTR();
+                auto& cache = frame->caches->properties[READ_SHORT()];
                 Value instanceVal = stackTop[-1];
                 if (!isInstance(instanceVal)) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Only instances have properties." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    SYNC_STACK_TOP();
+                    if (!getHostMember(&stackTop[-1], namePtr)) VM_THROW();
+                    VM_NEXT();
                 }
                 auto instance = asInstance(instanceVal);
-                const auto* instancePtr = instance.get();
-                auto versionIt = instanceVersions_.find(instancePtr);
-                uint64_t version = versionIt == instanceVersions_.end() ? 0 : versionIt->second;
+                const Shape* shape = instance->shape();
 #ifndef CLAW_DISABLE_IC_DIAGNOSTICS
-                if (propertyICMegamorphic_.count(cacheKey)) {
-                    Token nameToken(TokenType::Identifier, namePtr, 0);
-                    if (!instance->has(nameToken)) {
-                        auto method = instance->getClass()->findMethod(std::string(namePtr));
-                        if (!method) {
-                            stackTop_ = stackTop;
-                            std::cerr << "Undefined property '" << namePtr << "'." << std::endl;
-                            return InterpretResult::RuntimeError;
+                const bool megamorphic = cache.megamorphic;
+#else
+                constexpr bool megamorphic = false;
+#endif
+                if (!megamorphic) {
+                    bool hit = false;
+                    for (uint8_t i = 0; i < cache.count; i++) {
+                        const auto& e = cache.entries[i];
+                        if (e.shape == shape) {
+                            stackTop[-1] = instance->slot(e.slot);
+                            hit = true;
+                            break;
                         }
                     }
-                    stackTop[-1] = instance->get(nameToken);
-                    if (gRuntimeFlags.icDiagnostics) {
-                        std::fprintf(stderr, "[IC] megamorphic GetProperty key=%p name=%p inst=%p\n",
-                                     (const void*)cacheKey, (const void*)namePtr, (const void*)instancePtr);
+                    if (hit) {
+                        VM_NEXT();
                     }
-                    break;
                 }
-#endif
-                auto& entries = propertyInlineCache_[cacheKey];
-                bool hit = false;
-                for (auto& e : entries) {
-                    if (e.instance == instancePtr && e.name == namePtr && e.version == version) {
-                        stackTop[-1] = e.value;
-                        hit = true;
-                        break;
+                int slot = shape->lookup(namePtr);
+                if (slot < 0) {
+                    // Bound methods are fresh objects, so the site does not
+                    // cache them
+                    if (VMClosure* vmMethod = instance->getClassPtr()->findVMMethod(namePtr)) {
+                        SYNC_STACK_TOP();
+                        stackTop[-1] = boundMethodValue(instanceVal, vmMethod);
+                        VM_NEXT();
                     }
-                }
-                if (hit) break;
-                Token nameToken(TokenType::Identifier, namePtr, 0);
-                if (!instance->has(nameToken)) {
-                    auto method = instance->getClass()->findMethod(std::string(namePtr));
-                    if (!method) {
-                        stackTop_ = stackTop;
-                        std::cerr << "Undefined property '" << namePtr << "'." << std::endl;
-                        return InterpretResult::RuntimeError;
+                    if (!instance->getClassPtr()->findInternedMethod(namePtr)) {
+                        VM_ERROR(RUNTIME_ERROR, "Undefined property '" + std::string(namePtr) + "'.");
                     }
+                    stackTop[-1] = instance->get(Token(TokenType::Identifier, namePtr, 0));
+                    VM_NEXT();
                 }
-                Value value = instance->get(nameToken);
-                if (entries.size() >= 8) {
-                    entries.erase(entries.begin());
+                stackTop[-1] = instance->slot(static_cast<uint32_t>(slot));
+                if (megamorphic) {
+                    if (gRuntimeFlags.icDiagnostics) {
+                        std::fprintf(stderr, "[IC] megamorphic GetProperty key=%p name=%p shape=%p\n",
+                                     (const void*)siteIp, (const void*)namePtr, (const void*)shape);
+                    }
+                    VM_NEXT();
                 }
-                entries.push_back({instancePtr, namePtr, version, value});
+                cache.entries[cache.next] = {shape, static_cast<uint32_t>(slot), instance->getClass()};
+                cache.next = static_cast<uint8_t>((cache.next + 1) % PROPERTY_IC_ENTRIES);
+                if (cache.count < PROPERTY_IC_ENTRIES) cache.count++;
 #ifndef CLAW_DISABLE_IC_DIAGNOSTICS
-                auto& miss = propertyICMissCount_[cacheKey];
-                miss++;
+                uint32_t miss = ++cache.misses;
                 if (miss > 16) {
-                    propertyICMegamorphic_.insert(cacheKey);
+                    cache.megamorphic = true;
                     if (gRuntimeFlags.icDiagnostics) {
                         std::fprintf(stderr, "[IC] promote megamorphic GetProperty key=%p misses=%u\n",
-                                     (const void*)cacheKey, miss);
+                                     (const void*)siteIp, miss);
                     }
                 } else if (gRuntimeFlags.icDiagnostics) {
-                    std::fprintf(stderr, "[IC] property miss key=%p misses=%u\n", (const void*)cacheKey, miss);
+                    std::fprintf(stderr, "[IC] property miss key=%p misses=%u\n", (const void*)siteIp, miss);
                 }
 #endif
-                stackTop[-1] = value;
-                break;
+                VM_NEXT();
             }
-            case OpCode::SetProperty: {
+            VM_CASE(SetProperty): {
                 const char* namePtr = READ_STRING_PTR();
                 Value value = stackTop[-1];
                 Value instanceVal = stackTop[-2];
-                if (!isInstance(instanceVal)) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Only instances have fields." << std::endl;
-                    return InterpretResult::RuntimeError;
+                if (isInstance(instanceVal)) {
+                    asInstance(instanceVal)->setField(namePtr, value);
+                } else if (isHashMap(instanceVal)) {
+                    asHashMap(instanceVal)->set(namePtr, value);
+                } else {
+                    VM_ERROR(RUNTIME_ERROR, "Only instances and hash maps have fields.");
                 }
-                auto instance = asInstance(instanceVal);
-                Token nameToken(TokenType::Identifier, namePtr, 0);
-                instance->set(nameToken, value);
-                gcEphemeralEscape(value);
-                instanceVersions_[instance.get()]++;
                 stackTop[-2] = value;
                 stackTop--;
-                break;
+                VM_NEXT();
             }
-            case OpCode::GetIndex: {
+            VM_CASE(GetIndex): {
+                SYNC_STACK_TOP();
                 Value index = *(--stackTop);
                 Value object = *(--stackTop);
                 if (gRuntimeFlags.icDiagnostics) {
@@ -663,24 +1085,21 @@ InterpretResult VM::run() {
                 }
                 if (isArray(object)) {
                     if (!isNumber(index)) {
-                        stackTop_ = stackTop;
-                        std::cerr << "Array index must be a number." << std::endl;
-                        return InterpretResult::RuntimeError;
+                        VM_ERROR(TYPE_MISMATCH, "Array index must be a number");
                     }
                     auto array = asArray(object);
-                    int idx = static_cast<int>(asNumber(index));
+                    int idx = indexOperand(index);
                     if (idx < 0 || idx >= array->length()) {
-                        stackTop_ = stackTop;
-                        std::cerr << "Index " << idx << " out of bounds [0, " << (array->length() - 1) << "]." << std::endl;
-                        return InterpretResult::RuntimeError;
+                        VM_ERROR(INDEX_OUT_OF_BOUNDS, "Index " + std::to_string(idx) + " out of bounds [0, " +
+                                                          std::to_string(array->length() - 1) + "]");
                     }
                     Value v = array->get(static_cast<size_t>(idx));
-                    gcEphemeralEscape(v);
                     *stackTop++ = v;
                     if (gRuntimeFlags.icDiagnostics) {
                         std::cerr << "[GetIndexResult] " << valueToString(v) << std::endl;
                     }
-                    break;
+                    QUICKEN(GetIndexArray);
+                    VM_NEXT();
                 }
                 if (isHashMap(object)) {
                     auto map = asHashMap(object);
@@ -701,29 +1120,66 @@ InterpretResult VM::run() {
                     } else if (isBool(index)) {
                         key = asBool(index) ? "true" : "false";
                     } else {
-                        stackTop_ = stackTop;
-                        std::cerr << "Hash map index must be string, number, boolean, or nil." << std::endl;
-                        return InterpretResult::RuntimeError;
+                        VM_ERROR(TYPE_MISMATCH, "Hash map index must be a string, number, boolean, or nil");
                     }
                     {
                         Value v = map->get(key);
-                        gcEphemeralEscape(v);
                         *stackTop++ = v;
                     }
-                    break;
+                    VM_NEXT();
                 }
-                stackTop_ = stackTop;
-                std::cerr << "Can only index arrays and hash maps." << std::endl;
                 if (gRuntimeFlags.icDiagnostics) {
                     std::cerr << "[IndexDebug] objectTag=" << std::hex << tagBits(object)
                               << " isObj=" << (isObject(object) ? 1 : 0)
                               << " isArr=" << (isArray(object) ? 1 : 0)
                               << " isMap=" << (isHashMap(object) ? 1 : 0)
-                              << " objStr=" << valueToString(object) << std::endl;
+                              << " objStr=" << valueToString(object) << std::dec << std::endl;
                 }
-                return InterpretResult::RuntimeError;
+                VM_ERROR(NOT_INDEXABLE, "Can only index arrays and hash maps");
             }
-            case OpCode::SetIndex: {
+            VM_CASE(GetIndexArray): {
+                Value index = stackTop[-1];
+                Value object = stackTop[-2];
+                if (!isArray(object) || !isNumber(index)) {
+                    DEQUICKEN(GetIndex);
+                    VM_NEXT();
+                }
+                auto array = asArray(object);
+                int idx = indexOperand(index);
+                if (idx < 0 || idx >= array->length()) {
+                    DEQUICKEN(GetIndex);
+                    VM_NEXT();
+                }
+                Value v = array->get(static_cast<size_t>(idx));
+                stackTop[-2] = v;
+                stackTop--;
+                VM_NEXT();
+            }
+            // The loop around these checked once on entry that the local
+            // holds an array, and its test keeps the index in bounds
+            VM_CASE(JumpIfNotArray): {
+                uint8_t slot = READ_BYTE();
+                uint16_t offset = READ_SHORT();
+                if (!isArray(frame->slots[slot])) frame->ip += offset;
+                VM_NEXT();
+            }
+            VM_CASE(GetIndexUnchecked): {
+                auto* array = static_cast<ClawArray*>(asHeapObject(stackTop[-2]));
+                Value v = array->getUnchecked(static_cast<size_t>(indexOperand(stackTop[-1])));
+                stackTop[-2] = v;
+                stackTop--;
+                VM_NEXT();
+            }
+            VM_CASE(SetIndexUnchecked): {
+                Value value = stackTop[-1];
+                auto* array = static_cast<ClawArray*>(asHeapObject(stackTop[-3]));
+                array->setUnchecked(static_cast<size_t>(indexOperand(stackTop[-2])), value);
+                stackTop[-3] = value;
+                stackTop -= 2;
+                VM_NEXT();
+            }
+            VM_CASE(SetIndex): {
+                SYNC_STACK_TOP();
                 Value value = *(--stackTop);
                 Value index = *(--stackTop);
                 Value object = *(--stackTop);
@@ -734,21 +1190,17 @@ InterpretResult VM::run() {
                 }
                 if (isArray(object)) {
                     if (!isNumber(index)) {
-                        stackTop_ = stackTop;
-                        std::cerr << "Array index must be a number." << std::endl;
-                        return InterpretResult::RuntimeError;
+                        VM_ERROR(TYPE_MISMATCH, "Array index must be a number");
                     }
                     auto array = asArray(object);
-                    int idx = static_cast<int>(asNumber(index));
+                    int idx = indexOperand(index);
                     if (idx < 0 || idx >= array->length()) {
-                        stackTop_ = stackTop;
-                        std::cerr << "Index " << idx << " out of bounds [0, " << (array->length() - 1) << "]." << std::endl;
-                        return InterpretResult::RuntimeError;
+                        VM_ERROR(INDEX_OUT_OF_BOUNDS, "Index " + std::to_string(idx) + " out of bounds [0, " +
+                                                          std::to_string(array->length() - 1) + "]");
                     }
                     array->set(static_cast<size_t>(idx), value);
-                    gcEphemeralEscape(value);
                     *stackTop++ = value;
-                    break;
+                    VM_NEXT();
                 }
                 if (isHashMap(object)) {
                     auto map = asHashMap(object);
@@ -769,27 +1221,23 @@ InterpretResult VM::run() {
                     } else if (isBool(index)) {
                         key = asBool(index) ? "true" : "false";
                     } else {
-                        stackTop_ = stackTop;
-                        std::cerr << "Hash map index must be string, number, boolean, or nil." << std::endl;
-                        return InterpretResult::RuntimeError;
+                        VM_ERROR(TYPE_MISMATCH, "Hash map index must be a string, number, boolean, or nil");
                     }
                     map->set(key, value);
-                    gcEphemeralEscape(value);
                     *stackTop++ = value;
-                    break;
+                    VM_NEXT();
                 }
-                stackTop_ = stackTop;
-                std::cerr << "Can only index arrays and hash maps." << std::endl;
                 if (gRuntimeFlags.icDiagnostics) {
                     std::cerr << "[IndexDebug] objectTag=" << std::hex << tagBits(object)
                               << " isObj=" << (isObject(object) ? 1 : 0)
                               << " isArr=" << (isArray(object) ? 1 : 0)
                               << " isMap=" << (isHashMap(object) ? 1 : 0)
-                              << " objStr=" << valueToString(object) << std::endl;
+                              << " objStr=" << valueToString(object) << std::dec << std::endl;
                 }
-                return InterpretResult::RuntimeError;
+                VM_ERROR(NOT_INDEXABLE, "Can only index arrays and hash maps");
             }
-            case OpCode::EnsureIndexDefault: {
+            VM_CASE(EnsureIndexDefault): {
+                SYNC_STACK_TOP();
                 uint8_t opTag = READ_BYTE(); // 0:Add,1:Sub,2:Mul,3:Div,4:And,5:Or,6:Xor,7:Shl,8:Shr
                 Value rhs = stackTop[-1];
                 Value index = stackTop[-2];
@@ -813,15 +1261,12 @@ InterpretResult VM::run() {
                     } else if (isBool(index)) {
                         key = asBool(index) ? "true" : "false";
                     } else {
-                        stackTop_ = stackTop;
-                        std::cerr << "Hash map index must be string, number, boolean, or nil." << std::endl;
-                        return InterpretResult::RuntimeError;
+                        VM_ERROR(TYPE_MISMATCH, "Hash map index must be a string, number, boolean, or nil");
                     }
                     Value defaultVal = numberToValue(0.0);
                     if (opTag == 0) { // Add
                         if (isString(rhs)) {
-                            auto sv = StringPool::intern(std::string());
-                            defaultVal = stringValue(sv.data());
+                            defaultVal = internedStringValue("");
                         } else {
                             defaultVal = numberToValue(0.0);
                         }
@@ -831,17 +1276,61 @@ InterpretResult VM::run() {
                     map->ensureDefault(key, defaultVal);
                 }
                 // Arrays: do nothing; regular semantics apply
-                break;
+                VM_NEXT();
+            }
+            VM_CASE(BuildMap): {
+                SYNC_STACK_TOP();
+                // [key1, value1, ..., keyN, valueN] -> [map], keyed like the
+                // interpreter's map literals
+                uint16_t count = READ_SHORT();
+                Value* pairs = stackTop - 2 * count;
+                // Not presized: the bucket count decides the iteration order
+                // keys() and jsonEncode see, which must stay the interpreter's
+                auto map = gcNewHashMap();
+                for (uint16_t i = 0; i < count; i++) {
+                    Value value = pairs[2 * i + 1];
+                    map->set(valueToString(pairs[2 * i]), value);
+                }
+                stackTop = pairs;
+                *stackTop++ = hashMapValue(map);
+                VM_NEXT();
+            }
+            VM_CASE(BuildArray): {
+                SYNC_STACK_TOP();
+                // [e1, ..., eN] -> [array]
+                uint16_t count = READ_SHORT();
+                Value* elements = stackTop - count;
+                auto array = gcNewArrayReserved(count);
+                for (uint16_t i = 0; i < count; i++) array->push(elements[i]);
+                stackTop = elements;
+                *stackTop++ = arrayValue(array);
+                VM_NEXT();
+            }
+            VM_CASE(Interpret): {
+                Stmt* stmt = frame->closure->function->chunk->interpretedStmt(READ_SHORT());
+                stackTop_ = stackTop;
+                bool ok = interpretStatement(stmt);
+                stackTop = stackTop_;
+                frame = &frames_[frameCount_ - 1];
+                if (!ok) VM_THROW();
+                VM_NEXT();
             }
-            case OpCode::EnsurePropertyDefault: {
+            VM_CASE(EnsurePropertyDefault): {
+                SYNC_STACK_TOP();
                 const char* namePtr = READ_STRING_PTR();
                 uint8_t opTag = READ_BYTE();
                 Value rhs = stackTop[-1];
                 Value object = stackTop[-2];
+                // A hash map reads a missing key as nil, which no compound
+                // operator accepts: fail as the interpreter does
+                if (isHashMap(object)) {
+                    if (asHashMap(object)->contains(namePtr)) {
+                        VM_NEXT();
+                    }
+                    VM_ERROR(TYPE_MISMATCH, opTag == 0 ? "Operands must be compatible for +=" : "Operands must be numbers");
+                }
                 if (!isInstance(object)) {
-                    stackTop_ = stackTop;
-                    std::cerr << "Only instances have fields." << std::endl;
-                    return InterpretResult::RuntimeError;
+                    VM_ERROR(RUNTIME_ERROR, "Invalid object for member compound assignment");
                 }
                 auto instance = asInstance(object);
                 Token nameToken(TokenType::Identifier, namePtr, 0);
@@ -849,8 +1338,7 @@ InterpretResult VM::run() {
                     Value defaultVal = numberToValue(0.0);
                     if (opTag == 0) {
                         if (isString(rhs)) {
-                            auto sv = StringPool::intern(std::string());
-                            defaultVal = stringValue(sv.data());
+                            defaultVal = internedStringValue("");
                         } else {
                             defaultVal = numberToValue(0.0);
                         }
@@ -858,25 +1346,48 @@ InterpretResult VM::run() {
                         defaultVal = numberToValue(0.0);
                     }
                     instance->set(nameToken, defaultVal);
-                    gcEphemeralEscapeDeep(defaultVal);
                 }
-                break;
+                VM_NEXT();
             }
 
+#ifdef CLAW_COMPUTED_GOTO
+            op_Unknown:
+#endif
             default:
                 stackTop_ = stackTop;
                 std::cerr << "Unknown opcode " << static_cast<unsigned>(instruction) << std::endl;
                 return InterpretResult::RuntimeError;
         }
         stackTop_ = stackTop;
+        continue;
+
+        // A handler took the error; throwError() has moved its frame's ip to
+        // the catch block and left the error value on the stack.
+    caught:
+        frame = &frames_[frameCount_ - 1];
+        stackTop = stackTop_;
     }
 
 #undef READ_BYTE
 #undef READ_CONSTANT
 #undef READ_STRING_PTR
-#undef BINARY_OP
+#undef VM_THROW
+#undef VM_ERROR
+#undef NUMERIC_OP
 #undef COMPARE_OP
+#undef SYNC_STACK_TOP
+#undef SAFEPOINT_POLL
+#undef QUICKEN
+#undef DEQUICKEN
+#undef VM_CASE
+#undef VM_NEXT
+#ifdef CLAW_COMPUTED_GOTO
+#undef VM_TARGET
+#endif
 }
+#ifdef CLAW_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
 
 bool VM::osrEnter(const uint8_t* ip) {
     if (frameCount_ <= 0) return false;
@@ -885,10 +1396,10 @@ bool VM::osrEnter(const uint8_t* ip) {
 }
 
 bool VM::call(VMClosure* closure, int argCount) {
-    auto& fc = functionHotness_[closure->function.get()];
-    fc++;
+    InlineCacheTable* caches = cacheTableFor(closure->function);
+    caches->hotness++;
 #ifdef CLAW_ENABLE_JIT
-    if (fc.load() >= (jitConfig_.aggressive ? std::max(1u, jitConfig_.functionThreshold / 4) : jitConfig_.functionThreshold)) {
+    if (caches->hotness >= (jitConfig_.aggressive ? std::max(1u, jitConfig_.functionThreshold / 4) : jitConfig_.functionThreshold)) {
         if (!jit_.hasBaseline(closure->function.get())) {
             std::vector<JitEntry> entries;
             entries.push_back({closure->function->chunk->code().data(), nullptr, JitTier::Baseline});
@@ -897,99 +1408,501 @@ bool VM::call(VMClosure* closure, int argCount) {
     }
 #endif
     if (closure->function->arity != -1 && argCount != closure->function->arity) {
-        std::cerr << "Expected " << closure->function->arity
-                  << " arguments but got " << argCount << "." << std::endl;
-        return false;
+        return runtimeError(ErrorCode::ARGUMENT_COUNT_MISMATCH, "Expected " + std::to_string(closure->function->arity) +
+                                                                    " arguments but got " + std::to_string(argCount));
+    }
+    // Growth is only checked here, so the handlers never test for room
+    if (frameCount_ == static_cast<int>(frames_.size())) {
+        if (frameCount_ >= gRuntimeFlags.vmMaxFrames) {
+            return runtimeError(ErrorCode::STACK_OVERFLOW, "Stack overflow: Maximum call depth exceeded");
+        }
+        frames_.resize(std::min(frames_.size() * 2, static_cast<size_t>(gRuntimeFlags.vmMaxFrames)));
     }
-    if (frameCount_ >= FRAMES_MAX) {
-        std::cerr << "Stack overflow." << std::endl;
+    // The frame gets all the room its code can use, counted from the callee
+    int needed = closure->function->chunk->maxStackDepth() - argCount - 1;
+    if (stackEnd_ - stackTop_ < needed && !growStack(needed)) {
         return false;
     }
     CallFrame frame;
     frame.closure = closure;
     frame.ip = frame.closure->function->chunk->code().data();
     frame.slots = stackTop_ - argCount - 1;
+    frame.caches = caches;
     frames_[frameCount_++] = frame;
-    gcEphemeralFrameEnter();
     return true;
 }
 
 bool VM::callValue(Value callee, int argCount) {
     if (isVMClosure(callee)) {
-        auto closure = asVMClosurePtr(callee);
+        auto closure = asVMClosure(callee);
         if (!closure) {
-            std::cerr << "Invalid closure." << std::endl;
-            return false;
+            return runtimeError(ErrorCode::RUNTIME_ERROR, "Invalid closure");
         }
         return call(closure, argCount);
     }
     if (isVMFunction(callee)) {
-        auto closure = std::make_shared<VMClosure>();
-        closure->function = asVMFunction(callee);
-        closure->upvalues.resize(closure->function->upvalueCount);
+        auto closure = VMClosure::create(shareObject(asVMFunction(callee)));
         vmClosureValue(closure);
         return call(closure.get(), argCount);
     }
+    if (isVMBoundMethod(callee)) {
+        VMBoundMethod* bound = asVMBoundMethod(callee);
+        stackTop_[-argCount - 1] = bound->receiver;
+        return call(bound->method, argCount);
+    }
+    if (isClass(callee)) {
+        // Compiled classes construct here, with the new instance in the
+        // callee slot as init's receiver. A class with an interpreter init is
+        // left to ClawClass::call below.
+        static const char* const initName = StringPool::intern("init").data();
+        auto klass = asClass(callee);
+        VMClosure* initializer = klass->findVMMethod(initName);
+        if (initializer || !klass->findInternedMethod(initName)) {
+            stackTop_[-argCount - 1] = instanceValue(gcNewInstance(shareObject(klass)));
+            if (initializer) return call(initializer, argCount);
+            if (argCount != 0) {
+                return runtimeError(ErrorCode::ARGUMENT_COUNT_MISMATCH,
+                                    "Expected 0 arguments but got " + std::to_string(argCount));
+            }
+            return true;
+        }
+    }
     if (!isCallable(callee) && !isClass(callee)) {
-        std::cerr << "Can only call functions and classes." << std::endl;
-        return false;
+        return runtimeError(ErrorCode::NOT_CALLABLE, "Can only call functions and classes");
     }
     if (!interpreter_) {
-        std::cerr << "VM Call opcode requires interpreter context." << std::endl;
-        return false;
+        return runtimeError(ErrorCode::RUNTIME_ERROR, "VM Call opcode requires interpreter context");
     }
     std::shared_ptr<Callable> function;
     if (isClass(callee)) {
-        function = std::static_pointer_cast<Callable>(asClass(callee));
+        function = shareObject(asClass(callee));
     } else {
-        function = asCallable(callee);
+        function = shareObject(asCallable(callee));
+        if (auto native = dynamic_cast<NativeFunction*>(function.get()); native && native->fast()) {
+            return callNative(*native, argCount);
+        }
     }
     if (function->arity() != -1 && argCount != function->arity()) {
-        std::cerr << "Expected " << function->arity()
-                  << " arguments but got " << argCount << "." << std::endl;
-        return false;
+        return runtimeError(ErrorCode::ARGUMENT_COUNT_MISMATCH, "Expected " + std::to_string(function->arity()) +
+                                                                    " arguments but got " + std::to_string(argCount));
     }
-    gcEphemeralFrameEnter();
     std::vector<Value> arguments;
     arguments.reserve(argCount);
     for (int i = 0; i < argCount; i++) {
         arguments.push_back(stackTop_[-argCount + i]);
     }
-    Value result = function->call(*interpreter_, arguments);
-    gcEphemeralEscapeDeep(result);
-    gcEphemeralFrameLeave();
+    GCRootScope roots;
+    // Errors from natives and interpreted callees become VM errors, carrying
+    // the same value the interpreter's catch would see
+    Value result;
+    try {
+        result = function->call(*interpreter_, arguments);
+    } catch (const VMError& e) {
+        pendingError(e.what(), e.report, e.code);
+        return raisedAt(e.line, e.column, e.trace);
+    } catch (const RuntimeError& e) {
+        runtimeError(e.code, e.what());
+        return raisedAt(e.token.line, e.token.column, e.stack_trace);
+    } catch (const std::exception& e) {
+        return pendingError(e.what(), e.what());
+    }
     stackTop_ -= (argCount + 1);
     *stackTop_++ = result;
     return true;
 }
 
-std::shared_ptr<VMUpvalue> VM::captureUpvalue(Value* local) {
-    for (auto& upvalue : openUpvalues_) {
-        if (upvalue->location == local) {
-            gcEphemeralEscape(*local);
-            return upvalue;
+// Calls a fast native on the arguments where they sit on the stack. Nothing
+// is copied and no call stack entry is pushed; the signature is checked here
+// once so the native can read its operands unchecked. A method native takes
+// its receiver as its first argument, from the slot a plain call keeps the
+// callee in.
+bool VM::callNative(const NativeFunction& native, int argCount, bool method) {
+    const NativeSignature& signature = native.signature();
+    int argc = argCount + method;
+    if (signature.arity != -1 && argc != signature.arity) {
+        return runtimeError(ErrorCode::ARGUMENT_COUNT_MISMATCH, "Expected " + std::to_string(signature.arity - method) +
+                                                                    " arguments but got " + std::to_string(argCount));
+    }
+    const Value* args = stackTop_ - argc;
+    if (!signature.accepts(args, argc)) {
+        return pendingError(signature.typeError, signature.typeError);
+    }
+    Value result;
+    GCRootScope roots;
+    try {
+        result = native.fast()(*interpreter_, args, argc);
+    } catch (const VMError& e) {
+        pendingError(e.what(), e.report, e.code);
+        return raisedAt(e.line, e.column, e.trace);
+    } catch (const RuntimeError& e) {
+        runtimeError(e.code, e.what());
+        return raisedAt(e.token.line, e.token.column, e.stack_trace);
+    } catch (const std::exception& e) {
+        return pendingError(e.what(), e.what());
+    }
+    stackTop_ -= (argCount + 1);
+    *stackTop_++ = result;
+    return true;
+}
+
+// Records an error as the string Interpreter::visitTryStmt binds in a catch
+// block. The report printed when nothing catches it is the message, as the
+// interpreter prints its own.
+bool VM::runtimeError(ErrorCode code, const std::string& message) {
+    return pendingError(errorCodeToString(code) + ": " + message, message, code);
+}
+
+bool VM::pendingError(std::string value, std::string report, ErrorCode code) {
+    errorValue_ = std::move(value);
+    errorReport_ = std::move(report);
+    errorCode_ = code;
+    errorLine_ = 0;
+    errorColumn_ = 0;
+    errorTrace_.clear();
+    return false;
+}
+
+// Places the pending error where code the VM did not run raised it. A line
+// of 0 leaves it at the failing instruction.
+bool VM::raisedAt(int line, int column, std::vector<StackFrame> trace) {
+    errorLine_ = line;
+    errorColumn_ = line > 0 ? column : 0;
+    errorTrace_ = std::move(trace);
+    return false;
+}
+
+// Unwinds to the innermost handler whose range covers the failing
+// instruction of some frame. Frames above it are popped with their upvalues
+// closed, its stack is cut back to the depth of the try and the error value
+// is pushed for the catch block. Without a handler nothing is unwound and the
+// error is reported.
+bool VM::throwError() {
+    for (int i = frameCount_ - 1; i >= baseFrame_; i--) {
+        const Chunk& chunk = *frames_[i].closure->function->chunk;
+        if (chunk.exceptionHandlers().empty()) continue;
+        size_t offset = static_cast<size_t>(frames_[i].ip - chunk.code().data()) - 1;
+        const ExceptionHandler* handler = chunk.findExceptionHandler(offset);
+        if (!handler) continue;
+        while (frameCount_ - 1 > i) {
+            closeUpvalues(frames_[frameCount_ - 1].slots);
+            frameCount_--;
+        }
+        CallFrame& frame = frames_[i];
+        Value* base = frame.slots + handler->stackDepth;
+        closeUpvalues(base);
+        releaseScoped(base);
+        stackTop_ = base;
+        *stackTop_++ = newStringValue(errorValue_);
+        frame.ip = chunk.code().data() + handler->handler;
+        return true;
+    }
+    // Inside a host call the error leaves as a VMError and is reported, if
+    // at all, by whoever catches it last
+    if (hostCalls_ == 0) reportError();
+    return false;
+}
+
+// Ends the run for the error a safepoint recorded. No catch block sees it:
+// an interrupt or IDS stop must not be swallowed by the script it stops.
+InterpretResult VM::stopAtSafepoint() {
+    if (hostCalls_ == 0) reportError();
+    return InterpretResult::RuntimeError;
+}
+
+// Replaces *object with its member name as the interpreter reads it. Only
+// arrays and hash maps get here; their members are natives bound to them.
+bool VM::getHostMember(Value* object, const char* name) {
+    if (!isArray(*object) && !isHashMap(*object) && !isStringBuilder(*object)) {
+        return runtimeError(ErrorCode::NOT_INDEXABLE, "Only arrays, hash maps, and class instances have members");
+    }
+    GCRootScope roots;
+    try {
+        *object = interpreter_->getMember(*object, name, Token(TokenType::Identifier, name, 0));
+    } catch (const RuntimeError& e) {
+        return runtimeError(e.code, e.what());
+    }
+    return true;
+}
+
+// Runs a statement the compiler left to the interpreter, in the globals the
+// VM shares with it. Its errors become VM errors with the value the
+// interpreter's own catch would have bound.
+bool VM::interpretStatement(Stmt* stmt) {
+    try {
+        interpreter_->execute(stmt);
+    } catch (const VMError& e) {
+        pendingError(e.what(), e.report, e.code);
+        return raisedAt(e.line, e.column, e.trace);
+    } catch (const RuntimeError& e) {
+        runtimeError(e.code, e.what());
+        return raisedAt(e.token.line, e.token.column, e.stack_trace);
+    } catch (const ClawError& e) {
+        return runtimeError(e.code, e.what());
+    } catch (const std::exception& e) {
+        return pendingError(e.what(), e.what());
+    }
+    return true;
+}
+
+// The interpreter's foreign call hook. A compiled callee runs to completion
+// in a nested run above the frames already live. An error it does not catch
+// unwinds its frames and is rethrown to the interpreter as a VMError.
+bool VM::callFromHost(Value callee, const std::vector<Value>& arguments, Value* result) {
+    static const char* const initName = StringPool::intern("init").data();
+    bool compiled = isVMClosure(callee) || isVMFunction(callee) || isVMBoundMethod(callee) ||
+                    (isClass(callee) && asClass(callee)->findVMMethod(initName));
+    if (!compiled) return false;
+
+    size_t base = static_cast<size_t>(stackTop_ - stack_);
+    int frameCount = frameCount_;
+    bool ok = stackEnd_ - stackTop_ > static_cast<std::ptrdiff_t>(arguments.size()) ||
+              growStack(arguments.size() + 1);
+    if (ok) {
+        *stackTop_++ = callee;
+        for (Value argument : arguments) *stackTop_++ = argument;
+        ok = callValue(callee, static_cast<int>(arguments.size()));
+    }
+    if (ok && frameCount_ > frameCount) {
+        int baseFrame = baseFrame_;
+        baseFrame_ = frameCount;
+        hostCalls_++;
+        ok = run() == InterpretResult::Ok;
+        hostCalls_--;
+        baseFrame_ = baseFrame;
+    }
+    if (!ok) {
+        int line = 0;
+        int column = 0;
+        errorPosition(frameCount, &line, &column);
+        std::vector<StackFrame> trace = errorFrames(frameCount);
+        while (frameCount_ > frameCount) {
+            closeUpvalues(frames_[frameCount_ - 1].slots);
+            releaseScoped(frames_[frameCount_ - 1].slots + 1);
+            frameCount_--;
         }
+        stackTop_ = stack_ + base;
+        throw VMError(errorValue_, errorReport_, errorCode_, line, column, std::move(trace));
+    }
+    *result = stackTop_[-1];
+    stackTop_ = stack_ + base;
+    gcRootValue(*result);
+    return true;
+}
+
+// Replaces *receiver with the method name of superclass bound to it. The
+// superclass may have been defined by the interpreter, whose methods bind
+// the way ClawInstance::get binds them.
+bool VM::bindSuperMethod(const ClawClass& superclass, const char* name, Value* receiver) {
+    if (VMClosure* method = superclass.findVMMethod(name)) {
+        *receiver = boundMethodValue(*receiver, method);
+        return true;
+    }
+    auto method = superclass.findInternedMethod(name);
+    if (!method || !isInstance(*receiver)) {
+        return runtimeError(ErrorCode::RUNTIME_ERROR, "Undefined property '" + std::string(name) + "'.");
+    }
+    *receiver = callableValue(method->bind(shareObject(asInstance(*receiver))));
+    return true;
+}
+
+// Where the pending error was raised: where interpreted code or a nested run
+// put it, else at the instruction that failed in the innermost frame at or
+// above frame first. Both stay 0 when there is none.
+void VM::errorPosition(int first, int* line, int* column) const {
+    if (errorLine_ > 0) {
+        *line = errorLine_;
+        *column = errorColumn_;
+    } else if (frameCount_ > first) {
+        const CallFrame& frame = frames_[frameCount_ - 1];
+        const Chunk& chunk = *frame.closure->function->chunk;
+        int offset = std::max(0, static_cast<int>(frame.ip - chunk.code().data()) - 1);
+        *line = chunk.getLine(offset);
+        *column = chunk.getColumn(offset);
+    }
+}
+
+// The function calls the pending error passed through from frame first up,
+// outermost first, each at its declaration line as the interpreter's call
+// stack has them. Top-level code is not a call.
+std::vector<StackFrame> VM::errorFrames(int first) const {
+    std::vector<StackFrame> trace;
+    for (int i = first; i < frameCount_; i++) {
+        const VMFunction& function = *frames_[i].closure->function;
+        if (function.name != "<script>") trace.emplace_back(function.name, function.line);
+    }
+    trace.insert(trace.end(), errorTrace_.begin(), errorTrace_.end());
+    return trace;
+}
+
+// Prints the pending error the way printRuntimeError in main.cpp prints the
+// interpreter's
+void VM::reportError() const {
+    int line = 0;
+    int column = 0;
+    errorPosition(0, &line, &column);
+    std::cerr << "❌ " << errorCodeToString(errorCode_) << ": Runtime Error [Line " << line << ", Col " << column
+              << "]: " << errorReport_ << "\n";
+    std::vector<StackFrame> trace = errorFrames(0);
+    if (!trace.empty()) {
+        std::cerr << "Stack trace:\n";
+        for (auto it = trace.rbegin(); it != trace.rend(); ++it) {
+            std::cerr << "  at " << it->function_name << " (" << it->line << ")\n";
+        }
+    }
+    std::cerr.flush();
+}
+
+// Grows the value stack so that at least needed slots are free above the
+// top. Frame slots and open upvalues point into the stack and are moved to
+// the new storage; callers reload any stack pointer they cached.
+bool VM::growStack(size_t needed) {
+    size_t used = static_cast<size_t>(stackTop_ - stack_);
+    size_t required = used + needed;
+    if (required > gRuntimeFlags.vmMaxStackSlots) {
+        return runtimeError(ErrorCode::STACK_OVERFLOW, "Stack overflow: Maximum call depth exceeded");
+    }
+    size_t capacity = std::min(std::max(required, stackStorage_.size() * 2), gRuntimeFlags.vmMaxStackSlots);
+    std::vector<Value> storage(capacity);
+    std::copy(stack_, stackTop_, storage.begin());
+    Value* base = storage.data();
+    for (int i = 0; i < frameCount_; i++) {
+        frames_[i].slots = base + (frames_[i].slots - stack_);
+    }
+    for (VMUpvalue* upvalue = openUpvalues_; upvalue; upvalue = upvalue->next) {
+        upvalue->location = base + (upvalue->location - stack_);
+    }
+    stackStorage_.swap(storage);
+    stack_ = base;
+    stackEnd_ = base + capacity;
+    stackTop_ = base + used;
+    return true;
+}
+
+Value* VM::bindGlobal(int slot) {
+    // Chunks compiled after interpret() began, such as fallback code or
+    // another VM's, may use slots registered since globalSlots_ was sized
+    if (static_cast<size_t>(slot) >= globalSlots_.size()) {
+        globalSlots_.resize(GlobalTable::getInstance().size(), nullptr);
+    }
+    Value* binding = globals_->slot(GlobalTable::getInstance().name(slot));
+    globalSlots_[slot] = binding;
+    return binding;
+}
+
+VM::InlineCacheTable* VM::cacheTableFor(const std::shared_ptr<VMFunction>& function) {
+    auto [it, inserted] = cacheTables_.try_emplace(function.get());
+    InlineCacheTable& table = it->second;
+    if (inserted) {
+        const Chunk& chunk = *function->chunk;
+        table.function = function;
+        table.properties.resize(chunk.cacheSlotCount(CacheKind::Property));
+        table.calls.resize(chunk.cacheSlotCount(CacheKind::Call));
+        table.invokes.resize(chunk.cacheSlotCount(CacheKind::Invoke));
+        table.loops.resize(chunk.cacheSlotCount(CacheKind::Loop));
+    }
+    return &table;
+}
+
+// Finds the table of the function whose bytecode contains ip, trying the
+// innermost frame first.
+VM::InlineCacheTable* VM::cacheTableAt(const uint8_t* ip) {
+    return const_cast<InlineCacheTable*>(static_cast<const VM*>(this)->cacheTableAt(ip));
+}
+
+const VM::InlineCacheTable* VM::cacheTableAt(const uint8_t* ip) const {
+    auto contains = [ip](const InlineCacheTable& table) {
+        const auto& code = table.function->chunk->code();
+        return ip >= code.data() && ip < code.data() + code.size();
+    };
+    if (frameCount_ > 0 && frames_[frameCount_ - 1].caches && contains(*frames_[frameCount_ - 1].caches)) {
+        return frames_[frameCount_ - 1].caches;
+    }
+    for (const auto& [function, table] : cacheTables_) {
+        if (contains(table)) return &table;
+    }
+    return nullptr;
+}
+
+// Returns the open upvalue for local, creating it in its place on the list,
+// which is kept in descending slot order so closing stops at the first
+// upvalue below the cut.
+VMUpvalue* VM::captureUpvalue(Value* local) {
+    VMUpvalue* prev = nullptr;
+    VMUpvalue* upvalue = openUpvalues_;
+    while (upvalue && upvalue->location > local) {
+        prev = upvalue;
+        upvalue = upvalue->next;
+    }
+    if (upvalue && upvalue->location == local) return upvalue;
+    VMUpvalue* created = gcNewUpvalue(local);
+    created->refs = 1; // the open list's reference
+    created->next = upvalue;
+    if (prev) {
+        prev->next = created;
+    } else {
+        openUpvalues_ = created;
     }
-    auto created = std::make_shared<VMUpvalue>();
-    created->location = local;
-    openUpvalues_.push_back(created);
-    gcEphemeralEscape(*local);
     return created;
 }
 
 void VM::closeUpvalues(Value* last) {
-    for (auto& upvalue : openUpvalues_) {
-        if (upvalue->location >= last) {
-            upvalue->closed = *upvalue->location;
-            upvalue->location = &upvalue->closed;
+    while (openUpvalues_ && openUpvalues_->location >= last) {
+        VMUpvalue* upvalue = openUpvalues_;
+        upvalue->closed = *upvalue->location;
+        upvalue->location = &upvalue->closed;
+        gcBarrierUpvalue(upvalue, nilValue(), upvalue->closed);
+        openUpvalues_ = upvalue->next;
+        upvalue->next = nullptr;
+        gcReleaseUpvalue(upvalue);
+    }
+}
+
+// Room for size bytes in the frame region, released with slot
+uint8_t* VM::allocateScoped(size_t size, Value* slot) {
+    // Rounded up so every object in a block stays pointer aligned
+    size = (size + 15) & ~static_cast<size_t>(15);
+    ScopedAllocation allocation{nullptr, static_cast<size_t>(slot - stack_), scopedBlock_, scopedOffset_};
+    if (scopedBlock_ == scopedBlocks_.size() || scopedOffset_ + size > SCOPED_BLOCK_SIZE) {
+        if (scopedBlock_ < scopedBlocks_.size()) scopedBlock_++;
+        scopedOffset_ = 0;
+        if (scopedBlock_ == scopedBlocks_.size()) {
+            scopedBlocks_.push_back(std::make_unique<uint8_t[]>(SCOPED_BLOCK_SIZE));
         }
     }
-    openUpvalues_.erase(
-        std::remove_if(openUpvalues_.begin(), openUpvalues_.end(),
-                       [last](const std::shared_ptr<VMUpvalue>& upvalue) {
-                           return upvalue->location == &upvalue->closed;
-                       }),
-        openUpvalues_.end());
+    uint8_t* memory = scopedBlocks_[scopedBlock_].get() + scopedOffset_;
+    scopedOffset_ += size;
+    scopedObjects_.push_back(allocation);
+    return memory;
+}
+
+VMClosure* VM::allocateScopedClosure(std::shared_ptr<VMFunction> function, Value* slot) {
+    uint8_t* memory = allocateScoped(VMClosure::allocationSize(function->upvalueCount), slot);
+    VMClosure* closure = VMClosure::createAt(memory, std::move(function));
+    scopedObjects_.back().object = closure;
+    return closure;
+}
+
+ClawArray* VM::allocateScopedArray(const Value* elements, size_t count, Value* slot) {
+    auto* array = new (allocateScoped(sizeof(ClawArray), slot)) ClawArray(std::vector<Value>(elements, elements + count));
+    scopedObjects_.back().object = array;
+    return array;
+}
+
+// Frees the scoped objects in slots at or above last, newest first, and
+// rewinds the bump pointer to where the oldest of them was allocated.
+void VM::releaseScoped(Value* last) {
+    size_t slot = static_cast<size_t>(last - stack_);
+    while (!scopedObjects_.empty() && scopedObjects_.back().slot >= slot) {
+        const ScopedAllocation& top = scopedObjects_.back();
+        if (top.object->type == ObjectType::Array) {
+            static_cast<ClawArray*>(top.object)->~ClawArray();
+        } else {
+            static_cast<VMClosure*>(top.object)->~VMClosure();
+        }
+        scopedBlock_ = top.block;
+        scopedOffset_ = top.offset;
+        scopedObjects_.pop_back();
+    }
 }
 
 } // namespace claw
@@ -1024,10 +1937,10 @@ bool VM::apiReturn() {
     Value result = pop();
     Value* frameSlots = frame.slots;
     closeUpvalues(frame.slots);
-    gcEphemeralEscapeDeep(result);
-    gcEphemeralFrameLeave();
+    releaseScoped(frame.slots + 1);
     frameCount_--;
-    if (frameCount_ == 0) {
+    if (frameCount_ == baseFrame_) {
+        stackTop_ = frameSlots;
         push(result);
         return true;
     }
@@ -1038,52 +1951,51 @@ bool VM::apiReturn() {
 bool VM::apiIsFalsey(Value v) const { return isFalsey(v); }
 void VM::apiDefineGlobal(const char* name, Value v) {
     globals_->define(name, v);
-    globalVersion_++;
-    gcEphemeralEscape(v);
 }
 bool VM::apiGlobalExists(const char* name) const { return globals_->exists(name); }
 Value VM::apiGlobalGet(const char* name) const { return globals_->get(name); }
 void VM::apiGlobalAssign(const char* name, Value v) {
     globals_->assign(name, v);
-    globalVersion_++;
-    gcEphemeralEscape(v);
 }
-void VM::apiBumpGlobalVersion() { globalVersion_++; }
-std::shared_ptr<VMUpvalue> VM::apiCaptureUpvalue(Value* local) { return captureUpvalue(local); }
+void VM::apiBumpGlobalVersion() { std::fill(globalSlots_.begin(), globalSlots_.end(), nullptr); }
+VMUpvalue* VM::apiCaptureUpvalue(Value* local) { return captureUpvalue(local); }
 Value* VM::apiCurrentSlots() { return frames_[frameCount_ - 1].slots; }
-bool VM::apiCallValue(Value callee, int argCount) { return callValue(callee, argCount); }
+bool VM::apiCallValue(Value callee, int argCount) {
+    if (callValue(callee, argCount)) return true;
+    reportError();
+    return false;
+}
 VMClosure* VM::apiCurrentClosure() { return frames_[frameCount_ - 1].closure; }
 void VM::apiCloseTopUpvalue() { closeUpvalues(stackTop_ - 1); pop(); }
 int VM::apiTryGetGlobalCached(const char* name, const uint8_t* siteIp, Value* out) {
-    auto it = globalInlineCache_.find(siteIp);
-    if (it == globalInlineCache_.end()) return 0;
-    const auto& entry = it->second;
-    if (entry.name == name && entry.version == globalVersion_) {
-        *out = entry.value;
-        return 1;
-    }
-    return 0;
+    // siteIp is the GetGlobal opcode: [op][global slot hi][global slot lo]
+    size_t slot = static_cast<size_t>((siteIp[1] << 8) | siteIp[2]);
+    if (slot >= globalSlots_.size() || !globalSlots_[slot]) return 0;
+    if (GlobalTable::getInstance().name(static_cast<int>(slot)) != name) return 0;
+    *out = *globalSlots_[slot];
+    return 1;
 }
 int VM::apiTryGetPropertyCached(Value instanceVal, const char* name, const uint8_t* siteIp, Value* out) {
     if (!isInstance(instanceVal)) return 0;
     auto inst = asInstance(instanceVal);
-    const auto* ptr = inst.get();
-    auto vit = instanceVersions_.find(ptr);
-    uint64_t ver = vit == instanceVersions_.end() ? 0 : vit->second;
-    auto pit = propertyInlineCache_.find(siteIp);
-    if (pit == propertyInlineCache_.end()) return 0;
-    for (auto& e : pit->second) {
-        if (e.instance == ptr && e.name == name && e.version == ver) {
-            *out = e.value;
+    // siteIp is the GetProperty opcode: [op][name][slot hi][slot lo]
+    auto* table = cacheTableAt(siteIp);
+    if (!table) return 0;
+    const auto& cache = table->properties[(siteIp[2] << 8) | siteIp[3]];
+    for (uint8_t i = 0; i < cache.count; i++) {
+        const auto& e = cache.entries[i];
+        if (e.shape == inst->shape()) {
+            *out = inst->slot(e.slot);
             return 1;
         }
     }
     return 0;
 }
 int VM::apiTryCallCached(const uint8_t* siteIp, uint8_t argCount) {
-    auto it = callInlineCache_.find(siteIp);
-    if (it == callInlineCache_.end()) return 0;
-    auto& entry = it->second;
+    // siteIp is the Call argument count operand: [argc][slot hi][slot lo]
+    auto* table = cacheTableAt(siteIp);
+    if (!table) return 0;
+    const auto& entry = table->calls[(siteIp[1] << 8) | siteIp[2]];
     Value callee = apiPeek(argCount);
     if (entry.callee == asObjectPtr(callee) && entry.closure) {
         if (!call(entry.closure, argCount)) return 0;
@@ -1092,15 +2004,28 @@ int VM::apiTryCallCached(const uint8_t* siteIp, uint8_t argCount) {
     return 0;
 }
 uint32_t VM::apiGetFunctionHotness(const VMFunction* fn) {
-    auto it = functionHotness_.find(fn);
-    if (it == functionHotness_.end()) return 0;
-    return it->second.load();
+    auto it = cacheTables_.find(fn);
+    if (it == cacheTables_.end()) return 0;
+    return it->second.hotness;
 }
 uint32_t VM::apiGetLoopHotness(const uint8_t* ip) {
-    auto it = loopHotness_.find(ip);
-    if (it == loopHotness_.end()) return 0;
-    return it->second.load();
+    // ip follows the Loop offset operand: [slot hi][slot lo]
+    auto* table = cacheTableAt(ip);
+    if (!table) return 0;
+    return table->loops[(ip[0] << 8) | ip[1]];
+}
+#ifndef CLAW_DISABLE_IC_DIAGNOSTICS
+uint32_t VM::apiGetPropertyMisses(const uint8_t* siteIp) const {
+    auto* table = cacheTableAt(siteIp);
+    if (!table) return 0;
+    return table->properties[(siteIp[2] << 8) | siteIp[3]].misses;
+}
+bool VM::apiIsPropertyMegamorphic(const uint8_t* siteIp) const {
+    auto* table = cacheTableAt(siteIp);
+    if (!table) return false;
+    return table->properties[(siteIp[2] << 8) | siteIp[3]].megamorphic;
 }
+#endif
 #ifdef CLAW_ENABLE_JIT
 bool VM::apiHasBaseline(const VMFunction* fn) {
     return jit_.hasBaseline(fn);
@@ -1118,12 +2043,29 @@ void VM::forEachRoot(const std::function<void(Value)>& fn) const {
             while (s < stackTop_) { fn(*s); ++s; }
         }
         if (fr.closure) {
-            for (auto& up : fr.closure->upvalues) {
-                if (up->location) fn(*up->location);
-                fn(up->closed);
+            fn(objectValue(fr.closure));
+            for (int u = 0; u < fr.closure->upvalueCount; u++) {
+                if (const VMUpvalue* up = fr.closure->upvalue(u)) fn(*up->location);
             }
         }
     }
+    // Closures a Call site made for a bare function are held only here
+    for (const auto& [function, table] : cacheTables_) {
+        for (const auto& call : table.calls) {
+            if (call.kind == CallCacheKind::VMFunction && call.closure) fn(objectValue(call.closure));
+        }
+    }
+    // What the closures and arrays in the frame region hold
+    for (const auto& allocation : scopedObjects_) {
+        if (allocation.object->type == ObjectType::Array) {
+            for (Value element : static_cast<const ClawArray*>(allocation.object)->elements()) fn(element);
+            continue;
+        }
+        const auto* closure = static_cast<const VMClosure*>(allocation.object);
+        for (int u = 0; u < closure->upvalueCount; u++) {
+            if (const VMUpvalue* up = closure->upvalue(u)) fn(*up->location);
+        }
+    }
     if (globals_) {
         globals_->forEachValue(fn);
     }
@@ -1194,7 +2136,7 @@ extern "C" void claw_vm_print(claw::VM* vm) {
     else std::cout << claw::valueToString(v) << std::endl;
 }
 extern "C" void claw_vm_get_global(claw::VM* vm) {
-    const char* namePtr = vm->apiReadStringPtr();
+    const char* namePtr = claw::GlobalTable::getInstance().name(vm->apiReadShort());
     if (!vm->apiGlobalExists(namePtr)) {
         std::cerr << "Undefined variable '" << namePtr << "'." << std::endl;
         vm->apiPush(claw::nilValue());
@@ -1204,12 +2146,12 @@ extern "C" void claw_vm_get_global(claw::VM* vm) {
     vm->apiPush(value);
 }
 extern "C" void claw_vm_define_global(claw::VM* vm) {
-    const char* namePtr = vm->apiReadStringPtr();
+    const char* namePtr = claw::GlobalTable::getInstance().name(vm->apiReadShort());
     auto value = vm->apiPop();
     vm->apiDefineGlobal(namePtr, value);
 }
 extern "C" void claw_vm_set_global(claw::VM* vm) {
-    const char* namePtr = vm->apiReadStringPtr();
+    const char* namePtr = claw::GlobalTable::getInstance().name(vm->apiReadShort());
     if (!vm->apiGlobalExists(namePtr)) {
         std::cerr << "Undefined variable '" << namePtr << "'." << std::endl;
         return;
@@ -1224,6 +2166,7 @@ extern "C" int claw_vm_try_get_global_cached(claw::VM* vm, const char* namePtr,
 }
 extern "C" void claw_vm_call(claw::VM* vm) {
     uint8_t argCount = vm->apiReadByte();
+    vm->apiReadShort();
     claw::Value callee = vm->apiPeek(argCount);
     vm->apiCallValue(callee, argCount);
 }
@@ -1234,27 +2177,24 @@ extern "C" void claw_vm_closure(claw::VM* vm) {
         std::cerr << "Expected function constant." << std::endl;
         return;
     }
-    auto closure = std::make_shared<claw::VMClosure>();
-    closure->function = function;
-    closure->upvalues.resize(function->upvalueCount);
+    auto closure = claw::VMClosure::create(claw::shareObject(function));
     for (int i = 0; i < function->upvalueCount; i++) {
         uint8_t isLocal = vm->apiReadByte();
         uint8_t index = vm->apiReadByte();
-        if (isLocal) {
-            closure->upvalues[i] = vm->apiCaptureUpvalue(vm->apiCurrentSlots() + index);
-        } else {
-            closure->upvalues[i] = vm->apiCurrentClosure()->upvalues[index];
-        }
+        closure->setUpvalue(i, isLocal ? vm->apiCaptureUpvalue(vm->apiCurrentSlots() + index)
+                                       : vm->apiCurrentClosure()->upvalue(index));
     }
     vm->apiPush(claw::vmClosureValue(closure));
 }
 extern "C" void claw_vm_get_upvalue(claw::VM* vm) {
     uint8_t slot = vm->apiReadByte();
-    vm->apiPush(*vm->apiCurrentClosure()->upvalues[slot]->location);
+    vm->apiPush(*vm->apiCurrentClosure()->upvalue(slot)->location);
 }
 extern "C" void claw_vm_set_upvalue(claw::VM* vm) {
     uint8_t slot = vm->apiReadByte();
-    *vm->apiCurrentClosure()->upvalues[slot]->location = vm->apiPeek(0);
+    claw::VMUpvalue* upvalue = vm->apiCurrentClosure()->upvalue(slot);
+    claw::gcBarrierUpvalue(upvalue, *upvalue->location, vm->apiPeek(0));
+    *upvalue->location = vm->apiPeek(0);
 }
 extern "C" void claw_vm_close_upvalue(claw::VM* vm) {
     vm->apiCloseTopUpvalue();
@@ -1265,6 +2205,7 @@ extern "C" int claw_vm_osr_enter(claw::VM* vm, const uint8_t* ip) {
 extern "C" bool claw_vm_return(claw::VM* vm) { return vm->apiReturn(); }
 extern "C" void claw_vm_get_property(claw::VM* vm) {
     const char* namePtr = vm->apiReadStringPtr();
+    vm->apiReadShort();
     claw::Value instanceVal = vm->apiPeek();
     if (!claw::isInstance(instanceVal)) {
         std::cerr << "Only instances have properties." << std::endl;
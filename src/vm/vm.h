@@ -5,9 +5,13 @@
 #include <unordered_set>
 #include <atomic>
 #include <array>
+#include <stdexcept>
 #include "chunk.h"
+#include "safepoint.h"
 #include "interpreter/value.h"
 #include "interpreter/environment.h"
+#include "interpreter/errors.h"
+#include "interpreter/stack_trace.h"
 #ifdef CLAW_ENABLE_JIT
 #include "jit/jit.h"
 #endif
@@ -15,6 +19,8 @@
 namespace claw {
 
 class Interpreter;
+class NativeFunction;
+class Shape;
 
 struct RuntimeFlags {
     bool disableCallIC = false;
@@ -22,9 +28,31 @@ struct RuntimeFlags {
     bool idsEnabled = false;
     int idsStackMax = 64;
     uint64_t idsAllocRateMax = 0;
+    bool forceSwitchDispatch = false; // use the portable switch loop even when threaded dispatch is built
+    bool disableQuickening = false;   // keep generic Add/Less/GetIndex instead of rewriting them in place
+    uint32_t safepointInterval = 1024;        // safepoint polls between periodic IDS checks and GC steps
+    int vmMaxFrames = 100000;                 // call depth at which the VM reports a stack overflow
+    size_t vmMaxStackSlots = size_t(1) << 22; // value stack size at which the VM reports a stack overflow
+    double gcMaxPauseMs = 1.0;                // longest incremental full-collection step; 0 collects in one pause
 };
 extern RuntimeFlags gRuntimeFlags;
 
+// An error leaving the VM through a call made by the interpreter. what() is
+// the value a catch block receives; report is printed if nothing catches it,
+// at line and column and with the frames it unwound, outermost first.
+class VMError : public std::runtime_error {
+public:
+    VMError(const std::string& value, std::string report, ErrorCode code = ErrorCode::RUNTIME_ERROR, int line = 0,
+            int column = 0, std::vector<StackFrame> trace = {})
+        : std::runtime_error(value), report(std::move(report)), code(code), line(line), column(column),
+          trace(std::move(trace)) {}
+    std::string report;
+    ErrorCode code;
+    int line;
+    int column;
+    std::vector<StackFrame> trace;
+};
+
 enum class InterpretResult {
     Ok,
     CompileError,
@@ -40,48 +68,111 @@ public:
     explicit VM(Interpreter& interpreter);
     ~VM();
 
-    static constexpr int STACK_MAX = 256;
-    static constexpr int FRAMES_MAX = 64;
+    // Initial sizes of the value and frame stacks; both grow on demand up to
+    // gRuntimeFlags.vmMaxStackSlots and gRuntimeFlags.vmMaxFrames.
+    static constexpr int STACK_INITIAL = 1024;
+    static constexpr int FRAMES_INITIAL = 64;
 
     InterpretResult interpret(const Chunk& chunk);
     bool osrEnter(const uint8_t* ip);
 
+    // Live closures and arrays in the frame region and the blocks it has allocated
+    size_t scopedObjectCount() const { return scopedObjects_.size(); }
+    size_t scopedRegionBlocks() const { return scopedBlocks_.size(); }
+
 private:
-    struct CallFrame {
-        VMClosure* closure;
-        const uint8_t* ip;
-        Value* slots;
-    };
-    struct GlobalInlineCache {
-        const char* name;
-        uint64_t version;
-        Value value;
-    };
+    // A field found at a slot of the receiver's shape. Every receiver with
+    // that shape has the field at the same slot; holding the class keeps the
+    // shape alive. Methods are not cached here.
     struct PropertyInlineCacheEntry {
-        const ClawInstance* instance;
-        const char* name;
-        uint64_t version;
-        Value value;
+        const Shape* shape = nullptr;
+        uint32_t slot = 0;
+        std::shared_ptr<ClawClass> owner;
+    };
+    static constexpr int PROPERTY_IC_ENTRIES = 8;
+    struct PropertyInlineCache {
+        std::array<PropertyInlineCacheEntry, PROPERTY_IC_ENTRIES> entries{};
+        uint8_t count = 0;
+        uint8_t next = 0; // oldest entry once the cache is full
+#ifndef CLAW_DISABLE_IC_DIAGNOSTICS
+        uint32_t misses = 0;
+        bool megamorphic = false;
+#endif
     };
     enum class CallCacheKind : uint8_t {
         None,
         VMClosure,
-        VMFunction
+        VMFunction,
+        FastNative
     };
     struct CallInlineCache {
         void* callee = nullptr;
         CallCacheKind kind = CallCacheKind::None;
         VMClosure* closure = nullptr;
+        // Held so the native's address cannot be reused by another callee
+        std::shared_ptr<NativeFunction> native;
+    };
+    // Method resolved by an Invoke site for the last receiver class seen,
+    // and the last shape of that class seen without a field shadowing it.
+    // Holding the class keeps its address, and its shapes, from being reused.
+    struct InvokeInlineCache {
+        std::shared_ptr<ClawClass> klass;
+        const Shape* shape = nullptr;
+        VMClosure* method = nullptr;
+    };
+    // Side tables for one function, indexed by the cache slot operand that the
+    // compiler assigns to each GetProperty/Call/Invoke/Loop instruction.
+    struct InlineCacheTable {
+        std::shared_ptr<VMFunction> function;
+        std::vector<PropertyInlineCache> properties;
+        std::vector<CallInlineCache> calls;
+        std::vector<InvokeInlineCache> invokes;
+        std::vector<uint32_t> loops;
+        uint32_t hotness = 0;
+    };
+    struct CallFrame {
+        VMClosure* closure;
+        const uint8_t* ip;
+        Value* slots;
+        InlineCacheTable* caches;
     };
 
     InterpretResult run();
+    template <bool Threaded> InterpretResult runLoop();
+    bool idsCheck();
+    bool safepoint();
     bool call(VMClosure* closure, int argCount);
+    bool growStack(size_t needed);
+    Value* bindGlobal(int slot);
+    // Storage bound to a global slot, or nullptr until bindGlobal binds it
+    Value* boundGlobal(uint16_t slot) const { return slot < globalSlots_.size() ? globalSlots_[slot] : nullptr; }
+    InlineCacheTable* cacheTableFor(const std::shared_ptr<VMFunction>& function);
+    InlineCacheTable* cacheTableAt(const uint8_t* ip);
+    const InlineCacheTable* cacheTableAt(const uint8_t* ip) const;
     bool callValue(Value callee, int argCount);
-    std::shared_ptr<VMUpvalue> captureUpvalue(Value* local);
+    bool callNative(const NativeFunction& native, int argCount, bool method = false);
+    bool bindSuperMethod(const ClawClass& superclass, const char* name, Value* receiver);
+    bool getHostMember(Value* object, const char* name);
+    bool interpretStatement(Stmt* stmt);
+    bool callFromHost(Value callee, const std::vector<Value>& arguments, Value* result);
+    bool runtimeError(ErrorCode code, const std::string& message);
+    bool pendingError(std::string value, std::string report, ErrorCode code = ErrorCode::RUNTIME_ERROR);
+    bool raisedAt(int line, int column, std::vector<StackFrame> trace);
+    bool throwError();
+    InterpretResult stopAtSafepoint();
+    void errorPosition(int first, int* line, int* column) const;
+    std::vector<StackFrame> errorFrames(int first) const;
+    void reportError() const;
+    VMUpvalue* captureUpvalue(Value* local);
     void closeUpvalues(Value* last);
+    uint8_t* allocateScoped(size_t size, Value* slot);
+    VMClosure* allocateScopedClosure(std::shared_ptr<VMFunction> function, Value* slot);
+    ClawArray* allocateScopedArray(const Value* elements, size_t count, Value* slot);
+    void releaseScoped(Value* last);
 
     void push(Value value) {
-        if (stackTop_ - stack_ >= STACK_MAX) {
+        if (stackTop_ == stackEnd_ && !growStack(1)) {
+            reportError();
             return;
         }
         *stackTop_++ = value;
@@ -93,36 +184,62 @@ private:
         return stackTop_[-1 - distance];
     }
 
+    // Same truth as the interpreter's: 0, "" and empty collections are false
     bool isFalsey(Value value) const {
-        if (isNil(value)) return true;
         if (isBool(value)) return !asBool(value);
-        return false;
+        if (isNil(value)) return true;
+        return !isTruthy(value);
     }
 
     const Chunk* chunk_;
     const uint8_t* ip_;
-    Value stack_[STACK_MAX];
+    std::vector<Value> stackStorage_;
+    Value* stack_;
+    Value* stackEnd_;
     Value* stackTop_;
-    std::array<CallFrame, FRAMES_MAX> frames_;
+    std::vector<CallFrame> frames_;
     int frameCount_;
-    std::vector<std::shared_ptr<VMUpvalue>> openUpvalues_;
+    // Frames below this belong to an outer run; Return stops when it gets
+    // back here and throwError does not look below it
+    int baseFrame_ = 0;
+    int hostCalls_ = 0; // nested runs started by callFromHost
+    uint32_t safepointCountdown_ = 1;
+    // Error raised by the current instruction: the string a catch block
+    // receives and the message and code printed when no handler takes it
+    std::string errorValue_;
+    std::string errorReport_;
+    ErrorCode errorCode_ = ErrorCode::RUNTIME_ERROR;
+    // Where it was raised when that is not the failing instruction of the
+    // innermost frame: in interpreted code or in a run already unwound
+    int errorLine_ = 0;
+    int errorColumn_ = 0;
+    std::vector<StackFrame> errorTrace_; // frames it left, outermost first
+    VMUpvalue* openUpvalues_; // open upvalues, highest slot first
+    // Frame region for ScopedClosure, ScopedArray and ScopedCallback: the
+    // closures and arrays the compiler proved never outlive their scope or
+    // call, bump-allocated in fixed blocks and never tracked by the GC, which
+    // only traces them. Each sits in a stack slot, so allocation order is slot
+    // order and, like open upvalues, everything at or above a slot is
+    // released together when the slot goes away.
+    static constexpr size_t SCOPED_BLOCK_SIZE = 16 * 1024;
+    struct ScopedAllocation {
+        HeapObject* object; // a VMClosure or a ClawArray
+        size_t slot;  // stack index, stable across growStack
+        size_t block; // bump position before the allocation
+        size_t offset;
+    };
+    std::vector<std::unique_ptr<uint8_t[]>> scopedBlocks_;
+    std::vector<ScopedAllocation> scopedObjects_;
+    size_t scopedBlock_ = 0;
+    size_t scopedOffset_ = 0;
 #ifdef CLAW_ENABLE_JIT
     JitEngine jit_;
 #endif
     
     std::shared_ptr<Environment> globals_;
     Interpreter* interpreter_;
-    uint64_t globalVersion_;
-    std::unordered_map<const uint8_t*, GlobalInlineCache> globalInlineCache_;
-    std::unordered_map<const uint8_t*, std::vector<PropertyInlineCacheEntry>> propertyInlineCache_;
-    std::unordered_map<const ClawInstance*, uint64_t> instanceVersions_;
-    std::unordered_map<const uint8_t*, CallInlineCache> callInlineCache_;
-    std::unordered_map<const VMFunction*, std::atomic<uint32_t>> functionHotness_;
-    std::unordered_map<const uint8_t*, std::atomic<uint32_t>> loopHotness_;
-#ifndef CLAW_DISABLE_IC_DIAGNOSTICS
-    std::unordered_map<const uint8_t*, uint32_t> propertyICMissCount_;
-    std::unordered_set<const uint8_t*> propertyICMegamorphic_;
-#endif
+    std::vector<Value*> globalSlots_; // GlobalTable slot -> storage in globals_, nullptr until bound
+    std::unordered_map<const VMFunction*, InlineCacheTable> cacheTables_;
     const uint8_t* lastPropertySiteIp_ = nullptr;
 #ifdef CLAW_ENABLE_JIT
     JitConfig jitConfig_;
@@ -151,7 +268,7 @@ public:
     Value apiGlobalGet(const char* name) const;
     void apiGlobalAssign(const char* name, Value v);
     void apiBumpGlobalVersion();
-    std::shared_ptr<VMUpvalue> apiCaptureUpvalue(Value* local);
+    VMUpvalue* apiCaptureUpvalue(Value* local);
     Value* apiCurrentSlots();
     bool apiCallValue(Value callee, int argCount);
     VMClosure* apiCurrentClosure();
@@ -166,13 +283,8 @@ public:
 #endif
     const uint8_t* apiGetLastPropertySiteIp() const { return lastPropertySiteIp_; }
 #ifndef CLAW_DISABLE_IC_DIAGNOSTICS
-    uint32_t apiGetPropertyMisses(const uint8_t* siteIp) const {
-        auto it = propertyICMissCount_.find(siteIp);
-        return it == propertyICMissCount_.end() ? 0u : it->second;
-    }
-    bool apiIsPropertyMegamorphic(const uint8_t* siteIp) const {
-        return propertyICMegamorphic_.count(siteIp) > 0;
-    }
+    uint32_t apiGetPropertyMisses(const uint8_t* siteIp) const;
+    bool apiIsPropertyMegamorphic(const uint8_t* siteIp) const;
 #endif
 };
 
@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "parser/optimizer.h"
+
+static claw::Expr* printedExpr(const std::vector<claw::StmtPtr>& program, size_t index) {
+    auto* print = dynamic_cast<claw::PrintStmt*>(program.at(index).get());
+    return print ? print->expr.get() : nullptr;
+}
+
+static claw::LiteralExpr* printedLiteral(const std::vector<claw::StmtPtr>& program, size_t index) {
+    return dynamic_cast<claw::LiteralExpr*>(printedExpr(program, index));
+}
+
+static std::string runInterpreter(std::vector<claw::StmtPtr>& program) {
+    claw::Interpreter interp;
+    std::stringstream ss;
+    auto old = std::cout.rdbuf(ss.rdbuf());
+    try {
+        interp.execute(program);
+    } catch (const claw::RuntimeError& e) {
+        ss << "error: " << e.what() << "\n";
+    }
+    std::cout.rdbuf(old);
+    return ss.str();
+}
+
+static std::string runVM(std::vector<claw::StmtPtr>& program) {
+    claw::Compiler compiler;
+    auto chunk = compiler.compile(program);
+    claw::Interpreter interp;
+    claw::VM vm(interp);
+    std::stringstream ss;
+    auto old = std::cout.rdbuf(ss.rdbuf());
+    vm.interpret(*chunk);
+    std::cout.rdbuf(old);
+    return ss.str();
+}
+
+// Both backends must print the same thing at every level
+static void expectSameAtAllLevels(const std::string& src, const std::string& expected) {
+    for (int level = 0; level <= 2; level++) {
+        auto tree = parseSrc(src);
+        claw::optimizeProgram(tree, level);
+        EXPECT_EQ(runInterpreter(tree), expected) << "tree, level " << level << ": " << src;
+        auto bytecode = parseSrc(src);
+        claw::optimizeProgram(bytecode, level);
+        EXPECT_EQ(runVM(bytecode), expected) << "vm, level " << level << ": " << src;
+    }
+}
+
+TEST(AstOptimizer, FoldsLiteralOperators) {
+    auto program = parseSrc(
+        "print 60 * 60 * 24;"
+        "print \"n=\" + (1 + 2);"
+        "print !\"\";"
+        "print -(4 / 2) < 0 && \"yes\";"
+        "print nil == false;"
+        "print 1 / 0;"
+        "print 1 - \"a\";"
+        "print 5 & 3;");
+    auto stats = claw::optimizeProgram(program, 1);
+
+    ASSERT_NE(printedLiteral(program, 0), nullptr);
+    EXPECT_EQ(printedLiteral(program, 0)->numberValue, 86400);
+    ASSERT_NE(printedLiteral(program, 1), nullptr);
+    EXPECT_EQ(printedLiteral(program, 1)->stringValue, "n=3");
+    ASSERT_NE(printedLiteral(program, 2), nullptr);
+    EXPECT_TRUE(printedLiteral(program, 2)->boolValue);
+    ASSERT_NE(printedLiteral(program, 3), nullptr);
+    EXPECT_EQ(printedLiteral(program, 3)->stringValue, "yes");
+    ASSERT_NE(printedLiteral(program, 4), nullptr);
+    EXPECT_FALSE(printedLiteral(program, 4)->boolValue);
+    // Errors stay for the backend to raise; bitwise operators are not folded
+    EXPECT_EQ(printedLiteral(program, 5), nullptr);
+    EXPECT_EQ(printedLiteral(program, 6), nullptr);
+    EXPECT_EQ(printedLiteral(program, 7), nullptr);
+    EXPECT_GE(stats.folded, 8);
+
+    auto untouched = parseSrc("print 1 + 2;");
+    EXPECT_EQ(claw::optimizeProgram(untouched, 0).total(), 0);
+    EXPECT_EQ(printedLiteral(untouched, 0), nullptr);
+}
+
+TEST(AstOptimizer, RemovesDeadBranchesAndUnreachableCode) {
+    auto program = parseSrc(
+        "if (false) { print 1; }"
+        "if (1 > 2) { print 2; } else { print 3; }"
+        "while (0) { print 4; }"
+        "fn f() { return 5; print 6; }"
+        "print f();");
+    auto stats = claw::optimizeProgram(program, 1);
+    EXPECT_EQ(stats.deadBranches, 3);
+    EXPECT_EQ(stats.unreachable, 1);
+    ASSERT_EQ(program.size(), 3u);
+    EXPECT_NE(dynamic_cast<claw::BlockStmt*>(program[0].get()), nullptr);
+    auto* f = dynamic_cast<claw::FnStmt*>(program[1].get());
+    ASSERT_NE(f, nullptr);
+    EXPECT_EQ(f->body.size(), 1u);
+}
+
+TEST(AstOptimizer, PropagatesOnlyUnassignedSingleDeclarations) {
+    auto program = parseSrc(
+        "let secondsPerDay = 60 * 60 * 24;"
+        "let counter = 1;"
+        "let shadowed = 2;"
+        "fn g(shadowed) { return shadowed; }"
+        "counter = counter + 1;"
+        "print secondsPerDay;"
+        "print counter;"
+        "print shadowed;");
+    auto stats = claw::optimizeProgram(program, 2);
+    EXPECT_EQ(stats.propagated, 1);
+    ASSERT_NE(printedLiteral(program, 5), nullptr);
+    EXPECT_EQ(printedLiteral(program, 5)->numberValue, 86400);
+    EXPECT_EQ(printedLiteral(program, 6), nullptr);
+    EXPECT_EQ(printedLiteral(program, 7), nullptr);
+
+    // Level 1 folds but does not propagate
+    auto folded = parseSrc("let k = 2 * 3; print k;");
+    EXPECT_EQ(claw::optimizeProgram(folded, 1).propagated, 0);
+}
+
+TEST(AstOptimizer, PropagationRespectsScopeAndOrder) {
+    auto program = parseSrc(
+        "fn early() { return later; }"
+        "let later = 7;"
+        "{ let inner = 3; print inner; }"
+        "print inner;");
+    claw::optimizeProgram(program, 2);
+    auto* early = dynamic_cast<claw::FnStmt*>(program[0].get());
+    ASSERT_NE(early, nullptr);
+    auto* ret = dynamic_cast<claw::ReturnStmt*>(early->body[0].get());
+    ASSERT_NE(ret, nullptr);
+    EXPECT_NE(dynamic_cast<claw::VariableExpr*>(ret->value.get()), nullptr);
+    auto* block = dynamic_cast<claw::BlockStmt*>(program[2].get());
+    ASSERT_NE(block, nullptr);
+    EXPECT_NE(printedLiteral(block->statements, 1), nullptr);
+    // Outside the block the name is undefined and must stay an error
+    EXPECT_EQ(printedLiteral(program, 3), nullptr);
+    EXPECT_NE(runInterpreter(program).find("error"), std::string::npos);
+}
+
+TEST(AstOptimizer, InlinesSmallNonRecursiveFunctions) {
+    auto program = parseSrc(
+        "fn square(x) { return x * x; }"
+        "fn fact(n) { return n <= 1 ? 1 : n * fact(n - 1); }"
+        "fn first(a, b) { return a; }"
+        "let y = 4;"
+        "print square(3);"
+        "print square(y);"
+        "print fact(5);"
+        "print first(1, y);"
+        "print square(y + 1);");
+    auto stats = claw::optimizeProgram(program, 2);
+    EXPECT_EQ(stats.inlined, 4);
+    ASSERT_NE(printedLiteral(program, 4), nullptr);
+    EXPECT_EQ(printedLiteral(program, 4)->numberValue, 9);
+    // y is a constant too, so the inlined body folds all the way
+    ASSERT_NE(printedLiteral(program, 5), nullptr);
+    EXPECT_EQ(printedLiteral(program, 5)->numberValue, 16);
+    // Recursive functions are never inlined
+    EXPECT_NE(dynamic_cast<claw::CallExpr*>(printedExpr(program, 6)), nullptr);
+    ASSERT_NE(printedLiteral(program, 7), nullptr);
+    EXPECT_EQ(printedLiteral(program, 7)->numberValue, 1);
+    // y + 1 folds to 5 before the call is considered
+    ASSERT_NE(printedLiteral(program, 8), nullptr);
+    EXPECT_EQ(printedLiteral(program, 8)->numberValue, 25);
+}
+
+TEST(AstOptimizer, DoesNotInlineAcrossBindings) {
+    auto program = parseSrc(
+        "fn before() { return helper(2); }"
+        "fn helper(v) { return v + offset; }"
+        "let offset = 10;"
+        "fn unusedVar(v) { return 1; }"
+        "print helper(1);"
+        "print unusedVar(missing);");
+    auto stats = claw::optimizeProgram(program, 2);
+    // helper reads offset, which is not bound yet where helper is declared,
+    // and dropping the read of missing would hide its error
+    EXPECT_EQ(stats.inlined, 0);
+    EXPECT_NE(dynamic_cast<claw::CallExpr*>(printedExpr(program, 4)), nullptr);
+    EXPECT_NE(dynamic_cast<claw::CallExpr*>(printedExpr(program, 5)), nullptr);
+}
+
+TEST(AstOptimizer, KeepsCallsThatReadVariableArgumentsFirst) {
+    // bump changes x after f's argument was read; inlining would read it late
+    expectSameAtAllLevels(
+        "let x = 1;"
+        "fn bump() { x = 10; return 0; }"
+        "fn f(a) { return bump() + a; }"
+        "print f(x);",
+        "1\n");
+
+    // pick reads a only on one branch, but the call reads nope regardless
+    auto program = parseSrc(
+        "fn pick(c, a) { return c ? a : 0; }"
+        "let y = 5;"
+        "print pick(false, nope);"
+        "print pick(true, y);");
+    auto stats = claw::optimizeProgram(program, 2);
+    EXPECT_EQ(stats.inlined, 1);
+    EXPECT_NE(dynamic_cast<claw::CallExpr*>(printedExpr(program, 2)), nullptr);
+    EXPECT_NE(runInterpreter(program).find("error"), std::string::npos);
+}
+
+TEST(AstOptimizer, BackendsAgreeAtEveryLevel) {
+    expectSameAtAllLevels(
+        "let scale = 3;"
+        "fn scaled(v) { return v * scale; }"
+        "fn describe(n) { return n > 10 ? \"big \" + n : \"small \" + n; }"
+        "let total = 0;"
+        "for (let i = 0; i < 5; i = i + 1) {"
+        "  if (false) { total = -1; }"
+        "  total = total + scaled(i);"
+        "}"
+        "print total;"
+        "print describe(scaled(2));"
+        "print describe(total);"
+        "print 1 < 2 || missing;"
+        "print \"x\" + 2 * 3;",
+        "30\nsmall 6\nbig 30\ntrue\nx6\n");
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "vm/global_table.h"
+#include "features/callable.h"
+
+TEST(GlobalSlots, SameNameResolvesToSameSlotAcrossChunks) {
+    auto first = compileSrc("let slotProbe = 1;");
+    auto second = compileSrc("print slotProbe;");
+    int slot = claw::GlobalTable::getInstance().resolve("slotProbe");
+    // DefineGlobal and GetGlobal both carry the slot as a 16-bit operand
+    ASSERT_GE(first->size(), 3u);
+    ASSERT_GE(second->size(), 3u);
+    EXPECT_EQ(first->code()[0], static_cast<uint8_t>(claw::OpCode::Constant));
+    EXPECT_EQ(first->code()[2], static_cast<uint8_t>(claw::OpCode::DefineGlobal));
+    EXPECT_EQ((first->code()[3] << 8) | first->code()[4], slot);
+    EXPECT_EQ(second->code()[0], static_cast<uint8_t>(claw::OpCode::GetGlobal));
+    EXPECT_EQ((second->code()[1] << 8) | second->code()[2], slot);
+    EXPECT_STREQ(claw::GlobalTable::getInstance().name(slot), "slotProbe");
+}
+
+TEST(GlobalSlots, WritingOneGlobalKeepsOthersReadable) {
+    auto chunk = compileSrc(
+        "let base = 100; let counter = 0; let total = 0;"
+        "while (counter < 5) { total = total + base; counter = counter + 1; }"
+        "print total; print counter;");
+    claw::VM vm;
+    claw::InterpretResult res;
+    auto out = runVM(vm, *chunk, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "500\n5\n");
+}
+
+TEST(GlobalSlots, InterpreterSeesVMWrites) {
+    std::string decl = "fn readShared() { return shared; }";
+    claw::Lexer lex(decl);
+    auto toks = lex.tokenize();
+    claw::Parser parser(toks);
+    auto prog = parser.parseProgram();
+    ASSERT_FALSE(parser.hadError());
+    claw::Interpreter interp;
+    interp.execute(prog);
+    auto chunk = compileSrc("let shared = 5; print readShared(); shared = shared + 1; print readShared();");
+    claw::VM vm(interp);
+    claw::InterpretResult res;
+    auto out = runVM(vm, *chunk, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "5\n6\n");
+}
+
+TEST(GlobalSlots, UndefinedGlobalIsRuntimeError) {
+    auto chunk = compileSrc("print neverDefinedGlobal;");
+    claw::VM vm;
+    std::stringstream err;
+    auto old = std::cerr.rdbuf(err.rdbuf());
+    auto res = vm.interpret(*chunk);
+    std::cerr.rdbuf(old);
+    EXPECT_EQ(res, claw::InterpretResult::RuntimeError);
+    EXPECT_EQ(err.str(), "❌ E3001: Runtime Error [Line 1, Col 7]: Undefined variable: neverDefinedGlobal\n");
+}
+
+TEST(GlobalSlots, SlotsRegisteredDuringARunBindOnFirstUse) {
+    claw::Interpreter interp;
+    claw::VM outer(interp);
+    claw::VM inner(interp);
+    // load() compiles globals no chunk has named yet while outer is running
+    // and defines them through a second VM sharing the same globals
+    std::unique_ptr<claw::Chunk> loaded;
+    interp.getGlobals()->define("load", std::make_shared<claw::NativeFunction>(0, [&](const std::vector<claw::Value>&) {
+        loaded = compileSrc("let lateSlotA = 1; let lateSlotB = 2;"
+                            "fn lateSlotSum() { lateSlotB = lateSlotB + lateSlotA; return lateSlotB; }");
+        inner.interpret(*loaded);
+        return claw::nilValue();
+    }, "load"));
+    auto chunk = compileSrc("load(); print lateSlotSum(); print lateSlotSum();");
+    claw::InterpretResult res;
+    auto out = runVM(outer, *chunk, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "3\n4\n");
+}
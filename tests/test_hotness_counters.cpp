@@ -19,12 +19,12 @@ static std::unique_ptr<claw::Chunk> compileSrc(const std::string& src) {
 static const claw::VMFunction* getFn(claw::VM& vm, const char* namePtr) {
     claw::Value v = vm.apiGlobalGet(namePtr);
     if (claw::isVMClosure(v)) {
-        auto c = claw::asVMClosurePtr(v);
+        auto c = claw::asVMClosure(v);
         if (c) return c->function.get();
     }
     if (claw::isVMFunction(v)) {
         auto f = claw::asVMFunction(v);
-        if (f) return f.get();
+        if (f) return f;
     }
     return nullptr;
 }
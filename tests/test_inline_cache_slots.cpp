@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+
+TEST(InlineCacheSlots, CompilerAssignsDenseSlotsPerKind) {
+    auto chunk = compileSrc(
+        "let a = 1; let b = 2;"
+        "let i = 0;"
+        "while (i < 3) { print a + b; i = i + 1; }"
+        "print num(a);");
+    EXPECT_EQ(chunk->cacheSlotCount(claw::CacheKind::Call), 1);
+    EXPECT_EQ(chunk->cacheSlotCount(claw::CacheKind::Loop), 1);
+    EXPECT_EQ(chunk->cacheSlotCount(claw::CacheKind::Property), 0);
+    EXPECT_EQ(chunk->loopCount(), 1);
+}
+
+TEST(InlineCacheSlots, GlobalSlotSeesReassignment) {
+    auto chunk = compileSrc(
+        "let x = 1; let i = 0;"
+        "while (i < 4) { print x; x = x + 10; i = i + 1; }");
+    claw::VM vm;
+    claw::InterpretResult res;
+    auto out = runVM(vm, *chunk, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "1\n11\n21\n31\n");
+}
+
+TEST(InlineCacheSlots, PropertySlotEvictsOldestEntry) {
+    std::string classDecl = "class P { fn init() {} }";
+    claw::Lexer lex(classDecl);
+    auto toks = lex.tokenize();
+    claw::Parser parser(toks);
+    auto prog = parser.parseProgram();
+    ASSERT_FALSE(parser.hadError());
+    claw::Interpreter interp;
+    interp.execute(prog);
+    // Ten receivers at one site overflow the eight-entry cache; rereading the
+    // first receivers must still produce their own values.
+    auto chunk = compileSrc(
+        "let a0 = P(); a0.v = 0; let a1 = P(); a1.v = 1; let a2 = P(); a2.v = 2;"
+        "let a3 = P(); a3.v = 3; let a4 = P(); a4.v = 4; let a5 = P(); a5.v = 5;"
+        "let a6 = P(); a6.v = 6; let a7 = P(); a7.v = 7; let a8 = P(); a8.v = 8;"
+        "let a9 = P(); a9.v = 9;"
+        "fn get(o) { return o.v; }"
+        "let s = 0;"
+        "s = s + get(a0) + get(a1) + get(a2) + get(a3) + get(a4);"
+        "s = s + get(a5) + get(a6) + get(a7) + get(a8) + get(a9);"
+        "s = s + get(a0) + get(a1);"
+        "print s;");
+    claw::VM vm(interp);
+    claw::InterpretResult res;
+    auto out = runVM(vm, *chunk, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "46\n");
+}
+
+TEST(InlineCacheSlots, SharedChunkAcrossVMs) {
+    auto chunk = compileSrc(
+        "fn f(n) { return n + 1; }"
+        "let i = 0; let r = 0;"
+        "while (i < 5) { r = f(r); i = i + 1; }"
+        "print r;");
+    for (int run = 0; run < 2; ++run) {
+        claw::VM vm;
+        claw::InterpretResult res;
+        auto out = runVM(vm, *chunk, &res);
+        EXPECT_EQ(res, claw::InterpretResult::Ok);
+        EXPECT_EQ(out, "5\n");
+    }
+}
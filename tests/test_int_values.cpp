@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+
+using namespace claw;
+
+TEST(IntValues, TagRoundTrip) {
+    for (int32_t i : {0, 1, -1, 42, INT32_MAX, INT32_MIN}) {
+        Value v = intValue(i);
+        EXPECT_TRUE(isInt(v));
+        EXPECT_TRUE(isNumber(v));
+        EXPECT_FALSE(isDouble(v));
+        EXPECT_FALSE(isBool(v));
+        EXPECT_FALSE(isNil(v));
+        EXPECT_EQ(asInt(v), i);
+        EXPECT_EQ(asNumber(v), static_cast<double>(i));
+    }
+}
+
+TEST(IntValues, CompactNumberValue) {
+    EXPECT_TRUE(isInt(compactNumberValue(7.0)));
+    EXPECT_TRUE(isInt(compactNumberValue(-2147483648.0)));
+    EXPECT_FALSE(isInt(compactNumberValue(2147483648.0)));
+    EXPECT_FALSE(isInt(compactNumberValue(1.5)));
+    EXPECT_FALSE(isInt(compactNumberValue(-0.0)));
+    EXPECT_TRUE(isEqual(compactNumberValue(3.0), numberToValue(3.0)));
+}
+
+TEST(IntValues, ArithmeticOverflowsToDouble) {
+    EXPECT_TRUE(isInt(addNumbers(intValue(2), intValue(3))));
+    Value sum = addNumbers(intValue(INT32_MAX), intValue(1));
+    EXPECT_FALSE(isInt(sum));
+    EXPECT_EQ(asNumber(sum), 2147483648.0);
+    Value diff = subtractNumbers(intValue(INT32_MIN), intValue(1));
+    EXPECT_EQ(asNumber(diff), -2147483649.0);
+    Value product = multiplyNumbers(intValue(65536), intValue(65536));
+    EXPECT_FALSE(isInt(product));
+    EXPECT_EQ(asNumber(product), 4294967296.0);
+    Value negZero = multiplyNumbers(intValue(0), intValue(-3));
+    EXPECT_FALSE(isInt(negZero));
+    EXPECT_TRUE(std::signbit(asNumber(negZero)));
+}
+
+TEST(IntValues, VMLoopCounterOverflow) {
+    EXPECT_EQ(runVM("let x = 2147483646; for (let i = 0; i < 3; i = i + 1) { x = x + 1; print x; }"),
+              "2147483647\n2147483648\n2147483649\n");
+}
+
+TEST(IntValues, VMBitwiseMatchesDoublePath) {
+    EXPECT_EQ(runVM("print 12 & 10; print 12 | 3; print 6 ^ 3; print 1 << 31; print 1 << 40; print 256 >> 4;"),
+              "8\n15\n5\n2147483648\n1099511627776\n16\n");
+}
+
+TEST(IntValues, VMMixedIntAndDouble) {
+    EXPECT_EQ(runVM("print 1 + 0.5; print 3 * 1.5; print 7 / 2; print 2 < 2.5; print 4 == 4.0;"),
+              "1.5\n4.5\n3.5\ntrue\ntrue\n");
+}
+
+TEST(IntValues, VMIntegerArrayIndex) {
+    EXPECT_EQ(runVM("let a = jsonDecode(\"[4,5,6]\"); let s = 0;"
+                    "for (let i = 0; i < 3; i = i + 1) { s = s + a[i]; } print s; print a[1.0];"),
+              "15\n5\n");
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "features/callable.h"
+
+TEST(NativeABI, SignatureChecksMarkedArguments) {
+    claw::NativeSignature sig{2, 0b10, "second must be a number"};
+    claw::Value ok[] = {claw::nilValue(), claw::numberToValue(1)};
+    claw::Value bad[] = {claw::numberToValue(1), claw::nilValue()};
+    EXPECT_TRUE(sig.accepts(ok, 2));
+    EXPECT_FALSE(sig.accepts(bad, 2));
+    EXPECT_TRUE(claw::NativeSignature{-1}.accepts(bad, 2));
+}
+
+TEST(NativeABI, MathNativesUseTheFastABI) {
+    claw::Interpreter interp;
+    for (const char* name : {"abs", "sqrt", "pow", "min", "max", "floor", "len"}) {
+        auto callee = interp.getGlobals()->get(name);
+        auto native = dynamic_cast<claw::NativeFunction*>(claw::asCallable(callee));
+        ASSERT_NE(native, nullptr) << name;
+        EXPECT_NE(native->fast(), nullptr) << name;
+    }
+}
+
+TEST(NativeABI, ResultsMatchInterpreter) {
+    expectSameAsInterpreter(
+        "fn hyp(a, b) { return sqrt(pow(a, 2) + pow(b, 2)); }"
+        "let s = 0;"
+        "for (let i = 0; i < 100; i = i + 1) s = s + abs(-i) + min(i, 3) + max(i, 98);"
+        "print hyp(3, 4); print s; print floor(2.7) + ceil(2.2) + round(2.5);"
+        "print len(\"abcd\"); print len(jsonDecode(\"[1,2,3]\"));",
+        "5\n15045\n8\n4\n3\n");
+}
+
+TEST(NativeABI, ErrorsMatchInterpreterAndAreCatchable) {
+    expectSameAsInterpreter(
+        "try { print abs(\"x\"); } catch (e) { print e; }"
+        "try { print pow(2, nil); } catch (e) { print e; }"
+        "try { print sqrt(-1); } catch (e) { print e; }"
+        "try { print len(3); } catch (e) { print e; }"
+        "try { print abs(); } catch (e) { print e; }"
+        "try { print min(1, 2, 3); } catch (e) { print e; }",
+        "abs() requires a number\n"
+        "pow() requires two numbers\n"
+        "sqrt() argument must be non-negative\n"
+        "len() requires a string, array, or hash map argument\n"
+        "E4007: Expected 1 arguments but got 0\n"
+        "E4007: Expected 2 arguments but got 3\n");
+}
+
+TEST(NativeABI, CachedCallSiteRevalidatesArguments) {
+    // The same call site is cached on its first, well-typed call; later
+    // calls with a bad argument must still be rejected
+    expectSameAsInterpreter(
+        "fn f(v) { return abs(v); }"
+        "let out = 0; out = out + f(-2); out = out + f(3);"
+        "try { f(\"no\"); } catch (e) { print e; }"
+        "print out;",
+        "abs() requires a number\n5\n");
+}
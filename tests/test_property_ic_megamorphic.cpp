@@ -15,9 +15,16 @@ static std::unique_ptr<claw::Chunk> compileSrc(const std::string& src) {
 }
 #
 TEST(PropertyICDiagnostics, MegamorphicPromotionAfterMissThreshold) {
-    // Define a simple class via interpreter so VM GetProperty uses instance path.
-    std::string classDecl =
-        "class C { fn init() {} }";
+    // Instances of one class share a shape, so the site needs receivers of
+    // many classes to miss. make(i) returns an instance of class Ci.
+    std::string classDecl;
+    std::string make = "fn make(i) {";
+    for (int i = 0; i < 20; i++) {
+        std::string name = "C" + std::to_string(i);
+        classDecl += "class " + name + " { fn init() {} }";
+        make += "if (i == " + std::to_string(i) + ") return " + name + "();";
+    }
+    classDecl += make + "}";
     claw::Lexer lex1(classDecl);
     auto tokens1 = lex1.tokenize();
     claw::Parser parser1(tokens1);
@@ -26,11 +33,11 @@ TEST(PropertyICDiagnostics, MegamorphicPromotionAfterMissThreshold) {
     claw::Interpreter interp;
     interp.execute(program1);
     #
-    // VM chunk: create many distinct instances and access o.v at the same site.
+    // VM chunk: access o.v on instances of 20 classes at the same site.
     std::string loopSrc =
         "let i = 0;"
-        "while (i < 40) {"
-        "  let o = C();"
+        "while (i < 20) {"
+        "  let o = make(i);"
         "  o.v = i;"
         "  print o.v;"
         "  i = i + 1;"
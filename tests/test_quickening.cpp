@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "vm/opcodes.h"
+
+// Compiled with disablePeephole: superinstructions would hide the generic
+// opcodes these tests quicken
+
+// Function body is GetLocal a, GetLocal b, Add, so the Add sits at offset 4
+static constexpr size_t ADD_OFFSET = 4;
+
+TEST(Quickening, NumericAddIsRewrittenInPlace) {
+    auto chunk = compileSrc("fn add(a, b) { return a + b; } add(1, 2);", disablePeephole);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    ASSERT_EQ(body->code()[ADD_OFFSET], static_cast<uint8_t>(claw::OpCode::Add));
+    claw::VM vm;
+    claw::InterpretResult res;
+    runVM(vm, *chunk, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(body->code()[ADD_OFFSET], static_cast<uint8_t>(claw::OpCode::AddNum));
+}
+
+TEST(Quickening, DisabledLeavesGenericOpcode) {
+    auto chunk = compileSrc("fn add(a, b) { return a + b; } add(1, 2);", disablePeephole);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    claw::gRuntimeFlags.disableQuickening = true;
+    claw::VM vm;
+    claw::InterpretResult res;
+    runVM(vm, *chunk, &res);
+    claw::gRuntimeFlags.disableQuickening = false;
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(body->code()[ADD_OFFSET], static_cast<uint8_t>(claw::OpCode::Add));
+}
+
+TEST(Quickening, PolymorphicAddDeoptimizes) {
+    claw::InterpretResult res;
+    auto out = runVM(*compileSrc(
+        "fn add(a, b) { return a + b; }"
+        "print add(1, 2); print add(\"a\", \"b\"); print add(3, 4);"
+        "print add(\"x\", 1); print add(5, 6);", disablePeephole), &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "3\nab\n7\nx1\n11\n");
+}
+
+TEST(Quickening, LessNumGuardStillReportsTypeError) {
+    claw::InterpretResult res;
+    auto out = runVM(*compileSrc(
+        "fn lt(a, b) { return a < b; }"
+        "print lt(1, 2); print lt(\"a\", 2);", disablePeephole), &res);
+    EXPECT_EQ(res, claw::InterpretResult::RuntimeError);
+    EXPECT_EQ(out, "true\n");
+}
+
+TEST(Quickening, ArrayIndexFallsBackForMapsAndBounds) {
+    claw::InterpretResult res;
+    auto out = runVM(*compileSrc(
+        "fn at(c, k) { return c[k]; }"
+        "let a = jsonDecode(\"[10,20]\"); let m = jsonDecode(\"{\\\"k\\\":5}\");"
+        "print at(a, 1); print at(m, \"k\"); print at(a, 0); print at(a, 2);", disablePeephole), &res);
+    EXPECT_EQ(res, claw::InterpretResult::RuntimeError);
+    EXPECT_EQ(out, "20\n5\n10\n");
+}
+
+TEST(Quickening, LoopResultMatchesUnquickened) {
+    const char* src =
+        "let s = 0; let t = \"\";"
+        "for (let i = 0; i < 50; i = i + 1) { s = s + i; if (i < 3) t = t + \"ab\"; }"
+        "print s; print t;";
+    claw::InterpretResult res;
+    auto quick = runVM(*compileSrc(src, disablePeephole), &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    claw::gRuntimeFlags.disableQuickening = true;
+    auto plain = runVM(*compileSrc(src, disablePeephole), &res);
+    claw::gRuntimeFlags.disableQuickening = false;
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(quick, plain);
+    EXPECT_EQ(quick, "1225\nababab\n");
+}
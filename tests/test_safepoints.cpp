@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "vm/safepoint.h"
+#include <chrono>
+#include <thread>
+
+using namespace claw;
+
+TEST(Safepoints, InterruptStopsInfiniteLoop) {
+    std::thread interrupter([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        vmRequestSafepoint(SafepointInterrupt);
+    });
+    InterpretResult res;
+    std::string err;
+    runVM("let i = 0; while (true) { i = i + 1; }", &res, &err);
+    interrupter.join();
+    EXPECT_EQ(res, InterpretResult::RuntimeError);
+    EXPECT_EQ(err.find("❌ E4008: Runtime Error [Line 1, "), 0u) << err;
+    EXPECT_NE(err.find("]: Interrupted\n"), std::string::npos) << err;
+    EXPECT_EQ(gSafepointRequests.load(), 0u);
+}
+
+TEST(Safepoints, InterruptIsNotCaughtByTheScript) {
+    std::thread interrupter([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        vmRequestSafepoint(SafepointInterrupt);
+    });
+    InterpretResult res;
+    std::string err;
+    auto out = runVM("try { while (true) {} } catch (e) { print e; }", &res, &err);
+    interrupter.join();
+    EXPECT_EQ(res, InterpretResult::RuntimeError);
+    EXPECT_EQ(out, "");
+    EXPECT_NE(err.find("]: Interrupted\n"), std::string::npos);
+}
+
+TEST(Safepoints, PendingGCRequestIsServedWithoutStopping) {
+    vmRequestSafepoint(SafepointGC);
+    InterpretResult res;
+    auto out = runVM("let s = 0; for (let i = 0; i < 100; i = i + 1) { s = s + i; } print s;", &res);
+    EXPECT_EQ(res, InterpretResult::Ok);
+    EXPECT_EQ(out, "4950\n");
+    EXPECT_EQ(gSafepointRequests.load(), 0u);
+}
+
+TEST(Safepoints, IdsStackDepthCheckedAtCalls) {
+    auto saved = gRuntimeFlags;
+    gRuntimeFlags.idsEnabled = true;
+    gRuntimeFlags.idsStackMax = 10;
+    gRuntimeFlags.safepointInterval = 1;
+    InterpretResult res;
+    std::string err;
+    runVM("fn down(n) { if (n < 1) return 0; return down(n - 1); } down(50);", &res, &err);
+    gRuntimeFlags = saved;
+    EXPECT_EQ(res, InterpretResult::RuntimeError);
+    EXPECT_NE(err.find("E4003: Runtime Error [Line 1, "), std::string::npos) << err;
+    EXPECT_NE(err.find("]: Stack depth anomaly detected\nStack trace:\n  at down (1)\n"), std::string::npos) << err;
+}
+
+TEST(Safepoints, IdsEnabledLoopCompletes) {
+    auto saved = gRuntimeFlags;
+    gRuntimeFlags.idsEnabled = true;
+    InterpretResult res;
+    auto out = runVM("let s = 0; for (let i = 0; i < 100000; i = i + 1) { s = s + 1; } print s;", &res);
+    gRuntimeFlags = saved;
+    EXPECT_EQ(res, InterpretResult::Ok);
+    EXPECT_EQ(out, "100000\n");
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "interpreter/environment.h"
+#include "features/string_pool.h"
+
+TEST(StringRopes, LongConcatenationsAreRopesFlattenedOnRead) {
+    claw::Environment env;
+    const std::string a(200, 'a'), b(100, 'b');
+    env.define("short", claw::concatStrings(claw::newStringValue("x"), claw::newStringValue("y")));
+    env.define("long", claw::concatStrings(claw::newStringValue(a), claw::newStringValue(b)));
+    EXPECT_FALSE(claw::asStringObject(env.get("short"))->rope);
+    EXPECT_EQ(claw::asString(env.get("short")), "xy");
+
+    const claw::ClawString* rope = claw::asStringObject(env.get("long"));
+    ASSERT_TRUE(rope->rope);
+    EXPECT_EQ(rope->length, 300u);
+    EXPECT_FALSE(rope->flattened());
+    EXPECT_EQ(claw::asString(env.get("long")), a + b);
+    EXPECT_TRUE(rope->flattened());
+    EXPECT_TRUE(claw::isEqual(env.get("long"), claw::newStringValue(a + b)));
+}
+
+TEST(StringRopes, BuiltStringsFindTheirInternedTwin) {
+    claw::Environment env;
+    const std::string a(200, 'a'), b(100, 'b');
+    const claw::ClawString* pooled = claw::StringPool::internString(a + b);
+    env.define("rope", claw::concatStrings(claw::newStringValue(a), claw::newStringValue(b)));
+    env.define("other", claw::newStringValue(a + a));
+    const claw::ClawString* rope = claw::asStringObject(env.get("rope"));
+    const claw::ClawString* other = claw::asStringObject(env.get("other"));
+    // A string's cached hash is the one the pool files its twin under
+    EXPECT_EQ(rope->hash(), pooled->hash());
+    EXPECT_EQ(claw::StringPool::find(rope->view(), rope->hash()), pooled);
+    EXPECT_EQ(claw::StringPool::find(other->view(), other->hash()), nullptr);
+}
+
+TEST(StringRopes, DeepRopesFlattenAndSurviveCollections) {
+    claw::Environment env;
+    env.define("s", claw::newStringValue(std::string(300, '-')));
+    for (int i = 0; i < 200000; i++) {
+        env.assign("s", claw::concatStrings(env.get("s"), std::to_string(i % 10)));
+    }
+    claw::gcCollect();
+    std::string_view s = claw::asStringView(env.get("s"));
+    ASSERT_EQ(s.size(), 300u + 200000u);
+    EXPECT_EQ(s.substr(298, 12), "--0123456789");
+    EXPECT_EQ(s.back(), '9');
+}
+
+TEST(StringRopes, RepeatedConcatenationInBothEngines) {
+    // Long enough for ropes and several collections while they are built
+    const std::string src =
+        "let s = \"\";"
+        "let sb = StringBuilder();"
+        "for (let i = 0; i < 60000; i++) { s = s + \"<\" + i + \">\"; sb.append(\"<\").append(i).append(\">\"); }"
+        "print len(s);"
+        "print sb.length;"
+        "print s == sb.toString();"
+        "let t = \"head\";"
+        "t += s;"
+        "print len(t);";
+    const std::string expected = "408890\n408890\ntrue\n408894\n";
+    EXPECT_EQ(runInterpreter(src), expected);
+    EXPECT_EQ(runHybrid(src), expected);
+}
+
+TEST(StringRopes, StringBuilderAppendsAnyValue) {
+    const std::string src =
+        "let sb = StringBuilder();"
+        "sb.append(\"n=\").append(3).append(\" \").append(true).append(nil);"
+        "print sb.toString();"
+        "print type(sb);"
+        "sb.clear();"
+        "print sb.length;"
+        "print sb.toString() == \"\";";
+    const std::string expected = "n=3 truenil\nstringbuilder\n0\ntrue\n";
+    EXPECT_EQ(runInterpreter(src), expected);
+    EXPECT_EQ(runHybrid(src), expected);
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "vm/opcodes.h"
+
+static const char* kLoop =
+    "fn total(n) {"
+    "  let s = 0;"
+    "  for (let i = 0; i < 100; i = i + 1) { s = s + i; }"
+    "  return s + n;"
+    "}"
+    "print total(1);";
+
+static claw::PeepholeStats peepholeStats(const std::string& src) {
+    auto program = parseSrc(src);
+    claw::Compiler compiler;
+    compiler.compile(program);
+    return compiler.peepholeStats();
+}
+
+TEST(Superinstructions, ForLoopFusesAllThreePatterns) {
+    auto stats = peepholeStats(kLoop);
+    EXPECT_EQ(stats.lessLocalConstJump, 1);
+    EXPECT_EQ(stats.addConstSetLocal, 1);
+    // s + i in the body and s + n in the return
+    EXPECT_EQ(stats.addLocals, 2);
+    EXPECT_EQ(stats.total(), 4);
+}
+
+TEST(Superinstructions, FusionKeepsCodeSize) {
+    auto fused = compileSrc(kLoop);
+    auto plain = compileSrc(kLoop, disablePeephole);
+    EXPECT_EQ(fused->size(), plain->size());
+}
+
+TEST(Superinstructions, FusedAndUnfusedAgree) {
+    claw::InterpretResult fusedRes, plainRes;
+    auto fused = runVM(*compileSrc(kLoop), &fusedRes);
+    auto plain = runVM(*compileSrc(kLoop, disablePeephole), &plainRes);
+    EXPECT_EQ(fusedRes, claw::InterpretResult::Ok);
+    EXPECT_EQ(plainRes, claw::InterpretResult::Ok);
+    EXPECT_EQ(fused, "4951\n");
+    EXPECT_EQ(fused, plain);
+}
+
+TEST(Superinstructions, NonNumberOperandsTakeGenericPath) {
+    claw::InterpretResult res;
+    auto out = runVM(*compileSrc(
+        "fn cat(a, b) { return a + b; }"
+        "fn small(x) { if (x < 10) return \"yes\"; return \"no\"; }"
+        "print cat(\"a\", \"b\"); print cat(2, 3); print small(4); print small(40);"), &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "ab\n5\nyes\nno\n");
+}
+
+TEST(Superinstructions, StringConstantIsNotFused) {
+    auto stats = peepholeStats("fn f(s) { s = s + \"!\"; return s; }");
+    EXPECT_EQ(stats.addConstSetLocal, 0);
+}
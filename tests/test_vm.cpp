@@ -183,34 +183,34 @@ TEST_F(VMTest, CompoundIndexAssignNilEdgeCase) {
 
 TEST_F(VMTest, DivideByZeroErrors) {
     auto err1 = getError("print 10 / 0;");
-    EXPECT_NE(err1.find("Division by zero."), std::string::npos);
+    EXPECT_NE(err1.find("]: Division by zero\n"), std::string::npos);
     auto err2 = getError("let x = 0; print 5 / (x);");
-    EXPECT_NE(err2.find("Division by zero."), std::string::npos);
+    EXPECT_NE(err2.find("]: Division by zero\n"), std::string::npos);
 }
 
-TEST_F(VMTest, DivideByZeroVariant0) { auto err = getError("print 1 / 0;"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant1) { auto err = getError("let a = 0; print 10 / a;"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant2) { auto err = getError("print (1 + 2) / (3 - 3);"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant3) { auto err = getError("let a = 0; let b = 1; print b / a;"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant4) { auto err = getError("print 0 / 0;"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant5) { auto err = getError("print (4 / 2) / (1 - 1);"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant6) { auto err = getError("let z = 0; if (true) { print 7 / z; }"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant7) { auto err = getError("print 7 / (0 + 0);"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant8) { auto err = getError("print 1 / (num(0));"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant9) { auto err = getError("let f = fn() { return 0; }; print 2 / f();"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant10) { auto err = getError("print 10 / (true ? 0 : 1);"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant11) { auto err = getError("let g = fn(x) { return x; }; print 9 / g(0);"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant12) { auto err = getError("print 3 / ((1 - 1));"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant13) { auto err = getError("print (1 + 1) / ((2 - 2));"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant14) { auto err = getError("print 1 / ((1 - 1) + 0);"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
-TEST_F(VMTest, DivideByZeroVariant15) { auto err = getError("print (1 / 1) / ((1 - 1));"); EXPECT_NE(err.find("Division by zero."), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant0) { auto err = getError("print 1 / 0;"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant1) { auto err = getError("let a = 0; print 10 / a;"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant2) { auto err = getError("print (1 + 2) / (3 - 3);"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant3) { auto err = getError("let a = 0; let b = 1; print b / a;"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant4) { auto err = getError("print 0 / 0;"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant5) { auto err = getError("print (4 / 2) / (1 - 1);"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant6) { auto err = getError("let z = 0; if (true) { print 7 / z; }"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant7) { auto err = getError("print 7 / (0 + 0);"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant8) { auto err = getError("print 1 / (num(0));"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant9) { auto err = getError("let f = fn() { return 0; }; print 2 / f();"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant10) { auto err = getError("print 10 / (true ? 0 : 1);"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant11) { auto err = getError("let g = fn(x) { return x; }; print 9 / g(0);"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant12) { auto err = getError("print 3 / ((1 - 1));"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant13) { auto err = getError("print (1 + 1) / ((2 - 2));"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant14) { auto err = getError("print 1 / ((1 - 1) + 0);"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
+TEST_F(VMTest, DivideByZeroVariant15) { auto err = getError("print (1 / 1) / ((1 - 1));"); EXPECT_NE(err.find("]: Division by zero\n"), std::string::npos); }
 
 TEST_F(VMTest, ShiftCountBoundaries) {
     EXPECT_EQ(getOutput("print 1 << 0;"), "1\n");
     EXPECT_EQ(getOutput("print 1 << 63;"), "9223372036854775808\n");
     EXPECT_EQ(getOutput("print 8 >> 2;"), "2\n");
     auto err = getError("print 1 << -1;");
-    EXPECT_NE(err.find("Shift count must be non-negative."), std::string::npos);
+    EXPECT_NE(err.find("]: Shift count must be non-negative\n"), std::string::npos);
 }
 
 // Generate many shift boundary tests to grow coverage
@@ -258,4 +258,52 @@ TEST_F(VMTest, HashMapEnsureDefaultConcurrent) {
     EXPECT_TRUE(map->contains("x"));
 }
 
+TEST_F(VMTest, SwitchAndThreadedDispatchAgree) {
+    const std::string code =
+        "fn fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }"
+        "let h = 0;"
+        "for (let i = 0; i < 50; i = i + 1) { h = ((h << 3) ^ i) & 1023; }"
+        "print fib(12); print h; print !(h > 3) == false;";
+    gRuntimeFlags.forceSwitchDispatch = true;
+    std::string viaSwitch = getOutput(code);
+    gRuntimeFlags.forceSwitchDispatch = false;
+    std::string viaDefault = getOutput(code);
+    EXPECT_EQ(viaSwitch.substr(0, 4), "144\n");
+    EXPECT_EQ(viaSwitch, viaDefault);
+}
+
+TEST_F(VMTest, ClosuresShareAndCloseUpvalues) {
+    // Two closures over one variable see each other's writes before and
+    // after the frame returns; closures over separate frames do not mix
+    EXPECT_EQ(getOutput(
+        "fn counter() {"
+        "  let n = 0;"
+        "  fn inc() { n = n + 1; return n; }"
+        "  fn get() { return n; }"
+        "  inc(); print get();"
+        "  return {\"inc\": inc, \"get\": get};"
+        "}"
+        "let a = counter(); let b = counter();"
+        "let incA = a[\"inc\"]; let getA = a[\"get\"]; let getB = b[\"get\"];"
+        "incA(); incA(); print getA(); print getB();"
+        "fn outer() { let x = 1; fn mid() { let y = 10; fn inner() { x = x + y; return x; } return inner; } return mid(); }"
+        "let f = outer(); f(); print f();"),
+        "1\n1\n3\n1\n21\n");
+}
+
+TEST_F(VMTest, ReleasedUpvaluesAreRecycled) {
+    Value slot = numberToValue(1);
+    VMUpvalue* first = gcNewUpvalue(&slot);
+    first->refs = 1;
+    gcReleaseUpvalue(first);
+    VMUpvalue* second = gcNewUpvalue(&slot);
+    EXPECT_EQ(second, first);
+    EXPECT_EQ(second->refs, 0u);
+    EXPECT_EQ(second->next, nullptr);
+    second->refs = 2;
+    gcReleaseUpvalue(second);
+    EXPECT_EQ(second->refs, 1u);
+    gcReleaseUpvalue(second);
+}
+
 } // namespace claw
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "features/class.h"
+
+TEST(VMClasses, FieldsInitAndMethods) {
+    expectSameAsInterpreter(
+        "class Point {"
+        "  fn init(x, y) { this.x = x; this.y = y; }"
+        "  fn sum() { return this.x + this.y; }"
+        "  fn scale(k) { this.x = this.x * k; this.y = this.y * k; return this; }"
+        "}"
+        "let p = Point(2, 3);"
+        "print p.sum();"
+        "print p.scale(10).sum();"
+        "print p.x;",
+        "5\n50\n20\n");
+}
+
+TEST(VMClasses, InitAlwaysReturnsTheInstance) {
+    expectSameAsInterpreter(
+        "class C { fn init(v) { this.v = v; if (v > 1) return 99; } }"
+        "print C(1).v; print C(5).v;"
+        "class Empty {} let e = Empty(); e.tag = \"ok\"; print e.tag;",
+        "1\n5\nok\n");
+}
+
+TEST(VMClasses, InheritanceAndSuper) {
+    expectSameAsInterpreter(
+        "class Animal {"
+        "  fn init(name) { this.name = name; }"
+        "  fn speak() { return this.name + \" makes a sound\"; }"
+        "  fn kind() { return \"animal\"; }"
+        "}"
+        "class Dog < Animal {"
+        "  fn init(name) { super.init(name); this.tricks = 0; }"
+        "  fn speak() { return super.speak() + \" (woof)\"; }"
+        "}"
+        "let d = Dog(\"rex\");"
+        "print d.speak(); print d.kind(); print d.tricks;",
+        "rex makes a sound (woof)\nanimal\n0\n");
+}
+
+TEST(VMClasses, MethodsAsValuesAndClosuresOverThis) {
+    expectSameAsInterpreter(
+        "class Counter {"
+        "  fn init() { this.n = 0; }"
+        "  fn bump() { this.n = this.n + 1; return this.n; }"
+        "  fn adder() { fn add(k) { this.n = this.n + k; return this.n; } return add; }"
+        "}"
+        "let c = Counter();"
+        "let b = c.bump; b(); b();"
+        "let add = c.adder(); add(10);"
+        "print c.n;",
+        "12\n");
+}
+
+TEST(VMClasses, FieldHoldingFunctionShadowsMethod) {
+    expectSameAsInterpreter(
+        "fn shout() { return \"field\"; }"
+        "class C { fn f() { return \"method\"; } }"
+        "let c = C(); print c.f(); c.f = shout; print c.f();",
+        "method\nfield\n");
+}
+
+TEST(VMClasses, InvokeCacheFollowsReceiverClass) {
+    // One call site sees two classes alternately; the cache must not hand
+    // the method of one to the other.
+    expectSameAsInterpreter(
+        "class A { fn name() { return \"a\"; } }"
+        "class B { fn name() { return \"b\"; } }"
+        "let out = \"\"; let flip = true;"
+        "for (let i = 0; i < 20; i = i + 1) {"
+        "  let o = nil; if (flip) o = A(); else o = B();"
+        "  out = out + o.name(); flip = !flip;"
+        "}"
+        "print out;",
+        "abababababababababab\n");
+}
+
+TEST(VMClasses, ErrorsAreCatchable) {
+    const char* src =
+        "class C { fn init(a) { this.a = a; } }"
+        "try { C(); } catch (e) { print e; }"
+        "try { C(1).missing(); } catch (e) { print e; }"
+        "try { print C(1).nope; } catch (e) { print e; }"
+        "let n = 3; try { n.f(); } catch (e) { print e; }"
+        "try { class D < n {} } catch (e) { print e; }";
+    claw::InterpretResult res;
+    auto out = runVM(src, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out,
+              "E4007: Expected 1 arguments but got 0\n"
+              "E4008: Undefined property 'missing'.\n"
+              "E4008: Undefined property 'nope'.\n"
+              "E2003: Only arrays, hash maps, and class instances have members\n"
+              "E4008: Superclass must be a class.\n");
+    EXPECT_EQ(out, runInterpreter(src));
+}
+
+TEST(VMClasses, MethodCallsUseInvoke) {
+    auto program = parseSrc(
+        "class C { fn m() { return 1; } }"
+        "let c = C(); print c.m(); let f = c.m;");
+    claw::Compiler compiler;
+    auto chunk = compiler.compile(program);
+    EXPECT_EQ(chunk->countOpcode(claw::OpCode::Invoke), 1);
+    EXPECT_EQ(chunk->cacheSlotCount(claw::CacheKind::Invoke), 1);
+    EXPECT_EQ(chunk->cacheSlotCount(claw::CacheKind::Property), 1);
+}
+
+TEST(VMClasses, MethodTablesAreFlattenedByInternedName) {
+    using Methods = std::unordered_map<std::string, std::shared_ptr<claw::ClawFunction>>;
+    auto base = std::make_shared<claw::ClawClass>("Base", nullptr, Methods{});
+    auto derived = std::make_shared<claw::ClawClass>("Derived", base, Methods{});
+    const char* speak = claw::StringPool::intern(std::string("speak")).data();
+    const char* name = claw::StringPool::intern(std::string("name")).data();
+    auto baseSpeak = std::make_shared<claw::VMClosure>();
+    auto baseName = std::make_shared<claw::VMClosure>();
+    base->setVMMethod(speak, baseSpeak);
+    base->setVMMethod(name, baseName);
+    EXPECT_EQ(derived->findVMMethod(speak), baseSpeak.get());
+
+    // Defining or overriding a method later is seen by subclasses that
+    // already flattened their table
+    auto derivedSpeak = std::make_shared<claw::VMClosure>();
+    derived->setVMMethod(speak, derivedSpeak);
+    const char* extra = claw::StringPool::intern(std::string("extra")).data();
+    auto baseExtra = std::make_shared<claw::VMClosure>();
+    base->setVMMethod(extra, baseExtra);
+    EXPECT_EQ(derived->findVMMethod(speak), derivedSpeak.get());
+    EXPECT_EQ(derived->findVMMethod(name), baseName.get());
+    EXPECT_EQ(derived->findVMMethod(extra), baseExtra.get());
+    EXPECT_EQ(base->findVMMethod(speak), baseSpeak.get());
+    EXPECT_EQ(derived->findInternedMethod(speak), nullptr);
+
+    // Reparenting drops what was inherited
+    derived->setSuperclass(nullptr);
+    EXPECT_EQ(derived->findVMMethod(name), nullptr);
+    EXPECT_EQ(derived->findVMMethod(speak), derivedSpeak.get());
+}
+
+TEST(VMClasses, MethodChangesReachOnlyDescendants) {
+    using Methods = std::unordered_map<std::string, std::shared_ptr<claw::ClawFunction>>;
+    auto base = std::make_shared<claw::ClawClass>("Base", nullptr, Methods{});
+    auto middle = std::make_shared<claw::ClawClass>("Middle", base, Methods{});
+    auto leaf = std::make_shared<claw::ClawClass>("Leaf", middle, Methods{});
+    auto other = std::make_shared<claw::ClawClass>("Other", nullptr, Methods{});
+    const char* speak = claw::StringPool::intern(std::string("speak")).data();
+    auto baseSpeak = std::make_shared<claw::VMClosure>();
+    auto otherSpeak = std::make_shared<claw::VMClosure>();
+    other->setVMMethod(speak, otherSpeak);
+    base->setVMMethod(speak, baseSpeak);
+    EXPECT_EQ(leaf->findVMMethod(speak), baseSpeak.get());
+    EXPECT_EQ(other->findVMMethod(speak), otherSpeak.get());
+
+    // A destroyed subclass leaves its superclass's list
+    middle->setSuperclass(nullptr);
+    EXPECT_EQ(leaf->findVMMethod(speak), nullptr);
+    leaf.reset();
+    middle.reset();
+    auto baseName = std::make_shared<claw::VMClosure>();
+    base->setVMMethod(claw::StringPool::intern(std::string("name")).data(), baseName);
+    EXPECT_EQ(base->findVMMethod(speak), baseSpeak.get());
+}
+
+TEST(VMClasses, InterpretedMethodsResolveThroughTheFlatTable) {
+    expectSameAsInterpreter(
+        "class A { fn who() { return \"A\"; } fn hello() { return \"hi \" + this.who(); } }"
+        "class B < A { fn who() { return \"B\"; } }"
+        "class C < B {}"
+        "print C().hello(); print A().hello(); print C().who();",
+        "hi B\nhi A\nB\n");
+}
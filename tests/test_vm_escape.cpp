@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "compiler/escape.h"
+
+// expectSameAsInterpreter, also checking that every scoped closure was freed
+static void expectSameAndReleased(const std::string& src, const std::string& expected) {
+    auto chunk = compileSrc(src);
+    claw::Interpreter interp;
+    claw::VM vm(interp);
+    claw::InterpretResult res;
+    EXPECT_EQ(runVM(vm, *chunk, &res), expected) << src;
+    EXPECT_EQ(res, claw::InterpretResult::Ok) << src;
+    EXPECT_EQ(vm.scopedObjectCount(), 0u) << src;
+    EXPECT_EQ(runInterpreter(src), expected) << src;
+}
+
+TEST(EscapeAnalysis, OnlyCalledLocalsAreScoped) {
+    auto program = parseSrc(
+        "fn outer(k) {"
+        "  fn called(x) { return x + k; }"        // 0: only called
+        "  let lambda = fn(x) { return x * 2; };" // 1: only called
+        "  fn returned() { return 1; }"          // 2: returned
+        "  fn passed() { return 2; }"            // 3: printed as a value
+        "  let reassigned = fn() { return 3; };" // 4: assigned to
+        "  fn captured() { return 4; }"          // 5: named in a nested function
+        "  fn recursive(n) { return recursive(n); }" // 6: names itself
+        "  let read = fn() { return 5; };"       // 7: read into another local
+        "  reassigned = nil; let alias = read;"
+        "  let g = fn() { return captured(); };"
+        "  print called(1) + lambda(2); print passed;"
+        "  return returned;"
+        "}");
+    auto* outer = dynamic_cast<claw::FnStmt*>(program[0].get());
+    ASSERT_NE(outer, nullptr);
+    auto scoped = claw::findScopedDecls(outer->body);
+    EXPECT_EQ(scoped.count(outer->body[0].get()), 1u);
+    EXPECT_EQ(scoped.count(outer->body[1].get()), 1u);
+    for (int i = 2; i <= 7; i++) EXPECT_EQ(scoped.count(outer->body[i].get()), 0u) << i;
+}
+
+TEST(EscapeAnalysis, ScopedClosuresCompileToFrameRegionOpcodes) {
+    const char* src =
+        "fn sum(n) {"
+        "  let total = 0;"
+        "  let add = fn(x) { total = total + x; };"
+        "  fn twice(x) { return x * 2; }"
+        "  for (let i = 0; i < n; i = i + 1) { add(twice(i)); }"
+        "  let keep = fn() { return total; };"
+        "  return keep;"
+        "}";
+    auto chunk = compileSrc(src);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::ScopedClosure), 2);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::CallScoped), 2);
+
+    auto plainChunk = compileSrc(src, [](claw::Compiler& compiler) { compiler.setEscapeAnalysisEnabled(false); });
+    auto plain = firstFunctionChunk(*plainChunk);
+    ASSERT_NE(plain, nullptr);
+    EXPECT_EQ(plain->countOpcode(claw::OpCode::ScopedClosure), 0);
+    EXPECT_EQ(plain->countOpcode(claw::OpCode::CallScoped), 0);
+}
+
+TEST(EscapeAnalysis, ScopedClosuresMatchInterpreter) {
+    expectSameAndReleased(
+        "fn accumulate(n) {"
+        "  let total = 0;"
+        "  let add = fn(x) { total = total + x; };"
+        "  fn square(x) { return x * x; }"
+        "  for (let i = 0; i < n; i = i + 1) {"
+        "    let shift = fn(y) { return y + i; };"
+        "    add(shift(square(i)));"
+        "    if (i == 6) break;"
+        "  }"
+        "  return total;"
+        "}"
+        "print accumulate(3); print accumulate(100);"
+        "{ fn top(a, b) { return a - b; } print top(10, 4); }",
+        "8\n112\n6\n");
+}
+
+TEST(EscapeAnalysis, RegionIsReusedAcrossIterations) {
+    const char* src =
+        "fn loop(n) {"
+        "  let s = 0;"
+        "  for (let i = 0; i < n; i = i + 1) {"
+        "    let inc = fn(v) { return v + i; };"
+        "    s = inc(s);"
+        "  }"
+        "  return s;"
+        "}"
+        "print loop(10000);";
+    auto chunk = compileSrc(src);
+    claw::Interpreter interp;
+    claw::VM vm(interp);
+    claw::InterpretResult res;
+    EXPECT_EQ(runVM(vm, *chunk, &res), "49995000\n");
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(vm.scopedObjectCount(), 0u);
+    EXPECT_EQ(vm.scopedRegionBlocks(), 1u);
+}
+
+TEST(EscapeAnalysis, ErrorsUnwindScopedClosures) {
+    expectSameAndReleased(
+        "fn risky(n) {"
+        "  let out = \"\";"
+        "  for (let i = 0; i < n; i = i + 1) {"
+        "    try {"
+        "      let check = fn(v) { if (v == 2) throw \"bad \" + v; return v; };"
+        "      out = out + check(i);"
+        "    } catch (e) { out = out + \"!\"; }"
+        "  }"
+        "  fn fail() { return 1 / 0; }"
+        "  try { fail(); } catch (e) { out = out + \" \" + e; }"
+        "  return out;"
+        "}"
+        "print risky(4);",
+        "01!3 E4001: Division by zero\n");
+}
+
+TEST(EscapeAnalysis, NamedCallbacksAndReboundNativesGetHeapClosures) {
+    auto program = parseSrc(
+        "fn outer(a) {"
+        "  fn double(x) { return x * 2; }"
+        "  let odd = fn(x) { return x % 2 == 1; };"
+        "  return map(filter(a, odd), double);"
+        "}");
+    auto* outer = dynamic_cast<claw::FnStmt*>(program[0].get());
+    ASSERT_NE(outer, nullptr);
+    EXPECT_TRUE(claw::findScopedDecls(outer->body).empty());
+
+    // map is an ordinary global, so a script's own version may keep its callback
+    expectSameAndReleased(
+        "let kept = nil;"
+        "fn map(a, f) { kept = f; return f(a); }"
+        "fn go() { fn inc(x) { return x + 1; } return map(1, inc); }"
+        "print go(); print kept(41);"
+        "fn literal() { return map(2, fn(x) { return x * 10; }); }"
+        "print literal(); print kept(4);",
+        "2\n42\n20\n40\n");
+}
+
+TEST(EscapeAnalysis, OnlyIndexedArraysAreScoped) {
+    auto program = parseSrc(
+        "fn outer(k) {"
+        "  let a = [1, 2, 3];"                 // 0: indexed, assigned through, length read
+        "  let b = [k, k];"                    // 1: element compound-assigned
+        "  let returned = [1];"                // 2: returned
+        "  let printed = [2];"                 // 3: read as a value
+        "  let pushed = [3];"                  // 4: a method called on it
+        "  let captured = [4];"                // 5: named in a nested function
+        "  let passed = [5];"                  // 6: passed to a call
+        "  let k = [k];"                       // 7: an element names the name
+        "  a[0] = a[1] + a.length; b[0] += a[2];"
+        "  print printed; pushed.push(1); len(passed);"
+        "  let g = fn() { return captured[0]; };"
+        "  return returned;"
+        "}");
+    auto* outer = dynamic_cast<claw::FnStmt*>(program[0].get());
+    ASSERT_NE(outer, nullptr);
+    auto scoped = claw::findScopedDecls(outer->body);
+    EXPECT_EQ(scoped.count(outer->body[0].get()), 1u);
+    EXPECT_EQ(scoped.count(outer->body[1].get()), 1u);
+    for (int i = 2; i <= 7; i++) EXPECT_EQ(scoped.count(outer->body[i].get()), 0u) << i;
+}
+
+TEST(EscapeAnalysis, ScopedArraysMatchInterpreter) {
+    const char* src =
+        "fn window(n) {"
+        "  let best = 0;"
+        "  for (let i = 0; i < n; i++) {"
+        "    let w = [i, i * 2, i - 3];"
+        "    w[2] += w[0];"
+        "    let s = 0;"
+        "    for (let j = 0; j < w.length; j++) s = s + w[j];"
+        "    if (s > best) best = s;"
+        "    if (i == 50) break;"
+        "  }"
+        "  return best;"
+        "}"
+        "fn pick(i) {"
+        "  let names = [\"a\", \"b\"];"
+        "  let r = nil;"
+        "  try { r = names[i]; } catch (e) { r = e; }"
+        "  return r;"
+        "}"
+        "print window(10); print window(1000); print pick(1); print pick(5);";
+    auto chunk = compileSrc(src);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::ScopedArray), 1);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::BuildArray), 0);
+    expectSameAndReleased(src, "42\n247\nb\nE4002: Index 5 out of bounds [0, 1]\n");
+}
+
+TEST(EscapeAnalysis, ScopedArraysKeepTheirElementsAcrossCollections) {
+    // Only the scoped array holds the maps, while the loop allocates enough
+    // to run the nursery collector many times over
+    expectSameAndReleased(
+        "fn hold(n) {"
+        "  let kept = [{\"v\": 1}, {\"v\": 2}];"
+        "  let k = 0;"
+        "  for (let i = 0; i < n; i++) {"
+        "    let junk = {\"i\": i};"
+        "    kept[k] = {\"v\": junk.i};"
+        "    k = 1 - k;"
+        "  }"
+        "  return kept[0].v + kept[1].v;"
+        "}"
+        "print hold(100000);",
+        "199997\n");
+}
+
+TEST(EscapeAnalysis, CallbacksToBorrowingCalleesAreScoped) {
+    const char* src =
+        "fn go(xs, k) {"
+        "  let sum = 0;"
+        "  xs.forEach(fn(x) { sum = sum + x * k; });"
+        "  let big = xs.filter(fn(x) { return x > k; });"
+        "  let doubled = map(big, fn(x) { return x * 2; });"
+        "  return [sum, doubled, xs.reduce(fn(a, x) { return a + x; }, 0)];"
+        "}"
+        "print go([1, 2, 3, 4], 2);"
+        "fn safe(xs) {"
+        "  let r = nil;"
+        "  try { r = xs.map(fn(x) { if (x == 2) throw \"two\"; return x; }); } catch (e) { r = e; }"
+        "  return r;"
+        "}"
+        "print safe([1, 3]); print safe([1, 2]);"
+        "let m = {\"map\": fn(f) { return f(5); }};"
+        "print m.map(fn(x) { return x + 1; });"
+        "print [10, 20].map(fn(x) { return x / 10; });";
+    auto chunk = compileSrc(src);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::ScopedCallback), 4);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::ReleaseCallbacks), 4);
+    expectSameAndReleased(src, "[20, [6, 8], 10]\n[1, 3]\nE4008: two\n6\n[1, 2]\n");
+
+    auto plainChunk = compileSrc(src, [](claw::Compiler& compiler) { compiler.setEscapeAnalysisEnabled(false); });
+    auto plain = firstFunctionChunk(*plainChunk);
+    ASSERT_NE(plain, nullptr);
+    EXPECT_EQ(plain->countOpcode(claw::OpCode::ScopedCallback), 0);
+}
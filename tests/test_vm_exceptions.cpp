@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+
+TEST(VMExceptions, ThrowIsCaughtWithRuntimeErrorCode) {
+    claw::InterpretResult res;
+    auto out = runVM("try { throw \"boom\"; } catch (e) { print e; } print \"after\";", &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "E4008: boom\nafter\n");
+}
+
+TEST(VMExceptions, CatchValuesMatchInterpreter) {
+    expectSameAsInterpreter("try { print 1 / 0; } catch (e) { print e; }");
+    expectSameAsInterpreter("try { print missing; } catch (e) { print e; }");
+    expectSameAsInterpreter("try { print -\"a\"; } catch (e) { print e; }");
+    expectSameAsInterpreter("try { print 1 < \"a\"; } catch (e) { print e; }");
+    expectSameAsInterpreter("try { print 1 + nil; } catch (e) { print e; }");
+    expectSameAsInterpreter("try { print 1 << -1; } catch (e) { print e; }");
+    expectSameAsInterpreter("let a = jsonDecode(\"[1,2]\"); try { print a[5]; } catch (e) { print e; }");
+    expectSameAsInterpreter("let a = jsonDecode(\"[1,2]\"); try { print a[\"x\"]; } catch (e) { print e; }");
+    expectSameAsInterpreter("let n = 3; try { print n[0]; } catch (e) { print e; }");
+    expectSameAsInterpreter("fn f(a) { return a; } try { f(1, 2); } catch (e) { print e; }");
+    expectSameAsInterpreter("let x = 5; try { x(); } catch (e) { print e; }");
+    expectSameAsInterpreter("try { throw 42; } catch (e) { print e; }");
+}
+
+TEST(VMExceptions, StackOverflowIsCaughtWithItsErrorCode) {
+    const char* src = "fn overflow() { overflow(); } try { overflow(); } catch (e) { print e; } print \"after\";";
+    const char* expected = "E4003: Stack overflow: Maximum call depth exceeded\nafter\n";
+    expectSameAsInterpreter(src, expected);
+    // Running out of value stack before the frame limit reports the same error
+    auto saved = claw::gRuntimeFlags;
+    claw::gRuntimeFlags.vmMaxStackSlots = 512;
+    claw::InterpretResult res;
+    auto out = runVM(src, &res);
+    claw::gRuntimeFlags = saved;
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, expected);
+}
+
+TEST(VMExceptions, UnwindsFramesAndClosesUpvalues) {
+    const char* src =
+        "let keep = nil;"
+        "fn inner(d) { let v = 42; fn get() { return v; } keep = get; return 1 / d; }"
+        "fn outer(d) { let unused = 7; return inner(d) + unused; }"
+        "try { print outer(0); } catch (e) { print e; }"
+        "print keep();"
+        "print outer(1);";
+    for (bool forceSwitch : {false, true}) {
+        claw::gRuntimeFlags.forceSwitchDispatch = forceSwitch;
+        claw::InterpretResult res;
+        auto out = runVM(src, &res);
+        EXPECT_EQ(res, claw::InterpretResult::Ok);
+        EXPECT_EQ(out, "E4001: Division by zero\n42\n8\n");
+        EXPECT_EQ(out, runInterpreter(src));
+    }
+    claw::gRuntimeFlags.forceSwitchDispatch = false;
+}
+
+TEST(VMExceptions, StackIsCutBackToTryDepth) {
+    // Locals declared before and after the try must keep their slots once a
+    // throw abandons temporaries and inner locals.
+    expectSameAsInterpreter(
+        "fn f() {"
+        "  let a = 1;"
+        "  try { let b = 2; let c = b + (3 * (a / 0)); } catch (e) { print e; }"
+        "  let d = 4;"
+        "  return a + d;"
+        "}"
+        "print f();");
+}
+
+TEST(VMExceptions, NestedAndRethrownErrors) {
+    expectSameAsInterpreter(
+        "try {"
+        "  try { throw \"inner\"; } catch (e) { print e; throw \"outer\"; }"
+        "} catch (e2) { print e2; }");
+    expectSameAsInterpreter(
+        "let total = 0;"
+        "for (let i = 0; i < 5; i = i + 1) {"
+        "  try { if (i == 2) throw \"skip\"; total = total + i; } catch (e) { total = total + 100; }"
+        "}"
+        "print total;");
+}
+
+TEST(VMExceptions, UncaughtErrorStillStopsTheRun) {
+    claw::InterpretResult res;
+    auto out = runVM("print 1; throw \"nope\"; print 2;", &res);
+    EXPECT_EQ(res, claw::InterpretResult::RuntimeError);
+    EXPECT_EQ(out, "1\n");
+    out = runVM("try { print 1; } catch (e) { print e; } print 1 / 0;", &res);
+    EXPECT_EQ(res, claw::InterpretResult::RuntimeError);
+    EXPECT_EQ(out, "1\n");
+}
+
+TEST(VMExceptions, UncaughtErrorIsReportedWithItsLineAndStack) {
+    std::stringstream err;
+    auto old = std::cerr.rdbuf(err.rdbuf());
+    claw::InterpretResult res;
+    runVM("fn inner(n) {\n"
+          "  let x = n;\n"
+          "  return x / 0;\n"
+          "}\n"
+          "fn outer() { return inner(1); }\n"
+          "outer();\n", &res);
+    std::cerr.rdbuf(old);
+    EXPECT_EQ(res, claw::InterpretResult::RuntimeError);
+    EXPECT_EQ(err.str(), "❌ E4001: Runtime Error [Line 3, Col 12]: Division by zero\n"
+                         "Stack trace:\n"
+                         "  at inner (1)\n"
+                         "  at outer (5)\n");
+}
+
+// What printRuntimeError in main.cpp prints for the interpreter's report of
+// an error nothing catches in src
+static std::string interpreterReport(const std::string& src) {
+    auto program = parseSrc(src);
+    claw::Interpreter interp;
+    std::stringstream out;
+    auto old = std::cout.rdbuf(out.rdbuf());
+    std::string report;
+    try {
+        interp.execute(program);
+    } catch (const claw::RuntimeError& e) {
+        report = "❌ " + claw::errorCodeToString(e.code) + ": Runtime Error [Line " + std::to_string(e.token.line) +
+                 ", Col " + std::to_string(e.token.column) + "]: " + e.what() + "\n";
+        if (!e.stack_trace.empty()) report += "Stack trace:\n";
+        for (auto it = e.stack_trace.rbegin(); it != e.stack_trace.rend(); ++it) {
+            report += "  at " + it->function_name + " (" + std::to_string(it->line) + ")\n";
+        }
+    }
+    std::cout.rdbuf(old);
+    return report;
+}
+
+TEST(VMExceptions, UncaughtErrorsAreReportedAsTheInterpreterReportsThem) {
+    const char* sources[] = {
+        "let a = 1;\nprint a + nope;",
+        "let xs = jsonDecode(\"[1, 2]\");\nprint xs.length;\nlet s = xs.nothing(1);",
+        "let m = {\"k\": 1};\nm.k = m.k +\n  true;",
+        "fn pair(a, b) { return a; }\nlet f = fn(x) { return pair(x); };\nprint f(1);",
+        "class P { fn init() { this.v = 1; } }\nlet p = P();\nprint p.v;\np.w.z = 2;",
+        "fn at(i) {\n  let s = 0;\n  for (let j = 0; j < 3; j++) { s = s + jsonDecode(\"[1]\")[i + j]; }\n  return s;\n}\nprint at(0);",
+        // An error raised by interpreted code keeps its place
+        "fn inner(a) { let x = [1, 2 % 3]; return x[a]; }\nfn outer() { return inner(5); }\nouter();",
+    };
+    for (const char* src : sources) {
+        auto program = parseSrc(src);
+        claw::Compiler compiler;
+        compiler.setFallbackEnabled(true);
+        auto chunk = compiler.compile(program);
+        claw::InterpretResult res;
+        std::string err;
+        runVM(*chunk, &res, &err);
+        EXPECT_EQ(res, claw::InterpretResult::RuntimeError) << src;
+        EXPECT_FALSE(err.empty()) << src;
+        EXPECT_EQ(err, interpreterReport(src)) << src;
+    }
+}
+
+TEST(VMExceptions, MethodCallErrorsAreReportedAsTheInterpreterReportsThem) {
+    // Lookup errors at the method name, failed calls at the call
+    const char* sources[] = {
+        "let sb = StringBuilder();\nsb.append(\"a\").append(1, 2);",
+        "let sb = StringBuilder();\nprint sb.length();",
+        "let sb = StringBuilder();\nprint sb.toString(1);",
+        "let sb = StringBuilder();\nsb.reverse();",
+        "class C { fn m(a) { return a; } }\nlet c = C();\nprint c.m(1, 2);",
+        "class C { fn init() { this.f = 1; } }\nlet c = C();\nc.f();",
+        "class C {}\nlet c = C();\nc.nope();",
+        "let a = jsonDecode(\"[1]\");\na.push();",
+        "let m = {\"a\": 1};\nm.a();",
+    };
+    for (const char* src : sources) {
+        auto program = parseSrc(src);
+        claw::Compiler compiler;
+        compiler.setFallbackEnabled(true);
+        auto chunk = compiler.compile(program);
+        claw::InterpretResult res;
+        std::string err;
+        runVM(*chunk, &res, &err);
+        EXPECT_EQ(res, claw::InterpretResult::RuntimeError) << src;
+        EXPECT_FALSE(err.empty()) << src;
+        EXPECT_EQ(err, interpreterReport(src)) << src;
+    }
+}
+
+TEST(VMExceptions, HandlersLiveOnlyInTheTable) {
+    auto program = parseSrc(
+        "try { try { print 1; } catch (a) { print a; } } catch (b) { print b; }");
+    claw::Compiler compiler;
+    compiler.setPeepholeEnabled(false);
+    auto chunk = compiler.compile(program);
+    const auto& handlers = chunk->exceptionHandlers();
+    ASSERT_EQ(handlers.size(), 2u);
+    // Inner range first, nested inside the outer one
+    EXPECT_GE(handlers[0].start, handlers[1].start);
+    EXPECT_LE(handlers[0].end, handlers[1].end);
+    // The protected path is the body plus one jump over the catch block
+    EXPECT_EQ(chunk->code()[handlers[0].start], static_cast<uint8_t>(claw::OpCode::Constant));
+    EXPECT_EQ(chunk->code()[handlers[0].end], static_cast<uint8_t>(claw::OpCode::Jump));
+    EXPECT_EQ(chunk->countOpcode(claw::OpCode::Throw), 0);
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+
+// Runs src the way claw run does. Interpret instructions point into the
+// program, so it is kept alive until the VM is done.
+TEST(VMHybrid, OnlyUnsupportedTopLevelStatementsFallBack) {
+    auto program = parseSrc(
+        "run { print 0; } until (true);"         // run-until
+        "fn f(a) { return a + 1; }"
+        "fn g(a) { let i = 0; while (i < a) { i++; if (i == 1) continue; } return i; }"
+        "print f(1) * 10 % 7;"                   // modulo
+        "print g(3);");
+    claw::Compiler compiler;
+    compiler.setFallbackEnabled(true);
+    auto chunk = compiler.compile(program);
+    EXPECT_EQ(compiler.fallbackCount(), 3);
+    EXPECT_EQ(chunk->countOpcode(claw::OpCode::Interpret), 3);
+    EXPECT_EQ(chunk->interpretedStmt(0), program[0].get());
+    EXPECT_EQ(chunk->interpretedStmt(1), program[2].get());
+    EXPECT_EQ(chunk->interpretedStmt(2), program[3].get());
+
+    claw::Compiler plain;
+    plain.compile(program);
+    EXPECT_EQ(plain.fallbackCount(), 0);
+}
+
+TEST(VMHybrid, MixedProgramMatchesInterpreter) {
+    int fallbacks = 0;
+    claw::InterpretResult res;
+    const char* src =
+        "let xs = [3, 1, 2];"
+        "fn total(list) { let s = 0; for (let i = 0; i < list.length; i = i + 1) s = s + list[i]; return s; }"
+        "fn bump(list) { list.push(list.length * 10); }"
+        "let m = {\"k\": 4};"
+        "print total(xs); bump(xs); print xs;"
+        "print xs.map(fn(x) { return x * 2; });"
+        "print m.k + m.size;"
+        "let i = 0; while (i < 5) { i++; if (i == 2) continue; print i; }"
+        "print 7 % 4;";
+    auto out = runHybrid(src, &res, &fallbacks);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "6\n[3, 1, 2, 30]\n[6, 2, 4, 60]\n5\n1\n3\n4\n5\n3\n");
+    EXPECT_EQ(out, runInterpreter(src));
+    EXPECT_EQ(fallbacks, 2);
+}
+
+TEST(VMHybrid, AssigningAnUnboundNameDefinesItAsTheInterpreterDoes) {
+    int fallbacks = 0;
+    claw::InterpretResult res;
+    const char* src =
+        "square = fn(x) { return x * x; };"                 // a global
+        "print square(4);"
+        "fn scratch() { tmp = 3; return tmp * 2; }"         // a local: interpreted
+        "print scratch();"
+        "fn inc() { count = count + 1; }"
+        "count = 0; inc(); inc(); print count;"
+        "{ inner = 1; print inner; }"                       // a block local: interpreted
+        "total = 0; for (let i = 0; i < 3; i++) { total = total + i; } print total;";
+    auto out = runHybrid(src, &res, &fallbacks);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(out, "16\n6\n2\n1\n3\n");
+    EXPECT_EQ(out, runInterpreter(src));
+    EXPECT_EQ(fallbacks, 2);
+}
+
+TEST(VMHybrid, CompiledCodeSharesMapsAndClosuresWithNatives) {
+    expectSameAsInterpreter(
+        "let m = {\"a\": 1};"
+        "m.b = 2; m.a += 5; print m.a + m.b;"
+        "try { m.c += 1; } catch (e) { print e; }"
+        "fn twice(x) { return x * 2; }"
+        "let xs = [1, 2, 3];"
+        "print map(xs, twice); print filter(xs, fn(x) { return x > 1; });"
+        "print type(twice); print benchmark(twice, 4).result;",
+        "8\nE2001: Operands must be compatible for +=\n[2, 4, 6]\n[2, 3]\nfunction\n8\n", enableFallback);
+}
+
+TEST(VMHybrid, InterpretedCodeUsesCompiledClassesAndClosures) {
+    expectSameAsInterpreter(
+        "class Counter {"
+        "  fn init(start) { this.n = start; }"
+        "  fn add(k) { this.n = this.n + k; return this; }"
+        "}"
+        "fn adder(k) { return fn(x) { return x + k; }; }"
+        "let c = Counter(1);"
+        "let steps = [1, 2, 3 % 4];"                                   // interpreted
+        "for (let j = 0; j < steps.length; j++) { c.add(steps[j]); } print c.n;"
+        "let plus2 = adder(2); print [plus2(1), Counter(5).add(1).n % 7];", // interpreted
+        "7\n[3, 6]\n", enableFallback);
+}
+
+TEST(VMHybrid, ErrorsCrossTheBoundaryBothWays) {
+    expectSameAsInterpreter(
+        "fn div(a, b) { return a / b; }"
+        "try { let r = [div(1, 0) % 2]; } catch (e) { print e; }"      // VM error, interpreter catch
+        "fn bad() { let a = [1 % 2]; return a[3]; }"
+        "try { bad(); } catch (e) { print e; }"                       // interpreter error, VM catch
+        "try { let q = [div(1, 2), 3 % 2]; print q; throw \"up\"; } catch (e) { print e; }",
+        "E4001: Division by zero\n"
+        "E4002: Index 3 out of bounds [0, 0]\n"
+        "[0.5, 1]\n"
+        "E4008: up\n", enableFallback);
+
+    claw::InterpretResult res;
+    auto out = runHybrid("fn f() { return 1 / 0; } print [1]; let a = [f()]; print 2;", &res);
+    EXPECT_EQ(res, claw::InterpretResult::RuntimeError);
+    EXPECT_EQ(out, "[1]\n");
+}
+
+TEST(VMHybrid, CallsToNumUseWhatTheNameIsBoundTo) {
+    const char* src =
+        "print num(2);"
+        "fn viaParam(num) { return num(3); }"
+        "print viaParam(fn(x) { return x + 1; });"
+        "fn num(n) { let r = n; r = r * 100; return r; }"
+        "print num(3);";
+    int fallbacks = -1;
+    claw::InterpretResult res;
+    auto out = runHybrid(src, &res, &fallbacks);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(fallbacks, 0);
+    EXPECT_EQ(out, "2\n4\n300\n");
+    EXPECT_EQ(out, runInterpreter(src));
+}
+
+TEST(VMHybrid, LogicalAndUpdateExpressionsCompile) {
+    const char* src =
+        "fn pick(a, b) { return a || b; }"
+        "fn both(a, b) { return a && b; }"
+        "fn steps() { let i = 5; let a = i++; let b = ++i; let c = i--; return a * 100 + b * 10 + c; }"
+        "let g = 1; fn bumpGlobal() { g++; return ++g; }"
+        "print pick(nil, \"x\"); print pick(0, 1); print both(1, nil); print both(true, 3);"
+        "print steps(); print bumpGlobal(); print g;";
+    int fallbacks = -1;
+    claw::InterpretResult res;
+    auto out = runHybrid(src, &res, &fallbacks);
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+    EXPECT_EQ(fallbacks, 0);
+    EXPECT_EQ(out, "x\n1\nnil\n3\n577\n3\n3\n");
+    EXPECT_EQ(out, runInterpreter(src));
+}
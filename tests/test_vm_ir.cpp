@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+
+static claw::IRStats irStats(const std::string& src) {
+    auto program = parseSrc(src);
+    claw::Compiler compiler;
+    compiler.setFallbackEnabled(true);
+    compiler.compile(program);
+    return compiler.irStats();
+}
+
+static int countOps(const claw::Chunk& chunk, claw::OpCode op) {
+    int count = 0;
+    for (size_t offset = 0; offset < chunk.size(); offset += chunk.instructionLength(offset)) {
+        if (static_cast<claw::OpCode>(chunk.code()[offset]) == op) count++;
+    }
+    return count;
+}
+
+static int countFunctionOps(const std::string& src, claw::OpCode op) {
+    auto program = parseSrc(src);
+    claw::Compiler compiler;
+    compiler.setFallbackEnabled(true);
+    auto chunk = compiler.compile(program);
+    for (auto constant : chunk->constants()) {
+        if (claw::isVMFunction(constant)) return countOps(*claw::asVMFunction(constant)->chunk, op);
+    }
+    return -1;
+}
+
+// Output and errors of the VM, with the loop IR on or off
+static std::string runWithIR(const std::string& src, bool loopIR) {
+    auto program = parseSrc(src);
+    claw::Compiler compiler;
+    compiler.setLoopIREnabled(loopIR);
+    auto chunk = compiler.compile(program);
+    claw::InterpretResult result;
+    std::string err;
+    auto out = runVM(*chunk, &result, &err);
+    return result == claw::InterpretResult::Ok ? out : out + "error: " + err;
+}
+
+static void expectSameWithAndWithoutIR(const std::string& src, const std::string& expected) {
+    EXPECT_EQ(runWithIR(src, true), expected) << src;
+    EXPECT_EQ(runWithIR(src, false), expected) << src;
+}
+
+TEST(LoopIR, HoistsInvariantLengthOutOfLoops) {
+    const std::string src =
+        "fn sum(a) {"
+        "  let s = 0;"
+        "  for (let i = 0; i < a.length; i++) { s = s + a[i]; }"
+        "  return s;"
+        "}"
+        "print sum([1, 2, 3, 4]);"
+        "print sum([]);";
+    auto stats = irStats(src);
+    EXPECT_GE(stats.hoisted, 1);
+    expectSameWithAndWithoutIR(src, "10\n0\n");
+
+    auto off = parseSrc(src);
+    claw::Compiler compiler;
+    compiler.setLoopIREnabled(false);
+    compiler.compile(off);
+    EXPECT_EQ(compiler.irStats().total(), 0);
+}
+
+TEST(LoopIR, ReusesCommonSubexpressions) {
+    const std::string src =
+        "fn squares(a) {"
+        "  let s = 0;"
+        "  let i = 0;"
+        "  while (i < 3) { s = s + a[i] * a[i] + a[i] * a[i]; i = i + 1; }"
+        "  return s;"
+        "}"
+        "print squares([1, 2, 3]);";
+    EXPECT_GE(irStats(src).cse, 2);
+    expectSameWithAndWithoutIR(src, "28\n");
+}
+
+TEST(LoopIR, ForwardsConstantsAndDropsDeadStores) {
+    const std::string src =
+        "fn f() {"
+        "  let n = 0;"
+        "  while (n < 10) {"
+        "    let step = 3;"
+        "    let unused = step * 2;"
+        "    n = n + step;"
+        "  }"
+        "  return n;"
+        "}"
+        "print f();";
+    auto stats = irStats(src);
+    EXPECT_GE(stats.forwarded, 1);
+    EXPECT_GE(stats.deadStores, 1);
+    expectSameWithAndWithoutIR(src, "12\n");
+}
+
+TEST(LoopIR, DoesNotHoistPastWritesOrCalls) {
+    // The array grows inside the loop, so its length is read every pass
+    expectSameWithAndWithoutIR(
+        "fn grow(a) {"
+        "  let c = 0;"
+        "  for (let i = 0; i < a.length; i++) { if (a.length < 5) { a.push(i); } c++; }"
+        "  return c;"
+        "}"
+        "print grow([0]);",
+        "5\n");
+    // A call may change what a global holds
+    expectSameWithAndWithoutIR(
+        "let limit = 3;"
+        "fn shrink() { limit = limit - 1; }"
+        "fn count() {"
+        "  let c = 0;"
+        "  while (c < limit * 2) { c++; shrink(); }"
+        "  return c;"
+        "}"
+        "print count();",
+        "2\n");
+    // A closure may write a local of the loop's function
+    expectSameWithAndWithoutIR(
+        "fn outer() {"
+        "  let k = 1;"
+        "  let bump = fn() { k = k + 1; };"
+        "  let s = 0;"
+        "  for (let i = 0; i < 3; i++) { s = s + k * 10; bump(); }"
+        "  return s;"
+        "}"
+        "print outer();",
+        "60\n");
+}
+
+TEST(LoopIR, KeepsErrorsAndControlFlow) {
+    // An invariant that fails is not computed before the loop would reach it
+    expectSameWithAndWithoutIR(
+        "fn f(a) {"
+        "  let n = 0;"
+        "  while (n < 3) { if (n == 2) { print a.missing; } n++; }"
+        "  return n;"
+        "}"
+        "print f(nil);",
+        "error: ❌ E2003: Runtime Error [Line 1, Col 62]: Only arrays, hash maps, and class instances have members\n"
+        "Stack trace:\n  at f (1)\n");
+    expectSameWithAndWithoutIR(
+        "fn g(a) {"
+        "  let i = 0;"
+        "  while (true) { if (i >= a.length) { break; } i = i + a[i]; }"
+        "  return i;"
+        "}"
+        "print g([1, 1, 1, 1]);"
+        "for (let x = 0; x < 20; x = x + 7) { print x * 2; }",
+        "4\n0\n14\n28\n");
+}
+
+TEST(LoopIR, CountedLoopsIndexWithoutChecks) {
+    const std::string src =
+        "fn scale(a, k) {"
+        "  for (let i = 0; i < a.length; i++) { a[i] = a[i] * k; }"
+        "  let s = 0;"
+        "  for (let i = 0; i < a.length; i = i + 2) { s = s + a[i]; }"
+        "  return s;"
+        "}"
+        "let xs = [1, 2, 3, 4, 5];"
+        "print scale(xs, 3);"
+        "print xs;"
+        "print scale([], 2);";
+    EXPECT_EQ(irStats(src).boundsChecks, 3);
+    EXPECT_EQ(countFunctionOps(src, claw::OpCode::JumpIfNotArray), 2);
+    EXPECT_EQ(countFunctionOps(src, claw::OpCode::GetIndexUnchecked), 2);
+    EXPECT_EQ(countFunctionOps(src, claw::OpCode::SetIndexUnchecked), 1);
+    expectSameWithAndWithoutIR(src, "27\n[3, 6, 9, 12, 15]\n0\n");
+}
+
+TEST(LoopIR, KeepsChecksUnlessTheLoopIsCounted) {
+    // Calls may resize the array, and other indexes or loops are not known
+    // to be in bounds
+    const char* kept[] = {
+        "fn f(a) { for (let i = 0; i < a.length; i++) { a.push(a[i]); if (a.length > 4) break; } }",
+        "fn f(a) { for (let i = 0; i < a.length; i++) { print a[i + 1]; } }",
+        "fn f(a) { for (let i = 0; i <= a.length; i++) { print a[i]; } }",
+        "fn f(a) { for (let i = -1; i < a.length; i++) { print a[i]; } }",
+        "fn f(a) { for (let i = 0; i < a.length; i++) { i = i + 1; print a[i]; } }",
+        "fn f(a, b) { for (let i = 0; i < a.length; i++) { a = b; print a[i]; } }",
+        "fn f(a) { let i = 0; while (i < a.length) { print a[i]; i++; } }",
+    };
+    for (const char* src : kept) {
+        EXPECT_EQ(countFunctionOps(src, claw::OpCode::GetIndexUnchecked), 0) << src;
+        EXPECT_EQ(countFunctionOps(src, claw::OpCode::JumpIfNotArray), 0) << src;
+    }
+}
+
+TEST(LoopIR, CountedLoopsOverOtherValuesTakeTheCheckedCopy) {
+    expectSameWithAndWithoutIR(
+        "fn total(a) {"
+        "  let s = 0;"
+        "  for (let i = 0; i < a.length; i++) { s = s + a[i]; }"
+        "  return s;"
+        "}"
+        "print total([1, 2, 3]);"
+        "print total({\"length\": 2, \"0\": 5, \"1\": 6});"
+        "print total(nil);",
+        "6\n11\nerror: ❌ E2003: Runtime Error [Line 1, Col 50]: Only arrays, hash maps, and class instances have members\n"
+        "Stack trace:\n  at total (1)\n");
+    // Only the copy that runs on arrays reads the length once
+    expectSameWithAndWithoutIR(
+        "fn stretch(m) {"
+        "  let s = 0;"
+        "  for (let i = 0; i < m.length; i++) { s = s + m[i]; m[\"length\"] = 3; }"
+        "  return s;"
+        "}"
+        "print stretch({\"length\": 1, \"0\": 1, \"1\": 2, \"2\": 3});",
+        "6\n");
+    expectSameWithAndWithoutIR(
+        "fn firstRow(m) {"
+        "  let out = 0;"
+        "  for (let i = 0; i < m.length; i++) {"
+        "    for (let j = 0; j < m[i].length; j++) { out = out * 10 + m[i][j]; }"
+        "    if (i == 0) { break; }"
+        "  }"
+        "  return out;"
+        "}"
+        "print firstRow([[1, 2], [3]]);"
+        "print firstRow([]);",
+        "12\n0\n");
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+#include "features/class.h"
+
+static const char* name(const char* s) { return claw::StringPool::intern(std::string(s)).data(); }
+
+TEST(Shapes, InstancesWithTheSameFieldOrderShareAShape) {
+    auto klass = std::make_shared<claw::ClawClass>(
+        "P", nullptr, std::unordered_map<std::string, std::shared_ptr<claw::ClawFunction>>{});
+    claw::ClawInstance a(klass), b(klass), c(klass);
+    EXPECT_EQ(a.shape(), klass->rootShape());
+    a.setField(name("x"), claw::numberToValue(1));
+    a.setField(name("y"), claw::numberToValue(2));
+    b.setField(name("x"), claw::numberToValue(3));
+    b.setField(name("y"), claw::numberToValue(4));
+    c.setField(name("y"), claw::numberToValue(5));
+    c.setField(name("x"), claw::numberToValue(6));
+    EXPECT_EQ(a.shape(), b.shape());
+    EXPECT_NE(a.shape(), c.shape());
+    // Overwriting a field keeps the shape
+    const claw::Shape* before = a.shape();
+    a.setField(name("x"), claw::numberToValue(7));
+    EXPECT_EQ(a.shape(), before);
+    EXPECT_EQ(a.shape()->lookup(name("y")), 1);
+    EXPECT_EQ(c.shape()->lookup(name("y")), 0);
+    EXPECT_EQ(a.shape()->lookup(name("z")), -1);
+    EXPECT_EQ(claw::asNumber(a.slot(0)), 7);
+}
+
+TEST(Shapes, WideShapesLookUpEveryField) {
+    auto klass = std::make_shared<claw::ClawClass>(
+        "W", nullptr, std::unordered_map<std::string, std::shared_ptr<claw::ClawFunction>>{});
+    claw::ClawInstance wide(klass);
+    for (int i = 0; i < 20; i++) {
+        wide.setField(name(("f" + std::to_string(i)).c_str()), claw::numberToValue(i));
+    }
+    EXPECT_EQ(wide.shape()->slotCount(), 20u);
+    for (int i = 0; i < 20; i++) {
+        claw::Value v;
+        ASSERT_TRUE(wide.getField(name(("f" + std::to_string(i)).c_str()), &v));
+        EXPECT_EQ(claw::asNumber(v), i);
+    }
+    EXPECT_EQ(wide.shape()->lookup(name("f20")), -1);
+}
+
+TEST(Shapes, PropertySiteStaysMonomorphicAcrossInstances) {
+    auto program = parseSrc(
+        "class P { fn init(x, y) { this.x = x; this.y = y; } }"
+        "let total = 0;"
+        "for (let i = 0; i < 200; i = i + 1) { let p = P(i, 1); total = total + p.y; }"
+        "print total;");
+    claw::Compiler compiler;
+    auto chunk = compiler.compile(program);
+    claw::Interpreter interp;
+    claw::VM vm(interp);
+    claw::InterpretResult res;
+    EXPECT_EQ(runVM(vm, *chunk, &res), "200\n");
+    EXPECT_EQ(res, claw::InterpretResult::Ok);
+#ifndef CLAW_DISABLE_IC_DIAGNOSTICS
+    auto siteIp = vm.apiGetLastPropertySiteIp();
+    ASSERT_NE(siteIp, nullptr);
+    EXPECT_EQ(vm.apiGetPropertyMisses(siteIp), 1u);
+    EXPECT_FALSE(vm.apiIsPropertyMegamorphic(siteIp));
+#endif
+}
+
+TEST(Shapes, CachedSitesSeeDifferentLayouts) {
+    // One site reads x from receivers whose x sits at different slots
+    expectSameAsInterpreter(
+        "class P {}"
+        "fn readX(o) { return o.x; }"
+        "let a = P(); a.x = 1; a.y = 2;"
+        "let b = P(); b.y = 3; b.x = 4;"
+        "let c = P(); c.x = 5;"
+        "print readX(a) + readX(b) * 10 + readX(c) * 100;"
+        "a.x = 9; print readX(a);"
+        "let d = P(); try { print readX(d); } catch (e) { print e; }",
+        "541\n9\nE4008: Undefined property 'x'.\n");
+}
+
+TEST(Shapes, FieldAddedLaterShadowsCachedMethod) {
+    // The Invoke site caches the method for the shape without a field f;
+    // an instance that gains f gets a new shape and calls the field
+    expectSameAsInterpreter(
+        "fn shout() { return \"field\"; }"
+        "class C { fn init() { this.n = 1; } fn f() { return \"method\"; } }"
+        "fn call(o) { return o.f(); }"
+        "let a = C(); let b = C();"
+        "print call(a); print call(b);"
+        "b.f = shout; print call(b); print call(a);",
+        "method\nmethod\nfield\nmethod\n");
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+
+using namespace claw;
+
+TEST(VMStackGrowth, DeepRecursionBeyondInitialFrames) {
+    InterpretResult res;
+    auto out = runVM(
+        "fn depth(n) { if (n < 1) return 0; return 1 + depth(n - 1); }"
+        "print depth(5000);", &res);
+    EXPECT_EQ(res, InterpretResult::Ok);
+    EXPECT_EQ(out, "5000\n");
+}
+
+TEST(VMStackGrowth, OpenUpvaluesSurviveRelocation) {
+    // The closure captures x while it is still on the stack; the recursion
+    // then moves the stack, and the writes through the upvalue must land in
+    // the slot outer() reads.
+    InterpretResult res;
+    auto out = runVM(
+        "fn depth(n) { if (n < 1) return 0; return 1 + depth(n - 1); }"
+        "fn outer() {"
+        "  let x = 1;"
+        "  fn bump() { x = x + 1; return x; }"
+        "  depth(3000);"
+        "  bump();"
+        "  bump();"
+        "  return x;"
+        "}"
+        "print outer();", &res);
+    EXPECT_EQ(res, InterpretResult::Ok);
+    EXPECT_EQ(out, "3\n");
+}
+
+TEST(VMStackGrowth, FrameLimitReportsStackOverflow) {
+    int previous = gRuntimeFlags.vmMaxFrames;
+    gRuntimeFlags.vmMaxFrames = 200;
+    InterpretResult res;
+    std::string err;
+    runVM("fn forever(n) { return forever(n + 1); } forever(0);", &res, &err);
+    gRuntimeFlags.vmMaxFrames = previous;
+    EXPECT_EQ(res, InterpretResult::RuntimeError);
+    EXPECT_NE(err.find("]: Stack overflow: Maximum call depth exceeded\n"), std::string::npos);
+}
+
+TEST(VMStackGrowth, UnboundedRecursionStopsCleanly) {
+    InterpretResult res;
+    std::string err;
+    runVM("fn forever(n) { return forever(n + 1); } forever(0);", &res, &err);
+    EXPECT_EQ(res, InterpretResult::RuntimeError);
+    EXPECT_NE(err.find("]: Stack overflow: Maximum call depth exceeded\n"), std::string::npos);
+}
+
+TEST(VMStackGrowth, FrameGetsRoomForItsDeepestExpression) {
+    // Each level leaves an x on the stack until the innermost one is added,
+    // so one frame needs more slots than the whole initial stack
+    std::string expr = "x";
+    for (int i = 0; i < 1400; i++) expr = "x + (" + expr + ")";
+    InterpretResult res;
+    auto out = runVM("fn f(x) { return " + expr + "; } print f(1); let x = 2; print " + expr + ";", &res);
+    EXPECT_EQ(res, InterpretResult::Ok);
+    EXPECT_EQ(out, "1401\n2802\n");
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include "vm_test_util.h"
+
+static const char* kDenseSwitch =
+    "fn classify(n) {"
+    "  let out = \"\";"
+    "  switch (n) {"
+    "    case -1: out = out + \"neg\"; break;"
+    "    case 0: out = out + \"zero\";"
+    "    case 1: out = out + \"one\"; break;"
+    "    case 3: let t = \"three\"; out = out + t; break;"
+    "    default: out = out + \"other\";"
+    "  }"
+    "  return out;"
+    "}";
+
+TEST(VMSwitch, DenseIntegerCasesUseOneTable) {
+    auto chunk = compileSrc(kDenseSwitch, disablePeephole);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::Switch), 1);
+    EXPECT_EQ(body->switchTable(0).ints.size(), 5u);
+}
+
+TEST(VMSwitch, DenseIntegerCasesMatchInterpreter) {
+    expectSameAsInterpreter(std::string(kDenseSwitch) +
+        "print classify(-1); print classify(0); print classify(1); print classify(2);"
+        "print classify(3); print classify(3.0); print classify(2.5); print classify(\"1\");"
+        "print classify(99); print classify(nil);",
+        "neg\nzeroone\none\nother\nthree\nthree\nother\nother\nother\nother\n");
+}
+
+TEST(VMSwitch, StringCasesDispatchOnInternedPointers) {
+    const char* src =
+        "fn route(path) {"
+        "  switch (path) {"
+        "    case \"/\": return \"index\";"
+        "    case \"/users\": return \"users\";"
+        "    case \"/login\":"
+        "    case \"/signin\": return \"auth\";"
+        "  }"
+        "  return \"404\";"
+        "}"
+        "print route(\"/\"); print route(\"/us\" + \"ers\"); print route(\"/signin\");"
+        "print route(\"/login\"); print route(\"/nope\"); print route(1);";
+    expectSameAsInterpreter(src, "index\nusers\nauth\nauth\n404\n404\n");
+    auto chunk = compileSrc(src, disablePeephole);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::Switch), 1);
+    EXPECT_EQ(body->switchTable(0).strings.size(), 4u);
+}
+
+TEST(VMSwitch, SparseOrMixedCasesCompareInOrder) {
+    const char* src =
+        "let limit = 7;"
+        "fn pick(v) {"
+        "  switch (v) {"
+        "    case 1: return \"one\";"
+        "    case 1000: return \"thousand\";"
+        "    case limit: return \"limit\";"
+        "    case \"s\": return \"string\";"
+        "    default: return \"none\";"
+        "  }"
+        "}"
+        "print pick(1); print pick(1000); print pick(7); print pick(\"s\"); print pick(false);";
+    expectSameAsInterpreter(src, "one\nthousand\nlimit\nstring\nnone\n");
+    auto chunk = compileSrc(src, disablePeephole);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::Switch), 0);
+}
+
+TEST(VMSwitch, BreakBindsToInnermostLoopOrSwitch) {
+    expectSameAsInterpreter(
+        "let total = 0;"
+        "for (let i = 0; i < 40; i = i + 1) {"
+        "  switch (i) {"
+        "    case 3: total = total + 100; break;"
+        "    case 5: let j = 0; while (true) { j = j + 1; if (j > 4) break; } total = total + j; break;"
+        "  }"
+        "  if (i == 10) break;"
+        "  total = total + 1;"
+        "}"
+        "print total;",
+        "115\n");
+}
+
+TEST(VMSwitch, MapLiteralBuildsInOneInstruction) {
+    const char* src =
+        "fn make(v) { return {\"a\": v, b: {\"c\": v + 1}, 3: \"three\"}; }"
+        "let m = make(1);"
+        "print m[\"a\"]; print m[\"b\"][\"c\"]; print m[\"3\"];";
+    expectSameAsInterpreter(src, "1\n2\nthree\n");
+    auto chunk = compileSrc(src, disablePeephole);
+    auto body = firstFunctionChunk(*chunk);
+    ASSERT_NE(body, nullptr);
+    EXPECT_EQ(body->countOpcode(claw::OpCode::BuildMap), 2);
+}
+
+TEST(VMSwitch, MapLiteralKeysIterateInInterpreterOrder) {
+    expectSameAsInterpreter(
+        "fn make() { return {\"name\": \"John\", \"age\": 30, \"active\": true, \"id\": 7, \"tags\": nil}; }"
+        "let m = make();"
+        "print keys(m); print jsonEncode(m);");
+}
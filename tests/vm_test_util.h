@@ -0,0 +1,125 @@
+#pragma once
+#include <gtest/gtest.h>
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "compiler/compiler.h"
+#include "vm/vm.h"
+#include "interpreter/interpreter.h"
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+// Helpers shared by the VM tests: parse and compile a script, run it on the
+// VM or the interpreter with what it prints captured, and compare the two.
+
+// Sets compiler options before compileSrc compiles
+using CompilerSetup = std::function<void(claw::Compiler&)>;
+
+inline void enableFallback(claw::Compiler& compiler) { compiler.setFallbackEnabled(true); }
+inline void disablePeephole(claw::Compiler& compiler) { compiler.setPeepholeEnabled(false); }
+
+inline std::vector<claw::StmtPtr> parseSrc(const std::string& src) {
+    claw::Lexer lex(src);
+    auto tokens = lex.tokenize();
+    claw::Parser parser(tokens);
+    auto program = parser.parseProgram();
+    EXPECT_FALSE(parser.hadError());
+    return program;
+}
+
+inline std::unique_ptr<claw::Chunk> compileSrc(const std::string& src, const CompilerSetup& setup = nullptr) {
+    auto program = parseSrc(src);
+    claw::Compiler compiler;
+    if (setup) setup(compiler);
+    return compiler.compile(program);
+}
+
+// The chunk of the first function among chunk's constants
+inline const claw::Chunk* firstFunctionChunk(const claw::Chunk& chunk) {
+    for (auto constant : chunk.constants()) {
+        if (claw::isVMFunction(constant)) return claw::asVMFunction(constant)->chunk.get();
+    }
+    return nullptr;
+}
+
+// Runs chunk on vm and returns what it printed; err, when given, receives
+// what it wrote to stderr
+inline std::string runVM(claw::VM& vm, const claw::Chunk& chunk, claw::InterpretResult* result,
+                         std::string* err = nullptr) {
+    std::stringstream out, errs;
+    auto oldOut = std::cout.rdbuf(out.rdbuf());
+    auto oldErr = err ? std::cerr.rdbuf(errs.rdbuf()) : nullptr;
+    auto res = vm.interpret(chunk);
+    std::cout.rdbuf(oldOut);
+    if (err) {
+        std::cerr.rdbuf(oldErr);
+        *err = errs.str();
+    }
+    if (result) *result = res;
+    return out.str();
+}
+
+// Runs chunk on a fresh VM backed by its own interpreter
+inline std::string runVM(const claw::Chunk& chunk, claw::InterpretResult* result = nullptr,
+                         std::string* err = nullptr) {
+    claw::Interpreter interp;
+    claw::VM vm(interp);
+    return runVM(vm, chunk, result, err);
+}
+
+inline std::string runVM(const std::string& src, claw::InterpretResult* result = nullptr,
+                         std::string* err = nullptr) {
+    return runVM(*compileSrc(src), result, err);
+}
+
+// Runs src the way claw run does. Interpret instructions point into the
+// program, so it is kept alive until the VM is done.
+inline std::string runHybrid(const std::string& src, claw::InterpretResult* result = nullptr,
+                             int* fallbacks = nullptr) {
+    auto program = parseSrc(src);
+    claw::Compiler compiler;
+    compiler.setFallbackEnabled(true);
+    auto chunk = compiler.compile(program);
+    if (fallbacks) *fallbacks = compiler.fallbackCount();
+    return runVM(*chunk, result);
+}
+
+// Runs src on the interpreter; an error nothing catches is printed as
+// "error: <message>"
+inline std::string runInterpreter(const std::string& src) {
+    auto program = parseSrc(src);
+    claw::Interpreter interp;
+    std::stringstream ss;
+    auto old = std::cout.rdbuf(ss.rdbuf());
+    try {
+        interp.execute(program);
+    } catch (const claw::RuntimeError& e) {
+        ss << "error: " << e.what() << "\n";
+    }
+    std::cout.rdbuf(old);
+    return ss.str();
+}
+
+// Expects src to run without error on the VM and to print expected there
+// and on the interpreter. The program outlives the run, as runHybrid's does.
+inline void expectSameAsInterpreter(const std::string& src, const std::string& expected,
+                                    const CompilerSetup& setup = nullptr) {
+    auto program = parseSrc(src);
+    claw::Compiler compiler;
+    if (setup) setup(compiler);
+    auto chunk = compiler.compile(program);
+    claw::InterpretResult res;
+    auto vmOut = runVM(*chunk, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok) << src;
+    EXPECT_EQ(vmOut, expected) << src;
+    EXPECT_EQ(runInterpreter(src), expected) << src;
+}
+
+// Expects src to run without error on the VM and to print what the
+// interpreter prints
+inline void expectSameAsInterpreter(const std::string& src) {
+    claw::InterpretResult res;
+    auto vmOut = runVM(src, &res);
+    EXPECT_EQ(res, claw::InterpretResult::Ok) << src;
+    EXPECT_EQ(vmOut, runInterpreter(src)) << src;
+}